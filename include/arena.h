@@ -0,0 +1,52 @@
+#ifndef RPNMATH_ARENA_H
+#define RPNMATH_ARENA_H
+
+#include <stddef.h>
+
+#define RPNMATH_ARENA_CHUNK_SIZE 4096
+
+// A chunk of arena memory, allocations are carved from data
+typedef struct rpnmath_arena_chunk {
+  struct rpnmath_arena_chunk *next;
+  size_t capacity; // bytes available in data
+  char data[];
+} rpnmath_arena_chunk_t;
+
+// Bump allocator for everything that lives as long as one evaluation:
+// compiled programs, the operand stack, variable payloads and compiler
+// scratch memory. Nothing allocated from an arena is freed on its own,
+// one reset releases all of it at once. An arena is not synchronized, every
+// thread allocates from its own.
+typedef struct rpnmath_arena {
+  rpnmath_arena_chunk_t *root;    // first chunk, the one kept across resets
+  rpnmath_arena_chunk_t *current; // chunk allocations are carved from
+  size_t offset;                  // bytes used in current
+  size_t chunk_size;              // minimum size of a new chunk
+  size_t used;                    // bytes handed out since the last reset, padding included
+  void *last;                     // most recent allocation, the only one that can grow in place
+} rpnmath_arena_t;
+
+// Initialize the arena, chunk_size is the minimum size of every chunk (0 for the default)
+void rpnmath_arena_init(rpnmath_arena_t *arena, size_t chunk_size);
+
+// Release all memory owned by the arena
+void rpnmath_arena_cleanup(rpnmath_arena_t *arena);
+
+// Release every allocation at once. The arena keeps a single chunk big
+// enough for everything allocated since the previous reset, so repeating
+// the same evaluation does not touch the heap again.
+void rpnmath_arena_reset(rpnmath_arena_t *arena);
+
+// Allocate size zeroed bytes aligned for any type, NULL when out of memory
+void *rpnmath_arena_alloc(rpnmath_arena_t *arena, size_t size);
+
+// Grow an allocation from old_size to new_size bytes, the realloc of the
+// arena. The most recent allocation grows in place when its chunk has room,
+// anything else is copied and its old bytes stay unused until the next reset.
+// Returns NULL when out of memory, data is still valid then.
+void *rpnmath_arena_grow(rpnmath_arena_t *arena, void *data, size_t old_size, size_t new_size);
+
+// Format like printf into a new allocation, NULL when out of memory
+char *rpnmath_arena_printf(rpnmath_arena_t *arena, const char *format, ...);
+
+#endif // RPNMATH_ARENA_H
@@ -0,0 +1,46 @@
+#ifndef RPNMATH_BATCH_H
+#define RPNMATH_BATCH_H
+
+#include <stddef.h>
+#include "type.h"
+#include "value.h"
+#include "context.h"
+#include "program.h"
+
+// Rows evaluated together. Every instruction runs over a whole vector of
+// this many rows before the next one is dispatched, so the cost of
+// dispatching is shared by all of them.
+#define RPNMATH_BATCH_SIZE 1024
+
+// A column of rows of one type, each row stored like a variable's payload:
+// int8_t to int64_t (or 128 bits) for integers, float or double for floats
+// and the mantissa for decimals. Big integers with limbs have no fixed
+// width and can not be columns.
+typedef struct rpnmath_column {
+  rpnmath_type_t type;
+  void *data;
+} rpnmath_column_t;
+
+// Evaluate the program on rows rows. Variable $i of row r is row r of
+// inputs[i], every other variable starts out unassigned on every row, and
+// what the program returns for row r goes to row r of output. Results are
+// converted to the output's type when that is exact: any number to a float,
+// integers and decimals of at most the output's scale to a decimal, and
+// integers to an integer column they fit. Columns are numbered inputs first,
+// the output last, in RPNMATH_STATUS_COLUMN_TYPE errors.
+//
+// Returns the status of the lowest row that failed, with its index in
+// *failed_row and every row before it written. *failed_row is rows when
+// nothing failed or the failure is not tied to a row, like a column of the
+// wrong type; failed_row may be NULL. Scratch memory comes from the
+// context's arena and the context's variables are not kept.
+int rpnmath_batch_execute(const rpnmath_program_t *program, rpnmath_context_t *context,
+                          const rpnmath_column_t *inputs, size_t input_count, const rpnmath_column_t *output, size_t rows,
+                          size_t *failed_row);
+
+// Whether rpnmath_batch_execute runs the program a vector at a time, rows
+// taking different paths through branches and loops included. Programs
+// with explicit phi nodes run row by row on the context's engine.
+int rpnmath_batch_vectorizes(const rpnmath_program_t *program);
+
+#endif // RPNMATH_BATCH_H
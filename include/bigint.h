@@ -0,0 +1,48 @@
+#ifndef RPNMATH_BIGINT_H
+#define RPNMATH_BIGINT_H
+
+#include <stddef.h>
+#include "item.h"
+#include "value.h"
+#include "arena.h"
+
+// Arbitrary precision integers, values of kind RPNMATH_TYPEKIND_BIGINT.
+// type.size drives the representation: up to RPNMATH_BIGINT_INLINE_BITS a
+// big integer is stored inline exactly like a fixed width integer of 64 or
+// 128 bits, so small values never allocate. Wider values are type.size / 32
+// limbs in two's complement, least significant first, allocated from the
+// arena of the evaluation that produced them. Limbs are never written once
+// a value refers to them, so copies of a value share them freely.
+//
+// Results are normalized to the fewest limbs, and stored inline whenever
+// they fit. Big integers never overflow, an operation with one big operand
+// produces a big integer.
+
+#define RPNMATH_BIGINT_LIMB_BITS 32
+
+// Below this many limbs in the shorter operand schoolbook multiplication
+// beats Karatsuba's extra additions
+#define RPNMATH_BIGINT_KARATSUBA_THRESHOLD 32
+
+// left op right for ADD, SUB, MUL or DIV (nonzero divisor, truncating like C).
+// Either operand may be a fixed width integer. dst may alias an operand.
+// Returns RPNMATH_STATUS_OUT_OF_MEMORY with dst untouched when the arena
+// runs dry.
+int rpnmath_bigint_arith(rpnmath_op_t operation, rpnmath_value_t *dst, const rpnmath_value_t *left,
+                         const rpnmath_value_t *right, rpnmath_arena_t *arena);
+
+// -1, 0 or 1 as left is less than, equal to or greater than right
+int rpnmath_bigint_compare(const rpnmath_value_t *left, const rpnmath_value_t *right);
+
+// Value of a big integer with limbs as a double, inf when out of its range
+double rpnmath_bigint_to_double(const rpnmath_value_t *value);
+
+// Parse an optionally signed decimal integer, returns -1 if str is not one
+// and RPNMATH_STATUS_OUT_OF_MEMORY when its limbs can not be allocated
+int rpnmath_bigint_parse(rpnmath_value_t *value, const char *str, rpnmath_arena_t *arena);
+
+// Decimal text of a big integer with limbs, see rpnmath_value_format
+size_t rpnmath_bigint_format_size(const rpnmath_value_t *value);
+void rpnmath_bigint_format(const rpnmath_value_t *value, char *buffer, size_t size);
+
+#endif // RPNMATH_BIGINT_H
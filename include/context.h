@@ -0,0 +1,121 @@
+#ifndef RPNMATH_CONTEXT_H
+#define RPNMATH_CONTEXT_H
+
+#include <stddef.h>
+#include "item.h"
+#include "value.h"
+#include "arena.h"
+#include "status.h"
+
+#define RPNMATH_MAX_VARIABLES 65536 // highest variable id + 1, variable tables grow up to this
+
+typedef enum rpnmath_engine {
+  RPNMATH_ENGINE_SWITCH,   // Portable switch loop over the instruction array
+  RPNMATH_ENGINE_THREADED, // Direct-threaded code (computed goto on GCC/Clang)
+  RPNMATH_ENGINE_REGISTER, // Three-address register code lowered from the stack code
+  RPNMATH_ENGINE_COUNT,    // Number of engines (not a real engine)
+} rpnmath_engine_t;
+
+// SSA version table entry. Every assignment creates a new version of the
+// variable, and only phi nodes ever look at versions: they pick the most
+// recent one of their sources. A superseded version is dead, so each
+// variable keeps the storage of its live version only and the next
+// assignment recycles it in place.
+typedef struct rpnmath_variable {
+  rpnmath_item_const_t value; // storage of the live version
+  size_t version;  // SSA version of value, unique across variables, 0 = unassigned
+  size_t block_id; // Block where this variable was assigned
+} rpnmath_variable_t;
+
+// What the last failed evaluation ran into. Recording it only copies a few
+// words, so a failure costs about as much as the operation itself; the
+// message is formatted when somebody asks for it.
+typedef struct rpnmath_error {
+  rpnmath_status_t status;     // RPNMATH_STATUS_OK while nothing failed
+  rpnmath_op_t operation;      // arithmetic errors: the failed operation
+  rpnmath_value_t left, right; // arithmetic errors: its operands, right is VOID for unary ones
+  size_t detail;               // variable errors: the variable id, unknown instructions: the opcode
+} rpnmath_error_t;
+
+// Mutable state of one evaluation. A context is not tied to a program,
+// the same context can run any number of programs one after another, but
+// it is used by one thread at a time: concurrent evaluations each need a
+// context of their own, on an arena of their own.
+// Its tables live in the arena and are sized by the programs that run on
+// it, so the context itself is only a few dozen bytes and is released
+// together with everything else of the evaluation.
+typedef struct rpnmath_context {
+  rpnmath_engine_t engine; // engine used by rpnmath_program_execute
+  rpnmath_arena_t *arena;  // backs the tables below and wide variable payloads
+  
+  rpnmath_variable_t *variables; // SSA version table, indexed by variable id
+  size_t variable_capacity;
+  size_t version_clock; // last SSA version handed out
+  
+  // Blocks are laid out by the compiler, see rpnmath_block_t in program.h
+  size_t current_block;
+  
+  // Operand stack
+  rpnmath_value_t *values;
+  size_t value_capacity;
+  
+  // Payload of a result too wide to be stored inline, reused by every
+  // evaluation so that returning one does not allocate
+  void *result_data;
+  size_t result_capacity;
+  
+  rpnmath_error_t error;
+  const char *message; // error formatted in the arena, NULL until rpnmath_context_error asks
+} rpnmath_context_t;
+
+// Initialize the context, it stays valid until arena is reset
+void rpnmath_context_init(rpnmath_context_t *context, rpnmath_arena_t *arena);
+
+// Make the context ready for the next evaluation after its arena was reset.
+// The tables went with the arena, so this only forgets them; the engine is kept.
+void rpnmath_context_reset(rpnmath_context_t *context);
+
+// Make room for at least depth values on the operand stack and for
+// variable ids below variable_count, fails when out of memory
+int rpnmath_context_reserve(rpnmath_context_t *context, size_t depth, size_t variable_count);
+
+// Storage for the size bytes payload of a result, valid until the next
+// evaluation on the context. NULL when out of memory.
+void *rpnmath_context_result_storage(rpnmath_context_t *context, size_t size);
+
+// Reset block state to the root block, variables are kept
+void rpnmath_context_reset_blocks(rpnmath_context_t *context);
+
+// Make every variable unassigned again, their storage is reused by the
+// next assignments
+void rpnmath_context_forget_variables(rpnmath_context_t *context);
+
+// Variable operations
+int rpnmath_context_assign_variable(rpnmath_context_t *context, size_t var_id, rpnmath_item_const_t *value);
+rpnmath_item_const_t rpnmath_context_get_variable(rpnmath_context_t *context, size_t var_id); // wide payloads stay in the arena
+int rpnmath_context_load_variable(rpnmath_context_t *context, size_t var_id, rpnmath_value_t *value);
+int rpnmath_context_store_variable(rpnmath_context_t *context, size_t var_id, const rpnmath_value_t *value);
+
+// Phi node operations
+int rpnmath_context_resolve_phi(rpnmath_context_t *context, size_t target_var, const size_t *source_vars, size_t source_count);
+
+// Errors. The functions above and the engines record what failed in the
+// context and return its status; variable and engine errors go through
+// rpnmath_context_fail, arithmetic ones through rpnmath_context_fail_operation
+// with the operands, which the failed operation left untouched. Both
+// return status.
+int rpnmath_context_fail(rpnmath_context_t *context, rpnmath_status_t status, size_t detail);
+int rpnmath_context_fail_operation(rpnmath_context_t *context, rpnmath_status_t status, rpnmath_op_t operation,
+                                   const rpnmath_value_t *left, const rpnmath_value_t *right);
+
+// A failure that comes with its message, such as why a program does not
+// compile. message has to live as long as the arena, NULL leaves the
+// generic message of status.
+int rpnmath_context_fail_message(rpnmath_context_t *context, rpnmath_status_t status, const char *message);
+
+// Message of the last failure, e.g. "Division by zero", formatted on the
+// first call after it. NULL if nothing failed since the last reset. The
+// message lives in the arena.
+const char* rpnmath_context_error(rpnmath_context_t *context);
+
+#endif // RPNMATH_CONTEXT_H
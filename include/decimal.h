@@ -0,0 +1,94 @@
+#ifndef RPNMATH_DECIMAL_H
+#define RPNMATH_DECIMAL_H
+
+#include <stddef.h>
+#include "type.h"
+#include "item.h"
+#include "value.h"
+
+// Fixed point decimals, values of kind RPNMATH_TYPEKIND_DECIMAL. The value
+// is mantissa / 10^scale with type.scale digits after the point. The
+// mantissa is a 64 bit integer, or 128 bits where RPNMATH_INT128 is
+// available, stored like a fixed width integer of type.size bits.
+//
+// Results have the larger scale of the operands, integers count as scale
+// 0. Addition and subtraction are exact, multiplication and division round
+// their result to that scale following the program's rounding mode.
+// Decimals never wrap or saturate: a result that does not fit its mantissa
+// fails the evaluation, unless the promote policy can widen a 64 bit
+// mantissa to 128 bits. Without RPNMATH_INT128 the exact product or scaled
+// dividend has to fit 64 bits as well.
+
+#define RPNMATH_DECIMAL_MAX_SCALE 18
+
+// Widest integer arithmetic decimals are computed in
+#if RPNMATH_INT128
+typedef rpnmath_int128_t rpnmath_decimal_exact_t;
+typedef rpnmath_uint128_t rpnmath_decimal_unsigned_t;
+#  define RPNMATH_DECIMAL_POW10_COUNT 39
+#else
+typedef long long rpnmath_decimal_exact_t;
+typedef unsigned long long rpnmath_decimal_unsigned_t;
+#  define RPNMATH_DECIMAL_POW10_COUNT 19
+#endif
+
+// 10^0 up to the largest power of ten rpnmath_decimal_exact_t holds
+extern const rpnmath_decimal_exact_t rpnmath_decimal_pow10[RPNMATH_DECIMAL_POW10_COUNT];
+
+// numerator / denominator rounded to an integer by the rounding mode. The
+// denominator is nonzero and not -1 with the smallest numerator.
+#define RPNMATH_DECIMAL_DIVIDE_DEFINE(name, ctype, utype) \
+  static inline ctype name(ctype numerator, ctype denominator, rpnmath_rounding_t rounding) { \
+    ctype quotient = numerator / denominator; \
+    ctype remainder = numerator % denominator; \
+    if (remainder == 0) { \
+      return quotient; \
+    } \
+    /* The exact quotient lies between quotient and quotient + step */ \
+    int negative = (numerator < 0) != (denominator < 0); \
+    ctype step = negative ? -1 : 1; \
+    utype rest = remainder < 0 ? 0 - (utype)remainder : (utype)remainder; \
+    utype divisor = denominator < 0 ? 0 - (utype)denominator : (utype)denominator; \
+    utype other = divisor - rest; /* distance to quotient + step */ \
+    switch (rounding) { \
+      case RPNMATH_ROUNDING_HALF_EVEN: return rest > other || (rest == other && (quotient & 1)) ? quotient + step : quotient; \
+      case RPNMATH_ROUNDING_HALF_UP: return rest >= other ? quotient + step : quotient; \
+      case RPNMATH_ROUNDING_FLOOR: return negative ? quotient - 1 : quotient; \
+      case RPNMATH_ROUNDING_CEILING: return negative ? quotient : quotient + 1; \
+      default: return quotient; \
+    } \
+  }
+
+RPNMATH_DECIMAL_DIVIDE_DEFINE(rpnmath_decimal_divide, rpnmath_decimal_exact_t, rpnmath_decimal_unsigned_t)
+// The same on 64 bit mantissas, which spares the kernels 128 bit division
+#if RPNMATH_INT128
+RPNMATH_DECIMAL_DIVIDE_DEFINE(rpnmath_decimal_divide64, long long, unsigned long long)
+#else
+#  define rpnmath_decimal_divide64 rpnmath_decimal_divide
+#endif
+
+#undef RPNMATH_DECIMAL_DIVIDE_DEFINE
+
+// left op right for ADD, SUB, MUL or DIV, where at least one operand is a
+// decimal and the other one may be an integer. dst may alias an operand.
+// Returns RPNMATH_STATUS_DECIMAL_OVERFLOW when the result does not fit,
+// RPNMATH_STATUS_DIVISION_BY_ZERO, or RPNMATH_STATUS_OUT_OF_RANGE for a big
+// integer out of a mantissa's range. dst is untouched on failure.
+int rpnmath_decimal_arith(rpnmath_overflow_t overflow, rpnmath_rounding_t rounding, rpnmath_op_t operation, rpnmath_value_t *dst,
+                          const rpnmath_value_t *left, const rpnmath_value_t *right);
+
+// -1, 0 or 1 as left is less than, equal to or greater than right, one of
+// them a decimal and the other one a decimal or integer
+int rpnmath_decimal_compare(const rpnmath_value_t *left, const rpnmath_value_t *right);
+
+double rpnmath_decimal_to_double(const rpnmath_value_t *value);
+
+// Parse a decimal literal: an optionally signed number with a d suffix and
+// at most RPNMATH_DECIMAL_MAX_SCALE digits after the point ("12.50d", "3d").
+// Returns -1 if str is not one or the mantissa does not fit.
+int rpnmath_decimal_parse(rpnmath_value_t *value, const char *str);
+
+// "12.50d", see rpnmath_value_format
+void rpnmath_decimal_format(const rpnmath_value_t *value, char *buffer, size_t size);
+
+#endif // RPNMATH_DECIMAL_H
@@ -11,6 +11,7 @@ typedef enum rpnmath_itemkind {
   RPNMATH_ITEMKIND_LREF, // Local Reference ($0, $1, etc.)
   RPNMATH_ITEMKIND_VOP, // Variable Operation
   RPNMATH_ITEMKIND_CFOP, // Control Flow
+  RPNMATH_ITEMKIND_COUNT, // Number of item kinds (not a real kind)
 } rpnmath_itemkind_t;
 
 typedef enum rpnmath_op {
@@ -26,6 +27,16 @@ typedef enum rpnmath_op {
   RPNMATH_OP_LE,     // (Value,Value)-> Bool (<=)
   RPNMATH_OP_GT,     // (Value,Value)-> Bool (>)
   RPNMATH_OP_GE,     // (Value,Value)-> Bool (>=)
+  // Selections, evaluated without branching
+  RPNMATH_OP_SELECT, // (Cond,Value,Value)-> Value, the first value if Cond holds
+  RPNMATH_OP_MIN,    // (Value,Value)-> Value
+  RPNMATH_OP_MAX,    // (Value,Value)-> Value
+  RPNMATH_OP_ABS,    // (Value)-> Value
+  // Logic on truth values, && and || skip their right operand when the
+  // left one decides the result
+  RPNMATH_OP_AND,    // (Value,Value)-> Bool (&&)
+  RPNMATH_OP_OR,     // (Value,Value)-> Bool (||)
+  RPNMATH_OP_NOT,    // (Value)-> Bool (!)
 } rpnmath_op_t;
 
 typedef enum rpnmath_vop {
@@ -33,12 +44,14 @@ typedef enum rpnmath_vop {
   RPNMATH_VOP_CALL, // (...) -> (...)
 } rpnmath_vop_t;
 
+// COND if ... [elif COND if ... ] [else ...] end
+// while COND loop ... end
 typedef enum rpnmath_cfop {
   RPNMATH_CFOP_IF, // COND
-  RPNMATH_CFOP_ELIF, // COND
+  RPNMATH_CFOP_ELIF, // else, whose following if shares the end
   RPNMATH_CFOP_ELSE, //
-  RPNMATH_CFOP_LOOP, //
-  RPNMATH_CFOP_WHILE, // COND
+  RPNMATH_CFOP_LOOP, // COND
+  RPNMATH_CFOP_WHILE, // loop head
   RPNMATH_CFOP_MERGE, //
   RPNMATH_CFOP_END, // END
   RPNMATH_CFOP_PHI, // PHI node for SSA
@@ -48,13 +61,25 @@ typedef struct rpnmath_item {
   rpnmath_itemkind_t kind;
 } rpnmath_item_t;
 
+// Payloads up to this many bytes, every integer up to 64 bits, are stored
+// inside the item itself so constants never touch the heap
+#define RPNMATH_CONST_INLINE_SIZE 8
+
 typedef struct rpnmath_item_const {
   rpnmath_itemkind_t kind;
   rpnmath_type_t type;
-  void *data;
+  union {
+    void *data; // wider payloads: heap allocated, or right after the item on a stack
+    unsigned char payload[RPNMATH_CONST_INLINE_SIZE];
+  };
   size_t size; // if an i23 is used then size will be 3 bytes as it is rounded up
 } rpnmath_item_const_t;
 
+// Payload of a constant, wherever it is stored
+static inline void *rpnmath_const_data(const rpnmath_item_const_t *item) {
+  return item->size <= RPNMATH_CONST_INLINE_SIZE ? (void*)item->payload : item->data;
+}
+
 typedef struct rpnmath_item_localref {
   rpnmath_itemkind_t kind;
   size_t variable_id; // variable identifier ($0 = 0, $1 = 1, etc.)
@@ -99,4 +124,7 @@ const char* rpnmath_vop_name(rpnmath_vop_t op);
 
 const char* rpnmath_cfop_name(rpnmath_cfop_t op);
 
+// Release a constant's payload if it had to go on the heap
+void rpnmath_const_cleanup(rpnmath_item_const_t *item);
+
 #endif // RPNMATH_ITEMS_H
\ No newline at end of file
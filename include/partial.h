@@ -0,0 +1,36 @@
+#ifndef RPNMATH_PARTIAL_H
+#define RPNMATH_PARTIAL_H
+
+#include <stddef.h>
+#include "item.h"
+#include "value.h"
+#include "arena.h"
+#include "stack.h"
+#include "context.h"
+
+// Partially evaluate the items on stack into residual, an initialized and
+// usually empty stack. Every constant-only subexpression is folded and
+// variables with known values are propagated; whatever depends on values
+// only known at runtime (variables read before being assigned) is kept:
+//   10 10 +             -> [20]
+//   10 10 + $0 =        -> [20 $0 =]
+//   $1 10 + $0 = $0 2 * -> [$1 10 + $0 = $0 2 *]
+// An if with a known condition only leaves the part it takes, and whatever
+// follows a ret is dropped up to the next part or end. Any other control flow
+// is kept; after its end only what every path agrees on is known, and a loop
+// forgets the variables it assigns:
+//   0 if 5 else 6 end 2 *                   -> [12]
+//   1 if 100 ret/1 else 200 ret/1 end       -> [100 ret/1]
+//   5 $1 = $0 if 1 $2 = end $1 2 * ret/1    -> [5 $1 = $0 if 1 $2 = end 10 ret/1]
+// Control flow has to be balanced, as the compiler wants it, but the parts
+// an if drops are only checked for that and may leave a different number of
+// values than the part it takes.
+// Folding follows the overflow policy and rounding mode the residual will be
+// compiled with, an operation that would fail stays for runtime. Scratch
+// memory comes from the context's arena. Items that do not form a program
+// fail with RPNMATH_STATUS_COMPILE, recorded in the context like any other
+// error.
+int rpnmath_partial_evaluate(const rpnmath_stack_t *stack, rpnmath_stack_t *residual, rpnmath_overflow_t overflow,
+                             rpnmath_rounding_t rounding, rpnmath_context_t *context);
+
+#endif // RPNMATH_PARTIAL_H
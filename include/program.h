@@ -0,0 +1,263 @@
+#ifndef RPNMATH_PROGRAM_H
+#define RPNMATH_PROGRAM_H
+
+#include <stddef.h>
+#include "item.h"
+#include "value.h"
+#include "arena.h"
+#include "stack.h"
+#include "context.h"
+
+// Integer widths with their own kernels: X(op, WIDTH, bits, ctype)
+#if RPNMATH_INT128
+#  define RPNMATH_KERNEL_WIDTH_I128(X, op) X(op, I128, 128, rpnmath_int128_t)
+#  define RPNMATH_KERNEL_WIDTH_COUNT 5
+#else
+#  define RPNMATH_KERNEL_WIDTH_I128(X, op)
+#  define RPNMATH_KERNEL_WIDTH_COUNT 4
+#endif
+#define RPNMATH_KERNEL_WIDTHS(X, op) \
+  X(op, I8, 8, int8_t) X(op, I16, 16, int16_t) X(op, I32, 32, int32_t) X(op, I64, 64, int64_t) \
+  RPNMATH_KERNEL_WIDTH_I128(X, op)
+
+// Every (operation, width) pair with a kernel, see exec.h. DIV stays generic
+// as its zero check dominates the cost anyway.
+#define RPNMATH_KERNELS(X) \
+  RPNMATH_KERNEL_WIDTHS(X, ADD) RPNMATH_KERNEL_WIDTHS(X, SUB) RPNMATH_KERNEL_WIDTHS(X, MUL)
+
+// Kernels as fused into "$n CONST +"
+#define RPNMATH_KERNELS_ADD_VC(X) RPNMATH_KERNEL_WIDTHS(X, ADD_VC)
+
+// Float kernels, for ADD to DIV at either float width and for comparisons,
+// which compare floats of both widths as doubles. Mixed integer and float
+// operands are promoted at compile time: the instruction tells the kernel
+// which operand is an integer (RPNMATH_CONVERT_LEFT, RPNMATH_CONVERT_RIGHT).
+#define RPNMATH_FLOAT_WIDTHS(X, op) X(op, F32, 32, float) X(op, F64, 64, double)
+#define RPNMATH_FLOAT_KERNELS(X) \
+  RPNMATH_FLOAT_WIDTHS(X, ADD) RPNMATH_FLOAT_WIDTHS(X, SUB) RPNMATH_FLOAT_WIDTHS(X, MUL) RPNMATH_FLOAT_WIDTHS(X, DIV)
+#define RPNMATH_FLOAT_COMPARES(X) \
+  X(EQ, F, 64, double) X(NE, F, 64, double) X(LT, F, 64, double) \
+  X(LE, F, 64, double) X(GT, F, 64, double) X(GE, F, 64, double)
+
+#define RPNMATH_CONVERT_LEFT 1
+#define RPNMATH_CONVERT_RIGHT 2
+
+// Decimal kernels for 64 bit mantissas, where integers of up to 64 bits
+// count as decimals of scale 0. Type inference aligns the scales at compile
+// time: the instruction's layout holds the powers of ten the operands are
+// scaled by, the result's scale and the rounding mode. LEFT scales the left
+// mantissa (ADD, SUB, DIV, comparisons), RIGHT the right one (ADD, SUB,
+// comparisons) or divides the product (MUL).
+#define RPNMATH_DECIMAL_KERNELS(X) \
+  X(ADD, D64, 64, int64_t) X(SUB, D64, 64, int64_t) X(MUL, D64, 64, int64_t) X(DIV, D64, 64, int64_t)
+#define RPNMATH_DECIMAL_COMPARES(X) \
+  X(EQ, D64, 64, int64_t) X(NE, D64, 64, int64_t) X(LT, D64, 64, int64_t) \
+  X(LE, D64, 64, int64_t) X(GT, D64, 64, int64_t) X(GE, D64, 64, int64_t)
+
+#define RPNMATH_DECIMAL_LAYOUT(left, right, scale, rounding) \
+  ((size_t)(left) | (size_t)(right) << 6 | (size_t)(scale) << 12 | (size_t)(rounding) << 18)
+#define RPNMATH_DECIMAL_LAYOUT_LEFT(layout) ((layout) & 63)
+#define RPNMATH_DECIMAL_LAYOUT_RIGHT(layout) ((layout) >> 6 & 63)
+#define RPNMATH_DECIMAL_LAYOUT_SCALE(layout) ((layout) >> 12 & 63)
+#define RPNMATH_DECIMAL_LAYOUT_ROUNDING(layout) ((rpnmath_rounding_t)((layout) >> 18 & 7))
+
+#define RPNMATH_KERNEL_OPCODE(op, width, bits, ctype) RPNMATH_INSN_##op##_##width,
+
+typedef enum rpnmath_opcode {
+  RPNMATH_INSN_NOP,   // Unsupported control flow, kept for positions
+  RPNMATH_INSN_PUSH,  // operand = constant index
+  RPNMATH_INSN_LOAD,  // operand = variable id, register code: fail unless register a is assigned
+  RPNMATH_INSN_STORE, // operand = variable id, pops the value ($n =)
+  // Binary operations, one opcode each so execution needs a single dispatch
+  RPNMATH_INSN_ADD,
+  RPNMATH_INSN_SUB,
+  RPNMATH_INSN_MUL,
+  RPNMATH_INSN_DIV,
+  RPNMATH_INSN_EQ,
+  RPNMATH_INSN_NE,
+  RPNMATH_INSN_LT,
+  RPNMATH_INSN_LE,
+  RPNMATH_INSN_GT,
+  RPNMATH_INSN_GE,
+  // Selections, the chosen operand is copied without a branch on its value
+  RPNMATH_INSN_SELECT, // pops the condition and two values, keeps the first if the condition holds
+  RPNMATH_INSN_MIN,
+  RPNMATH_INSN_MAX,
+  RPNMATH_INSN_ABS,    // pops one value
+  // Control flow, operand = block id. Jump targets are read from the
+  // program's block table, "while" only marks the loop head and emits nothing.
+  RPNMATH_INSN_IF,    // pops the condition, false continues at the block's next_pos
+  RPNMATH_INSN_ELSE,  // end of a taken part, continues at the chain's end (operand = first block of the chain)
+  RPNMATH_INSN_LOOP,  // pops the condition, false leaves the loop
+  RPNMATH_INSN_END,   // jumps back to start_pos for loops
+  RPNMATH_INSN_PHI,   // operand = phi index
+  RPNMATH_INSN_RET,   // operand = argcount
+  RPNMATH_INSN_HALT,  // Falls off the end of the program, only in threaded and register code
+  RPNMATH_INSN_MOVE,  // dst = a, only in register code
+  // Superinstructions produced by the fusion pass, operand2 holds what the
+  // instructions folded into them used to carry
+  RPNMATH_INSN_ADD_VC,  // "$n CONST +", operand = variable id, operand2 = constant index
+  RPNMATH_INSN_STORE_C, // "CONST $n =", operand = variable id, operand2 = constant index
+  RPNMATH_INSN_IF_CMP,  // "a b < if", operand = block id, operand2 = comparison opcode
+  // Width specialized arithmetic chosen by type inference when the width of
+  // both operands is known ahead of time, e.g. RPNMATH_INSN_ADD_I32
+  RPNMATH_KERNELS(RPNMATH_KERNEL_OPCODE)
+  RPNMATH_KERNELS_ADD_VC(RPNMATH_KERNEL_OPCODE)
+  // Float kernels, e.g. RPNMATH_INSN_MUL_F64 or RPNMATH_INSN_LT_F,
+  // operand = RPNMATH_CONVERT_* flags (block in register code)
+  RPNMATH_FLOAT_KERNELS(RPNMATH_KERNEL_OPCODE)
+  RPNMATH_FLOAT_COMPARES(RPNMATH_KERNEL_OPCODE)
+  // Decimal kernels, e.g. RPNMATH_INSN_MUL_D64, operand = RPNMATH_DECIMAL_LAYOUT
+  // (block in register code)
+  RPNMATH_DECIMAL_KERNELS(RPNMATH_KERNEL_OPCODE)
+  RPNMATH_DECIMAL_COMPARES(RPNMATH_KERNEL_OPCODE)
+} rpnmath_opcode_t;
+
+// Blocks are laid out once by the compiler: block 0 is the whole program,
+// every if/elif/else part and every loop gets its own. Executing control
+// flow only reads them, so it neither allocates nor limits trip counts.
+typedef struct rpnmath_block {
+  size_t parent_block; // enclosing block
+  size_t start_pos;    // first instruction of the block, the condition for loops
+  size_t next_pos;     // if parts: where a false condition continues
+  size_t next_block;   // if parts: block entered at next_pos
+  size_t end_pos;      // first block of an if chain, and loops: position of the matching end
+  size_t depth;        // operand stack depth entering the block (before the condition for loops)
+  size_t end_depth;    // operand stack depth after the matching end
+  int is_loop;
+} rpnmath_block_t;
+
+typedef struct rpnmath_insn {
+  rpnmath_opcode_t opcode;
+  size_t operand;
+  size_t operand2; // only used by superinstructions
+} rpnmath_insn_t;
+
+typedef enum rpnmath_fusion {
+  RPNMATH_FUSION_ADD_VC,
+  RPNMATH_FUSION_STORE_C,
+  RPNMATH_FUSION_IF_CMP,
+  RPNMATH_FUSION_COUNT
+} rpnmath_fusion_t;
+
+// How often each fusion fired while compiling a program
+typedef struct rpnmath_fusion_stats {
+  size_t fired[RPNMATH_FUSION_COUNT];
+  size_t removed; // instructions saved in total
+} rpnmath_fusion_stats_t;
+
+// Pre-decoded instruction for the threaded engine: the handler address
+// replaces the opcode and constants are referenced directly
+typedef struct rpnmath_threaded_insn {
+  const void *handler; // NULL when built without computed goto
+  rpnmath_opcode_t opcode;
+  union {
+    size_t operand;
+    const rpnmath_value_t *constant;
+  };
+  union {
+    size_t operand2;
+    const rpnmath_value_t *constant2; // ADD_VC and STORE_C
+  };
+} rpnmath_threaded_insn_t;
+
+// Three-address instruction for the register engine. Registers are laid out
+// as [stack temporaries][variables][constants], see rpnmath_regcode_t.
+typedef struct rpnmath_reg_insn {
+  rpnmath_opcode_t opcode;
+  unsigned dst;   // comparison opcode for IF_CMP
+  unsigned a;     // first source register, or phi index for PHI
+  unsigned b;     // second source register, or variable id for LOAD
+  unsigned block; // control flow: block id, float kernels: RPNMATH_CONVERT_* flags, decimal kernels: layout,
+                  // SELECT: condition register
+} rpnmath_reg_insn_t;
+
+typedef struct rpnmath_regcode {
+  rpnmath_reg_insn_t *code; // count + 1 entries, the last one halts
+  size_t count;
+  size_t register_count;
+  size_t variable_base; // register of $0, variable n lives in variable_base + n
+  size_t constant_base; // register of constant 0, loaded before every run
+  size_t *inputs;       // variables read before the program writes them
+  size_t input_count;
+  size_t *outputs;      // variables the program writes, copied back to the context
+  size_t output_count;
+  rpnmath_block_t *blocks; // the program's blocks with positions in register code
+} rpnmath_regcode_t;
+
+typedef struct rpnmath_phi {
+  size_t target_var;
+  size_t first_source; // index into rpnmath_program_t.phi_sources
+  size_t source_count;
+} rpnmath_phi_t;
+
+// A compiled, read-only program. Once compiled it is never written to,
+// so any number of contexts (and threads) can execute it at once.
+typedef struct rpnmath_program {
+  rpnmath_insn_t *code;
+  size_t count;
+  
+  rpnmath_value_t *constants;
+  size_t constant_count;
+  
+  rpnmath_phi_t *phis;
+  size_t phi_count;
+  size_t *phi_sources;
+  
+  rpnmath_block_t *blocks;
+  size_t block_count;
+  
+  rpnmath_threaded_insn_t *threaded; // count + 1 entries, the last one halts
+  rpnmath_regcode_t regcode;
+  
+  rpnmath_overflow_t overflow; // policy of every integer operation
+  rpnmath_rounding_t rounding; // of every decimal operation
+  
+  size_t max_depth;      // deepest the operand stack can get
+  size_t variable_count; // highest variable id referenced + 1
+  
+  rpnmath_fusion_stats_t fusion;
+  size_t specialized; // arithmetic instructions type inference gave a width specialized kernel
+  size_t converted;   // if/else chains the if-conversion pass turned into a SELECT
+  
+  const char *error; // why rpnmath_program_compile failed, in the arena; NULL when it did not
+} rpnmath_program_t;
+
+// Compile the items on the stack, the stack is left untouched (several threads
+// can compile the same stack into arenas of their own). Integer
+// arithmetic of the program follows the overflow policy, decimal results
+// are rounded as rounding says. Everything the program points to, and all
+// scratch memory of the compiler, comes from arena: the program stays
+// valid until the arena is reset. Returns RPNMATH_STATUS_COMPILE when the
+// items do not form a program, or RPNMATH_STATUS_OUT_OF_MEMORY, with the
+// reason in program->error.
+int rpnmath_program_compile(rpnmath_program_t *program, const rpnmath_stack_t *stack, rpnmath_overflow_t overflow,
+                            rpnmath_rounding_t rounding, rpnmath_arena_t *arena);
+
+// Execute the program with the context's engine, variables already assigned
+// in the context act as inputs. A result payload too wide to be stored
+// inline belongs to the context and stays valid until its next evaluation,
+// so nothing is allocated per evaluation. Execution is reentrant: it reads the program,
+// writes only the context and its arena, and the library keeps no global
+// mutable state, nor does it print or stop the process. Any number of threads
+// can execute the same program at once, each with a context and arena of
+// its own, without any locking.
+int rpnmath_program_execute(const rpnmath_program_t *program, rpnmath_context_t *context, rpnmath_item_const_t *result);
+
+// Engines, normally reached through rpnmath_program_execute
+int rpnmath_switch_execute(const rpnmath_program_t *program, rpnmath_context_t *context, rpnmath_item_const_t *result);
+int rpnmath_threaded_execute(const rpnmath_program_t *program, rpnmath_context_t *context, rpnmath_item_const_t *result);
+int rpnmath_regvm_execute(const rpnmath_program_t *program, rpnmath_context_t *context, rpnmath_item_const_t *result);
+
+// Build program->threaded and program->regcode, called by rpnmath_program_compile.
+// Return -1 when out of memory.
+int rpnmath_threaded_compile(rpnmath_program_t *program, rpnmath_arena_t *arena);
+int rpnmath_regvm_compile(rpnmath_program_t *program, rpnmath_arena_t *arena);
+
+const char* rpnmath_engine_name(rpnmath_engine_t engine);
+
+const char* rpnmath_opcode_name(rpnmath_opcode_t opcode);
+
+const char* rpnmath_fusion_name(rpnmath_fusion_t fusion);
+
+#endif // RPNMATH_PROGRAM_H
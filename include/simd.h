@@ -0,0 +1,69 @@
+#ifndef RPNMATH_SIMD_H
+#define RPNMATH_SIMD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "item.h"
+
+// Kernels over arrays of native integers, for evaluating a whole column at
+// once. Every instruction set the library was built with has its own
+// variant of each kernel, the best one the CPU supports is picked the first
+// time rpnmath_simd_best is called.
+
+typedef enum rpnmath_simd_isa {
+  RPNMATH_SIMD_SCALAR, // Portable loops, always available
+  RPNMATH_SIMD_SSE2,   // 128 bit vectors, every x86-64 CPU
+  RPNMATH_SIMD_AVX2,   // 256 bit vectors
+  RPNMATH_SIMD_AVX512, // 512 bit vectors (AVX-512F and BW)
+  RPNMATH_SIMD_ISA_COUNT,
+} rpnmath_simd_isa_t;
+
+// Native integer widths, int8_t to int64_t elements
+typedef enum rpnmath_simd_width {
+  RPNMATH_SIMD_I8,
+  RPNMATH_SIMD_I16,
+  RPNMATH_SIMD_I32,
+  RPNMATH_SIMD_I64,
+  RPNMATH_SIMD_WIDTH_COUNT,
+} rpnmath_simd_width_t;
+
+// dst[row] = left[row] op right[row] for rows 0 to n. Arithmetic (ADD, SUB,
+// MUL, DIV) writes the result wrapped to the width and returns the first
+// row whose exact result does not fit or whose divisor is zero, n when
+// there is none; rows divided by zero get 0. Comparisons (EQ to GE) write
+// a mask to dst, one byte per row that is 1 where the comparison holds and
+// 0 elsewhere, and return n.
+typedef size_t rpnmath_simd_kernel_t(size_t n, const void *left, const void *right, void *dst);
+
+// dst[row] = mask[row] ? left[row] : right[row], mask as the comparisons
+// write it
+typedef void rpnmath_simd_select_t(size_t n, const uint8_t *mask, const void *left, const void *right, void *dst);
+
+// Copy the rows of src whose mask byte is set to the front of dst, which
+// must hold n elements and may be src. Returns how many were copied.
+typedef size_t rpnmath_simd_filter_t(size_t n, const uint8_t *mask, const void *src, void *dst);
+
+// The kernels of one instruction set. Wherever it has no instructions that
+// pay off (64 bit multiplication and division, filters below AVX-512, which
+// has the only compress instruction) the entry is the scalar one.
+typedef struct rpnmath_simd {
+  rpnmath_simd_isa_t isa;
+  rpnmath_simd_kernel_t *kernels[RPNMATH_OP_GE + 1][RPNMATH_SIMD_WIDTH_COUNT]; // NULL for RPNMATH_OP_ASSIGN
+  rpnmath_simd_select_t *select[RPNMATH_SIMD_WIDTH_COUNT];
+  rpnmath_simd_filter_t *filter[RPNMATH_SIMD_WIDTH_COUNT];
+} rpnmath_simd_t;
+
+const char* rpnmath_simd_isa_name(rpnmath_simd_isa_t isa);
+
+// The width holding integers of bits bits, which must be at most 64
+rpnmath_simd_width_t rpnmath_simd_width(size_t bits);
+
+// The kernels of an instruction set, NULL when it was not built or the CPU
+// does not support it
+const rpnmath_simd_t* rpnmath_simd_get(rpnmath_simd_isa_t isa);
+
+// The kernels of the widest instruction set the CPU supports. The choice is
+// made once, safely from any thread.
+const rpnmath_simd_t* rpnmath_simd_best(void);
+
+#endif // RPNMATH_SIMD_H
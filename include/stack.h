@@ -3,88 +3,75 @@
 
 #include <stddef.h>
 #include "item.h"
-
-#define RPNMATH_MAX_VARIABLES 256
-#define RPNMATH_MAX_BLOCKS 128
-#define RPNMATH_MAX_BLOCK_STACK 32
-
-typedef struct rpnmath_variable {
-  rpnmath_item_const_t value;
-  int is_assigned; // 0 = unassigned, 1 = assigned (for SSA enforcement)
-  size_t version;  // SSA version number
-  size_t block_id; // Block where this variable was assigned
-} rpnmath_variable_t;
-
-typedef struct rpnmath_block {
-  size_t id;
-  size_t start_pos;     // Start position in bytecode
-  size_t end_pos;       // End position in bytecode
-  size_t parent_block;  // Parent block ID
-  int is_loop;          // 1 if this is a loop block
-  int condition_result; // For conditional blocks: 0 = false, 1 = true, -1 = not evaluated
-} rpnmath_block_t;
+#include "value.h"
+#include "arena.h"
+#include "context.h"
+
+// Every item record on the stack is laid out as [item][payload][padding][trailer].
+// The trailer makes the last record reachable from the end of the buffer, and
+// the per-kind links make the last record of any kind reachable in O(1).
+typedef struct rpnmath_stack_trailer {
+  size_t size;    // total record size in bytes (item + payload + padding + trailer)
+  size_t prev;    // offset of the previous live record of the same kind (SIZE_MAX if none)
+  int removed;    // 1 once the record was popped while records above it were still live
+} rpnmath_stack_trailer_t;
 
 typedef struct rpnmath_stack {
   char *data;
   size_t size; // current size (bytes used)
   size_t capacity; // size the stack can expand to
-  rpnmath_variable_t variables[RPNMATH_MAX_VARIABLES]; // variable storage
-  
-  // Block management
-  rpnmath_block_t blocks[RPNMATH_MAX_BLOCKS];
-  size_t block_count;
-  size_t current_block;
-  
-  // Block execution stack
-  size_t block_stack[RPNMATH_MAX_BLOCK_STACK];
-  size_t block_stack_size;
-  
-  // Variable versioning for SSA
-  size_t variable_versions[RPNMATH_MAX_VARIABLES];
+  size_t last[RPNMATH_ITEMKIND_COUNT]; // offset of the last live record per kind (SIZE_MAX if none)
+  size_t counts[RPNMATH_ITEMKIND_COUNT]; // live records per kind
 } rpnmath_stack_t;
 
-// Initialize the stack
-void rpnmath_stack_init(rpnmath_stack_t *stack, size_t sizehint);
+// Initialize the stack, RPNMATH_STATUS_OUT_OF_MEMORY leaves it empty but usable
+int rpnmath_stack_init(rpnmath_stack_t *stack, size_t sizehint);
 
 // Clean up the stack
 void rpnmath_stack_cleanup(rpnmath_stack_t *stack);
 
-// Check if stack is empty
-int rpnmath_stack_isempty(rpnmath_stack_t *stack);
-
-// Push operations
-void rpnmath_stack_pushc(rpnmath_stack_t *stack, rpnmath_item_const_t *item);
-void rpnmath_stack_pushlr(rpnmath_stack_t *stack, rpnmath_item_localref_t *item);
-void rpnmath_stack_pushop(rpnmath_stack_t *stack, rpnmath_item_op_t *item);
-void rpnmath_stack_pushvop(rpnmath_stack_t *stack, rpnmath_item_vop_t *item);
-void rpnmath_stack_pushcfop(rpnmath_stack_t *stack, rpnmath_item_cfop_t *item);
+// Remove every item, the buffer keeps its capacity for the next expression
+void rpnmath_stack_reset(rpnmath_stack_t *stack);
 
-// Pop operations
-rpnmath_itemkind_t rpnmath_stack_peekk(rpnmath_stack_t *stack);
+// Check if stack is empty
+int rpnmath_stack_isempty(const rpnmath_stack_t *stack);
+
+// Push operations, RPNMATH_STATUS_OUT_OF_MEMORY leaves the stack unchanged
+int rpnmath_stack_pushc(rpnmath_stack_t *stack, rpnmath_item_const_t *item);
+int rpnmath_stack_pushlr(rpnmath_stack_t *stack, rpnmath_item_localref_t *item);
+int rpnmath_stack_pushop(rpnmath_stack_t *stack, rpnmath_item_op_t *item);
+int rpnmath_stack_pushvop(rpnmath_stack_t *stack, rpnmath_item_vop_t *item);
+int rpnmath_stack_pushcfop(rpnmath_stack_t *stack, rpnmath_item_cfop_t *item);
+
+// Pop operations, a VOID item when there is none of the kind. rpnmath_stack_popc
+// also returns VOID, leaving the constant on the stack, when its payload can
+// not be copied.
+rpnmath_itemkind_t rpnmath_stack_peekk(const rpnmath_stack_t *stack);
 rpnmath_item_const_t rpnmath_stack_popc(rpnmath_stack_t *stack);
 rpnmath_item_localref_t rpnmath_stack_poplr(rpnmath_stack_t *stack);
 rpnmath_item_op_t rpnmath_stack_popop(rpnmath_stack_t *stack);
 rpnmath_item_vop_t rpnmath_stack_popvop(rpnmath_stack_t *stack);
 rpnmath_item_cfop_t rpnmath_stack_popcfop(rpnmath_stack_t *stack);
 
-// Variable operations
-int rpnmath_stack_assign_variable(rpnmath_stack_t *stack, size_t var_id, rpnmath_item_const_t *value);
-rpnmath_item_const_t rpnmath_stack_get_variable(rpnmath_stack_t *stack, size_t var_id);
+// Phi node operations
+int rpnmath_stack_create_phi(rpnmath_stack_t *stack, size_t target_var, size_t *source_vars, size_t source_count);
 
-// Block management
-size_t rpnmath_stack_create_block(rpnmath_stack_t *stack, size_t parent_block, int is_loop);
-void rpnmath_stack_enter_block(rpnmath_stack_t *stack, size_t block_id);
-void rpnmath_stack_exit_block(rpnmath_stack_t *stack);
-int rpnmath_stack_evaluate_condition(rpnmath_stack_t *stack);
+// Iterate live items in push order:
+// for (pos = rpnmath_stack_begin(stack); pos < stack->size; pos = rpnmath_stack_next(stack, pos))
+size_t rpnmath_stack_begin(const rpnmath_stack_t *stack);
+size_t rpnmath_stack_next(const rpnmath_stack_t *stack, size_t pos);
 
-// Phi node operations
-void rpnmath_stack_create_phi(rpnmath_stack_t *stack, size_t target_var, size_t *source_vars, size_t source_count);
-int rpnmath_stack_resolve_phi(rpnmath_stack_t *stack, rpnmath_item_cfop_t *phi_op);
+// Read the constant record at pos without copying, wide payloads point into the stack
+rpnmath_item_const_t rpnmath_stack_const_at(const rpnmath_stack_t *stack, size_t pos);
 
 // Count items
-int rpnmath_stack_count_constants(rpnmath_stack_t *stack);
-
-// Execute
-int rpnmath_stack_execute(rpnmath_stack_t *stack, rpnmath_item_const_t *result);
+int rpnmath_stack_count_constants(const rpnmath_stack_t *stack);
+
+// Compile and execute once on context, see program.h to execute repeatedly.
+// The program is allocated from the context's arena, reset it afterwards.
+// Returns the status of rpnmath_program_compile or rpnmath_program_execute,
+// the details of either failure are in context.
+int rpnmath_stack_execute(const rpnmath_stack_t *stack, rpnmath_context_t *context, rpnmath_item_const_t *result,
+                          rpnmath_overflow_t overflow, rpnmath_rounding_t rounding);
 
 #endif // RPNMATH_STACK_H
\ No newline at end of file
@@ -0,0 +1,31 @@
+#ifndef RPNMATH_STATUS_H
+#define RPNMATH_STATUS_H
+
+// Why an operation failed. Functions that can fail while a program runs
+// return RPNMATH_STATUS_OK, which is 0, or one of these codes as an int,
+// so callers that only care whether something failed keep testing != 0.
+// The context of a failed evaluation holds the details, see
+// rpnmath_context_error.
+typedef enum rpnmath_status {
+  RPNMATH_STATUS_OK,
+  RPNMATH_STATUS_DIVISION_BY_ZERO,    // integer or decimal division by zero
+  RPNMATH_STATUS_OVERFLOW,            // integer result out of range under the trap policy
+  RPNMATH_STATUS_DECIMAL_OVERFLOW,    // decimal result does not fit its mantissa
+  RPNMATH_STATUS_OUT_OF_RANGE,        // big integer operand beyond any decimal mantissa
+  RPNMATH_STATUS_UNASSIGNED,          // variable read before it was assigned
+  RPNMATH_STATUS_VARIABLE_ID,         // variable id of RPNMATH_MAX_VARIABLES or more
+  RPNMATH_STATUS_NO_PHI_SOURCE,       // none of the sources of a phi node was assigned
+  RPNMATH_STATUS_NO_RETURN,           // the program ended without ret
+  RPNMATH_STATUS_UNKNOWN_INSTRUCTION, // the engine can not run the program
+  RPNMATH_STATUS_UNKNOWN_ENGINE,
+  RPNMATH_STATUS_COLUMN_TYPE,         // batch column of a type without a fixed width layout
+  RPNMATH_STATUS_COLUMN_RANGE,        // batch result the output column can not hold exactly
+  RPNMATH_STATUS_COMPILE,             // the items do not form a program, the message says why
+  RPNMATH_STATUS_OUT_OF_MEMORY,
+  RPNMATH_STATUS_COUNT, // Number of status codes (not a real status)
+} rpnmath_status_t;
+
+// "division_by_zero", "overflow", ...
+const char* rpnmath_status_name(rpnmath_status_t status);
+
+#endif // RPNMATH_STATUS_H
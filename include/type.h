@@ -3,9 +3,25 @@
 
 #include <stddef.h>
 
+// Integers wider than 64 bits (up to 128) use the compiler's native 128 bit
+// type. Without it widths above 64 bits stay unsupported.
+#if defined(__SIZEOF_INT128__) && (defined(__GNUC__) || defined(__clang__))
+#  define RPNMATH_INT128 1
+__extension__ typedef __int128 rpnmath_int128_t;
+__extension__ typedef unsigned __int128 rpnmath_uint128_t;
+#else
+#  define RPNMATH_INT128 0
+#endif
+
+// Big integers up to this width are stored inline like fixed width integers
+#define RPNMATH_BIGINT_INLINE_BITS (RPNMATH_INT128 ? 128 : 64)
+
 typedef enum rpnmath_typekind {
   RPNMATH_TYPEKIND_VOID, // Error
   RPNMATH_TYPEKIND_INT,
+  RPNMATH_TYPEKIND_BIGINT, // arbitrary precision, size is the width of the current value, see bigint.h
+  RPNMATH_TYPEKIND_FLOAT,  // IEEE 754 binary floating point, size is 32 or 64
+  RPNMATH_TYPEKIND_DECIMAL, // fixed point, size is the mantissa's 64 or 128 bits, see decimal.h
 } rpnmath_typekind_t;
 
 typedef struct rpnmath_type {
@@ -13,6 +29,7 @@ typedef struct rpnmath_type {
   size_t size; // size is in bits (size is needed in bits for packing optimizations)
   union {
     size_t _int;
+    size_t scale; // DECIMAL: digits after the point
   };
 } rpnmath_type_t;
 
@@ -20,8 +37,17 @@ size_t rpnmath_type_sizeof(size_t bitsize); // rounds up bit size to byte size
 size_t rpnmath_type_allignof(size_t bytesize); // max allignment is sizeof(void*)
 
 void rpnmath_type_int(rpnmath_type_t *type, size_t bitwidth);
+void rpnmath_type_bigint(rpnmath_type_t *type, size_t bitwidth);
+void rpnmath_type_float(rpnmath_type_t *type, size_t bitwidth);
+void rpnmath_type_decimal(rpnmath_type_t *type, size_t bitwidth, size_t scale);
 
 size_t rpnmath_type_native_size(size_t bitwidth);
+size_t rpnmath_type_bytes(const rpnmath_type_t *type); // storage of a value of the type
+
+// Big integers too wide to be stored inline keep their value in limbs
+static inline int rpnmath_type_has_limbs(const rpnmath_type_t *type) {
+  return type->kind == RPNMATH_TYPEKIND_BIGINT && type->size > RPNMATH_BIGINT_INLINE_BITS;
+}
 
 int rpnmath_type_would_overflow_add(long long a, long long b);
 int rpnmath_type_would_overflow_sub(long long a, long long b);
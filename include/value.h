@@ -0,0 +1,104 @@
+#ifndef RPNMATH_VALUE_H
+#define RPNMATH_VALUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "type.h"
+#include "item.h"
+#include "arena.h"
+#include "status.h"
+
+// A runtime value on the operand stack. Integers are kept sign extended
+// to 64 bits and narrowed to type.size whenever an operation produces them.
+// Integers wider than 64 bits keep their lower half in i and their upper
+// half in hi, which is not maintained (nor read) for narrower ones. Big
+// integers with limbs (rpnmath_type_has_limbs) refer to them instead.
+// Floats of either width are kept in f, 32 bit ones rounded to float.
+// Decimals keep their mantissa like an integer of type.size bits.
+typedef struct rpnmath_value {
+  rpnmath_type_t type;
+  union {
+    struct {
+      long long i;
+      long long hi;
+    };
+    const uint32_t *limbs; // never NULL, so i reads as nonzero
+    double f;
+  };
+} rpnmath_value_t;
+
+#if RPNMATH_INT128
+static inline rpnmath_int128_t rpnmath_value_get128(const rpnmath_value_t *value) {
+  if (value->type.size <= 64) {
+    return value->i;
+  }
+  return (rpnmath_int128_t)(((rpnmath_uint128_t)(unsigned long long)value->hi << 64) | (unsigned long long)value->i);
+}
+
+static inline void rpnmath_value_set128(rpnmath_value_t *value, rpnmath_int128_t wide) {
+  value->i = (long long)wide;
+  value->hi = (long long)(wide >> 64);
+}
+#endif
+
+// What integer arithmetic does with a result that does not fit its width.
+// The policy is part of a compiled program, see rpnmath_program_compile.
+typedef enum rpnmath_overflow {
+  RPNMATH_OVERFLOW_WRAP,     // two's complement wrap around (the default)
+  RPNMATH_OVERFLOW_TRAP,     // fail the evaluation
+  RPNMATH_OVERFLOW_SATURATE, // clamp to the smallest or largest value of the width
+  RPNMATH_OVERFLOW_PROMOTE,  // widen the result to twice the width, past 128 bits to a big integer
+  RPNMATH_OVERFLOW_COUNT
+} rpnmath_overflow_t;
+
+const char* rpnmath_overflow_name(rpnmath_overflow_t overflow);
+
+// How decimal multiplication and division round a result to its scale,
+// part of a compiled program like the overflow policy
+typedef enum rpnmath_rounding {
+  RPNMATH_ROUNDING_HALF_EVEN, // to nearest, ties to even (the default)
+  RPNMATH_ROUNDING_HALF_UP,   // to nearest, ties away from zero
+  RPNMATH_ROUNDING_DOWN,      // toward zero
+  RPNMATH_ROUNDING_FLOOR,     // toward negative infinity
+  RPNMATH_ROUNDING_CEILING,   // toward positive infinity
+  RPNMATH_ROUNDING_COUNT
+} rpnmath_rounding_t;
+
+const char* rpnmath_rounding_name(rpnmath_rounding_t rounding);
+
+// Whether an overflowing result fails the evaluation under the policy
+int rpnmath_overflow_fails(rpnmath_overflow_t overflow);
+
+// Slow path of integer arithmetic: left op right (ADD, SUB, MUL or DIV) was
+// found not to fit in bits, store what the policy makes of it into dst.
+// Returns RPNMATH_STATUS_OVERFLOW when the evaluation has to fail, leaving
+// dst untouched. dst may alias an operand, big integers promoted to are
+// allocated from arena.
+int rpnmath_value_overflow(rpnmath_overflow_t overflow, rpnmath_arena_t *arena, rpnmath_op_t operation, rpnmath_value_t *dst,
+                           const rpnmath_value_t *left, const rpnmath_value_t *right, size_t bits);
+
+// Narrow an integer to the native storage of the given bit width
+long long rpnmath_value_narrow(long long value, size_t bitwidth);
+
+// Format a value in decimal, the buffer should hold
+// rpnmath_value_format_size bytes, which is RPNMATH_VALUE_FORMAT_SIZE for
+// anything but big integers with limbs
+#define RPNMATH_VALUE_FORMAT_SIZE 48
+size_t rpnmath_value_format_size(const rpnmath_value_t *value);
+void rpnmath_value_format(const rpnmath_value_t *value, char *buffer, size_t size);
+
+// Any numeric value as a double
+double rpnmath_value_to_double(const rpnmath_value_t *value);
+
+// Parse a float literal: decimal digits with a fraction or an exponent
+// ("2.5", "1e-3"), an f suffix makes it 32 bit ("0.1f"). Returns -1 if str
+// is not one.
+int rpnmath_value_parse_float(rpnmath_value_t *value, const char *str);
+
+// Conversions between values and constant items
+void rpnmath_value_from_const(rpnmath_value_t *value, const rpnmath_item_const_t *item);
+void rpnmath_value_load(rpnmath_value_t *value, const rpnmath_type_t *type, const void *data); // reads what rpnmath_value_store wrote
+void rpnmath_value_store(const rpnmath_value_t *value, void *data); // writes rpnmath_type_bytes of its type
+rpnmath_item_const_t rpnmath_value_to_const(const rpnmath_value_t *value); // release with rpnmath_const_cleanup, VOID when out of memory
+
+#endif // RPNMATH_VALUE_H
@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "arena.h"
+
+#define RPNMATH_ARENA_ALIGN _Alignof(max_align_t)
+
+static rpnmath_arena_chunk_t *rpnmath_arena_new_chunk(size_t capacity) {
+  rpnmath_arena_chunk_t *chunk = malloc(sizeof(rpnmath_arena_chunk_t) + capacity);
+  if (!chunk) {
+    return NULL;
+  }
+  chunk->next = NULL;
+  chunk->capacity = capacity;
+  return chunk;
+}
+
+// Offset of the first aligned byte at or after offset in chunk
+static size_t rpnmath_arena_align(const rpnmath_arena_chunk_t *chunk, size_t offset) {
+  uintptr_t address = (uintptr_t)(chunk->data + offset);
+  uintptr_t misalignment = address % RPNMATH_ARENA_ALIGN;
+  return misalignment ? offset + (RPNMATH_ARENA_ALIGN - misalignment) : offset;
+}
+
+void rpnmath_arena_init(rpnmath_arena_t *arena, size_t chunk_size) {
+  memset(arena, 0, sizeof(*arena));
+  arena->chunk_size = chunk_size ? chunk_size : RPNMATH_ARENA_CHUNK_SIZE;
+}
+
+void rpnmath_arena_cleanup(rpnmath_arena_t *arena) {
+  rpnmath_arena_chunk_t *chunk = arena->root;
+  while (chunk) {
+    rpnmath_arena_chunk_t *next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
+  arena->root = NULL;
+  arena->current = NULL;
+  arena->offset = 0;
+  arena->used = 0;
+  arena->last = NULL;
+}
+
+void rpnmath_arena_reset(rpnmath_arena_t *arena) {
+  // Everything fit in one chunk, nothing to do but rewind
+  if (arena->root && arena->root->next) {
+    size_t capacity = arena->used > arena->chunk_size ? arena->used : arena->chunk_size;
+    rpnmath_arena_cleanup(arena);
+    arena->root = rpnmath_arena_new_chunk(capacity);
+  }
+
+  arena->current = arena->root;
+  arena->offset = 0;
+  arena->used = 0;
+  arena->last = NULL;
+}
+
+void *rpnmath_arena_alloc(rpnmath_arena_t *arena, size_t size) {
+  size_t start = 0;
+  if (arena->current) {
+    start = rpnmath_arena_align(arena->current, arena->offset);
+  }
+
+  if (!arena->current || start + size > arena->current->capacity) {
+    // Leave the rest of the current chunk unused and start a new one
+    size_t capacity = size + RPNMATH_ARENA_ALIGN;
+    if (capacity < arena->chunk_size) {
+      capacity = arena->chunk_size;
+    }
+
+    rpnmath_arena_chunk_t *chunk = rpnmath_arena_new_chunk(capacity);
+    if (!chunk) {
+      return NULL;
+    }
+    if (arena->current) {
+      arena->current->next = chunk;
+    } else {
+      arena->root = chunk;
+    }
+    arena->current = chunk;
+    arena->offset = 0;
+    start = rpnmath_arena_align(chunk, 0);
+  }
+
+  void *result = arena->current->data + start;
+  arena->used += start + size - arena->offset;
+  arena->offset = start + size;
+  arena->last = result;
+
+  memset(result, 0, size);
+  return result;
+}
+
+void *rpnmath_arena_grow(rpnmath_arena_t *arena, void *data, size_t old_size, size_t new_size) {
+  if (!data) {
+    return rpnmath_arena_alloc(arena, new_size);
+  }
+  if (new_size <= old_size) {
+    return data;
+  }
+
+  // The most recent allocation can simply take more of its chunk
+  if (data == arena->last) {
+    size_t start = (size_t)((char*)data - arena->current->data);
+    if (start + new_size <= arena->current->capacity) {
+      memset((char*)data + old_size, 0, new_size - old_size);
+      arena->used += new_size - old_size;
+      arena->offset = start + new_size;
+      return data;
+    }
+  }
+
+  void *result = rpnmath_arena_alloc(arena, new_size);
+  if (result) {
+    memcpy(result, data, old_size);
+  }
+  return result;
+}
+
+char *rpnmath_arena_printf(rpnmath_arena_t *arena, const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(NULL, 0, format, args);
+  va_end(args);
+
+  char *text = length < 0 ? NULL : rpnmath_arena_alloc(arena, (size_t)length + 1);
+  if (text) {
+    va_start(args, format);
+    vsnprintf(text, (size_t)length + 1, format, args);
+    va_end(args);
+  }
+  return text;
+}
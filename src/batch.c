@@ -0,0 +1,1335 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <math.h>
+#include "type.h"
+#include "item.h"
+#include "value.h"
+#include "arena.h"
+#include "context.h"
+#include "program.h"
+#include "decimal.h"
+#include "simd.h"
+#include "batch.h"
+#include "exec.h"
+
+// Vector engine. The program runs one instruction at a time over a vector
+// of RPNMATH_BATCH_SIZE rows: every slot of the operand stack and every
+// variable holds a vector, a plain array of int8_t to int64_t, float or
+// double wherever its rows share a type that fits one, and an array of
+// values only where they do not (decimals, integers wider than 64 bits,
+// rows of different types). Integer arrays go through the kernels of
+// simd.h, float arrays through loops the compiler vectorizes, values
+// through the kernels the other engines run on one value.
+//
+// Branches and loops run under a mask of the active rows: each part of an
+// if chain runs on the rows taking it, a loop runs until its condition
+// failed on every row. Instructions compute every row, and a result that
+// would overwrite what rows outside the mask still need is blended in
+// under it. A row the vector can not follow, one promoted past the width
+// of its array, runs on its own on the context's engine.
+
+// How the rows of a vector are stored
+typedef enum rpnmath_batch_lane {
+  RPNMATH_BATCH_VALUES, // rpnmath_value_t, every row with a type of its own
+  RPNMATH_BATCH_INTS,   // native integers of type's width, every row of type
+  RPNMATH_BATCH_FLOATS, // float or double, every row of type
+} rpnmath_batch_lane_t;
+
+typedef struct rpnmath_batch_vector {
+  rpnmath_batch_lane_t lane;
+  rpnmath_type_t type; // of every row, unless lane is RPNMATH_BATCH_VALUES
+  void *data;          // room for RPNMATH_BATCH_SIZE values whatever the lane
+} rpnmath_batch_vector_t;
+
+// An if chain or loop the active rows are in. Masks hold a byte per row,
+// 1 for the rows in them, the way the comparisons of simd.h write them.
+typedef struct rpnmath_batch_frame {
+  size_t block;   // the loop, or the first part of the chain
+  int is_loop;
+  int later_part; // if: the rows of the first part are through it
+  uint8_t *rows;  // if: rows entering the chain, loop: rows that left it
+  uint8_t *taken; // if: rows the first part ran on
+} rpnmath_batch_frame_t;
+
+typedef struct rpnmath_batch {
+  const rpnmath_program_t *program;
+  rpnmath_context_t *context;
+  const rpnmath_simd_t *simd;
+  const rpnmath_column_t *inputs;
+  size_t input_count;
+  const rpnmath_column_t *output;
+  size_t output_stride;              // bytes per row of output
+  size_t first;                      // row of the columns the vector starts at
+  size_t n;                          // rows in the vector
+  rpnmath_batch_vector_t *values;    // max_depth vectors, the operand stack
+  rpnmath_batch_vector_t *variables; // variable_count vectors
+  uint8_t *assigned;                 // variable_count masks, the rows each variable is assigned on
+  rpnmath_batch_vector_t result;     // what the running instruction computes
+  rpnmath_batch_vector_t constant;   // the constant operand of ADD_VC
+  size_t constant_index;             // constant held by constant, SIZE_MAX for none
+  void *scratch[2];                  // operands converted to a common type
+  uint8_t *live;                     // rows that did not return yet
+  uint8_t *active;                   // live rows on the path being run
+  uint8_t *mask;                     // the condition of a branch or loop
+  size_t live_count;
+  size_t active_count;
+  size_t keep;                       // stack slots below keep hold what live rows outside active still need
+  rpnmath_batch_frame_t *frames;     // block_count entries, as no block opens two
+  size_t frame_count;
+} rpnmath_batch_t;
+
+// Rows the kernels go on with after a row they could not compute
+#define RPNMATH_BATCH_WINDOW 32
+
+#define RPNMATH_BATCH_ROWS for (size_t row = 0; row < n; row++)
+
+// X(ctype) for the integers of bytes bytes, or the floats of bits bits
+#define RPNMATH_BATCH_INTEGERS(bytes, X) \
+  switch (bytes) { \
+    case 1: X(int8_t) break; \
+    case 2: X(int16_t) break; \
+    case 4: X(int32_t) break; \
+    default: X(int64_t) break; \
+  }
+#define RPNMATH_BATCH_FLOATS(bits, X) \
+  if ((bits) == 32) { \
+    X(float) \
+  } else { \
+    X(double) \
+  }
+
+// Whether values of the type have a fixed width layout a column can hold
+static int rpnmath_batch_fixed(const rpnmath_type_t *type) {
+  switch (type->kind) {
+    case RPNMATH_TYPEKIND_INT:
+    case RPNMATH_TYPEKIND_BIGINT:
+      return type->size > 0 && type->size <= RPNMATH_BIGINT_INLINE_BITS;
+    case RPNMATH_TYPEKIND_FLOAT:
+      return type->size == 32 || type->size == 64;
+    case RPNMATH_TYPEKIND_DECIMAL:
+      return (type->size == 64 || (RPNMATH_INT128 && type->size == 128)) && type->scale <= RPNMATH_DECIMAL_MAX_SCALE;
+    default:
+      return 0;
+  }
+}
+
+// The integer, or the mantissa of a decimal, of a value without limbs
+static rpnmath_decimal_exact_t rpnmath_batch_exact(const rpnmath_value_t *value) {
+#if RPNMATH_INT128
+  if (value->type.size > 64) {
+    return rpnmath_value_get128(value);
+  }
+#endif
+  return value->i;
+}
+
+// Make value exact of type, an integer or decimal type whose native width
+// has to hold it
+static int rpnmath_batch_fit(rpnmath_value_t *value, const rpnmath_type_t *type, rpnmath_decimal_exact_t exact) {
+  size_t bits = rpnmath_type_native_size(type->size) * 8;
+#if RPNMATH_INT128
+  if (bits > 64) {
+    value->type = *type;
+    rpnmath_value_set128(value, exact);
+    return 0;
+  }
+  if (exact < LLONG_MIN || exact > LLONG_MAX) {
+    return -1;
+  }
+#endif
+  if (rpnmath_value_narrow((long long)exact, bits) != (long long)exact) {
+    return -1;
+  }
+  value->type = *type;
+  value->i = (long long)exact;
+  return 0;
+}
+
+// Convert a result to the output's type, fails unless that is exact. Floats
+// take any number, nothing else takes a float.
+static int rpnmath_batch_convert(rpnmath_value_t *value, const rpnmath_type_t *type) {
+  if (type->kind == RPNMATH_TYPEKIND_FLOAT) {
+    double result = rpnmath_value_to_double(value);
+    rpnmath_type_float(&value->type, type->size);
+    value->f = result;
+    return 0;
+  }
+  if (value->type.kind == RPNMATH_TYPEKIND_FLOAT || rpnmath_type_has_limbs(&value->type)) {
+    return -1;
+  }
+  if (type->kind == RPNMATH_TYPEKIND_DECIMAL) {
+    // Adding a zero of the output's scale aligns the scales without rounding
+    rpnmath_value_t zero = {0};
+    rpnmath_type_decimal(&zero.type, 64, type->scale);
+    if (rpnmath_decimal_arith(RPNMATH_OVERFLOW_PROMOTE, RPNMATH_ROUNDING_DOWN, RPNMATH_OP_ADD, value, &zero, value) != 0 ||
+        value->type.scale != type->scale) {
+      return -1;
+    }
+  } else if (value->type.kind == RPNMATH_TYPEKIND_DECIMAL) {
+    return -1;
+  }
+  return rpnmath_batch_fit(value, type, rpnmath_batch_exact(value));
+}
+
+// Write the result of a row to the output column
+static int rpnmath_batch_put(rpnmath_batch_t *batch, size_t row, const rpnmath_value_t *value) {
+  rpnmath_value_t result = *value;
+  if (RPNMATH_UNLIKELY(rpnmath_batch_convert(&result, &batch->output->type) != 0)) {
+    return rpnmath_context_fail_operation(batch->context, RPNMATH_STATUS_COLUMN_RANGE, RPNMATH_OP_ASSIGN, value, NULL);
+  }
+  rpnmath_value_store(&result, (char*)batch->output->data + row * batch->output_stride);
+  return RPNMATH_STATUS_OK;
+}
+
+// Run the program on rows first to first + count one at a time on the
+// context's engine, stops at the first row that fails and stores its index
+// in *failed_row
+static int rpnmath_batch_rows(rpnmath_batch_t *batch, size_t first, size_t count, size_t *failed_row) {
+  const rpnmath_program_t *program = batch->program;
+  rpnmath_context_t *context = batch->context;
+  size_t bound = batch->input_count < program->variable_count ? batch->input_count : program->variable_count;
+  
+  for (size_t row = first; row < first + count; row++) {
+    *failed_row = row;
+    rpnmath_context_forget_variables(context);
+    for (size_t id = 0; id < bound; id++) {
+      const rpnmath_column_t *column = &batch->inputs[id];
+      rpnmath_value_t value;
+      rpnmath_value_load(&value, &column->type, (const char*)column->data + row * rpnmath_type_bytes(&column->type));
+      if (rpnmath_context_store_variable(context, id, &value) != 0) {
+        return context->error.status;
+      }
+    }
+    
+    rpnmath_item_const_t result;
+    int status = rpnmath_program_execute(program, context, &result);
+    if (status != 0) {
+      return status;
+    }
+    rpnmath_value_t value;
+    rpnmath_value_from_const(&value, &result);
+    status = rpnmath_batch_put(batch, row, &value);
+    if (status != 0) {
+      return status;
+    }
+  }
+  *failed_row = first + count;
+  return RPNMATH_STATUS_OK;
+}
+
+// How a vector whose rows all are of type stores them
+static rpnmath_batch_lane_t rpnmath_batch_lane(const rpnmath_type_t *type) {
+  if (type->kind == RPNMATH_TYPEKIND_INT && type->size <= 64) {
+    return RPNMATH_BATCH_INTS;
+  }
+  if (type->kind == RPNMATH_TYPEKIND_FLOAT) {
+    return RPNMATH_BATCH_FLOATS;
+  }
+  return RPNMATH_BATCH_VALUES;
+}
+
+// Bytes per row of a vector
+static size_t rpnmath_batch_bytes(const rpnmath_batch_vector_t *vector) {
+  switch (vector->lane) {
+    case RPNMATH_BATCH_INTS: return rpnmath_type_native_size(vector->type.size);
+    case RPNMATH_BATCH_FLOATS: return vector->type.size / 8;
+    default: return sizeof(rpnmath_value_t);
+  }
+}
+
+static void rpnmath_batch_get(const rpnmath_batch_vector_t *vector, size_t row, rpnmath_value_t *value) {
+  if (vector->lane == RPNMATH_BATCH_VALUES) {
+    *value = ((const rpnmath_value_t*)vector->data)[row];
+    return;
+  }
+  value->type = vector->type;
+  value->hi = 0;
+#define RPNMATH_BATCH_GET_INT(ctype) value->i = ((const ctype*)vector->data)[row];
+#define RPNMATH_BATCH_GET_FLOAT(ctype) value->f = ((const ctype*)vector->data)[row];
+  if (vector->lane == RPNMATH_BATCH_INTS) {
+    RPNMATH_BATCH_INTEGERS(rpnmath_batch_bytes(vector), RPNMATH_BATCH_GET_INT)
+  } else {
+    RPNMATH_BATCH_FLOATS(vector->type.size, RPNMATH_BATCH_GET_FLOAT)
+  }
+#undef RPNMATH_BATCH_GET_INT
+#undef RPNMATH_BATCH_GET_FLOAT
+}
+
+// Row of an integer vector becomes i, which fits its width
+static void rpnmath_batch_set(rpnmath_batch_vector_t *vector, size_t row, long long i) {
+#define RPNMATH_BATCH_SET(ctype) ((ctype*)vector->data)[row] = (ctype)i;
+  RPNMATH_BATCH_INTEGERS(rpnmath_batch_bytes(vector), RPNMATH_BATCH_SET)
+#undef RPNMATH_BATCH_SET
+}
+
+// Store the rows of a vector as values, which rows of any type can be
+// blended into. A value is wider than any element, so going backwards
+// reads every element before a value overwrites it.
+static void rpnmath_batch_values(rpnmath_batch_vector_t *vector, size_t n) {
+  if (vector->lane == RPNMATH_BATCH_VALUES) {
+    return;
+  }
+  rpnmath_value_t *values = vector->data;
+  for (size_t row = n; row-- > 0;) {
+    rpnmath_value_t value;
+    rpnmath_batch_get(vector, row, &value);
+    values[row] = value;
+  }
+  vector->lane = RPNMATH_BATCH_VALUES;
+}
+
+// Every row of vector becomes value
+static void rpnmath_batch_fill(rpnmath_batch_vector_t *vector, const rpnmath_value_t *value, size_t n) {
+  vector->lane = rpnmath_batch_lane(&value->type);
+  vector->type = value->type;
+#define RPNMATH_BATCH_FILL_INT(ctype) { \
+    ctype *rows = vector->data; \
+    RPNMATH_BATCH_ROWS { \
+      rows[row] = (ctype)value->i; \
+    } \
+  }
+#define RPNMATH_BATCH_FILL_FLOAT(ctype) { \
+    ctype *rows = vector->data; \
+    RPNMATH_BATCH_ROWS { \
+      rows[row] = (ctype)value->f; \
+    } \
+  }
+  switch (vector->lane) {
+    case RPNMATH_BATCH_INTS:
+      RPNMATH_BATCH_INTEGERS(rpnmath_batch_bytes(vector), RPNMATH_BATCH_FILL_INT)
+      break;
+    case RPNMATH_BATCH_FLOATS:
+      RPNMATH_BATCH_FLOATS(vector->type.size, RPNMATH_BATCH_FILL_FLOAT)
+      break;
+    default: {
+      rpnmath_value_t *rows = vector->data;
+      RPNMATH_BATCH_ROWS {
+        rows[row] = *value;
+      }
+      break;
+    }
+  }
+#undef RPNMATH_BATCH_FILL_INT
+#undef RPNMATH_BATCH_FILL_FLOAT
+}
+
+// Unpack the rows of the vector from an input column into the vector of
+// its variable. Integers and floats are laid out in the column as they are
+// in a vector.
+static void rpnmath_batch_unpack(rpnmath_batch_t *batch, const rpnmath_column_t *column, rpnmath_batch_vector_t *vector) {
+  size_t n = batch->n;
+  size_t stride = rpnmath_type_bytes(&column->type);
+  const char *data = (const char*)column->data + batch->first * stride;
+  vector->lane = rpnmath_batch_lane(&column->type);
+  vector->type = column->type;
+  if (vector->lane != RPNMATH_BATCH_VALUES) {
+    memcpy(vector->data, data, n * stride);
+    return;
+  }
+  rpnmath_value_t *values = vector->data;
+  RPNMATH_BATCH_ROWS {
+    rpnmath_value_load(&values[row], &column->type, data + row * stride);
+  }
+}
+
+// The rows of an integer vector as integers of bytes bytes, at least as
+// wide as its own, in scratch unless they already are
+static const void *rpnmath_batch_widen(const rpnmath_batch_vector_t *vector, size_t bytes, void *scratch, size_t n) {
+  size_t from = rpnmath_batch_bytes(vector);
+  if (from == bytes) {
+    return vector->data;
+  }
+#define RPNMATH_BATCH_WIDENINGS(X) \
+  X(int8_t, int16_t) X(int8_t, int32_t) X(int8_t, int64_t) X(int16_t, int32_t) X(int16_t, int64_t) X(int32_t, int64_t)
+#define RPNMATH_BATCH_WIDEN(narrow_t, wide_t) \
+    case sizeof(narrow_t) * 16 + sizeof(wide_t): { \
+      const narrow_t *narrow = vector->data; \
+      wide_t *wide = scratch; \
+      RPNMATH_BATCH_ROWS { \
+        wide[row] = narrow[row]; \
+      } \
+      break; \
+    }
+  switch (from * 16 + bytes) {
+    RPNMATH_BATCH_WIDENINGS(RPNMATH_BATCH_WIDEN)
+    default:
+      break;
+  }
+#undef RPNMATH_BATCH_WIDENINGS
+#undef RPNMATH_BATCH_WIDEN
+  return scratch;
+}
+
+// The rows of an integer or float vector as floats of bits bits, in
+// scratch unless they already are. Integers convert straight to them like
+// they do in the float kernels.
+static const void *rpnmath_batch_float(const rpnmath_batch_vector_t *vector, size_t bits, void *scratch, size_t n) {
+  if (vector->lane == RPNMATH_BATCH_FLOATS && vector->type.size == bits) {
+    return vector->data;
+  }
+#define RPNMATH_BATCH_CONVERT(ctype) { \
+    const ctype *in = vector->data; \
+    RPNMATH_BATCH_ROWS { \
+      out[row] = in[row]; \
+    } \
+  }
+#define RPNMATH_BATCH_CONVERT_ANY \
+  if (vector->lane == RPNMATH_BATCH_FLOATS) { \
+    RPNMATH_BATCH_FLOATS(vector->type.size, RPNMATH_BATCH_CONVERT) \
+  } else { \
+    RPNMATH_BATCH_INTEGERS(rpnmath_batch_bytes(vector), RPNMATH_BATCH_CONVERT) \
+  }
+  if (bits == 32) {
+    float *out = scratch;
+    RPNMATH_BATCH_CONVERT_ANY
+  } else {
+    double *out = scratch;
+    RPNMATH_BATCH_CONVERT_ANY
+  }
+#undef RPNMATH_BATCH_CONVERT
+#undef RPNMATH_BATCH_CONVERT_ANY
+  return scratch;
+}
+
+// Make vector what the running instruction computed into result for the
+// active rows. With keep the other rows keep what they have, blended
+// under the mask, otherwise result replaces vector whole by trading
+// storage with it.
+static void rpnmath_batch_write(rpnmath_batch_t *batch, rpnmath_batch_vector_t *vector, rpnmath_batch_vector_t *result, int keep) {
+  size_t n = batch->n;
+  if (!keep) {
+    rpnmath_batch_vector_t replaced = *vector;
+    *vector = *result;
+    *result = replaced;
+    return;
+  }
+  
+  if (vector->lane != result->lane || (vector->lane != RPNMATH_BATCH_VALUES && vector->type.size != result->type.size)) {
+    rpnmath_batch_values(vector, n);
+    rpnmath_batch_values(result, n);
+  }
+  if (vector->lane == RPNMATH_BATCH_VALUES) {
+    rpnmath_value_t *rows = vector->data;
+    const rpnmath_value_t *results = result->data;
+    RPNMATH_BATCH_ROWS {
+      if (batch->active[row]) {
+        rows[row] = results[row];
+      }
+    }
+    return;
+  }
+  rpnmath_simd_width_t width = rpnmath_simd_width(rpnmath_batch_bytes(vector) * 8);
+  batch->simd->select[width](n, batch->active, result->data, vector->data, vector->data);
+}
+
+// The result of the running instruction becomes slot of the operand stack
+static void rpnmath_batch_push(rpnmath_batch_t *batch, size_t slot) {
+  int partial = batch->active_count < batch->live_count;
+  rpnmath_batch_write(batch, &batch->values[slot], &batch->result, partial && slot < batch->keep);
+}
+
+// Store vector in a variable on the active rows
+static void rpnmath_batch_store(rpnmath_batch_t *batch, size_t var_id, rpnmath_batch_vector_t *vector) {
+  size_t n = batch->n;
+  uint8_t *assigned = batch->assigned + var_id * RPNMATH_BATCH_SIZE;
+  uint8_t kept = 0;
+  if (batch->active_count < batch->live_count) {
+    RPNMATH_BATCH_ROWS {
+      kept |= batch->live[row] & (batch->active[row] ^ 1) & assigned[row];
+    }
+  }
+  rpnmath_batch_write(batch, &batch->variables[var_id], vector, kept);
+  RPNMATH_BATCH_ROWS {
+    assigned[row] |= batch->active[row];
+  }
+}
+
+// Fails unless the variable is assigned on every active row
+static int rpnmath_batch_assigned(rpnmath_batch_t *batch, size_t var_id) {
+  size_t n = batch->n;
+  const uint8_t *assigned = batch->assigned + var_id * RPNMATH_BATCH_SIZE;
+  uint8_t missing = 0;
+  RPNMATH_BATCH_ROWS {
+    missing |= batch->active[row] & (assigned[row] ^ 1);
+  }
+  if (RPNMATH_UNLIKELY(missing)) {
+    return rpnmath_context_fail(batch->context, RPNMATH_STATUS_UNASSIGNED, var_id);
+  }
+  return RPNMATH_STATUS_OK;
+}
+
+// Run a row the vector can not follow on its own on the context's engine,
+// which writes what it returns. The row is done in the vector then.
+static int rpnmath_batch_escape(rpnmath_batch_t *batch, size_t row) {
+  size_t failed_row;
+  int status = rpnmath_batch_rows(batch, batch->first + row, 1, &failed_row);
+  if (status != 0) {
+    return status;
+  }
+  batch->live_count--;
+  batch->active_count--;
+  batch->live[row] = 0;
+  batch->active[row] = 0;
+  return RPNMATH_STATUS_OK;
+}
+
+// One row of a binary instruction, dst = left op right with the kernel the
+// other engines run. Failures return their status.
+static int rpnmath_batch_row(const rpnmath_batch_t *batch, rpnmath_opcode_t opcode, size_t operand, rpnmath_value_t *dst,
+                             const rpnmath_value_t *left, const rpnmath_value_t *right) {
+  rpnmath_overflow_t overflow = batch->program->overflow;
+  rpnmath_rounding_t rounding = batch->program->rounding;
+  rpnmath_arena_t *arena = batch->context->arena;
+  
+  switch (opcode) {
+#define RPNMATH_BATCH_KERNEL(op, width, bits, ctype) \
+    case RPNMATH_INSN_##op##_##width: \
+      return rpnmath_kernel_##op##_##width(overflow, arena, dst, left, right);
+#define RPNMATH_BATCH_KERNEL_OPERAND(op, width, bits, ctype) \
+    case RPNMATH_INSN_##op##_##width: \
+      rpnmath_kernel_##op##_##width(operand, dst, left, right); \
+      return 0;
+#define RPNMATH_BATCH_KERNEL_DECIMAL(op, width, bits, ctype) \
+    case RPNMATH_INSN_##op##_##width: \
+      return rpnmath_kernel_##op##_##width(overflow, operand, dst, left, right);
+    RPNMATH_KERNELS(RPNMATH_BATCH_KERNEL)
+    RPNMATH_FLOAT_KERNELS(RPNMATH_BATCH_KERNEL_OPERAND)
+    RPNMATH_FLOAT_COMPARES(RPNMATH_BATCH_KERNEL_OPERAND)
+    RPNMATH_DECIMAL_KERNELS(RPNMATH_BATCH_KERNEL_DECIMAL)
+    RPNMATH_DECIMAL_COMPARES(RPNMATH_BATCH_KERNEL_OPERAND)
+#undef RPNMATH_BATCH_KERNEL
+#undef RPNMATH_BATCH_KERNEL_OPERAND
+#undef RPNMATH_BATCH_KERNEL_DECIMAL
+    case RPNMATH_INSN_ADD: return rpnmath_exec_arith(overflow, rounding, arena, RPNMATH_OP_ADD, dst, left, right);
+    case RPNMATH_INSN_SUB: return rpnmath_exec_arith(overflow, rounding, arena, RPNMATH_OP_SUB, dst, left, right);
+    case RPNMATH_INSN_MUL: return rpnmath_exec_arith(overflow, rounding, arena, RPNMATH_OP_MUL, dst, left, right);
+    case RPNMATH_INSN_DIV: return rpnmath_exec_div(overflow, rounding, arena, dst, left, right);
+    default:
+      rpnmath_exec_compare(dst, rpnmath_exec_test(opcode, left, right));
+      return 0;
+  }
+}
+
+// A row whose integer result the kernel could not compute, as it does not
+// fit the width or divides by zero, gets what the overflow policy makes of
+// it. One promoted past the width leaves the vector.
+static int rpnmath_batch_overflow(rpnmath_batch_t *batch, rpnmath_op_t operation, size_t bits, const rpnmath_batch_vector_t *left,
+                                  const rpnmath_batch_vector_t *right, rpnmath_batch_vector_t *dst, size_t row) {
+  const rpnmath_program_t *program = batch->program;
+  rpnmath_arena_t *arena = batch->context->arena;
+  rpnmath_value_t l, r, result;
+  rpnmath_batch_get(left, row, &l);
+  rpnmath_batch_get(right, row, &r);
+  
+  int status = operation == RPNMATH_OP_DIV ? rpnmath_exec_div(program->overflow, program->rounding, arena, &result, &l, &r) :
+               rpnmath_exec_integer(program->overflow, arena, operation, bits, &result, &l, &r);
+  if (status != 0) {
+    return rpnmath_context_fail_operation(batch->context, status, operation, &l, &r);
+  }
+  if (result.type.kind == RPNMATH_TYPEKIND_INT && result.type.size == bits) {
+    rpnmath_batch_set(dst, row, result.i);
+    return RPNMATH_STATUS_OK;
+  }
+  return rpnmath_batch_escape(batch, row);
+}
+
+// Integer arithmetic or comparison of two integer vectors with the kernels,
+// for results of bits bits. The kernels compute every row and report the
+// first whose result they could not, the active ones of those take the
+// policy one at a time.
+static int rpnmath_batch_integers(rpnmath_batch_t *batch, rpnmath_op_t operation, size_t bits, const rpnmath_batch_vector_t *left,
+                                  const rpnmath_batch_vector_t *right, rpnmath_batch_vector_t *dst) {
+  size_t n = batch->n;
+  size_t bytes = rpnmath_type_native_size(bits);
+  const char *a = rpnmath_batch_widen(left, bytes, batch->scratch[0], n);
+  const char *b = rpnmath_batch_widen(right, bytes, batch->scratch[1], n);
+  rpnmath_simd_kernel_t *kernel = batch->simd->kernels[operation][rpnmath_simd_width(bits)];
+  char *d = dst->data;
+  
+  dst->lane = RPNMATH_BATCH_INTS;
+  if (operation >= RPNMATH_OP_EQ) {
+    rpnmath_type_int(&dst->type, 8);
+    kernel(n, a, b, d);
+    return RPNMATH_STATUS_OK;
+  }
+  rpnmath_type_int(&dst->type, bits);
+  size_t failed = kernel(n, a, b, d);
+  
+  // Wrapped sums, differences and products are what the policy makes of them
+  if (batch->program->overflow == RPNMATH_OVERFLOW_WRAP && operation != RPNMATH_OP_DIV) {
+    return RPNMATH_STATUS_OK;
+  }
+  while (failed < n) {
+    if (batch->active[failed]) {
+      int status = rpnmath_batch_overflow(batch, operation, bits, left, right, dst, failed);
+      if (status != 0) {
+        return status;
+      }
+    }
+    // The rows after one go in windows, so that rows failing one after
+    // another do not each rescan the rest of the vector
+    size_t next = failed + 1;
+    failed = n;
+    while (next < n) {
+      size_t count = n - next < RPNMATH_BATCH_WINDOW ? n - next : RPNMATH_BATCH_WINDOW;
+      size_t at = kernel(count, a + next * bytes, b + next * bytes, d + next * bytes);
+      if (at < count) {
+        failed = next + at;
+        break;
+      }
+      next += count;
+    }
+  }
+  return RPNMATH_STATUS_OK;
+}
+
+// Float arithmetic or comparison of two vectors of floats and integers, at
+// bits bits for a float kernel and the width of the wider float otherwise.
+// Comparisons compare doubles.
+static void rpnmath_batch_floats(rpnmath_batch_t *batch, rpnmath_op_t operation, size_t bits, const rpnmath_batch_vector_t *left,
+                                 const rpnmath_batch_vector_t *right, rpnmath_batch_vector_t *dst) {
+  size_t n = batch->n;
+  if (operation >= RPNMATH_OP_EQ) {
+    bits = 64;
+    dst->lane = RPNMATH_BATCH_INTS;
+    rpnmath_type_int(&dst->type, 8);
+  } else {
+    if (bits == 0) {
+      bits = (left->lane == RPNMATH_BATCH_FLOATS && left->type.size == 64) ||
+             (right->lane == RPNMATH_BATCH_FLOATS && right->type.size == 64) ? 64 : 32;
+    }
+    dst->lane = RPNMATH_BATCH_FLOATS;
+    rpnmath_type_float(&dst->type, bits);
+  }
+
+#define RPNMATH_BATCH_LOOP(op) \
+      case RPNMATH_OP_##op: \
+        RPNMATH_BATCH_ROWS { \
+          out[row] = a[row] RPNMATH_KERNEL_OP_##op b[row]; \
+        } \
+        break;
+#define RPNMATH_BATCH_FLOAT_OP(ctype) { \
+    const ctype *a = rpnmath_batch_float(left, bits, batch->scratch[0], n); \
+    const ctype *b = rpnmath_batch_float(right, bits, batch->scratch[1], n); \
+    if (operation >= RPNMATH_OP_EQ) { \
+      uint8_t *out = dst->data; \
+      switch (operation) { \
+        RPNMATH_BATCH_LOOP(EQ) \
+        RPNMATH_BATCH_LOOP(NE) \
+        RPNMATH_BATCH_LOOP(LT) \
+        RPNMATH_BATCH_LOOP(LE) \
+        RPNMATH_BATCH_LOOP(GT) \
+        default: \
+          RPNMATH_BATCH_ROWS { \
+            out[row] = a[row] >= b[row]; \
+          } \
+          break; \
+      } \
+    } else { \
+      ctype *out = dst->data; \
+      switch (operation) { \
+        RPNMATH_BATCH_LOOP(ADD) \
+        RPNMATH_BATCH_LOOP(SUB) \
+        RPNMATH_BATCH_LOOP(MUL) \
+        default: \
+          RPNMATH_BATCH_ROWS { \
+            out[row] = a[row] / b[row]; \
+          } \
+          break; \
+      } \
+    } \
+  }
+  RPNMATH_BATCH_FLOATS(bits, RPNMATH_BATCH_FLOAT_OP)
+#undef RPNMATH_BATCH_LOOP
+#undef RPNMATH_BATCH_FLOAT_OP
+}
+
+// dst = left op right for the active rows, opcode being an arithmetic
+// instruction or comparison and operand what the instruction carries
+static int rpnmath_batch_binary(rpnmath_batch_t *batch, rpnmath_opcode_t opcode, size_t operand, const rpnmath_batch_vector_t *left,
+                                const rpnmath_batch_vector_t *right, rpnmath_batch_vector_t *dst) {
+  rpnmath_op_t operation;
+  size_t int_bits = 0;   // width of an integer kernel
+  size_t float_bits = 0; // width of a float kernel
+  int plain = 1;         // whether arrays have a loop for it, which decimals do not
+  
+  switch (opcode) {
+#define RPNMATH_BATCH_KERNEL(op, width, bits, ctype) \
+    case RPNMATH_INSN_##op##_##width: operation = RPNMATH_OP_##op; int_bits = bits; break;
+#define RPNMATH_BATCH_KERNEL_FLOAT(op, width, bits, ctype) \
+    case RPNMATH_INSN_##op##_##width: operation = RPNMATH_OP_##op; float_bits = bits; break;
+#define RPNMATH_BATCH_KERNEL_DECIMAL(op, width, bits, ctype) \
+    case RPNMATH_INSN_##op##_##width: operation = RPNMATH_OP_##op; plain = 0; break;
+    RPNMATH_KERNELS(RPNMATH_BATCH_KERNEL)
+    RPNMATH_FLOAT_KERNELS(RPNMATH_BATCH_KERNEL_FLOAT)
+    RPNMATH_FLOAT_COMPARES(RPNMATH_BATCH_KERNEL_FLOAT)
+    RPNMATH_DECIMAL_KERNELS(RPNMATH_BATCH_KERNEL_DECIMAL)
+    RPNMATH_DECIMAL_COMPARES(RPNMATH_BATCH_KERNEL_DECIMAL)
+#undef RPNMATH_BATCH_KERNEL
+#undef RPNMATH_BATCH_KERNEL_FLOAT
+#undef RPNMATH_BATCH_KERNEL_DECIMAL
+    case RPNMATH_INSN_ADD: operation = RPNMATH_OP_ADD; break;
+    case RPNMATH_INSN_SUB: operation = RPNMATH_OP_SUB; break;
+    case RPNMATH_INSN_MUL: operation = RPNMATH_OP_MUL; break;
+    case RPNMATH_INSN_DIV: operation = RPNMATH_OP_DIV; break;
+    case RPNMATH_INSN_EQ: operation = RPNMATH_OP_EQ; break;
+    case RPNMATH_INSN_NE: operation = RPNMATH_OP_NE; break;
+    case RPNMATH_INSN_LT: operation = RPNMATH_OP_LT; break;
+    case RPNMATH_INSN_LE: operation = RPNMATH_OP_LE; break;
+    case RPNMATH_INSN_GT: operation = RPNMATH_OP_GT; break;
+    case RPNMATH_INSN_GE: operation = RPNMATH_OP_GE; break;
+    default:
+      return rpnmath_context_fail(batch->context, RPNMATH_STATUS_UNKNOWN_INSTRUCTION, opcode);
+  }
+  
+  int ints = left->lane == RPNMATH_BATCH_INTS && right->lane == RPNMATH_BATCH_INTS;
+  int numbers = left->lane != RPNMATH_BATCH_VALUES && right->lane != RPNMATH_BATCH_VALUES;
+  if (plain && float_bits == 0 && ints) {
+    size_t bits = int_bits ? int_bits : (left->type.size > right->type.size ? left->type.size : right->type.size);
+    if (bits <= 64 && rpnmath_batch_bytes(left) <= rpnmath_type_native_size(bits) &&
+        rpnmath_batch_bytes(right) <= rpnmath_type_native_size(bits)) {
+      return rpnmath_batch_integers(batch, operation, bits, left, right, dst);
+    }
+  } else if (plain && int_bits == 0 && numbers) {
+    rpnmath_batch_floats(batch, operation, float_bits, left, right, dst);
+    return RPNMATH_STATUS_OK;
+  }
+  
+  size_t n = batch->n;
+  rpnmath_value_t *out = dst->data;
+  dst->lane = RPNMATH_BATCH_VALUES;
+  RPNMATH_BATCH_ROWS {
+    if (!batch->active[row]) {
+      continue;
+    }
+    rpnmath_value_t l, r;
+    rpnmath_batch_get(left, row, &l);
+    rpnmath_batch_get(right, row, &r);
+    int status = rpnmath_batch_row(batch, opcode, operand, &out[row], &l, &r);
+    if (RPNMATH_UNLIKELY(status != 0)) {
+      return rpnmath_context_fail_operation(batch->context, status, operation, &l, &r);
+    }
+  }
+  return RPNMATH_STATUS_OK;
+}
+
+// Whether two vectors store rows of one and the same type
+static int rpnmath_batch_same(const rpnmath_batch_vector_t *left, const rpnmath_batch_vector_t *right) {
+  return left->lane != RPNMATH_BATCH_VALUES && left->lane == right->lane && left->type.size == right->type.size;
+}
+
+// dst = the smaller (MIN) or larger (MAX) of left and right for the active
+// rows, ties and unordered floats keeping left like rpnmath_exec_min does
+static void rpnmath_batch_extreme(rpnmath_batch_t *batch, rpnmath_opcode_t opcode, const rpnmath_batch_vector_t *left,
+                                  const rpnmath_batch_vector_t *right, rpnmath_batch_vector_t *dst) {
+  size_t n = batch->n;
+  int min = opcode == RPNMATH_INSN_MIN;
+  if (rpnmath_batch_same(left, right) && left->lane == RPNMATH_BATCH_INTS) {
+    // The rows right is picked on, by the comparison kernel
+    rpnmath_simd_width_t width = rpnmath_simd_width(left->type.size);
+    batch->simd->kernels[min ? RPNMATH_OP_LT : RPNMATH_OP_GT][width](n, right->data, left->data, batch->mask);
+    batch->simd->select[width](n, batch->mask, right->data, left->data, dst->data);
+  } else if (rpnmath_batch_same(left, right)) {
+#define RPNMATH_BATCH_EXTREME(ctype) { \
+    const ctype *l = left->data; \
+    const ctype *r = right->data; \
+    ctype *out = dst->data; \
+    if (min) { \
+      RPNMATH_BATCH_ROWS { \
+        out[row] = r[row] < l[row] ? r[row] : l[row]; \
+      } \
+    } else { \
+      RPNMATH_BATCH_ROWS { \
+        out[row] = r[row] > l[row] ? r[row] : l[row]; \
+      } \
+    } \
+  }
+    RPNMATH_BATCH_FLOATS(left->type.size, RPNMATH_BATCH_EXTREME)
+#undef RPNMATH_BATCH_EXTREME
+  } else {
+    // Types differing by row pick a whole value each
+    rpnmath_value_t *out = dst->data;
+    RPNMATH_BATCH_ROWS {
+      if (batch->active[row]) {
+        rpnmath_value_t l, r;
+        rpnmath_batch_get(left, row, &l);
+        rpnmath_batch_get(right, row, &r);
+        if (min) {
+          rpnmath_exec_min(&out[row], &l, &r);
+        } else {
+          rpnmath_exec_max(&out[row], &l, &r);
+        }
+      }
+    }
+    dst->lane = RPNMATH_BATCH_VALUES;
+    return;
+  }
+  dst->lane = left->lane;
+  dst->type = left->type;
+}
+
+// mask[row] = whether row of vector holds, for the active rows at least
+static void rpnmath_batch_truth(const rpnmath_batch_t *batch, const rpnmath_batch_vector_t *vector, uint8_t *mask) {
+  size_t n = batch->n;
+#define RPNMATH_BATCH_TRUTH(ctype) { \
+    const ctype *rows = vector->data; \
+    RPNMATH_BATCH_ROWS { \
+      mask[row] = rows[row] != 0; \
+    } \
+  }
+  switch (vector->lane) {
+    case RPNMATH_BATCH_INTS:
+      RPNMATH_BATCH_INTEGERS(rpnmath_batch_bytes(vector), RPNMATH_BATCH_TRUTH)
+      break;
+    case RPNMATH_BATCH_FLOATS:
+      RPNMATH_BATCH_FLOATS(vector->type.size, RPNMATH_BATCH_TRUTH)
+      break;
+    default: {
+      const rpnmath_value_t *rows = vector->data;
+      RPNMATH_BATCH_ROWS {
+        mask[row] = batch->active[row] && rpnmath_exec_truth(&rows[row]);
+      }
+      break;
+    }
+  }
+#undef RPNMATH_BATCH_TRUTH
+}
+
+// dst = the first of left and right where condition holds, right elsewhere
+static void rpnmath_batch_select(rpnmath_batch_t *batch, const rpnmath_batch_vector_t *condition, const rpnmath_batch_vector_t *left,
+                                 const rpnmath_batch_vector_t *right, rpnmath_batch_vector_t *dst) {
+  size_t n = batch->n;
+  rpnmath_batch_truth(batch, condition, batch->mask);
+  if (rpnmath_batch_same(left, right)) {
+    batch->simd->select[rpnmath_simd_width(rpnmath_batch_bytes(left) * 8)](n, batch->mask, left->data, right->data, dst->data);
+    dst->lane = left->lane;
+    dst->type = left->type;
+    return;
+  }
+  rpnmath_value_t *out = dst->data;
+  RPNMATH_BATCH_ROWS {
+    if (batch->active[row]) {
+      rpnmath_batch_get(batch->mask[row] ? left : right, row, &out[row]);
+    }
+  }
+  dst->lane = RPNMATH_BATCH_VALUES;
+}
+
+// dst = |vector| for the active rows. The smallest integer of a width has
+// no negation of that width and takes the overflow policy on its own.
+static int rpnmath_batch_abs(rpnmath_batch_t *batch, const rpnmath_batch_vector_t *vector, rpnmath_batch_vector_t *dst) {
+  const rpnmath_program_t *program = batch->program;
+  rpnmath_arena_t *arena = batch->context->arena;
+  size_t n = batch->n;
+  
+  if (vector->lane == RPNMATH_BATCH_VALUES) {
+    rpnmath_value_t *out = dst->data;
+    RPNMATH_BATCH_ROWS {
+      if (!batch->active[row]) {
+        continue;
+      }
+      rpnmath_value_t value;
+      rpnmath_batch_get(vector, row, &value);
+      int status = rpnmath_exec_abs(program->overflow, program->rounding, arena, &out[row], &value);
+      if (RPNMATH_UNLIKELY(status != 0)) {
+        return rpnmath_context_fail_operation(batch->context, status, RPNMATH_OP_ABS, &value, NULL);
+      }
+    }
+    dst->lane = RPNMATH_BATCH_VALUES;
+    return RPNMATH_STATUS_OK;
+  }
+  
+  dst->lane = vector->lane;
+  dst->type = vector->type;
+  if (vector->lane == RPNMATH_BATCH_FLOATS) {
+#define RPNMATH_BATCH_FABS(ctype) { \
+    const ctype *in = vector->data; \
+    ctype *out = dst->data; \
+    RPNMATH_BATCH_ROWS { \
+      out[row] = (ctype)fabs(in[row]); \
+    } \
+  }
+    RPNMATH_BATCH_FLOATS(vector->type.size, RPNMATH_BATCH_FABS)
+#undef RPNMATH_BATCH_FABS
+    return RPNMATH_STATUS_OK;
+  }
+  
+  int smallest = 0;
+#define RPNMATH_BATCH_ABS(ctype) { \
+    const ctype *in = vector->data; \
+    ctype *out = dst->data; \
+    const ctype min = (ctype)((unsigned long long)1 << (sizeof(ctype) * 8 - 1)); \
+    RPNMATH_BATCH_ROWS { \
+      ctype x = in[row]; \
+      smallest |= x == min; \
+      out[row] = x < 0 && x != min ? (ctype)-x : x; \
+    } \
+  }
+  RPNMATH_BATCH_INTEGERS(rpnmath_batch_bytes(vector), RPNMATH_BATCH_ABS)
+#undef RPNMATH_BATCH_ABS
+  if (!smallest) {
+    return RPNMATH_STATUS_OK;
+  }
+  
+  long long min = (long long)((unsigned long long)-1 << (rpnmath_batch_bytes(vector) * 8 - 1));
+  RPNMATH_BATCH_ROWS {
+    rpnmath_value_t value, result;
+    rpnmath_batch_get(vector, row, &value);
+    if (!batch->active[row] || value.i != min) {
+      continue;
+    }
+    int status = rpnmath_exec_abs(program->overflow, program->rounding, arena, &result, &value);
+    if (status != 0) {
+      return rpnmath_context_fail_operation(batch->context, status, RPNMATH_OP_ABS, &value, NULL);
+    }
+    if (result.type.kind == RPNMATH_TYPEKIND_INT && result.type.size == vector->type.size) {
+      rpnmath_batch_set(dst, row, result.i);
+    } else if ((status = rpnmath_batch_escape(batch, row)) != 0) {
+      return status;
+    }
+  }
+  return RPNMATH_STATUS_OK;
+}
+
+// Count the active rows and work out the stack slots the live rows outside
+// them still need: the ones below where they continue
+static void rpnmath_batch_update(rpnmath_batch_t *batch) {
+  size_t n = batch->n;
+  size_t count = 0;
+  RPNMATH_BATCH_ROWS {
+    count += batch->active[row];
+  }
+  batch->active_count = count;
+  
+  batch->keep = 0;
+  for (size_t i = 0; i < batch->frame_count; i++) {
+    const rpnmath_batch_frame_t *frame = &batch->frames[i];
+    const rpnmath_block_t *block = &batch->program->blocks[frame->block];
+    size_t keep = block->depth;
+    // Rows through the first part wait at the end with their results
+    if (frame->later_part && block->end_depth > keep) {
+      keep = block->end_depth;
+    }
+    if (keep > batch->keep) {
+      batch->keep = keep;
+    }
+  }
+}
+
+static rpnmath_batch_frame_t *rpnmath_batch_open(rpnmath_batch_t *batch, size_t block, int is_loop) {
+  rpnmath_batch_frame_t *frame = &batch->frames[batch->frame_count];
+  if (!frame->rows) {
+    frame->rows = rpnmath_arena_alloc(batch->context->arena, 2 * RPNMATH_BATCH_SIZE);
+    if (!frame->rows) {
+      rpnmath_context_fail(batch->context, RPNMATH_STATUS_OUT_OF_MEMORY, 0);
+      return NULL;
+    }
+    frame->taken = frame->rows + RPNMATH_BATCH_SIZE;
+  }
+  frame->block = block;
+  frame->is_loop = is_loop;
+  frame->later_part = 0;
+  batch->frame_count++;
+  return frame;
+}
+
+// active = rows & live
+static void rpnmath_batch_restore(rpnmath_batch_t *batch, const uint8_t *rows) {
+  size_t n = batch->n;
+  RPNMATH_BATCH_ROWS {
+    batch->active[row] = rows[row] & batch->live[row];
+  }
+}
+
+// Open the if chain of block, its first part runs on the active rows
+// condition holds on
+static int rpnmath_batch_branch(rpnmath_batch_t *batch, size_t block, const uint8_t *condition) {
+  size_t n = batch->n;
+  rpnmath_batch_frame_t *frame = rpnmath_batch_open(batch, block, 0);
+  if (!frame) {
+    return batch->context->error.status;
+  }
+  RPNMATH_BATCH_ROWS {
+    frame->rows[row] = batch->active[row];
+    frame->taken[row] = batch->active[row] & condition[row];
+    batch->active[row] = frame->taken[row];
+  }
+  rpnmath_batch_update(batch);
+  return RPNMATH_STATUS_OK;
+}
+
+// The end at end_pos closes the if chains ending there, the rows that
+// entered them are active again. Returns the position after it.
+static size_t rpnmath_batch_end(rpnmath_batch_t *batch, size_t end_pos, size_t *top) {
+  const rpnmath_program_t *program = batch->program;
+  while (batch->frame_count > 0) {
+    const rpnmath_batch_frame_t *frame = &batch->frames[batch->frame_count - 1];
+    if (frame->is_loop || program->blocks[frame->block].end_pos != end_pos) {
+      break;
+    }
+    rpnmath_batch_restore(batch, frame->rows);
+    batch->frame_count--;
+  }
+  *top = program->blocks[program->code[end_pos].operand].end_depth;
+  rpnmath_batch_update(batch);
+  return end_pos + 1;
+}
+
+// The active rows are through the current part of the chain frame opened:
+// the rows waiting for the next part run it, or the chain ends. Returns
+// the position to continue at.
+static size_t rpnmath_batch_next_part(rpnmath_batch_t *batch, rpnmath_batch_frame_t *frame, size_t *top) {
+  const rpnmath_block_t *block = &batch->program->blocks[frame->block];
+  size_t n = batch->n;
+  if (frame->later_part || block->next_pos == block->end_pos) {
+    return rpnmath_batch_end(batch, block->end_pos, top);
+  }
+  frame->later_part = 1;
+  RPNMATH_BATCH_ROWS {
+    batch->active[row] = frame->rows[row] & (frame->taken[row] ^ 1) & batch->live[row];
+  }
+  *top = block->depth;
+  rpnmath_batch_update(batch);
+  return block->next_pos;
+}
+
+// No row is active: continue where the rows of the innermost frame wait
+static size_t rpnmath_batch_leave(rpnmath_batch_t *batch, size_t *top) {
+  if (batch->frame_count == 0) {
+    return batch->program->count;
+  }
+  rpnmath_batch_frame_t *frame = &batch->frames[batch->frame_count - 1];
+  if (!frame->is_loop) {
+    return rpnmath_batch_next_part(batch, frame, top);
+  }
+  // The loop is over for every row
+  const rpnmath_block_t *block = &batch->program->blocks[frame->block];
+  rpnmath_batch_restore(batch, frame->rows);
+  batch->frame_count--;
+  *top = block->depth;
+  rpnmath_batch_update(batch);
+  return block->end_pos + 1;
+}
+
+// The active rows returned vector, which goes to the output column. They
+// are done.
+static int rpnmath_batch_return(rpnmath_batch_t *batch, const rpnmath_batch_vector_t *vector) {
+  size_t n = batch->n;
+  RPNMATH_BATCH_ROWS {
+    if (!batch->active[row]) {
+      continue;
+    }
+    rpnmath_value_t value;
+    rpnmath_batch_get(vector, row, &value);
+    if (rpnmath_batch_put(batch, batch->first + row, &value) != 0) {
+      return batch->context->error.status;
+    }
+    batch->live[row] = 0;
+    batch->active[row] = 0;
+  }
+  batch->live_count -= batch->active_count;
+  batch->active_count = 0;
+  return RPNMATH_STATUS_OK;
+}
+
+// The opcode of ADD_VC's addition
+static rpnmath_opcode_t rpnmath_batch_add_opcode(rpnmath_opcode_t opcode) {
+  switch (opcode) {
+#define RPNMATH_BATCH_ADD_VC(op, width, bits, ctype) case RPNMATH_INSN_##op##_##width: return RPNMATH_INSN_ADD_##width;
+    RPNMATH_KERNELS_ADD_VC(RPNMATH_BATCH_ADD_VC)
+#undef RPNMATH_BATCH_ADD_VC
+    default: return RPNMATH_INSN_ADD;
+  }
+}
+
+// Run the program on rows first to first + n, at most RPNMATH_BATCH_SIZE
+static int rpnmath_batch_vector(rpnmath_batch_t *batch, size_t first, size_t n) {
+  const rpnmath_program_t *program = batch->program;
+  rpnmath_context_t *context = batch->context;
+  rpnmath_batch_vector_t *values = batch->values;
+  size_t top = 0;
+  size_t pc = 0;
+  
+  batch->first = first;
+  batch->n = n;
+  memset(batch->live, 1, n);
+  memset(batch->active, 1, n);
+  batch->live_count = n;
+  batch->active_count = n;
+  batch->keep = 0;
+  batch->frame_count = 0;
+  batch->constant_index = SIZE_MAX;
+  for (size_t id = 0; id < program->variable_count; id++) {
+    int input = id < batch->input_count;
+    memset(batch->assigned + id * RPNMATH_BATCH_SIZE, input, n);
+    if (input) {
+      rpnmath_batch_unpack(batch, &batch->inputs[id], &batch->variables[id]);
+    }
+  }
+  
+  while (pc < program->count) {
+    if (batch->active_count == 0) {
+      if (batch->live_count == 0) {
+        return RPNMATH_STATUS_OK;
+      }
+      pc = rpnmath_batch_leave(batch, &top);
+      continue;
+    }
+    const rpnmath_insn_t *insn = &program->code[pc];
+    size_t next = pc + 1;
+    
+    switch (insn->opcode) {
+      case RPNMATH_INSN_NOP:
+        break;
+        
+      case RPNMATH_INSN_PUSH:
+        rpnmath_batch_fill(&batch->result, &program->constants[insn->operand], n);
+        rpnmath_batch_push(batch, top++);
+        break;
+        
+      case RPNMATH_INSN_LOAD: {
+        if (rpnmath_batch_assigned(batch, insn->operand) != 0) {
+          return context->error.status;
+        }
+        const rpnmath_batch_vector_t *variable = &batch->variables[insn->operand];
+        batch->result.lane = variable->lane;
+        batch->result.type = variable->type;
+        memcpy(batch->result.data, variable->data, n * rpnmath_batch_bytes(variable));
+        rpnmath_batch_push(batch, top++);
+        break;
+      }
+      
+      case RPNMATH_INSN_STORE:
+        top--;
+        rpnmath_batch_store(batch, insn->operand, &values[top]);
+        break;
+        
+      case RPNMATH_INSN_STORE_C:
+        rpnmath_batch_fill(&batch->result, &program->constants[insn->operand2], n);
+        rpnmath_batch_store(batch, insn->operand, &batch->result);
+        break;
+
+#define RPNMATH_BATCH_CASE(op, width, bits, ctype) case RPNMATH_INSN_##op##_##width:
+      RPNMATH_KERNELS_ADD_VC(RPNMATH_BATCH_CASE)
+      case RPNMATH_INSN_ADD_VC:
+        if (rpnmath_batch_assigned(batch, insn->operand) != 0) {
+          return context->error.status;
+        }
+        if (batch->constant_index != insn->operand2) {
+          rpnmath_batch_fill(&batch->constant, &program->constants[insn->operand2], n);
+          batch->constant_index = insn->operand2;
+        }
+        if (rpnmath_batch_binary(batch, rpnmath_batch_add_opcode(insn->opcode), 0, &batch->variables[insn->operand],
+                                 &batch->constant, &batch->result) != 0) {
+          return context->error.status;
+        }
+        rpnmath_batch_push(batch, top++);
+        break;
+        
+      // Binary operations pop right and leave their result in left
+      RPNMATH_KERNELS(RPNMATH_BATCH_CASE)
+      RPNMATH_FLOAT_KERNELS(RPNMATH_BATCH_CASE)
+      RPNMATH_FLOAT_COMPARES(RPNMATH_BATCH_CASE)
+      RPNMATH_DECIMAL_KERNELS(RPNMATH_BATCH_CASE)
+      RPNMATH_DECIMAL_COMPARES(RPNMATH_BATCH_CASE)
+#undef RPNMATH_BATCH_CASE
+      case RPNMATH_INSN_ADD:
+      case RPNMATH_INSN_SUB:
+      case RPNMATH_INSN_MUL:
+      case RPNMATH_INSN_DIV:
+      case RPNMATH_INSN_EQ:
+      case RPNMATH_INSN_NE:
+      case RPNMATH_INSN_LT:
+      case RPNMATH_INSN_LE:
+      case RPNMATH_INSN_GT:
+      case RPNMATH_INSN_GE:
+        top--;
+        if (rpnmath_batch_binary(batch, insn->opcode, insn->operand, &values[top - 1], &values[top], &batch->result) != 0) {
+          return context->error.status;
+        }
+        rpnmath_batch_push(batch, top - 1);
+        break;
+        
+      case RPNMATH_INSN_MIN:
+      case RPNMATH_INSN_MAX:
+        top--;
+        rpnmath_batch_extreme(batch, insn->opcode, &values[top - 1], &values[top], &batch->result);
+        rpnmath_batch_push(batch, top - 1);
+        break;
+        
+      case RPNMATH_INSN_SELECT:
+        top -= 2;
+        rpnmath_batch_select(batch, &values[top - 1], &values[top], &values[top + 1], &batch->result);
+        rpnmath_batch_push(batch, top - 1);
+        break;
+        
+      case RPNMATH_INSN_ABS:
+        if (rpnmath_batch_abs(batch, &values[top - 1], &batch->result) != 0) {
+          return context->error.status;
+        }
+        rpnmath_batch_push(batch, top - 1);
+        break;
+        
+      case RPNMATH_INSN_IF:
+        top--;
+        rpnmath_batch_truth(batch, &values[top], batch->mask);
+        if (rpnmath_batch_branch(batch, insn->operand, batch->mask) != 0) {
+          return context->error.status;
+        }
+        break;
+        
+      case RPNMATH_INSN_IF_CMP:
+        top -= 2;
+        // Comparisons leave a mask of 8 bit booleans in result
+        if (rpnmath_batch_binary(batch, insn->operand2, 0, &values[top], &values[top + 1], &batch->result) != 0) {
+          return context->error.status;
+        }
+        if (batch->result.lane != RPNMATH_BATCH_INTS) {
+          rpnmath_batch_truth(batch, &batch->result, batch->mask);
+        } else {
+          memcpy(batch->mask, batch->result.data, n);
+        }
+        if (rpnmath_batch_branch(batch, insn->operand, batch->mask) != 0) {
+          return context->error.status;
+        }
+        break;
+        
+      case RPNMATH_INSN_ELSE:
+        next = rpnmath_batch_next_part(batch, &batch->frames[batch->frame_count - 1], &top);
+        break;
+        
+      case RPNMATH_INSN_LOOP: {
+        top--;
+        rpnmath_batch_truth(batch, &values[top], batch->mask);
+        rpnmath_batch_frame_t *frame = batch->frame_count ? &batch->frames[batch->frame_count - 1] : NULL;
+        if (!frame || !frame->is_loop || frame->block != insn->operand) {
+          // First time around
+          frame = rpnmath_batch_open(batch, insn->operand, 1);
+          if (!frame) {
+            return context->error.status;
+          }
+          memset(frame->rows, 0, n);
+        }
+        RPNMATH_BATCH_ROWS {
+          frame->rows[row] |= batch->active[row] & (batch->mask[row] ^ 1);
+          batch->active[row] &= batch->mask[row];
+        }
+        rpnmath_batch_update(batch);
+        break;
+      }
+      
+      case RPNMATH_INSN_END: {
+        const rpnmath_block_t *block = &program->blocks[insn->operand];
+        if (block->is_loop) {
+          next = block->start_pos;
+          top = block->depth;
+        } else {
+          next = rpnmath_batch_end(batch, pc, &top);
+        }
+        break;
+      }
+      
+      case RPNMATH_INSN_RET:
+        if (rpnmath_batch_return(batch, &values[top - 1]) != 0) {
+          return context->error.status;
+        }
+        break;
+        
+      default:
+        // Phi nodes, see rpnmath_batch_vectorizes
+        return rpnmath_context_fail(context, RPNMATH_STATUS_UNKNOWN_INSTRUCTION, insn->opcode);
+    }
+    
+    pc = next;
+  }
+  
+  if (batch->live_count == 0) {
+    return RPNMATH_STATUS_OK;
+  }
+  return rpnmath_context_fail(context, RPNMATH_STATUS_NO_RETURN, 0);
+}
+
+int rpnmath_batch_vectorizes(const rpnmath_program_t *program) {
+  for (size_t pc = 0; pc < program->count; pc++) {
+    if (program->code[pc].opcode == RPNMATH_INSN_PHI) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+int rpnmath_batch_execute(const rpnmath_program_t *program, rpnmath_context_t *context,
+                          const rpnmath_column_t *inputs, size_t input_count, const rpnmath_column_t *output, size_t rows,
+                          size_t *failed_row) {
+  size_t failed;
+  if (!failed_row) {
+    failed_row = &failed;
+  }
+  *failed_row = rows;
+  
+  for (size_t i = 0; i < input_count; i++) {
+    if (!rpnmath_batch_fixed(&inputs[i].type)) {
+      return rpnmath_context_fail(context, RPNMATH_STATUS_COLUMN_TYPE, i);
+    }
+  }
+  if (!rpnmath_batch_fixed(&output->type)) {
+    return rpnmath_context_fail(context, RPNMATH_STATUS_COLUMN_TYPE, input_count);
+  }
+  
+  rpnmath_batch_t batch = {0};
+  batch.program = program;
+  batch.context = context;
+  batch.simd = rpnmath_simd_best();
+  batch.inputs = inputs;
+  batch.input_count = input_count;
+  batch.output = output;
+  batch.output_stride = rpnmath_type_bytes(&output->type);
+  if (!rpnmath_batch_vectorizes(program)) {
+    return rpnmath_batch_rows(&batch, 0, rows, failed_row);
+  }
+  
+  // The compiler proved the stack never goes deeper than max_depth. Every
+  // vector has room for values, as any of them can end up holding some.
+  size_t vector_size = RPNMATH_BATCH_SIZE * sizeof(rpnmath_value_t);
+  size_t slots = program->max_depth + program->variable_count;
+  char *storage = rpnmath_arena_alloc(context->arena, (slots + 4) * vector_size);
+  batch.values = rpnmath_arena_alloc(context->arena, slots * sizeof(rpnmath_batch_vector_t));
+  uint8_t *masks = rpnmath_arena_alloc(context->arena, (program->variable_count + 3) * RPNMATH_BATCH_SIZE);
+  batch.frames = rpnmath_arena_alloc(context->arena, program->block_count * sizeof(rpnmath_batch_frame_t));
+  if (!storage || !batch.values || !masks || !batch.frames) {
+    return rpnmath_context_fail(context, RPNMATH_STATUS_OUT_OF_MEMORY, 0);
+  }
+  memset(storage, 0, (slots + 4) * vector_size);
+  memset(batch.frames, 0, program->block_count * sizeof(rpnmath_batch_frame_t));
+  
+  for (size_t i = 0; i < slots; i++) {
+    batch.values[i] = (rpnmath_batch_vector_t){.lane = RPNMATH_BATCH_VALUES, .data = storage + i * vector_size};
+  }
+  batch.variables = batch.values + program->max_depth;
+  batch.result.data = storage + slots * vector_size;
+  batch.constant.data = storage + (slots + 1) * vector_size;
+  batch.scratch[0] = storage + (slots + 2) * vector_size;
+  batch.scratch[1] = storage + (slots + 3) * vector_size;
+  batch.live = masks;
+  batch.active = masks + RPNMATH_BATCH_SIZE;
+  batch.mask = masks + 2 * RPNMATH_BATCH_SIZE;
+  batch.assigned = masks + 3 * RPNMATH_BATCH_SIZE;
+  
+  for (size_t first = 0; first < rows; first += RPNMATH_BATCH_SIZE) {
+    size_t n = rows - first < RPNMATH_BATCH_SIZE ? rows - first : RPNMATH_BATCH_SIZE;
+    if (rpnmath_batch_vector(&batch, first, n) != 0) {
+      // The instruction that failed ran on every row of the vector, a later
+      // one could have failed on a lower row. Running the rows one by one
+      // finds the lowest, the way the row by row path does, and writes the
+      // rows before it.
+      int status = rpnmath_batch_rows(&batch, first, n, failed_row);
+      if (status != 0) {
+        return status;
+      }
+      *failed_row = rows;
+    }
+  }
+  return RPNMATH_STATUS_OK;
+}
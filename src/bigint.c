@@ -0,0 +1,575 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "type.h"
+#include "item.h"
+#include "value.h"
+#include "arena.h"
+#include "bigint.h"
+
+// The kernels work on magnitudes: little endian limb arrays without sign.
+// Operands are turned into magnitudes, results back into two's complement.
+
+typedef uint32_t rpnmath_limb_t;
+typedef uint64_t rpnmath_dlimb_t; // holds the product of two limbs plus two carries
+
+#define RPNMATH_LIMB_MAX UINT32_MAX
+#define RPNMATH_INLINE_LIMBS (RPNMATH_BIGINT_INLINE_BITS / RPNMATH_BIGINT_LIMB_BITS)
+
+// Scratch up to this many limbs lives on the C stack, so small operations
+// do not touch the arena
+#define RPNMATH_LOCAL_LIMBS 8
+
+#if RPNMATH_INT128
+typedef rpnmath_int128_t rpnmath_inline_t;
+typedef rpnmath_uint128_t rpnmath_inline_unsigned_t;
+#  define RPNMATH_INLINE_GET(value) rpnmath_value_get128(value)
+#else
+typedef long long rpnmath_inline_t;
+typedef unsigned long long rpnmath_inline_unsigned_t;
+#  define RPNMATH_INLINE_GET(value) ((value)->i)
+#endif
+
+typedef struct rpnmath_magnitude {
+  const rpnmath_limb_t *limbs;
+  size_t count; // without leading zero limbs, 0 for zero
+  int negative;
+} rpnmath_magnitude_t;
+
+static size_t rpnmath_limbs_trim(const rpnmath_limb_t *limbs, size_t count) {
+  while (count && !limbs[count - 1]) {
+    count--;
+  }
+  return count;
+}
+
+static rpnmath_limb_t *rpnmath_limbs_scratch(rpnmath_limb_t *local, size_t count, rpnmath_arena_t *arena) {
+  if (count <= RPNMATH_LOCAL_LIMBS) {
+    memset(local, 0, count * sizeof(rpnmath_limb_t));
+    return local;
+  }
+  return rpnmath_arena_alloc(arena, count * sizeof(rpnmath_limb_t));
+}
+
+// Two's complement negation in place
+static void rpnmath_limbs_negate(rpnmath_limb_t *limbs, size_t count) {
+  rpnmath_dlimb_t carry = 1;
+  for (size_t i = 0; i < count; i++) {
+    carry += (rpnmath_limb_t)~limbs[i];
+    limbs[i] = (rpnmath_limb_t)carry;
+    carry >>= RPNMATH_BIGINT_LIMB_BITS;
+  }
+}
+
+// Limb index of the value in two's complement, sign extended past its width
+static rpnmath_limb_t rpnmath_bigint_limb(const rpnmath_value_t *value, size_t index) {
+  if (rpnmath_type_has_limbs(&value->type)) {
+    size_t count = value->type.size / RPNMATH_BIGINT_LIMB_BITS;
+    if (index < count) {
+      return value->limbs[index];
+    }
+    return (value->limbs[count - 1] >> (RPNMATH_BIGINT_LIMB_BITS - 1)) ? RPNMATH_LIMB_MAX : 0;
+  }
+
+  rpnmath_inline_t inline_value = RPNMATH_INLINE_GET(value);
+  if (index >= RPNMATH_INLINE_LIMBS) {
+    return inline_value < 0 ? RPNMATH_LIMB_MAX : 0;
+  }
+  return (rpnmath_limb_t)((rpnmath_inline_unsigned_t)inline_value >> (index * RPNMATH_BIGINT_LIMB_BITS));
+}
+
+static size_t rpnmath_bigint_limb_count(const rpnmath_value_t *value) {
+  return rpnmath_type_has_limbs(&value->type) ? value->type.size / RPNMATH_BIGINT_LIMB_BITS : RPNMATH_INLINE_LIMBS;
+}
+
+// Magnitude of an operand, borrowing its limbs when it is not negative.
+// local has room for RPNMATH_LOCAL_LIMBS limbs.
+static int rpnmath_bigint_magnitude(const rpnmath_value_t *value, rpnmath_limb_t *local, rpnmath_arena_t *arena,
+                                    rpnmath_magnitude_t *magnitude) {
+  size_t count = rpnmath_bigint_limb_count(value);
+  magnitude->negative = rpnmath_bigint_limb(value, count - 1) >> (RPNMATH_BIGINT_LIMB_BITS - 1);
+
+  if (rpnmath_type_has_limbs(&value->type) && !magnitude->negative) {
+    magnitude->limbs = value->limbs;
+    magnitude->count = rpnmath_limbs_trim(value->limbs, count);
+    return RPNMATH_STATUS_OK;
+  }
+
+  rpnmath_limb_t *limbs = rpnmath_limbs_scratch(local, count, arena);
+  if (!limbs) {
+    return RPNMATH_STATUS_OUT_OF_MEMORY;
+  }
+  for (size_t i = 0; i < count; i++) {
+    limbs[i] = rpnmath_bigint_limb(value, i);
+  }
+  if (magnitude->negative) {
+    rpnmath_limbs_negate(limbs, count);
+  }
+  magnitude->limbs = limbs;
+  magnitude->count = rpnmath_limbs_trim(limbs, count);
+  return RPNMATH_STATUS_OK;
+}
+
+// Store a signed magnitude into dst, inline when it fits. dst is untouched
+// when the limbs can not be allocated.
+static int rpnmath_bigint_result(rpnmath_value_t *dst, const rpnmath_limb_t *limbs, size_t count, int negative,
+                                 rpnmath_arena_t *arena) {
+  count = rpnmath_limbs_trim(limbs, count);
+
+  if (count <= RPNMATH_INLINE_LIMBS) {
+    rpnmath_inline_unsigned_t magnitude = 0;
+    for (size_t i = count; i-- > 0; ) {
+      magnitude = (magnitude << RPNMATH_BIGINT_LIMB_BITS) | limbs[i];
+    }
+
+    rpnmath_inline_unsigned_t limit = (rpnmath_inline_unsigned_t)1 << (RPNMATH_BIGINT_INLINE_BITS - 1);
+    if (magnitude < limit || (negative && magnitude == limit)) {
+      rpnmath_inline_t inline_value = (rpnmath_inline_t)(negative ? 0 - magnitude : magnitude);
+#if RPNMATH_INT128
+      if (inline_value < INT64_MIN || inline_value > INT64_MAX) {
+        rpnmath_type_bigint(&dst->type, 128);
+        rpnmath_value_set128(dst, inline_value);
+        return RPNMATH_STATUS_OK;
+      }
+#endif
+      rpnmath_type_bigint(&dst->type, 64);
+      dst->i = (long long)inline_value;
+      return RPNMATH_STATUS_OK;
+    }
+  }
+
+  // One more limb than the magnitude leaves room for the sign bit
+  size_t total = count + 1;
+  rpnmath_limb_t *result = rpnmath_arena_alloc(arena, total * sizeof(rpnmath_limb_t));
+  if (!result) {
+    return RPNMATH_STATUS_OUT_OF_MEMORY;
+  }
+  memcpy(result, limbs, count * sizeof(rpnmath_limb_t));
+  if (negative) {
+    rpnmath_limbs_negate(result, total);
+  }
+
+  // Drop limbs that only repeat the sign of the one below
+  while (total > RPNMATH_INLINE_LIMBS + 1) {
+    rpnmath_limb_t top = result[total - 1];
+    int below_negative = result[total - 2] >> (RPNMATH_BIGINT_LIMB_BITS - 1);
+    if (top != (below_negative ? RPNMATH_LIMB_MAX : 0)) {
+      break;
+    }
+    total--;
+  }
+
+  rpnmath_type_bigint(&dst->type, total * RPNMATH_BIGINT_LIMB_BITS);
+  dst->limbs = result;
+  return RPNMATH_STATUS_OK;
+}
+
+static int rpnmath_mag_compare(const rpnmath_limb_t *a, size_t n, const rpnmath_limb_t *b, size_t m) {
+  if (n != m) {
+    return n < m ? -1 : 1;
+  }
+  for (size_t i = n; i-- > 0; ) {
+    if (a[i] != b[i]) {
+      return a[i] < b[i] ? -1 : 1;
+    }
+  }
+  return 0;
+}
+
+// r[0..n] = a + b with n >= m
+static void rpnmath_mag_add(const rpnmath_limb_t *a, size_t n, const rpnmath_limb_t *b, size_t m, rpnmath_limb_t *r) {
+  rpnmath_dlimb_t carry = 0;
+  size_t i = 0;
+  for (; i < m; i++) {
+    carry += (rpnmath_dlimb_t)a[i] + b[i];
+    r[i] = (rpnmath_limb_t)carry;
+    carry >>= RPNMATH_BIGINT_LIMB_BITS;
+  }
+  for (; i < n; i++) {
+    carry += a[i];
+    r[i] = (rpnmath_limb_t)carry;
+    carry >>= RPNMATH_BIGINT_LIMB_BITS;
+  }
+  r[n] = (rpnmath_limb_t)carry;
+}
+
+// r[0..n) = a - b with a >= b, r may be a
+static void rpnmath_mag_sub(const rpnmath_limb_t *a, size_t n, const rpnmath_limb_t *b, size_t m, rpnmath_limb_t *r) {
+  rpnmath_limb_t borrow = 0;
+  for (size_t i = 0; i < n; i++) {
+    rpnmath_dlimb_t subtrahend = (rpnmath_dlimb_t)(i < m ? b[i] : 0) + borrow;
+    borrow = a[i] < subtrahend;
+    r[i] = (rpnmath_limb_t)(a[i] - subtrahend);
+  }
+}
+
+// r[0..n) += b[0..m) with m <= n, the carry stops at the end of r
+static void rpnmath_mag_add_into(rpnmath_limb_t *r, size_t n, const rpnmath_limb_t *b, size_t m) {
+  rpnmath_dlimb_t carry = 0;
+  for (size_t i = 0; i < n && (i < m || carry); i++) {
+    carry += (rpnmath_dlimb_t)r[i] + (i < m ? b[i] : 0);
+    r[i] = (rpnmath_limb_t)carry;
+    carry >>= RPNMATH_BIGINT_LIMB_BITS;
+  }
+}
+
+// r[0..n+m) = a * b
+static void rpnmath_mag_mul_schoolbook(const rpnmath_limb_t *a, size_t n, const rpnmath_limb_t *b, size_t m, rpnmath_limb_t *r) {
+  memset(r, 0, (n + m) * sizeof(rpnmath_limb_t));
+  for (size_t i = 0; i < m; i++) {
+    rpnmath_dlimb_t carry = 0;
+    for (size_t j = 0; j < n; j++) {
+      carry += (rpnmath_dlimb_t)a[j] * b[i] + r[i + j];
+      r[i + j] = (rpnmath_limb_t)carry;
+      carry >>= RPNMATH_BIGINT_LIMB_BITS;
+    }
+    r[i + n] = (rpnmath_limb_t)carry;
+  }
+}
+
+// Scratch limbs rpnmath_mag_mul needs for operands of at most n limbs:
+// every level takes less than 2n + 6 and recurses on (n + 1) / 2 + 1 limbs
+static size_t rpnmath_mag_mul_scratch(size_t n) {
+  size_t total = 0;
+  for (size_t k = n; k >= RPNMATH_BIGINT_KARATSUBA_THRESHOLD; k = (k + 1) / 2 + 1) {
+    total += 2 * k + 6;
+  }
+  return total;
+}
+
+// r[0..n+m) = a * b, Karatsuba once the shorter operand reaches the
+// threshold. Operands of very different length are multiplied in chunks
+// of the shorter one, so every Karatsuba step splits balanced halves.
+static void rpnmath_mag_mul(const rpnmath_limb_t *a, size_t n, const rpnmath_limb_t *b, size_t m,
+                            rpnmath_limb_t *r, rpnmath_limb_t *scratch) {
+  if (n < m) {
+    const rpnmath_limb_t *swap = a;
+    a = b;
+    b = swap;
+    size_t swap_count = n;
+    n = m;
+    m = swap_count;
+  }
+  if (m < RPNMATH_BIGINT_KARATSUBA_THRESHOLD) {
+    rpnmath_mag_mul_schoolbook(a, n, b, m, r);
+    return;
+  }
+
+  size_t half = (n + 1) / 2;
+  if (m <= half) {
+    memset(r, 0, (n + m) * sizeof(rpnmath_limb_t));
+    for (size_t offset = 0; offset < n; offset += m) {
+      size_t piece = n - offset < m ? n - offset : m;
+      rpnmath_limb_t *product = scratch;
+      rpnmath_mag_mul(a + offset, piece, b, m, product, scratch + piece + m);
+      rpnmath_mag_add_into(r + offset, n + m - offset, product, piece + m);
+    }
+    return;
+  }
+
+  // a = a1 B^half + a0 and b = b1 B^half + b0:
+  // a b = z2 B^2half + (z1 - z2 - z0) B^half + z0 with z1 = (a0 + a1)(b0 + b1)
+  rpnmath_limb_t *a_sum = scratch;
+  rpnmath_limb_t *b_sum = a_sum + half + 1;
+  rpnmath_limb_t *z1 = b_sum + half + 1;
+  rpnmath_limb_t *rest = z1 + 2 * half + 2;
+
+  rpnmath_mag_mul(a, half, b, half, r, rest);                           // z0
+  rpnmath_mag_mul(a + half, n - half, b + half, m - half, r + 2 * half, rest); // z2
+  rpnmath_mag_add(a, half, a + half, n - half, a_sum);
+  rpnmath_mag_add(b, half, b + half, m - half, b_sum);
+  rpnmath_mag_mul(a_sum, half + 1, b_sum, half + 1, z1, rest);
+
+  rpnmath_mag_sub(z1, 2 * half + 2, r, 2 * half, z1);
+  rpnmath_mag_sub(z1, 2 * half + 2, r + 2 * half, n + m - 2 * half, z1);
+  size_t z1_count = rpnmath_limbs_trim(z1, 2 * half + 2);
+  rpnmath_mag_add_into(r + half, n + m - half, z1, z1_count);
+}
+
+// q[0..n-m] = u / v for n >= m >= 2 and a normalized v[m - 1] != 0 (Knuth's
+// algorithm D). un (n + 1 limbs) and vn (m limbs) are scratch.
+static void rpnmath_mag_div(const rpnmath_limb_t *u, size_t n, const rpnmath_limb_t *v, size_t m,
+                            rpnmath_limb_t *q, rpnmath_limb_t *un, rpnmath_limb_t *vn) {
+  const rpnmath_dlimb_t base = (rpnmath_dlimb_t)1 << RPNMATH_BIGINT_LIMB_BITS;
+
+  // Shift so the divisor's top bit is set, which keeps qhat at most 2 too big
+  unsigned shift = 0;
+  while (!((v[m - 1] << shift) >> (RPNMATH_BIGINT_LIMB_BITS - 1))) {
+    shift++;
+  }
+  for (size_t i = m - 1; i > 0; i--) {
+    vn[i] = (v[i] << shift) | (rpnmath_limb_t)((rpnmath_dlimb_t)v[i - 1] >> (RPNMATH_BIGINT_LIMB_BITS - shift));
+  }
+  vn[0] = v[0] << shift;
+  un[n] = (rpnmath_limb_t)((rpnmath_dlimb_t)u[n - 1] >> (RPNMATH_BIGINT_LIMB_BITS - shift));
+  for (size_t i = n - 1; i > 0; i--) {
+    un[i] = (u[i] << shift) | (rpnmath_limb_t)((rpnmath_dlimb_t)u[i - 1] >> (RPNMATH_BIGINT_LIMB_BITS - shift));
+  }
+  un[0] = u[0] << shift;
+
+  for (size_t j = n - m + 1; j-- > 0; ) {
+    rpnmath_dlimb_t numerator = ((rpnmath_dlimb_t)un[j + m] << RPNMATH_BIGINT_LIMB_BITS) | un[j + m - 1];
+    rpnmath_dlimb_t qhat = numerator / vn[m - 1];
+    rpnmath_dlimb_t rhat = numerator % vn[m - 1];
+    while (qhat >= base || qhat * vn[m - 2] > ((rhat << RPNMATH_BIGINT_LIMB_BITS) | un[j + m - 2])) {
+      qhat--;
+      rhat += vn[m - 1];
+      if (rhat >= base) break;
+    }
+
+    // Multiply and subtract, adding back once if qhat was still one too big
+    int64_t borrow = 0;
+    int64_t t;
+    for (size_t i = 0; i < m; i++) {
+      rpnmath_dlimb_t product = qhat * vn[i];
+      t = (int64_t)un[i + j] - borrow - (int64_t)(product & RPNMATH_LIMB_MAX);
+      un[i + j] = (rpnmath_limb_t)t;
+      borrow = (int64_t)(product >> RPNMATH_BIGINT_LIMB_BITS) - (t >> RPNMATH_BIGINT_LIMB_BITS);
+    }
+    t = (int64_t)un[j + m] - borrow;
+    un[j + m] = (rpnmath_limb_t)t;
+
+    q[j] = (rpnmath_limb_t)qhat;
+    if (t < 0) {
+      q[j]--;
+      rpnmath_dlimb_t carry = 0;
+      for (size_t i = 0; i < m; i++) {
+        carry += (rpnmath_dlimb_t)un[i + j] + vn[i];
+        un[i + j] = (rpnmath_limb_t)carry;
+        carry >>= RPNMATH_BIGINT_LIMB_BITS;
+      }
+      un[j + m] += (rpnmath_limb_t)carry;
+    }
+  }
+}
+
+// Divide a[0..n) by a single limb in place, returns the remainder
+static rpnmath_limb_t rpnmath_mag_div_limb(rpnmath_limb_t *a, size_t n, rpnmath_limb_t divisor) {
+  rpnmath_dlimb_t remainder = 0;
+  for (size_t i = n; i-- > 0; ) {
+    remainder = (remainder << RPNMATH_BIGINT_LIMB_BITS) | a[i];
+    a[i] = (rpnmath_limb_t)(remainder / divisor);
+    remainder %= divisor;
+  }
+  return (rpnmath_limb_t)remainder;
+}
+
+int rpnmath_bigint_arith(rpnmath_op_t operation, rpnmath_value_t *dst, const rpnmath_value_t *left,
+                         const rpnmath_value_t *right, rpnmath_arena_t *arena) {
+  rpnmath_limb_t left_local[RPNMATH_LOCAL_LIMBS];
+  rpnmath_limb_t right_local[RPNMATH_LOCAL_LIMBS];
+  rpnmath_limb_t result_local[RPNMATH_LOCAL_LIMBS];
+  rpnmath_magnitude_t a;
+  rpnmath_magnitude_t b;
+  if (rpnmath_bigint_magnitude(left, left_local, arena, &a) != 0 ||
+      rpnmath_bigint_magnitude(right, right_local, arena, &b) != 0) {
+    return RPNMATH_STATUS_OUT_OF_MEMORY;
+  }
+
+  if (operation == RPNMATH_OP_SUB) {
+    b.negative = !b.negative;
+    operation = RPNMATH_OP_ADD;
+  }
+
+  switch (operation) {
+    case RPNMATH_OP_ADD: {
+      if (a.negative == b.negative) {
+        if (a.count < b.count) {
+          rpnmath_magnitude_t swap = a;
+          a = b;
+          b = swap;
+        }
+        rpnmath_limb_t *result = rpnmath_limbs_scratch(result_local, a.count + 1, arena);
+        if (!result) {
+          return RPNMATH_STATUS_OUT_OF_MEMORY;
+        }
+        rpnmath_mag_add(a.limbs, a.count, b.limbs, b.count, result);
+        return rpnmath_bigint_result(dst, result, a.count + 1, a.negative, arena);
+      }
+      // Opposite signs subtract the smaller magnitude from the larger
+      if (rpnmath_mag_compare(a.limbs, a.count, b.limbs, b.count) < 0) {
+        rpnmath_magnitude_t swap = a;
+        a = b;
+        b = swap;
+      }
+      rpnmath_limb_t *result = rpnmath_limbs_scratch(result_local, a.count, arena);
+      if (!result) {
+        return RPNMATH_STATUS_OUT_OF_MEMORY;
+      }
+      rpnmath_mag_sub(a.limbs, a.count, b.limbs, b.count, result);
+      return rpnmath_bigint_result(dst, result, a.count, a.negative, arena);
+    }
+
+    case RPNMATH_OP_MUL: {
+      size_t count = a.count + b.count;
+      rpnmath_limb_t *result = rpnmath_limbs_scratch(result_local, count, arena);
+      if (!result) {
+        return RPNMATH_STATUS_OUT_OF_MEMORY;
+      }
+      if (a.count && b.count) {
+        size_t shorter = a.count < b.count ? a.count : b.count;
+        size_t scratch_count = shorter < RPNMATH_BIGINT_KARATSUBA_THRESHOLD ? 0 :
+                               rpnmath_mag_mul_scratch(a.count > b.count ? a.count : b.count);
+        rpnmath_limb_t *scratch = scratch_count ? rpnmath_arena_alloc(arena, scratch_count * sizeof(rpnmath_limb_t)) : NULL;
+        if (scratch_count && !scratch) {
+          return RPNMATH_STATUS_OUT_OF_MEMORY;
+        }
+        rpnmath_mag_mul(a.limbs, a.count, b.limbs, b.count, result, scratch);
+      }
+      return rpnmath_bigint_result(dst, result, count, a.negative != b.negative, arena);
+    }
+
+    default: {
+      // Truncating division, the quotient takes the sign like in C
+      int negative = a.negative != b.negative;
+      if (a.count < b.count) {
+        return rpnmath_bigint_result(dst, NULL, 0, 0, arena);
+      }
+
+      size_t count = a.count - b.count + 1;
+      rpnmath_limb_t *quotient = rpnmath_limbs_scratch(result_local, count, arena);
+      if (!quotient) {
+        return RPNMATH_STATUS_OUT_OF_MEMORY;
+      }
+      if (b.count == 1) {
+        memcpy(quotient, a.limbs, a.count * sizeof(rpnmath_limb_t));
+        rpnmath_mag_div_limb(quotient, a.count, b.limbs[0]);
+      } else {
+        rpnmath_limb_t *un = rpnmath_arena_alloc(arena, (a.count + 1 + b.count) * sizeof(rpnmath_limb_t));
+        if (!un) {
+          return RPNMATH_STATUS_OUT_OF_MEMORY;
+        }
+        rpnmath_mag_div(a.limbs, a.count, b.limbs, b.count, quotient, un, un + a.count + 1);
+      }
+      return rpnmath_bigint_result(dst, quotient, count, negative, arena);
+    }
+  }
+}
+
+int rpnmath_bigint_compare(const rpnmath_value_t *left, const rpnmath_value_t *right) {
+  size_t left_count = rpnmath_bigint_limb_count(left);
+  size_t right_count = rpnmath_bigint_limb_count(right);
+  size_t count = left_count > right_count ? left_count : right_count;
+
+  // Sign extended to the same width, values of equal sign order like their limbs
+  int left_negative = rpnmath_bigint_limb(left, count - 1) >> (RPNMATH_BIGINT_LIMB_BITS - 1);
+  int right_negative = rpnmath_bigint_limb(right, count - 1) >> (RPNMATH_BIGINT_LIMB_BITS - 1);
+  if (left_negative != right_negative) {
+    return left_negative ? -1 : 1;
+  }
+  for (size_t i = count; i-- > 0; ) {
+    rpnmath_limb_t l = rpnmath_bigint_limb(left, i);
+    rpnmath_limb_t r = rpnmath_bigint_limb(right, i);
+    if (l != r) {
+      return l < r ? -1 : 1;
+    }
+  }
+  return 0;
+}
+
+double rpnmath_bigint_to_double(const rpnmath_value_t *value) {
+  // Magnitude limb by limb, least significant first, negated on the way
+  size_t count = value->type.size / RPNMATH_BIGINT_LIMB_BITS;
+  int negative = value->limbs[count - 1] >> (RPNMATH_BIGINT_LIMB_BITS - 1);
+  double result = 0;
+  rpnmath_dlimb_t borrow = negative;
+  double scale = 1;
+  for (size_t i = 0; i < count; i++) {
+    rpnmath_dlimb_t limb = negative ? (rpnmath_limb_t)~value->limbs[i] + borrow : value->limbs[i];
+    borrow = limb >> RPNMATH_BIGINT_LIMB_BITS;
+    result += (double)(rpnmath_limb_t)limb * scale;
+    scale *= 4294967296.0;
+  }
+  return negative ? -result : result;
+}
+
+int rpnmath_bigint_parse(rpnmath_value_t *value, const char *str, rpnmath_arena_t *arena) {
+  int negative = *str == '-';
+  if (*str == '-' || *str == '+') {
+    str++;
+  }
+  size_t digits = strlen(str);
+  if (digits == 0 || strspn(str, "0123456789") != digits) {
+    return -1;
+  }
+
+  // Nine digits at a time, each chunk adds at most one limb
+  rpnmath_limb_t local[RPNMATH_LOCAL_LIMBS];
+  size_t capacity = digits / 9 + 2;
+  rpnmath_limb_t *limbs = rpnmath_limbs_scratch(local, capacity, arena);
+  if (!limbs) {
+    return RPNMATH_STATUS_OUT_OF_MEMORY;
+  }
+  size_t count = 0;
+  while (*str) {
+    rpnmath_limb_t chunk = 0;
+    rpnmath_limb_t scale = 1;
+    for (size_t i = 0; i < 9 && *str; i++, str++) {
+      chunk = chunk * 10 + (rpnmath_limb_t)(*str - '0');
+      scale *= 10;
+    }
+
+    rpnmath_dlimb_t carry = chunk;
+    for (size_t i = 0; i < count; i++) {
+      carry += (rpnmath_dlimb_t)limbs[i] * scale;
+      limbs[i] = (rpnmath_limb_t)carry;
+      carry >>= RPNMATH_BIGINT_LIMB_BITS;
+    }
+    if (carry) {
+      limbs[count++] = (rpnmath_limb_t)carry;
+    }
+  }
+
+  return rpnmath_bigint_result(value, limbs, count, negative, arena);
+}
+
+size_t rpnmath_bigint_format_size(const rpnmath_value_t *value) {
+  // log10(2) < 0.30103, plus sign and terminator
+  return value->type.size * 30103 / 100000 + 3;
+}
+
+void rpnmath_bigint_format(const rpnmath_value_t *value, char *buffer, size_t size) {
+  size_t count = value->type.size / RPNMATH_BIGINT_LIMB_BITS;
+  int negative = value->limbs[count - 1] >> (RPNMATH_BIGINT_LIMB_BITS - 1);
+
+  // Formatting is never on a hot path, the working copy comes from the heap
+  rpnmath_limb_t *magnitude = malloc(count * sizeof(rpnmath_limb_t));
+  char *digits = malloc(rpnmath_bigint_format_size(value));
+  if (!magnitude || !digits) {
+    free(magnitude);
+    free(digits);
+    snprintf(buffer, size, "?");
+    return;
+  }
+  memcpy(magnitude, value->limbs, count * sizeof(rpnmath_limb_t));
+  if (negative) {
+    rpnmath_limbs_negate(magnitude, count);
+  }
+
+  // Nine digits per division, produced backwards
+  size_t digit_count = 0;
+  count = rpnmath_limbs_trim(magnitude, count);
+  do {
+    rpnmath_limb_t chunk = rpnmath_mag_div_limb(magnitude, count, 1000000000);
+    count = rpnmath_limbs_trim(magnitude, count);
+    for (int i = 0; i < 9 && (count || chunk); i++) {
+      digits[digit_count++] = (char)('0' + chunk % 10);
+      chunk /= 10;
+    }
+  } while (count);
+
+  size_t length = 0;
+  if (negative && length + 1 < size) {
+    buffer[length++] = '-';
+  }
+  while (digit_count && length + 1 < size) {
+    buffer[length++] = digits[--digit_count];
+  }
+  if (size) {
+    buffer[length] = '\0';
+  }
+
+  free(digits);
+  free(magnitude);
+}
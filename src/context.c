@@ -0,0 +1,331 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "type.h"
+#include "item.h"
+#include "value.h"
+#include "arena.h"
+#include "context.h"
+#include "program.h"
+
+void rpnmath_context_init(rpnmath_context_t *context, rpnmath_arena_t *arena) {
+  context->engine = RPNMATH_ENGINE_THREADED;
+  context->arena = arena;
+  rpnmath_context_reset(context);
+}
+
+void rpnmath_context_reset(rpnmath_context_t *context) {
+  // Everything is allocated on first use, see rpnmath_context_reserve
+  context->variables = NULL;
+  context->variable_capacity = 0;
+  context->version_clock = 0;
+  context->values = NULL;
+  context->value_capacity = 0;
+  context->result_data = NULL;
+  context->result_capacity = 0;
+  context->error.status = RPNMATH_STATUS_OK;
+  context->message = NULL;
+  
+  rpnmath_context_reset_blocks(context);
+}
+
+int rpnmath_context_reserve(rpnmath_context_t *context, size_t depth, size_t variable_count) {
+  if (depth > context->value_capacity) {
+    rpnmath_value_t *values = rpnmath_arena_grow(context->arena, context->values, context->value_capacity * sizeof(rpnmath_value_t),
+                                                 depth * sizeof(rpnmath_value_t));
+    if (!values) {
+      return rpnmath_context_fail(context, RPNMATH_STATUS_OUT_OF_MEMORY, 0);
+    }
+    context->values = values;
+    context->value_capacity = depth;
+  }
+  
+  // New entries are zeroed, which is VOID and unassigned
+  if (variable_count > context->variable_capacity) {
+    rpnmath_variable_t *variables = rpnmath_arena_grow(context->arena, context->variables, context->variable_capacity * sizeof(rpnmath_variable_t),
+                                                       variable_count * sizeof(rpnmath_variable_t));
+    if (!variables) {
+      return rpnmath_context_fail(context, RPNMATH_STATUS_OUT_OF_MEMORY, 0);
+    }
+    context->variables = variables;
+    context->variable_capacity = variable_count;
+  }
+  return RPNMATH_STATUS_OK;
+}
+
+void *rpnmath_context_result_storage(rpnmath_context_t *context, size_t size) {
+  if (size > context->result_capacity) {
+    void *data = rpnmath_arena_alloc(context->arena, size);
+    if (!data) {
+      return NULL;
+    }
+    context->result_data = data;
+    context->result_capacity = size;
+  }
+  return context->result_data;
+}
+
+void rpnmath_context_reset_blocks(rpnmath_context_t *context) {
+  context->current_block = 0; // Start with root block
+}
+
+void rpnmath_context_forget_variables(rpnmath_context_t *context) {
+  for (size_t i = 0; i < context->variable_capacity; i++) {
+    context->variables[i].version = 0;
+  }
+}
+
+// Start a new version of a variable and return the storage for its size
+// bytes payload. The previous version is dead, so its storage is reused
+// whenever the new payload fits, except for limbs of big integers: values
+// loaded from the old version may still refer to those. NULL when out of
+// memory, the variable keeps its version then.
+static void *rpnmath_context_new_version(rpnmath_context_t *context, size_t var_id, rpnmath_type_t type, size_t size) {
+  if (var_id >= context->variable_capacity) {
+    // Grow geometrically, stores outside a program can come in any order
+    size_t capacity = context->variable_capacity * 2 > var_id + 1 ? context->variable_capacity * 2 : var_id + 1;
+    if (rpnmath_context_reserve(context, 0, capacity) != 0) {
+      return NULL;
+    }
+  }
+  rpnmath_variable_t *variable = &context->variables[var_id];
+  rpnmath_item_const_t *value = &variable->value;
+  
+  if (size > RPNMATH_CONST_INLINE_SIZE &&
+      (rpnmath_type_has_limbs(&type) || !(value->size > RPNMATH_CONST_INLINE_SIZE && value->size >= size))) {
+    void *data = rpnmath_arena_alloc(context->arena, size);
+    if (!data) {
+      rpnmath_context_fail(context, RPNMATH_STATUS_OUT_OF_MEMORY, 0);
+      return NULL;
+    }
+    value->data = data;
+  }
+  value->kind = RPNMATH_ITEMKIND_CONST;
+  value->type = type;
+  value->size = size;
+  
+  variable->version = ++context->version_clock;
+  variable->block_id = context->current_block;
+  return rpnmath_const_data(value);
+}
+
+// Variable operations
+int rpnmath_context_assign_variable(rpnmath_context_t *context, size_t var_id, rpnmath_item_const_t *value) {
+  if (var_id >= RPNMATH_MAX_VARIABLES) {
+    return rpnmath_context_fail(context, RPNMATH_STATUS_VARIABLE_ID, var_id);
+  }
+  
+  // Copied first, value may point into the table that is about to grow.
+  // memmove, a phi may assign a variable its own wide value.
+  rpnmath_item_const_t source = *value;
+  void *storage = rpnmath_context_new_version(context, var_id, source.type, source.size);
+  if (!storage) {
+    return RPNMATH_STATUS_OUT_OF_MEMORY;
+  }
+  memmove(storage, rpnmath_const_data(&source), source.size);
+  return RPNMATH_STATUS_OK;
+}
+
+rpnmath_item_const_t rpnmath_context_get_variable(rpnmath_context_t *context, size_t var_id) {
+  rpnmath_item_const_t empty_item = {0};
+  empty_item.kind = RPNMATH_ITEMKIND_VOID;
+  
+  if (var_id >= context->variable_capacity || !context->variables[var_id].version) {
+    rpnmath_context_fail(context, RPNMATH_STATUS_UNASSIGNED, var_id);
+    return empty_item;
+  }
+  
+  return context->variables[var_id].value;
+}
+
+// Reads a variable straight into a value, without copying its payload
+int rpnmath_context_load_variable(rpnmath_context_t *context, size_t var_id, rpnmath_value_t *value) {
+  if (var_id >= context->variable_capacity || !context->variables[var_id].version) {
+    return rpnmath_context_fail(context, RPNMATH_STATUS_UNASSIGNED, var_id);
+  }
+  
+  rpnmath_value_from_const(value, &context->variables[var_id].value);
+  return RPNMATH_STATUS_OK;
+}
+
+int rpnmath_context_store_variable(rpnmath_context_t *context, size_t var_id, const rpnmath_value_t *value) {
+  if (var_id >= RPNMATH_MAX_VARIABLES) {
+    return rpnmath_context_fail(context, RPNMATH_STATUS_VARIABLE_ID, var_id);
+  }
+  
+  // The value is written straight into the new version's storage
+  size_t size = rpnmath_type_bytes(&value->type);
+  void *storage = rpnmath_context_new_version(context, var_id, value->type, size);
+  if (!storage) {
+    return RPNMATH_STATUS_OUT_OF_MEMORY;
+  }
+  rpnmath_value_store(value, storage);
+  return RPNMATH_STATUS_OK;
+}
+
+int rpnmath_context_resolve_phi(rpnmath_context_t *context, size_t target_var, const size_t *source_vars, size_t source_count) {
+  // Find the most recent assignment to any of the source variables
+  rpnmath_item_const_t result_value = {0};
+  result_value.kind = RPNMATH_ITEMKIND_VOID;
+  
+  size_t highest_version = 0;
+  int found_value = 0;
+  
+  // Versions are handed out in assignment order, the highest one is the most recent
+  for (size_t i = 0; i < source_count; i++) {
+    size_t source_var = source_vars[i];
+    if (source_var < context->variable_capacity &&
+        context->variables[source_var].version > highest_version) {
+      highest_version = context->variables[source_var].version;
+      result_value = context->variables[source_var].value;
+      found_value = 1;
+    }
+  }
+  
+  if (!found_value) {
+    return rpnmath_context_fail(context, RPNMATH_STATUS_NO_PHI_SOURCE, target_var);
+  }
+  
+  // Assign the result to the target variable
+  return rpnmath_context_assign_variable(context, target_var, &result_value);
+}
+
+const char* rpnmath_status_name(rpnmath_status_t status) {
+  switch (status) {
+    case RPNMATH_STATUS_OK: return "ok";
+    case RPNMATH_STATUS_DIVISION_BY_ZERO: return "division_by_zero";
+    case RPNMATH_STATUS_OVERFLOW: return "overflow";
+    case RPNMATH_STATUS_DECIMAL_OVERFLOW: return "decimal_overflow";
+    case RPNMATH_STATUS_OUT_OF_RANGE: return "out_of_range";
+    case RPNMATH_STATUS_UNASSIGNED: return "unassigned";
+    case RPNMATH_STATUS_VARIABLE_ID: return "variable_id";
+    case RPNMATH_STATUS_NO_PHI_SOURCE: return "no_phi_source";
+    case RPNMATH_STATUS_NO_RETURN: return "no_return";
+    case RPNMATH_STATUS_UNKNOWN_INSTRUCTION: return "unknown_instruction";
+    case RPNMATH_STATUS_UNKNOWN_ENGINE: return "unknown_engine";
+    case RPNMATH_STATUS_COLUMN_TYPE: return "column_type";
+    case RPNMATH_STATUS_COLUMN_RANGE: return "column_range";
+    case RPNMATH_STATUS_COMPILE: return "compile";
+    case RPNMATH_STATUS_OUT_OF_MEMORY: return "out_of_memory";
+    default: return "unknown";
+  }
+}
+
+int rpnmath_context_fail(rpnmath_context_t *context, rpnmath_status_t status, size_t detail) {
+  context->error.status = status;
+  context->error.detail = detail;
+  context->message = NULL;
+  return status;
+}
+
+int rpnmath_context_fail_operation(rpnmath_context_t *context, rpnmath_status_t status, rpnmath_op_t operation,
+                                   const rpnmath_value_t *left, const rpnmath_value_t *right) {
+  // Limbs of big integer operands stay in the arena until the next reset
+  context->error.status = status;
+  context->error.operation = operation;
+  context->error.left = *left;
+  if (right) {
+    context->error.right = *right;
+  } else {
+    memset(&context->error.right, 0, sizeof(context->error.right));
+  }
+  context->message = NULL;
+  return status;
+}
+
+int rpnmath_context_fail_message(rpnmath_context_t *context, rpnmath_status_t status, const char *message) {
+  rpnmath_context_fail(context, status, 0);
+  context->message = message;
+  return status;
+}
+
+const char* rpnmath_context_error(rpnmath_context_t *context) {
+  const rpnmath_error_t *error = &context->error;
+  if (error->status == RPNMATH_STATUS_OK) {
+    return NULL;
+  }
+  if (context->message) {
+    return context->message;
+  }
+  
+  // Operands are only formatted for the errors that show them
+  const char *operation = rpnmath_op_name(error->operation);
+  const char *left = "", *right = "";
+  if (error->status == RPNMATH_STATUS_OVERFLOW || error->status == RPNMATH_STATUS_DECIMAL_OVERFLOW ||
+      error->status == RPNMATH_STATUS_COLUMN_RANGE) {
+    size_t left_size = rpnmath_value_format_size(&error->left);
+    size_t right_size = rpnmath_value_format_size(&error->right);
+    char *left_text = rpnmath_arena_alloc(context->arena, left_size);
+    char *right_text = rpnmath_arena_alloc(context->arena, right_size);
+    if (!left_text || !right_text) {
+      return rpnmath_status_name(error->status);
+    }
+    rpnmath_value_format(&error->left, left_text, left_size);
+    if (error->right.type.kind != RPNMATH_TYPEKIND_VOID) {
+      rpnmath_value_format(&error->right, right_text, right_size);
+    }
+    left = left_text;
+    right = right_text;
+  }
+  size_t size = 96 + strlen(left) + strlen(right);
+  char *message = rpnmath_arena_alloc(context->arena, size);
+  if (!message) {
+    return rpnmath_status_name(error->status);
+  }
+  
+  switch (error->status) {
+    case RPNMATH_STATUS_DIVISION_BY_ZERO:
+      snprintf(message, size, "Division by zero");
+      break;
+    case RPNMATH_STATUS_OVERFLOW: {
+      // The result has the wider operand's width
+      size_t bits = error->left.type.size > error->right.type.size ? error->left.type.size : error->right.type.size;
+      size_t native_bits = rpnmath_type_native_size(bits) * 8;
+      if (error->right.type.kind == RPNMATH_TYPEKIND_VOID) {
+        snprintf(message, size, "Integer overflow in %s of %s (%zu bit)", operation, left, native_bits);
+      } else {
+        snprintf(message, size, "Integer overflow in %s of %s and %s (%zu bit)", operation, left, right, native_bits);
+      }
+      break;
+    }
+    case RPNMATH_STATUS_DECIMAL_OVERFLOW:
+      snprintf(message, size, "Decimal overflow in %s of %s and %s", operation, left, right);
+      break;
+    case RPNMATH_STATUS_OUT_OF_RANGE:
+      snprintf(message, size, "Big integer out of decimal range in %s", operation);
+      break;
+    case RPNMATH_STATUS_UNASSIGNED:
+      snprintf(message, size, "Variable $%zu not assigned", error->detail);
+      break;
+    case RPNMATH_STATUS_VARIABLE_ID:
+      snprintf(message, size, "Variable ID %zu exceeds maximum %d", error->detail, RPNMATH_MAX_VARIABLES - 1);
+      break;
+    case RPNMATH_STATUS_NO_PHI_SOURCE:
+      snprintf(message, size, "No valid source for phi node of $%zu", error->detail);
+      break;
+    case RPNMATH_STATUS_NO_RETURN:
+      snprintf(message, size, "No return statement found");
+      break;
+    case RPNMATH_STATUS_UNKNOWN_INSTRUCTION:
+      snprintf(message, size, "Unknown instruction %s", rpnmath_opcode_name((rpnmath_opcode_t)error->detail));
+      break;
+    case RPNMATH_STATUS_UNKNOWN_ENGINE:
+      snprintf(message, size, "Unknown engine");
+      break;
+    case RPNMATH_STATUS_COLUMN_TYPE:
+      snprintf(message, size, "Column %zu has no fixed width type", error->detail);
+      break;
+    case RPNMATH_STATUS_COLUMN_RANGE:
+      snprintf(message, size, "Result %s does not fit the output column", left);
+      break;
+    case RPNMATH_STATUS_COMPILE:
+      snprintf(message, size, "Compilation failed");
+      break;
+    default:
+      snprintf(message, size, "Out of memory");
+      break;
+  }
+  context->message = message;
+  return message;
+}
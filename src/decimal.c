@@ -0,0 +1,244 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include "type.h"
+#include "item.h"
+#include "value.h"
+#include "bigint.h"
+#include "decimal.h"
+
+#define RPNMATH_E18 ((rpnmath_decimal_exact_t)1000000000000000000LL)
+
+const rpnmath_decimal_exact_t rpnmath_decimal_pow10[RPNMATH_DECIMAL_POW10_COUNT] = {
+  1, 10, 100, 1000,
+  10000, 100000, 1000000, 10000000,
+  100000000, 1000000000, 10000000000LL, 100000000000LL,
+  1000000000000LL, 10000000000000LL, 100000000000000LL, 1000000000000000LL,
+  10000000000000000LL, 100000000000000000LL, 1000000000000000000LL,
+#if RPNMATH_INT128
+  RPNMATH_E18 * 10, RPNMATH_E18 * 100, RPNMATH_E18 * 1000, RPNMATH_E18 * 10000,
+  RPNMATH_E18 * 100000, RPNMATH_E18 * 1000000, RPNMATH_E18 * 10000000, RPNMATH_E18 * 100000000,
+  RPNMATH_E18 * 1000000000, RPNMATH_E18 * 10000000000LL, RPNMATH_E18 * 100000000000LL, RPNMATH_E18 * 1000000000000LL,
+  RPNMATH_E18 * 10000000000000LL, RPNMATH_E18 * 100000000000000LL, RPNMATH_E18 * 1000000000000000LL,
+  RPNMATH_E18 * 10000000000000000LL, RPNMATH_E18 * 100000000000000000LL, RPNMATH_E18 * RPNMATH_E18,
+  RPNMATH_E18 * RPNMATH_E18 * 10, RPNMATH_E18 * RPNMATH_E18 * 100,
+#endif
+};
+
+#if RPNMATH_INT128
+#  define RPNMATH_DECIMAL_GET(value) rpnmath_value_get128(value)
+#  define RPNMATH_DECIMAL_MAX_BITS 128
+#else
+#  define RPNMATH_DECIMAL_GET(value) ((value)->i)
+#  define RPNMATH_DECIMAL_MAX_BITS 64
+#endif
+#define RPNMATH_DECIMAL_MIN ((rpnmath_decimal_exact_t)((rpnmath_decimal_unsigned_t)1 << (RPNMATH_DECIMAL_MAX_BITS - 1)))
+
+// Overflow checked arithmetic on rpnmath_decimal_exact_t
+static int rpnmath_decimal_checked(rpnmath_op_t operation, rpnmath_decimal_exact_t left, rpnmath_decimal_exact_t right,
+                                   rpnmath_decimal_exact_t *result) {
+#if RPNMATH_INT128
+  switch (operation) {
+    case RPNMATH_OP_ADD: return __builtin_add_overflow(left, right, result);
+    case RPNMATH_OP_SUB: return __builtin_sub_overflow(left, right, result);
+    default: return __builtin_mul_overflow(left, right, result);
+  }
+#else
+  switch (operation) {
+    case RPNMATH_OP_ADD:
+      if (rpnmath_type_would_overflow_add(left, right)) return 1;
+      *result = left + right;
+      return 0;
+    case RPNMATH_OP_SUB:
+      if (rpnmath_type_would_overflow_sub(left, right)) return 1;
+      *result = left - right;
+      return 0;
+    default:
+      if (rpnmath_type_would_overflow_mul(left, right)) return 1;
+      *result = left * right;
+      return 0;
+  }
+#endif
+}
+
+// Mantissa, scale and mantissa width of an operand, integers being decimals of scale 0
+typedef struct rpnmath_decimal_operand {
+  rpnmath_decimal_exact_t mantissa;
+  size_t scale;
+  size_t bits;
+} rpnmath_decimal_operand_t;
+
+static int rpnmath_decimal_operand(const rpnmath_value_t *value, rpnmath_decimal_operand_t *operand) {
+  if (rpnmath_type_has_limbs(&value->type)) {
+    return -1;
+  }
+  operand->mantissa = RPNMATH_DECIMAL_GET(value);
+  operand->scale = value->type.kind == RPNMATH_TYPEKIND_DECIMAL ? value->type.scale : 0;
+  operand->bits = value->type.size > 64 ? 128 : 64;
+  return 0;
+}
+
+int rpnmath_decimal_arith(rpnmath_overflow_t overflow, rpnmath_rounding_t rounding, rpnmath_op_t operation, rpnmath_value_t *dst,
+                          const rpnmath_value_t *left, const rpnmath_value_t *right) {
+  rpnmath_decimal_operand_t l, r;
+  if (rpnmath_decimal_operand(left, &l) != 0 || rpnmath_decimal_operand(right, &r) != 0) {
+    return RPNMATH_STATUS_OUT_OF_RANGE;
+  }
+  size_t scale = l.scale > r.scale ? l.scale : r.scale;
+  size_t bits = l.bits > r.bits ? l.bits : r.bits;
+
+  rpnmath_decimal_exact_t result;
+  switch (operation) {
+    case RPNMATH_OP_ADD:
+    case RPNMATH_OP_SUB: {
+      // Align both mantissas to the result's scale
+      rpnmath_decimal_exact_t a, b;
+      if (rpnmath_decimal_checked(RPNMATH_OP_MUL, l.mantissa, rpnmath_decimal_pow10[scale - l.scale], &a) ||
+          rpnmath_decimal_checked(RPNMATH_OP_MUL, r.mantissa, rpnmath_decimal_pow10[scale - r.scale], &b) ||
+          rpnmath_decimal_checked(operation, a, b, &result)) {
+        return RPNMATH_STATUS_DECIMAL_OVERFLOW;
+      }
+      break;
+    }
+    case RPNMATH_OP_MUL: {
+      // The exact product has scale l.scale + r.scale
+      rpnmath_decimal_exact_t product;
+      if (rpnmath_decimal_checked(RPNMATH_OP_MUL, l.mantissa, r.mantissa, &product)) {
+        return RPNMATH_STATUS_DECIMAL_OVERFLOW;
+      }
+      result = rpnmath_decimal_divide(product, rpnmath_decimal_pow10[l.scale + r.scale - scale], rounding);
+      break;
+    }
+    default: {
+      if (r.mantissa == 0) {
+        return RPNMATH_STATUS_DIVISION_BY_ZERO;
+      }
+      // Scaling the dividend by 10^(scale + r.scale - l.scale) leaves a quotient of the result's scale
+      size_t exponent = scale + r.scale - l.scale;
+      rpnmath_decimal_exact_t dividend;
+      if (exponent >= RPNMATH_DECIMAL_POW10_COUNT ||
+          rpnmath_decimal_checked(RPNMATH_OP_MUL, l.mantissa, rpnmath_decimal_pow10[exponent], &dividend) ||
+          (r.mantissa == -1 && dividend == RPNMATH_DECIMAL_MIN)) {
+        return RPNMATH_STATUS_DECIMAL_OVERFLOW;
+      }
+      result = rpnmath_decimal_divide(dividend, r.mantissa, rounding);
+      break;
+    }
+  }
+
+  if (bits == 64 && (result < LLONG_MIN || result > LLONG_MAX)) {
+    if (overflow != RPNMATH_OVERFLOW_PROMOTE || RPNMATH_DECIMAL_MAX_BITS == 64) {
+      return RPNMATH_STATUS_DECIMAL_OVERFLOW;
+    }
+    bits = RPNMATH_DECIMAL_MAX_BITS;
+  }
+  rpnmath_type_decimal(&dst->type, bits, scale);
+#if RPNMATH_INT128
+  rpnmath_value_set128(dst, result);
+#else
+  dst->i = result;
+#endif
+  return RPNMATH_STATUS_OK;
+}
+
+int rpnmath_decimal_compare(const rpnmath_value_t *left, const rpnmath_value_t *right) {
+  // A big integer with limbs is beyond any mantissa, its sign decides
+  rpnmath_value_t zero = {0};
+  rpnmath_type_int(&zero.type, 8);
+  if (rpnmath_type_has_limbs(&left->type)) {
+    return rpnmath_bigint_compare(left, &zero);
+  }
+  if (rpnmath_type_has_limbs(&right->type)) {
+    return -rpnmath_bigint_compare(right, &zero);
+  }
+
+  rpnmath_decimal_operand_t l = {0}, r = {0};
+  rpnmath_decimal_operand(left, &l);
+  rpnmath_decimal_operand(right, &r);
+  // Only the operand with the smaller scale is scaled up. When that
+  // overflows its magnitude exceeds the other one's.
+  rpnmath_decimal_exact_t a = l.mantissa, b = r.mantissa;
+  if (l.scale < r.scale && rpnmath_decimal_checked(RPNMATH_OP_MUL, l.mantissa, rpnmath_decimal_pow10[r.scale - l.scale], &a)) {
+    return l.mantissa < 0 ? -1 : 1;
+  }
+  if (r.scale < l.scale && rpnmath_decimal_checked(RPNMATH_OP_MUL, r.mantissa, rpnmath_decimal_pow10[l.scale - r.scale], &b)) {
+    return r.mantissa < 0 ? 1 : -1;
+  }
+  return (a > b) - (a < b);
+}
+
+double rpnmath_decimal_to_double(const rpnmath_value_t *value) {
+  return (double)RPNMATH_DECIMAL_GET(value) / (double)rpnmath_decimal_pow10[value->type.scale];
+}
+
+int rpnmath_decimal_parse(rpnmath_value_t *value, const char *str) {
+  const char *p = str;
+  int negative = *p == '-';
+  if (*p == '-' || *p == '+') p++;
+
+  // The magnitude may reach one past the largest mantissa for negative values
+  rpnmath_decimal_unsigned_t limit = (rpnmath_decimal_unsigned_t)1 << (RPNMATH_DECIMAL_MAX_BITS - 1);
+  rpnmath_decimal_unsigned_t magnitude = 0;
+  size_t digits = 0;
+  size_t scale = 0;
+  int point = 0;
+  for (;; p++) {
+    if (*p == '.' && !point) {
+      point = 1;
+      continue;
+    }
+    if (!isdigit((unsigned char)*p)) {
+      break;
+    }
+    if (magnitude > (limit - (rpnmath_decimal_unsigned_t)(*p - '0')) / 10) {
+      return -1;
+    }
+    magnitude = magnitude * 10 + (rpnmath_decimal_unsigned_t)(*p - '0');
+    digits++;
+    scale += point;
+  }
+  if (digits == 0 || (*p != 'd' && *p != 'D') || p[1] != '\0' || scale > RPNMATH_DECIMAL_MAX_SCALE ||
+      (!negative && magnitude == limit)) {
+    return -1;
+  }
+
+  rpnmath_decimal_exact_t mantissa = negative ? (rpnmath_decimal_exact_t)(0 - magnitude) : (rpnmath_decimal_exact_t)magnitude;
+  size_t bits = mantissa >= LLONG_MIN && mantissa <= LLONG_MAX ? 64 : RPNMATH_DECIMAL_MAX_BITS;
+  rpnmath_type_decimal(&value->type, bits, scale);
+#if RPNMATH_INT128
+  rpnmath_value_set128(value, mantissa);
+#else
+  value->i = mantissa;
+#endif
+  return 0;
+}
+
+void rpnmath_decimal_format(const rpnmath_value_t *value, char *buffer, size_t size) {
+  rpnmath_decimal_exact_t mantissa = RPNMATH_DECIMAL_GET(value);
+  rpnmath_decimal_unsigned_t magnitude = mantissa < 0 ? 0 - (rpnmath_decimal_unsigned_t)mantissa : (rpnmath_decimal_unsigned_t)mantissa;
+
+  // Digits backwards, at least one before the point
+  char digits[RPNMATH_VALUE_FORMAT_SIZE];
+  size_t count = 0;
+  do {
+    digits[count++] = (char)('0' + (int)(magnitude % 10));
+    magnitude /= 10;
+  } while (magnitude || count <= value->type.scale);
+
+  char text[RPNMATH_VALUE_FORMAT_SIZE];
+  size_t length = 0;
+  if (mantissa < 0) {
+    text[length++] = '-';
+  }
+  while (count) {
+    if (count == value->type.scale) {
+      text[length++] = '.';
+    }
+    text[length++] = digits[--count];
+  }
+  text[length++] = 'd';
+  text[length] = '\0';
+  snprintf(buffer, size, "%s", text);
+}
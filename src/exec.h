@@ -0,0 +1,509 @@
+#ifndef RPNMATH_EXEC_H
+#define RPNMATH_EXEC_H
+
+// Semantics shared by the execution engines. Everything here is static
+// inline so each engine gets its own copy folded into its dispatch loop.
+
+#include <stdint.h>
+#include <limits.h>
+#include <math.h>
+#include "type.h"
+#include "value.h"
+#include "context.h"
+#include "program.h"
+#include "bigint.h"
+#include "decimal.h"
+
+#if defined(__GNUC__) || defined(__clang__)
+#  define RPNMATH_UNLIKELY(x) __builtin_expect(!!(x), 0)
+#else
+#  define RPNMATH_UNLIKELY(x) (x)
+#endif
+
+// Run an operation that may fail, e.g. rpnmath_exec_arith, and on failure
+// return from the engine after recording it in context. The operation left
+// its operands untouched, so they are still there to be recorded.
+#define RPNMATH_EXEC_TRY(context, call, operation, left, right) \
+  do { \
+    int rpnmath_status = (call); \
+    if (RPNMATH_UNLIKELY(rpnmath_status != 0)) { \
+      return rpnmath_context_fail_operation(context, rpnmath_status, operation, left, right); \
+    } \
+  } while (0)
+
+// Fast path of integer arithmetic: computes left op right (ADD, SUB, MUL or
+// DIV, the divisor being nonzero) at the native width of bits into *result.
+// Returns nonzero when the exact result does not fit, *result is meaningless
+// then. With constant operation and bits, as in the kernels, this folds into
+// the machine instruction and a branch on its overflow flag.
+static inline int rpnmath_exec_checked(rpnmath_op_t operation, long long left, long long right, size_t bits, long long *result) {
+  if (operation == RPNMATH_OP_DIV) {
+    if (right == -1 && left == LLONG_MIN) {
+      return 1;
+    }
+    long long quotient = left / right;
+    *result = rpnmath_value_narrow(quotient, bits);
+    return *result != quotient;
+  }
+  
+#if defined(__GNUC__) || defined(__clang__)
+#define RPNMATH_EXEC_CHECKED(ctype) do { \
+    ctype value; \
+    int overflow = operation == RPNMATH_OP_ADD ? __builtin_add_overflow(left, right, &value) : \
+                   operation == RPNMATH_OP_SUB ? __builtin_sub_overflow(left, right, &value) : \
+                   __builtin_mul_overflow(left, right, &value); \
+    *result = value; \
+    return overflow; \
+  } while (0)
+  if (bits <= 8) RPNMATH_EXEC_CHECKED(int8_t);
+  if (bits <= 16) RPNMATH_EXEC_CHECKED(int16_t);
+  if (bits <= 32) RPNMATH_EXEC_CHECKED(int32_t);
+  RPNMATH_EXEC_CHECKED(int64_t);
+#undef RPNMATH_EXEC_CHECKED
+#else
+  // Portable fallback on the checks of type.c, narrower widths compare the
+  // 64 bit result with its narrowed self
+  int overflow;
+  unsigned long long value;
+  switch (operation) {
+    case RPNMATH_OP_ADD:
+      overflow = rpnmath_type_would_overflow_add(left, right);
+      value = (unsigned long long)left + (unsigned long long)right;
+      break;
+    case RPNMATH_OP_SUB:
+      overflow = rpnmath_type_would_overflow_sub(left, right);
+      value = (unsigned long long)left - (unsigned long long)right;
+      break;
+    default:
+      overflow = rpnmath_type_would_overflow_mul(left, right);
+      value = (unsigned long long)left * (unsigned long long)right;
+      break;
+  }
+  *result = rpnmath_value_narrow((long long)value, bits);
+  return overflow || *result != (long long)value;
+#endif
+}
+
+#if RPNMATH_INT128
+// rpnmath_exec_checked for integers wider than 64 bits
+static inline int rpnmath_exec_checked128(rpnmath_op_t operation, rpnmath_int128_t left, rpnmath_int128_t right, rpnmath_int128_t *result) {
+  switch (operation) {
+    case RPNMATH_OP_ADD: return __builtin_add_overflow(left, right, result);
+    case RPNMATH_OP_SUB: return __builtin_sub_overflow(left, right, result);
+    case RPNMATH_OP_MUL: return __builtin_mul_overflow(left, right, result);
+    default:
+      if (right == -1 && left == (rpnmath_int128_t)((rpnmath_uint128_t)1 << 127)) {
+        return 1;
+      }
+      *result = left / right;
+      return 0;
+  }
+}
+
+static inline int rpnmath_exec_arith128(rpnmath_overflow_t overflow, rpnmath_arena_t *arena, rpnmath_op_t operation, rpnmath_value_t *dst,
+                                        const rpnmath_value_t *left, const rpnmath_value_t *right, size_t bits) {
+  rpnmath_int128_t result;
+  if (RPNMATH_UNLIKELY(rpnmath_exec_checked128(operation, rpnmath_value_get128(left), rpnmath_value_get128(right), &result))) {
+    return rpnmath_value_overflow(overflow, arena, operation, dst, left, right, bits);
+  }
+  rpnmath_type_int(&dst->type, bits);
+  rpnmath_value_set128(dst, result);
+  return 0;
+}
+#endif
+
+// Integer operation producing a result of the given width, what happens
+// when it does not fit is up to the overflow policy. dst may alias an
+// operand, arena holds any big integer the policy promotes to.
+static inline int rpnmath_exec_integer(rpnmath_overflow_t overflow, rpnmath_arena_t *arena, rpnmath_op_t operation, size_t bits,
+                                       rpnmath_value_t *dst, const rpnmath_value_t *left, const rpnmath_value_t *right) {
+#if RPNMATH_INT128
+  if (RPNMATH_UNLIKELY(bits > 64)) {
+    return rpnmath_exec_arith128(overflow, arena, operation, dst, left, right, bits);
+  }
+#endif
+  long long result;
+  if (RPNMATH_UNLIKELY(rpnmath_exec_checked(operation, left->i, right->i, bits, &result))) {
+    return rpnmath_value_overflow(overflow, arena, operation, dst, left, right, bits);
+  }
+  dst->type.kind = RPNMATH_TYPEKIND_INT;
+  dst->type.size = bits;
+  dst->type._int = bits;
+  dst->i = result;
+  return 0;
+}
+
+// Whether the exact result of an integer operation does not fit in bits,
+// never for big integers
+static inline int rpnmath_exec_overflows(rpnmath_op_t operation, size_t bits, const rpnmath_value_t *left, const rpnmath_value_t *right) {
+  if (left->type.kind != RPNMATH_TYPEKIND_INT || right->type.kind != RPNMATH_TYPEKIND_INT) {
+    return 0;
+  }
+#if RPNMATH_INT128
+  if (bits > 64) {
+    rpnmath_int128_t result;
+    return rpnmath_exec_checked128(operation, rpnmath_value_get128(left), rpnmath_value_get128(right), &result);
+  }
+#endif
+  long long result;
+  return rpnmath_exec_checked(operation, left->i, right->i, bits, &result);
+}
+
+// An operand of a float operation at the precision of ctype. Integers up
+// to 64 bits convert straight to it, like they do in the float kernels.
+#define RPNMATH_EXEC_FLOAT_OPERAND(ctype, value) \
+  ((value)->type.kind == RPNMATH_TYPEKIND_INT && (value)->type.size <= 64 ? (ctype)(value)->i : \
+   (ctype)rpnmath_value_to_double(value))
+
+// Float arithmetic of the generic path, taken when type inference could not
+// pick a float kernel. The result has the width of the wider float operand.
+static inline void rpnmath_exec_float(rpnmath_op_t operation, rpnmath_value_t *dst,
+                                      const rpnmath_value_t *left, const rpnmath_value_t *right) {
+  size_t bits = 32;
+  if ((left->type.kind == RPNMATH_TYPEKIND_FLOAT && left->type.size == 64) ||
+      (right->type.kind == RPNMATH_TYPEKIND_FLOAT && right->type.size == 64)) {
+    bits = 64;
+  }
+  
+#define RPNMATH_EXEC_FLOAT(ctype) do { \
+    ctype l = RPNMATH_EXEC_FLOAT_OPERAND(ctype, left); \
+    ctype r = RPNMATH_EXEC_FLOAT_OPERAND(ctype, right); \
+    ctype result = operation == RPNMATH_OP_ADD ? l + r : operation == RPNMATH_OP_SUB ? l - r : \
+                   operation == RPNMATH_OP_MUL ? l * r : l / r; \
+    rpnmath_type_float(&dst->type, bits); \
+    dst->f = result; \
+  } while (0)
+  if (bits == 32) {
+    RPNMATH_EXEC_FLOAT(float);
+  } else {
+    RPNMATH_EXEC_FLOAT(double);
+  }
+#undef RPNMATH_EXEC_FLOAT
+}
+
+// Arithmetic results take the wider operand's width. Any float operand
+// makes the result a float, otherwise any decimal a decimal rounded as
+// rounding says, otherwise any big integer a big integer. Failures return
+// their rpnmath_status_t and leave dst untouched.
+static inline int rpnmath_exec_arith(rpnmath_overflow_t overflow, rpnmath_rounding_t rounding, rpnmath_arena_t *arena,
+                                     rpnmath_op_t operation, rpnmath_value_t *dst,
+                                     const rpnmath_value_t *left, const rpnmath_value_t *right) {
+  if (RPNMATH_UNLIKELY(left->type.kind != RPNMATH_TYPEKIND_INT || right->type.kind != RPNMATH_TYPEKIND_INT)) {
+    if (left->type.kind == RPNMATH_TYPEKIND_FLOAT || right->type.kind == RPNMATH_TYPEKIND_FLOAT) {
+      rpnmath_exec_float(operation, dst, left, right);
+    } else if (left->type.kind == RPNMATH_TYPEKIND_DECIMAL || right->type.kind == RPNMATH_TYPEKIND_DECIMAL) {
+      return rpnmath_decimal_arith(overflow, rounding, operation, dst, left, right);
+    } else {
+      return rpnmath_bigint_arith(operation, dst, left, right, arena);
+    }
+    return 0;
+  }
+  size_t result_bitwidth = left->type.size > right->type.size ? left->type.size : right->type.size;
+  return rpnmath_exec_integer(overflow, arena, operation, result_bitwidth, dst, left, right);
+}
+
+// Width specialized kernels, one per entry of RPNMATH_KERNELS, e.g.
+// rpnmath_kernel_ADD_I32. Both operands are known to have at most the
+// kernel's width, so the result type and the overflow check are fixed at
+// compile time and only an actual overflow leaves the kernel.
+#define RPNMATH_KERNEL_DEFINE(op, width, bits, ctype) \
+  static inline int rpnmath_kernel_##op##_##width(rpnmath_overflow_t overflow, rpnmath_arena_t *arena, rpnmath_value_t *dst, \
+                                                  const rpnmath_value_t *left, const rpnmath_value_t *right) { \
+    return rpnmath_exec_integer(overflow, arena, RPNMATH_OP_##op, bits, dst, left, right); \
+  }
+
+RPNMATH_KERNELS(RPNMATH_KERNEL_DEFINE)
+
+#undef RPNMATH_KERNEL_DEFINE
+
+// Comparison results are 8 bit booleans
+static inline void rpnmath_exec_compare(rpnmath_value_t *dst, int result_val) {
+  rpnmath_type_int(&dst->type, 8);
+  dst->i = result_val;
+}
+
+// Float kernels, one per entry of RPNMATH_FLOAT_KERNELS and
+// RPNMATH_FLOAT_COMPARES, e.g. rpnmath_kernel_MUL_F64. Type inference
+// proved both operands to be floats, or integers of at most 64 bits where
+// convert says so, which leaves no type to look at while running.
+#define RPNMATH_KERNEL_FLOAT_OPERANDS(ctype) \
+  ctype l = (convert & RPNMATH_CONVERT_LEFT) ? (ctype)left->i : (ctype)left->f; \
+  ctype r = (convert & RPNMATH_CONVERT_RIGHT) ? (ctype)right->i : (ctype)right->f;
+
+#define RPNMATH_KERNEL_OP_ADD +
+#define RPNMATH_KERNEL_OP_SUB -
+#define RPNMATH_KERNEL_OP_MUL *
+#define RPNMATH_KERNEL_OP_DIV /
+#define RPNMATH_KERNEL_OP_EQ ==
+#define RPNMATH_KERNEL_OP_NE !=
+#define RPNMATH_KERNEL_OP_LT <
+#define RPNMATH_KERNEL_OP_LE <=
+#define RPNMATH_KERNEL_OP_GT >
+#define RPNMATH_KERNEL_OP_GE >=
+
+#define RPNMATH_KERNEL_FLOAT_DEFINE(op, width, bits, ctype) \
+  static inline void rpnmath_kernel_##op##_##width(size_t convert, rpnmath_value_t *dst, \
+                                                   const rpnmath_value_t *left, const rpnmath_value_t *right) { \
+    RPNMATH_KERNEL_FLOAT_OPERANDS(ctype) \
+    ctype result = l RPNMATH_KERNEL_OP_##op r; \
+    rpnmath_type_float(&dst->type, bits); \
+    dst->f = result; \
+  }
+
+#define RPNMATH_KERNEL_COMPARE_DEFINE(op, width, bits, ctype) \
+  static inline void rpnmath_kernel_##op##_##width(size_t convert, rpnmath_value_t *dst, \
+                                                   const rpnmath_value_t *left, const rpnmath_value_t *right) { \
+    RPNMATH_KERNEL_FLOAT_OPERANDS(ctype) \
+    rpnmath_exec_compare(dst, l RPNMATH_KERNEL_OP_##op r); \
+  }
+
+RPNMATH_FLOAT_KERNELS(RPNMATH_KERNEL_FLOAT_DEFINE)
+RPNMATH_FLOAT_COMPARES(RPNMATH_KERNEL_COMPARE_DEFINE)
+
+#undef RPNMATH_KERNEL_FLOAT_DEFINE
+#undef RPNMATH_KERNEL_COMPARE_DEFINE
+#undef RPNMATH_KERNEL_FLOAT_OPERANDS
+
+// Decimal kernels, one per entry of RPNMATH_DECIMAL_KERNELS, e.g.
+// rpnmath_kernel_MUL_D64. Both operands are known to be decimals with 64
+// bit mantissas or integers of at most 64 bits, and layout says how their
+// scales line up, so the hot path is plain 64 bit integer arithmetic. A
+// result that does not fit takes the generic path, which knows the policy.
+#define RPNMATH_KERNEL_DECIMAL_ALIGNED_DEFINE(op) \
+  static inline int rpnmath_kernel_##op##_D64(rpnmath_overflow_t overflow, size_t layout, rpnmath_value_t *dst, \
+                                              const rpnmath_value_t *left, const rpnmath_value_t *right) { \
+    long long a, b, result; \
+    if (RPNMATH_UNLIKELY( \
+          rpnmath_exec_checked(RPNMATH_OP_MUL, left->i, (long long)rpnmath_decimal_pow10[RPNMATH_DECIMAL_LAYOUT_LEFT(layout)], 64, &a) || \
+          rpnmath_exec_checked(RPNMATH_OP_MUL, right->i, (long long)rpnmath_decimal_pow10[RPNMATH_DECIMAL_LAYOUT_RIGHT(layout)], 64, &b) || \
+          rpnmath_exec_checked(RPNMATH_OP_##op, a, b, 64, &result))) { \
+      return rpnmath_decimal_arith(overflow, RPNMATH_DECIMAL_LAYOUT_ROUNDING(layout), RPNMATH_OP_##op, dst, left, right); \
+    } \
+    rpnmath_type_decimal(&dst->type, 64, RPNMATH_DECIMAL_LAYOUT_SCALE(layout)); \
+    dst->i = result; \
+    return 0; \
+  }
+
+RPNMATH_KERNEL_DECIMAL_ALIGNED_DEFINE(ADD)
+RPNMATH_KERNEL_DECIMAL_ALIGNED_DEFINE(SUB)
+
+#undef RPNMATH_KERNEL_DECIMAL_ALIGNED_DEFINE
+
+static inline int rpnmath_kernel_MUL_D64(rpnmath_overflow_t overflow, size_t layout, rpnmath_value_t *dst,
+                                         const rpnmath_value_t *left, const rpnmath_value_t *right) {
+  // The exact product is rounded back to the result's scale
+  long long product;
+  if (RPNMATH_UNLIKELY(rpnmath_exec_checked(RPNMATH_OP_MUL, left->i, right->i, 64, &product))) {
+    return rpnmath_decimal_arith(overflow, RPNMATH_DECIMAL_LAYOUT_ROUNDING(layout), RPNMATH_OP_MUL, dst, left, right);
+  }
+  size_t divisor = RPNMATH_DECIMAL_LAYOUT_RIGHT(layout);
+  rpnmath_type_decimal(&dst->type, 64, RPNMATH_DECIMAL_LAYOUT_SCALE(layout));
+  dst->i = divisor == 0 ? product :
+           rpnmath_decimal_divide64(product, (long long)rpnmath_decimal_pow10[divisor], RPNMATH_DECIMAL_LAYOUT_ROUNDING(layout));
+  return 0;
+}
+
+static inline int rpnmath_kernel_DIV_D64(rpnmath_overflow_t overflow, size_t layout, rpnmath_value_t *dst,
+                                         const rpnmath_value_t *left, const rpnmath_value_t *right) {
+  // Scaling the dividend up leaves a quotient of the result's scale
+  size_t exponent = RPNMATH_DECIMAL_LAYOUT_LEFT(layout);
+  long long dividend;
+  if (RPNMATH_UNLIKELY(right->i == 0 || exponent > RPNMATH_DECIMAL_MAX_SCALE ||
+                       rpnmath_exec_checked(RPNMATH_OP_MUL, left->i, (long long)rpnmath_decimal_pow10[exponent], 64, &dividend) ||
+                       (right->i == -1 && dividend == LLONG_MIN))) {
+    return rpnmath_decimal_arith(overflow, RPNMATH_DECIMAL_LAYOUT_ROUNDING(layout), RPNMATH_OP_DIV, dst, left, right);
+  }
+  rpnmath_type_decimal(&dst->type, 64, RPNMATH_DECIMAL_LAYOUT_SCALE(layout));
+  dst->i = rpnmath_decimal_divide64(dividend, right->i, RPNMATH_DECIMAL_LAYOUT_ROUNDING(layout));
+  return 0;
+}
+
+// Comparison of two numbers, opcode being one of EQ to GE. Engines pass a
+// constant opcode except for IF_CMP, which folds a comparison into a branch.
+// Only integers of up to 64 bits stay on the fast path.
+static inline int rpnmath_exec_test(rpnmath_opcode_t opcode, const rpnmath_value_t *left, const rpnmath_value_t *right) {
+  if (RPNMATH_UNLIKELY(left->type.kind != RPNMATH_TYPEKIND_INT || right->type.kind != RPNMATH_TYPEKIND_INT ||
+                       left->type.size > 64 || right->type.size > 64)) {
+    if (left->type.kind == RPNMATH_TYPEKIND_FLOAT || right->type.kind == RPNMATH_TYPEKIND_FLOAT) {
+      double l = RPNMATH_EXEC_FLOAT_OPERAND(double, left);
+      double r = RPNMATH_EXEC_FLOAT_OPERAND(double, right);
+      switch (opcode) {
+        case RPNMATH_INSN_EQ: return l == r;
+        case RPNMATH_INSN_NE: return l != r;
+        case RPNMATH_INSN_LT: return l < r;
+        case RPNMATH_INSN_LE: return l <= r;
+        case RPNMATH_INSN_GT: return l > r;
+        default: return l >= r;
+      }
+    }
+    int decimal = left->type.kind == RPNMATH_TYPEKIND_DECIMAL || right->type.kind == RPNMATH_TYPEKIND_DECIMAL;
+#if RPNMATH_INT128
+    if (!decimal && !rpnmath_type_has_limbs(&left->type) && !rpnmath_type_has_limbs(&right->type)) {
+      rpnmath_int128_t l = rpnmath_value_get128(left);
+      rpnmath_int128_t r = rpnmath_value_get128(right);
+      switch (opcode) {
+        case RPNMATH_INSN_EQ: return l == r;
+        case RPNMATH_INSN_NE: return l != r;
+        case RPNMATH_INSN_LT: return l < r;
+        case RPNMATH_INSN_LE: return l <= r;
+        case RPNMATH_INSN_GT: return l > r;
+        default: return l >= r;
+      }
+    }
+#endif
+    int order = decimal ? rpnmath_decimal_compare(left, right) : rpnmath_bigint_compare(left, right);
+    switch (opcode) {
+      case RPNMATH_INSN_EQ: return order == 0;
+      case RPNMATH_INSN_NE: return order != 0;
+      case RPNMATH_INSN_LT: return order < 0;
+      case RPNMATH_INSN_LE: return order <= 0;
+      case RPNMATH_INSN_GT: return order > 0;
+      default: return order >= 0;
+    }
+  }
+  switch (opcode) {
+    case RPNMATH_INSN_EQ: return left->i == right->i;
+    case RPNMATH_INSN_NE: return left->i != right->i;
+    case RPNMATH_INSN_LT: return left->i < right->i;
+    case RPNMATH_INSN_LE: return left->i <= right->i;
+    case RPNMATH_INSN_GT: return left->i > right->i;
+    default: return left->i >= right->i;
+  }
+}
+
+// Decimal comparisons, one per entry of RPNMATH_DECIMAL_COMPARES. Scaling
+// up can only overflow for an operand beyond the other one's range, which
+// the generic comparison sorts out.
+#define RPNMATH_KERNEL_DECIMAL_COMPARE_DEFINE(op, width, bits, ctype) \
+  static inline void rpnmath_kernel_##op##_##width(size_t layout, rpnmath_value_t *dst, \
+                                                   const rpnmath_value_t *left, const rpnmath_value_t *right) { \
+    long long l, r; \
+    if (RPNMATH_UNLIKELY( \
+          rpnmath_exec_checked(RPNMATH_OP_MUL, left->i, (long long)rpnmath_decimal_pow10[RPNMATH_DECIMAL_LAYOUT_LEFT(layout)], 64, &l) || \
+          rpnmath_exec_checked(RPNMATH_OP_MUL, right->i, (long long)rpnmath_decimal_pow10[RPNMATH_DECIMAL_LAYOUT_RIGHT(layout)], 64, &r))) { \
+      rpnmath_exec_compare(dst, rpnmath_exec_test(RPNMATH_INSN_##op, left, right)); \
+      return; \
+    } \
+    rpnmath_exec_compare(dst, l RPNMATH_KERNEL_OP_##op r); \
+  }
+
+RPNMATH_DECIMAL_COMPARES(RPNMATH_KERNEL_DECIMAL_COMPARE_DEFINE)
+
+#undef RPNMATH_KERNEL_DECIMAL_COMPARE_DEFINE
+
+// Conditions are true unless zero, big integers with limbs never are. Only
+// -0.0 has bits set and is still zero. The common case tests nothing but
+// the value itself, so selections on it need no branch.
+static inline int rpnmath_exec_truth(const rpnmath_value_t *value) {
+  if (RPNMATH_UNLIKELY(value->type.kind == RPNMATH_TYPEKIND_FLOAT)) {
+    return value->f != 0;
+  }
+  if (RPNMATH_UNLIKELY(value->type.size > 64)) {
+    return (value->i | value->hi) != 0;
+  }
+  return value->i != 0;
+}
+
+// Integer division by zero fails, float division follows IEEE 754
+static inline int rpnmath_exec_div(rpnmath_overflow_t overflow, rpnmath_rounding_t rounding, rpnmath_arena_t *arena, rpnmath_value_t *dst,
+                                   const rpnmath_value_t *left, const rpnmath_value_t *right) {
+  if (!rpnmath_exec_truth(right) &&
+      left->type.kind != RPNMATH_TYPEKIND_FLOAT && right->type.kind != RPNMATH_TYPEKIND_FLOAT) {
+    return RPNMATH_STATUS_DIVISION_BY_ZERO;
+  }
+  return rpnmath_exec_arith(overflow, rounding, arena, RPNMATH_OP_DIV, dst, left, right);
+}
+
+// Selections copy one operand whole. Only the pointer to it depends on the
+// data, which compiles to a conditional move instead of a branch the
+// predictor has to guess. dst may alias any operand.
+static inline void rpnmath_exec_pick(rpnmath_value_t *dst, int first, const rpnmath_value_t *a, const rpnmath_value_t *b) {
+  rpnmath_value_t chosen = *(first ? a : b);
+  *dst = chosen;
+}
+
+static inline void rpnmath_exec_select(rpnmath_value_t *dst, const rpnmath_value_t *condition,
+                                       const rpnmath_value_t *left, const rpnmath_value_t *right) {
+  rpnmath_exec_pick(dst, rpnmath_exec_truth(condition), left, right);
+}
+
+// Ties and unordered floats keep the left operand
+static inline void rpnmath_exec_min(rpnmath_value_t *dst, const rpnmath_value_t *left, const rpnmath_value_t *right) {
+  rpnmath_exec_pick(dst, rpnmath_exec_test(RPNMATH_INSN_LT, right, left), right, left);
+}
+
+static inline void rpnmath_exec_max(rpnmath_value_t *dst, const rpnmath_value_t *left, const rpnmath_value_t *right) {
+  rpnmath_exec_pick(dst, rpnmath_exec_test(RPNMATH_INSN_GT, right, left), right, left);
+}
+
+// The negation is computed either way and selected by the sign, so the
+// smallest integer of a width overflows as the policy says. Floats clear
+// their sign bit, which also turns -0.0 and negative NaNs positive.
+static inline int rpnmath_exec_abs(rpnmath_overflow_t overflow, rpnmath_rounding_t rounding, rpnmath_arena_t *arena,
+                                   rpnmath_value_t *dst, const rpnmath_value_t *value) {
+  if (RPNMATH_UNLIKELY(value->type.kind == RPNMATH_TYPEKIND_FLOAT)) {
+    *dst = *value;
+    dst->f = fabs(dst->f);
+    return 0;
+  }
+  rpnmath_value_t zero = {0};
+  rpnmath_type_int(&zero.type, value->type.kind == RPNMATH_TYPEKIND_INT ? value->type.size : 8);
+  rpnmath_value_t negated;
+  int status = rpnmath_exec_arith(overflow, rounding, arena, RPNMATH_OP_SUB, &negated, &zero, value);
+  if (status != 0) {
+    return status;
+  }
+  rpnmath_exec_pick(dst, rpnmath_exec_test(RPNMATH_INSN_LT, value, &zero), &negated, value);
+  return 0;
+}
+
+// Hand the result of ret to the caller, a wide payload goes to the
+// context's result storage
+static inline int rpnmath_exec_ret(rpnmath_context_t *context, rpnmath_item_const_t *result, const rpnmath_value_t *value) {
+  rpnmath_item_const_t item = {0};
+  item.kind = RPNMATH_ITEMKIND_CONST;
+  item.type = value->type;
+  item.size = rpnmath_type_bytes(&value->type);
+  if (item.size > RPNMATH_CONST_INLINE_SIZE) {
+    item.data = rpnmath_context_result_storage(context, item.size);
+    if (RPNMATH_UNLIKELY(!item.data)) {
+      return rpnmath_context_fail(context, RPNMATH_STATUS_OUT_OF_MEMORY, 0);
+    }
+  }
+  rpnmath_value_store(value, rpnmath_const_data(&item));
+  *result = item;
+  return 0;
+}
+
+// Control flow returns the position to continue at, pc being the position
+// of the executing instruction and blocks the table the positions refer to
+
+static inline size_t rpnmath_exec_if(rpnmath_context_t *context, const rpnmath_block_t *blocks, size_t block, size_t pc, int condition) {
+  if (condition) {
+    context->current_block = block;
+    return pc + 1;
+  }
+  context->current_block = blocks[block].next_block;
+  return blocks[block].next_pos;
+}
+
+static inline size_t rpnmath_exec_else(const rpnmath_block_t *blocks, size_t block) {
+  // The part ran, skip the rest of the chain
+  return blocks[block].end_pos;
+}
+
+static inline size_t rpnmath_exec_loop(rpnmath_context_t *context, const rpnmath_block_t *blocks, size_t block, size_t pc, int condition) {
+  if (condition) {
+    context->current_block = block;
+    return pc + 1;
+  }
+  context->current_block = blocks[block].parent_block;
+  return blocks[block].end_pos + 1;
+}
+
+static inline size_t rpnmath_exec_end(rpnmath_context_t *context, const rpnmath_block_t *blocks, size_t block, size_t pc) {
+  context->current_block = blocks[block].parent_block;
+  return blocks[block].is_loop ? blocks[block].start_pos : pc + 1;
+}
+
+#endif // RPNMATH_EXEC_H
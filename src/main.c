@@ -4,11 +4,27 @@
 #include <ctype.h>
 #include <math.h>
 #include <limits.h>
+#include <errno.h>
 #include <stdint.h>
+#include <time.h>
+#include <threads.h>
 #include "type.h"
 #include "item.h"
+#include "arena.h"
 #include "stack.h"
+#include "context.h"
+#include "program.h"
+#include "partial.h"
+#include "bigint.h"
+#include "decimal.h"
+#include "batch.h"
+#include "simd.h"
 
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#endif
+
+/*
 10 10 +
 [20]
 
@@ -23,7 +39,7 @@
 
 10 10 + $x =
 [20 $x =]
-
+*/
 
 // Helper function to determine if a string is a number
 int is_number(const char *str) {
@@ -38,12 +54,14 @@ int is_number(const char *str) {
 int is_operation(const char *str) {
   if (strlen(str) == 1) {
     return (*str == '+' || *str == '-' || *str == '*' || *str == '/' || 
-            *str == '=' || *str == '<' || *str == '>');
+            *str == '=' || *str == '<' || *str == '>' || *str == '!');
   } else if (strlen(str) == 2) {
     return (strcmp(str, "==") == 0 || strcmp(str, "!=") == 0 || 
-            strcmp(str, "<=") == 0 || strcmp(str, ">=") == 0);
+            strcmp(str, "<=") == 0 || strcmp(str, ">=") == 0 ||
+            strcmp(str, "&&") == 0 || strcmp(str, "||") == 0);
   } else {
-    return 0;
+    return (strcmp(str, "select") == 0 || strcmp(str, "min") == 0 ||
+            strcmp(str, "max") == 0 || strcmp(str, "abs") == 0);
   }
 }
 
@@ -108,6 +126,7 @@ rpnmath_op_t get_operation(const char *str) {
       case '=': return RPNMATH_OP_ASSIGN;
       case '<': return RPNMATH_OP_LT;
       case '>': return RPNMATH_OP_GT;
+      case '!': return RPNMATH_OP_NOT;
       default: return RPNMATH_OP_ADD; // fallback
     }
   } else if (strlen(str) == 2) {
@@ -115,6 +134,13 @@ rpnmath_op_t get_operation(const char *str) {
     if (strcmp(str, "!=") == 0) return RPNMATH_OP_NE;
     if (strcmp(str, "<=") == 0) return RPNMATH_OP_LE;
     if (strcmp(str, ">=") == 0) return RPNMATH_OP_GE;
+    if (strcmp(str, "&&") == 0) return RPNMATH_OP_AND;
+    if (strcmp(str, "||") == 0) return RPNMATH_OP_OR;
+  } else {
+    if (strcmp(str, "select") == 0) return RPNMATH_OP_SELECT;
+    if (strcmp(str, "min") == 0) return RPNMATH_OP_MIN;
+    if (strcmp(str, "max") == 0) return RPNMATH_OP_MAX;
+    if (strcmp(str, "abs") == 0) return RPNMATH_OP_ABS;
   }
   return RPNMATH_OP_ADD; // fallback
 }
@@ -153,7 +179,7 @@ size_t determine_bitwidth(long long value) {
 }
 
 // Helper function to create and push a constant to stack
-void push_number(rpnmath_stack_t *stack, long long value) {
+int push_number(rpnmath_stack_t *stack, long long value) {
   rpnmath_item_const_t item = {0};
   item.kind = RPNMATH_ITEMKIND_CONST;
   
@@ -162,104 +188,854 @@ void push_number(rpnmath_stack_t *stack, long long value) {
   
   size_t native_size = rpnmath_type_native_size(bitwidth);
   item.size = native_size;
-  item.data = malloc(native_size);
-  
-  if (!item.data) {
-    fprintf(stderr, "Memory allocation failed\n");
-    exit(1);
-  }
   
+  // Every literal fits inline, so nothing is allocated here. A long long
+  // needs at most 64 bits, wider literals go through push_value.
+  void *data = rpnmath_const_data(&item);
   switch (native_size) {
-    case 1: *(int8_t*)item.data = (int8_t)value; break;
-    case 2: *(int16_t*)item.data = (int16_t)value; break;
-    case 4: *(int32_t*)item.data = (int32_t)value; break;
-    case 8: *(int64_t*)item.data = (int64_t)value; break;
-    default:
-      printf("TODO: Support for integers over 64 bits not implemented\n");
-      free(item.data);
-      abort();
+    case 1: *(int8_t*)data = (int8_t)value; break;
+    case 2: *(int16_t*)data = (int16_t)value; break;
+    case 4: *(int32_t*)data = (int32_t)value; break;
+    default: *(int64_t*)data = (int64_t)value; break;
   }
   
-  rpnmath_stack_pushc(stack, &item);
-  free(item.data);
+  return rpnmath_stack_pushc(stack, &item);
+}
+
+#if RPNMATH_INT128
+// Helper function to parse a decimal literal too wide for long long, returns 0 when it does not fit 128 bits either
+int parse_wide_number(const char *str, rpnmath_int128_t *value) {
+  int negative = *str == '-';
+  if (*str == '-' || *str == '+') str++;
+  
+  // Accumulate negatively so the smallest value fits as well
+  rpnmath_int128_t result = 0;
+  for (; *str; str++) {
+    if (__builtin_mul_overflow(result, 10, &result) || __builtin_sub_overflow(result, *str - '0', &result)) {
+      return 0;
+    }
+  }
+  if (!negative && __builtin_mul_overflow(result, -1, &result)) {
+    return 0;
+  }
+  *value = result;
+  return 1;
+}
+
+#endif
+
+// Helper function to push a constant that is not a 64 bit integer
+int push_value(rpnmath_stack_t *stack, const rpnmath_value_t *value) {
+  // Pushing copies the payload into the stack
+  rpnmath_item_const_t item = rpnmath_value_to_const(value);
+  if (item.kind == RPNMATH_ITEMKIND_VOID) {
+    return RPNMATH_STATUS_OUT_OF_MEMORY;
+  }
+  int status = rpnmath_stack_pushc(stack, &item);
+  rpnmath_const_cleanup(&item);
+  return status;
 }
 
 // Helper function to create and push an operation to stack
-void push_operation(rpnmath_stack_t *stack, rpnmath_op_t operation) {
+int push_operation(rpnmath_stack_t *stack, rpnmath_op_t operation) {
   rpnmath_item_op_t item = {0};
   item.kind = RPNMATH_ITEMKIND_OP;
   item.operation = operation;
   
-  rpnmath_stack_pushop(stack, &item);
+  return rpnmath_stack_pushop(stack, &item);
 }
 
 // Helper function to create and push a variable operation to stack
-void push_vop(rpnmath_stack_t *stack, rpnmath_vop_t operation, size_t argcount, size_t retcount) {
+int push_vop(rpnmath_stack_t *stack, rpnmath_vop_t operation, size_t argcount, size_t retcount) {
   rpnmath_item_vop_t item = {0};
   item.kind = RPNMATH_ITEMKIND_VOP;
   item.operation = operation;
   item.argcount = argcount;
   item.retcount = retcount;
   
-  rpnmath_stack_pushvop(stack, &item);
+  return rpnmath_stack_pushvop(stack, &item);
 }
 
 // Helper function to create and push a control flow operation to stack
-void push_cfop(rpnmath_stack_t *stack, rpnmath_cfop_t operation) {
+int push_cfop(rpnmath_stack_t *stack, rpnmath_cfop_t operation) {
   rpnmath_item_cfop_t item = {0};
   item.kind = RPNMATH_ITEMKIND_CFOP;
   item.operation = operation;
   
-  rpnmath_stack_pushcfop(stack, &item);
+  return rpnmath_stack_pushcfop(stack, &item);
 }
 
 // Helper function to create and push a local reference to stack
-void push_localref(rpnmath_stack_t *stack, size_t var_id) {
+int push_localref(rpnmath_stack_t *stack, size_t var_id) {
   rpnmath_item_localref_t item = {0};
   item.kind = RPNMATH_ITEMKIND_LREF;
   item.variable_id = var_id;
   
-  rpnmath_stack_pushlr(stack, &item);
+  return rpnmath_stack_pushlr(stack, &item);
 }
 
-// Helper function to get the result value from a const item
-long long get_result_value(rpnmath_item_const_t *result_item) {
-  if (result_item->kind != RPNMATH_ITEMKIND_CONST) {
-    return 0;
+// Helper function to format the value of a const item, the text is allocated from arena
+const char* format_result(const rpnmath_item_const_t *result_item, rpnmath_arena_t *arena) {
+  rpnmath_value_t value;
+  rpnmath_value_from_const(&value, result_item);
+  size_t size = rpnmath_value_format_size(&value);
+  char *text = rpnmath_arena_alloc(arena, size);
+  if (!text) {
+    return "?";
+  }
+  rpnmath_value_format(&value, text, size);
+  return text;
+}
+
+// Helper function to get the token an operation is written as
+const char* get_operation_token(rpnmath_op_t operation) {
+  switch (operation) {
+    case RPNMATH_OP_ADD: return "+";
+    case RPNMATH_OP_SUB: return "-";
+    case RPNMATH_OP_MUL: return "*";
+    case RPNMATH_OP_DIV: return "/";
+    case RPNMATH_OP_ASSIGN: return "=";
+    case RPNMATH_OP_EQ: return "==";
+    case RPNMATH_OP_NE: return "!=";
+    case RPNMATH_OP_LT: return "<";
+    case RPNMATH_OP_LE: return "<=";
+    case RPNMATH_OP_GT: return ">";
+    case RPNMATH_OP_GE: return ">=";
+    case RPNMATH_OP_SELECT: return "select";
+    case RPNMATH_OP_MIN: return "min";
+    case RPNMATH_OP_MAX: return "max";
+    case RPNMATH_OP_ABS: return "abs";
+    case RPNMATH_OP_AND: return "&&";
+    case RPNMATH_OP_OR: return "||";
+    case RPNMATH_OP_NOT: return "!";
+    default: return "?";
+  }
+}
+
+// Helper function to print the items on a stack as they would be typed, e.g. "[20 $0 =]"
+void print_stack(rpnmath_stack_t *stack, rpnmath_arena_t *arena) {
+  printf("[");
+  for (size_t pos = rpnmath_stack_begin(stack); pos < stack->size; pos = rpnmath_stack_next(stack, pos)) {
+    const char *item = stack->data + pos;
+    
+    if (pos != rpnmath_stack_begin(stack)) {
+      printf(" ");
+    }
+    
+    switch (*(const rpnmath_itemkind_t*)item) {
+      case RPNMATH_ITEMKIND_CONST: {
+        rpnmath_item_const_t view = rpnmath_stack_const_at(stack, pos);
+        printf("%s", format_result(&view, arena));
+        break;
+      }
+      case RPNMATH_ITEMKIND_LREF:
+        printf("$%zu", ((const rpnmath_item_localref_t*)item)->variable_id);
+        break;
+      case RPNMATH_ITEMKIND_OP:
+        printf("%s", get_operation_token(((const rpnmath_item_op_t*)item)->operation));
+        break;
+      case RPNMATH_ITEMKIND_VOP: {
+        const rpnmath_item_vop_t *vop = (const rpnmath_item_vop_t*)item;
+        printf("%s/%zu", vop->operation == RPNMATH_VOP_RET ? "ret" : "call", vop->argcount);
+        break;
+      }
+      case RPNMATH_ITEMKIND_CFOP:
+        printf("%s", rpnmath_cfop_name(((const rpnmath_item_cfop_t*)item)->operation));
+        break;
+      default:
+        printf("?");
+        break;
+    }
+  }
+  printf("]");
+}
+
+// Helper function to parse an expression into items on the stack, returns 1 on error
+int parse_expression(rpnmath_stack_t *stack, const char *expression, int verbose, rpnmath_arena_t *arena) {
+  char *expression_copy = rpnmath_arena_alloc(arena, strlen(expression) + 1);
+  if (!expression_copy) {
+    printf("Error: Out of memory\n");
+    return 1;
   }
+  strcpy(expression_copy, expression);
   
-  size_t native_size = rpnmath_type_native_size(result_item->type.size);
-  long long value = 0;
+  char *token = strtok(expression_copy, " \t");
+  int error = 0;
+  rpnmath_value_t literal;
   
-  switch (native_size) {
-    case 1: value = *(int8_t*)result_item->data; break;
-    case 2: value = *(int16_t*)result_item->data; break;
-    case 4: value = *(int32_t*)result_item->data; break;
-    case 8: value = *(int64_t*)result_item->data; break;
-    default:
-      printf("TODO: Support for integers over 64 bits not implemented\n");
-      abort();
+  while (token != NULL && !error) {
+    int pushed = 0; // a failed push leaves the stack as it was
+    if (is_number(token)) {
+      char *endptr;
+      errno = 0;
+      long long value = strtoll(token, &endptr, 10);
+      
+      if (*endptr != '\0') {
+        printf("Error: Invalid number '%s'\n", token);
+        error = 1;
+        break;
+      }
+      
+      if (errno != ERANGE) {
+        pushed = push_number(stack, value);
+        if (verbose) printf("  Pushed number: %lld\n", value);
+      } else {
+        // Wider literals are 128 bit integers while they fit, big integers past that
+        rpnmath_value_t wide;
+#if RPNMATH_INT128
+        rpnmath_int128_t wide_value;
+        if (parse_wide_number(token, &wide_value)) {
+          rpnmath_type_int(&wide.type, 128);
+          rpnmath_value_set128(&wide, wide_value);
+        } else
+#endif
+        if (rpnmath_bigint_parse(&wide, token, arena) != 0) {
+          printf("Error: Number '%s' out of range\n", token);
+          error = 1;
+          break;
+        }
+        pushed = push_value(stack, &wide);
+        if (verbose) printf("  Pushed number: %s\n", token);
+      }
+      
+    } else if (rpnmath_value_parse_float(&literal, token) == 0 || rpnmath_decimal_parse(&literal, token) == 0) {
+      pushed = push_value(stack, &literal);
+      if (verbose) printf("  Pushed number: %s\n", token);
+      
+    } else if (is_variable(token)) {
+      size_t var_id = get_variable_id(token);
+      
+      if (var_id >= RPNMATH_MAX_VARIABLES) {
+        printf("Error: Variable ID %zu exceeds maximum %d\n", var_id, RPNMATH_MAX_VARIABLES - 1);
+        error = 1;
+        break;
+      }
+      
+      pushed = push_localref(stack, var_id);
+      if (verbose) printf("  Pushed local reference: $%zu\n", var_id);
+      
+    } else if (is_operation(token)) {
+      rpnmath_op_t operation = get_operation(token);
+      
+      pushed = push_operation(stack, operation);
+      if (verbose) printf("  Pushed operation: %s (%s)\n", token, rpnmath_op_name(operation));
+      
+    } else {
+      // Check for VOP syntax (like "ret/1")
+      char op_name[64];
+      size_t argcount, retcount;
+      
+      if (parse_vop_syntax(token, op_name, &argcount, &retcount)) {
+        if (is_vop(op_name)) {
+          rpnmath_vop_t vop = get_vop(op_name);
+          pushed = push_vop(stack, vop, argcount, retcount);
+          if (verbose) printf("  Pushed variable operation: %s/%zu/%zu (%s)\n", 
+                              op_name, argcount, retcount, rpnmath_vop_name(vop));
+        } else {
+          printf("Error: Unknown variable operation '%s'\n", op_name);
+          error = 1;
+          break;
+        }
+      } else if (is_cfop(token)) {
+        rpnmath_cfop_t cfop = get_cfop(token);
+        pushed = push_cfop(stack, cfop);
+        if (verbose) printf("  Pushed control flow operation: %s (%s)\n", token, rpnmath_cfop_name(cfop));
+      } else {
+        printf("Error: Unknown token '%s'\n", token);
+        error = 1;
+        break;
+      }
+    }
+    
+    if (pushed != 0) {
+      printf("Error: Out of memory\n");
+      error = 1;
+      break;
+    }
+    token = strtok(NULL, " \t");
   }
   
-  return value;
+  return error;
+}
+
+// Helper function to get a monotonic-enough timestamp in nanoseconds
+double now_ns(void) {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+// Helper function to count cycles of the time stamp counter, which ticks at
+// the CPU's nominal clock; nanoseconds where there is none
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define CYCLE_UNIT "cycle"
+double now_cycles(void) {
+  return (double)__rdtsc();
+}
+#else
+#define CYCLE_UNIT "ns"
+double now_cycles(void) {
+  return now_ns();
+}
+#endif
+
+// Helper function to time one expression on every engine ("bench <iterations> <expression>")
+void run_benchmark(const char *args, rpnmath_overflow_t overflow, rpnmath_rounding_t rounding) {
+  char *expression;
+  long iterations = strtol(args, &expression, 10);
+  if (iterations <= 0) {
+    printf("Usage: bench <iterations> <expression>\n\n");
+    return;
+  }
+  
+  rpnmath_stack_t stack;
+  rpnmath_stack_init(&stack, 1024);
+  rpnmath_arena_t arena;
+  rpnmath_arena_init(&arena, 0);
+  
+  rpnmath_program_t program = {0};
+  if (parse_expression(&stack, expression, 0, &arena) || rpnmath_program_compile(&program, &stack, overflow, rounding, &arena) != 0) {
+    printf("Error: %s\n\n", program.error ? program.error : "Compilation failed");
+    rpnmath_arena_cleanup(&arena);
+    rpnmath_stack_cleanup(&stack);
+    return;
+  }
+  
+  rpnmath_context_t context;
+  rpnmath_context_init(&context, &arena);
+  
+  printf("  %zu instructions (%zu fused away, %zu width specialized, %zu if/else converted), %ld iterations, overflow %s\n",
+         program.count, program.fusion.removed, program.specialized, program.converted, iterations,
+         rpnmath_overflow_name(program.overflow));
+  for (int fusion = 0; fusion < RPNMATH_FUSION_COUNT; fusion++) {
+    if (program.fusion.fired[fusion]) {
+      printf("  fused %-12s x%zu\n", rpnmath_fusion_name((rpnmath_fusion_t)fusion), program.fusion.fired[fusion]);
+    }
+  }
+  for (int engine = 0; engine < RPNMATH_ENGINE_COUNT; engine++) {
+    context.engine = (rpnmath_engine_t)engine;
+    
+    double start = now_ns();
+    long i;
+    for (i = 0; i < iterations; i++) {
+      rpnmath_item_const_t result;
+      if (rpnmath_program_execute(&program, &context, &result) != 0) break;
+    }
+    double elapsed = now_ns() - start;
+    
+    if (i < iterations) {
+      printf("  %-10s failed: %s\n", rpnmath_engine_name(context.engine), rpnmath_context_error(&context));
+      continue;
+    }
+    printf("  %-10s %8.2f ns/op %12.1f ns/eval\n", rpnmath_engine_name(context.engine),
+           elapsed / ((double)iterations * (double)program.count), elapsed / (double)iterations);
+  }
+  printf("\n");
+  
+  rpnmath_arena_cleanup(&arena);
+  rpnmath_stack_cleanup(&stack);
+}
+
+// Helper function to time the same summing loop on every integer width with
+// kernels, on big integers, floats and decimals ("bench-widths <iterations>"), the
+// seed literal decides the width
+void run_width_benchmark(const char *args, rpnmath_overflow_t overflow, rpnmath_rounding_t rounding) {
+  static const struct { const char *name; const char *seed; } widths[] = {
+    {"i32", "100000"},
+    {"i64", "9000000000"},
+#if RPNMATH_INT128
+    {"i128", "18446744073709551616"},
+#endif
+    {"big", "1606938044258990275541962092341162602522202993782792835301376"},
+    {"f32", "1.5f"},
+    {"f64", "1.5"},
+    {"d64", "1.50d"},
+  };
+  long iterations = strtol(args, NULL, 10);
+  if (iterations <= 0) {
+    printf("Usage: bench-widths <iterations>\n\n");
+    return;
+  }
+  
+  for (size_t i = 0; i < sizeof(widths) / sizeof(widths[0]); i++) {
+    char bench_args[256];
+    snprintf(bench_args, sizeof(bench_args),
+             "%ld %s $9 = 0 $9 * $0 = 0 $9 * $1 = while $0 1000 < loop $0 1 + $0 = $1 $0 + $1 = end $1 ret/1",
+             iterations, widths[i].seed);
+    printf("  %s:\n", widths[i].name);
+    run_benchmark(bench_args, overflow, rounding);
+  }
+}
+
+// Helper function to time conditions whose right-hand clause is a long
+// arithmetic chain, once short-circuited and once combined with * or +
+// after evaluating both clauses ("bench-logic <iterations>")
+void run_logic_benchmark(const char *args, rpnmath_overflow_t overflow, rpnmath_rounding_t rounding) {
+  static const struct { const char *name; const char *left; const char *combine; } cases[] = {
+    {"&& (false left)", "$0 0 <", "&&"},
+    {"* (false left)", "$0 0 <", "*"},
+    {"|| (true left)", "$0 0 >=", "||"},
+    {"+ (true left)", "$0 0 >=", "+"},
+  };
+  static const char *chain = "$0 3 * 7 + 5 * 11 - 2 * 13 + 3 * 17 - $0 - 4 * 9 + 100 >";
+  long iterations = strtol(args, NULL, 10);
+  if (iterations <= 0) {
+    printf("Usage: bench-logic <iterations>\n\n");
+    return;
+  }
+  
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    char bench_args[512];
+    snprintf(bench_args, sizeof(bench_args),
+             "%ld 100000 $9 = 0 $9 * $0 = 0 $9 * $1 = while $0 1000 < loop %s %s %s if $1 1 + $1 = end $0 1 + $0 = end $1 ret/1",
+             iterations, cases[i].left, chain, cases[i].combine);
+    printf("  %s:\n", cases[i].name);
+    run_benchmark(bench_args, overflow, rounding);
+  }
+}
+
+// One thread of "bench-threads": its own arena and context on the shared program
+typedef struct bench_thread {
+  const rpnmath_program_t *program;
+  rpnmath_engine_t engine;
+  long iterations;
+  char result[128]; // last result, or the error of the evaluation that failed
+  int failed;
+} bench_thread_t;
+
+int run_bench_thread(void *arg) {
+  bench_thread_t *bench = arg;
+  rpnmath_arena_t arena;
+  rpnmath_arena_init(&arena, 0);
+  rpnmath_context_t context;
+  rpnmath_context_init(&context, &arena);
+  context.engine = bench->engine;
+  
+  bench->failed = 0;
+  bench->result[0] = '\0';
+  for (long i = 0; i < bench->iterations; i++) {
+    rpnmath_item_const_t result;
+    if (rpnmath_program_execute(bench->program, &context, &result) != 0) {
+      snprintf(bench->result, sizeof(bench->result), "%s", rpnmath_context_error(&context));
+      bench->failed = 1;
+      break;
+    }
+    if (i == bench->iterations - 1) {
+      snprintf(bench->result, sizeof(bench->result), "%s", format_result(&result, &arena));
+    }
+  }
+  
+  rpnmath_arena_cleanup(&arena);
+  return 0;
+}
+
+// Helper function to run one compiled program on 1, 2, 4, ... threads at
+// once, every thread with a context of its own, and compare the throughput
+// ("bench-threads <threads> <iterations> <expression>")
+void run_thread_benchmark(const char *args, rpnmath_overflow_t overflow, rpnmath_rounding_t rounding) {
+  char *rest;
+  long threads = strtol(args, &rest, 10);
+  char *expression;
+  long iterations = strtol(rest, &expression, 10);
+  if (threads <= 0 || threads > 256 || iterations <= 0) {
+    printf("Usage: bench-threads <threads> <iterations> <expression>\n\n");
+    return;
+  }
+  
+  rpnmath_stack_t stack;
+  rpnmath_stack_init(&stack, 1024);
+  rpnmath_arena_t arena;
+  rpnmath_arena_init(&arena, 0);
+  
+  rpnmath_program_t program = {0};
+  if (parse_expression(&stack, expression, 0, &arena) || rpnmath_program_compile(&program, &stack, overflow, rounding, &arena) != 0) {
+    printf("Error: %s\n\n", program.error ? program.error : "Compilation failed");
+    rpnmath_arena_cleanup(&arena);
+    rpnmath_stack_cleanup(&stack);
+    return;
+  }
+  
+  bench_thread_t *benches = malloc((size_t)threads * sizeof(bench_thread_t));
+  thrd_t *handles = malloc((size_t)threads * sizeof(thrd_t));
+  if (!benches || !handles) {
+    printf("Error: Out of memory\n\n");
+    free(benches);
+    free(handles);
+    rpnmath_arena_cleanup(&arena);
+    rpnmath_stack_cleanup(&stack);
+    return;
+  }
+  
+  printf("  %zu instructions, %ld iterations per thread\n", program.count, iterations);
+  for (int engine = 0; engine < RPNMATH_ENGINE_COUNT; engine++) {
+    printf("  %s:\n", rpnmath_engine_name((rpnmath_engine_t)engine));
+    double single = 0;
+    for (long count = 1; count <= threads; count = count * 2 > threads && count < threads ? threads : count * 2) {
+      double start = now_ns();
+      long started;
+      for (started = 0; started < count; started++) {
+        benches[started].program = &program;
+        benches[started].engine = (rpnmath_engine_t)engine;
+        benches[started].iterations = iterations;
+        if (thrd_create(&handles[started], run_bench_thread, &benches[started]) != thrd_success) break;
+      }
+      for (long i = 0; i < started; i++) {
+        thrd_join(handles[i], NULL);
+      }
+      double elapsed = now_ns() - start;
+      
+      if (started < count) {
+        printf("  %3ld threads could not be started\n", count);
+        break;
+      }
+      // Every thread ran the same program, so they all have to agree
+      long mismatch = 0;
+      for (long i = 1; i < count; i++) {
+        if (strcmp(benches[i].result, benches[0].result) != 0) mismatch = i;
+      }
+      if (benches[0].failed || mismatch) {
+        printf("  %3ld threads failed: %s%s%s\n", count, benches[mismatch].result, mismatch ? " vs " : "",
+               mismatch ? benches[0].result : "");
+        break;
+      }
+      
+      double throughput = (double)count * (double)iterations / elapsed * 1e3; // million evaluations per second
+      if (count == 1) single = throughput;
+      printf("  %3ld threads %12.1f ns/eval per thread %10.2f M evals/s %6.2fx\n", count,
+             elapsed / (double)iterations, throughput, throughput / single);
+    }
+  }
+  if (!benches[0].failed) {
+    printf("  Result: %s\n", benches[0].result);
+  }
+  printf("\n");
+  
+  free(benches);
+  free(handles);
+  rpnmath_arena_cleanup(&arena);
+  rpnmath_stack_cleanup(&stack);
+}
+
+// Helper function to evaluate one row of 64 bit input columns on its own,
+// the way the batch API runs programs it can not vectorize
+int run_batch_row(const rpnmath_program_t *program, rpnmath_context_t *context, const rpnmath_column_t *inputs,
+                  size_t input_count, size_t row, rpnmath_item_const_t *result) {
+  rpnmath_context_forget_variables(context);
+  for (size_t i = 0; i < input_count; i++) {
+    rpnmath_value_t value;
+    rpnmath_value_load(&value, &inputs[i].type, (const int64_t*)inputs[i].data + row);
+    if (rpnmath_context_store_variable(context, i, &value) != 0) {
+      return context->error.status;
+    }
+  }
+  return rpnmath_program_execute(program, context, result);
+}
+
+// Helper function to time a program over input columns, row by row on
+// every engine and with the batch API. The result of the first row decides
+// the type of the output column.
+void run_batch_columns(const rpnmath_program_t *program, rpnmath_context_t *context, const rpnmath_column_t *inputs,
+                       size_t input_count, size_t rows) {
+  rpnmath_item_const_t result;
+  if (run_batch_row(program, context, inputs, input_count, 0, &result) != 0) {
+    printf("Error: %s\n\n", rpnmath_context_error(context));
+    return;
+  }
+  rpnmath_column_t output = {0};
+  output.type = result.type;
+  if (rpnmath_type_has_limbs(&output.type)) {
+    printf("Error: The result of the first row has no fixed width type\n\n");
+    return;
+  }
+  size_t stride = rpnmath_type_bytes(&output.type);
+  output.data = malloc(rows * stride);
+  if (!output.data) {
+    printf("Error: Out of memory\n\n");
+    return;
+  }
+  
+  printf("  %zu instructions, %zu rows, %zu input columns, %s\n", program->count, rows, input_count,
+         rpnmath_batch_vectorizes(program) ? "vectorized" : "row by row");
+  double fastest = 0;
+  for (int engine = 0; engine < RPNMATH_ENGINE_COUNT; engine++) {
+    context->engine = (rpnmath_engine_t)engine;
+    
+    double start = now_ns();
+    size_t row;
+    for (row = 0; row < rows; row++) {
+      if (run_batch_row(program, context, inputs, input_count, row, &result) != 0) break;
+    }
+    double elapsed = now_ns() - start;
+    
+    if (row < rows) {
+      printf("  %-10s failed on row %zu: %s\n", rpnmath_engine_name(context->engine), row, rpnmath_context_error(context));
+      continue;
+    }
+    double per_row = elapsed / (double)rows;
+    if (fastest == 0 || per_row < fastest) fastest = per_row;
+    printf("  %-10s %10.1f ns/row\n", rpnmath_engine_name(context->engine), per_row);
+  }
+  
+  context->engine = RPNMATH_ENGINE_THREADED;
+  double start = now_ns();
+  size_t failed_row;
+  int status = rpnmath_batch_execute(program, context, inputs, input_count, &output, rows, &failed_row);
+  double per_row = (now_ns() - start) / (double)rows;
+  if (status != 0) {
+    printf("  %-10s failed on row %zu: %s\n\n", "batch", failed_row, rpnmath_context_error(context));
+    free(output.data);
+    return;
+  }
+  printf("  %-10s %10.1f ns/row %6.2fx\n", "batch", per_row, fastest / per_row);
+  
+  // Every row has to match its evaluation on its own
+  size_t mismatches = 0;
+  for (size_t row = 0; row < rows; row++) {
+    if (run_batch_row(program, context, inputs, input_count, row, &result) != 0) {
+      continue;
+    }
+    rpnmath_value_t value;
+    rpnmath_value_load(&value, &output.type, (const char*)output.data + row * stride);
+    char batch_text[RPNMATH_VALUE_FORMAT_SIZE];
+    rpnmath_value_format(&value, batch_text, sizeof(batch_text));
+    const char *text = format_result(&result, context->arena);
+    if (strcmp(text, batch_text) != 0 && mismatches++ == 0) {
+      printf("  Row %zu differs: %s, batch %s\n", row, text, batch_text);
+    }
+  }
+  printf("  %zu of %zu rows differ\n\n", mismatches, rows);
+  free(output.data);
+}
+
+// Helper function to time an expression over columns of rows ("bench-batch
+// <rows> <expression>"), $i reads column i of 64 bit integers from 1 to 997
+void run_batch_benchmark(const char *args, rpnmath_overflow_t overflow, rpnmath_rounding_t rounding) {
+  char *expression;
+  long rows = strtol(args, &expression, 10);
+  if (rows <= 0) {
+    printf("Usage: bench-batch <rows> <expression>\n\n");
+    return;
+  }
+  
+  rpnmath_stack_t stack;
+  rpnmath_stack_init(&stack, 1024);
+  rpnmath_arena_t arena;
+  rpnmath_arena_init(&arena, 0);
+  
+  rpnmath_program_t program = {0};
+  if (parse_expression(&stack, expression, 0, &arena) || rpnmath_program_compile(&program, &stack, overflow, rounding, &arena) != 0) {
+    printf("Error: %s\n\n", program.error ? program.error : "Compilation failed");
+    rpnmath_arena_cleanup(&arena);
+    rpnmath_stack_cleanup(&stack);
+    return;
+  }
+  
+  size_t count = (size_t)rows;
+  size_t input_count = program.variable_count;
+  rpnmath_column_t *inputs = malloc((input_count + 1) * sizeof(rpnmath_column_t));
+  int64_t *data = malloc((input_count * count + 1) * sizeof(int64_t));
+  if (!inputs || !data) {
+    printf("Error: Out of memory\n\n");
+  } else {
+    for (size_t i = 0; i < input_count; i++) {
+      rpnmath_type_int(&inputs[i].type, 64);
+      inputs[i].data = data + i * count;
+      for (size_t row = 0; row < count; row++) {
+        data[i * count + row] = (int64_t)((row * (2 * i + 3) + i) % 997) + 1;
+      }
+    }
+    rpnmath_context_t context;
+    rpnmath_context_init(&context, &arena);
+    run_batch_columns(&program, &context, inputs, input_count, count);
+  }
+  
+  free(data);
+  free(inputs);
+  rpnmath_arena_cleanup(&arena);
+  rpnmath_stack_cleanup(&stack);
+}
+
+// Helper function to fill row of a column of SIMD kernel operands
+void set_simd_element(void *data, rpnmath_simd_width_t width, size_t row, long long value) {
+  switch (width) {
+    case RPNMATH_SIMD_I8: ((int8_t*)data)[row] = (int8_t)value; break;
+    case RPNMATH_SIMD_I16: ((int16_t*)data)[row] = (int16_t)value; break;
+    case RPNMATH_SIMD_I32: ((int32_t*)data)[row] = (int32_t)value; break;
+    default: ((int64_t*)data)[row] = value; break;
+  }
+}
+
+// Helper function to time every SIMD kernel on every instruction set the
+// CPU supports ("bench-simd <rows>"), repeated over the same rows until
+// about 16 million elements went through it. Operands stay small enough
+// that no row overflows, divisors are never zero.
+void run_simd_benchmark(const char *args) {
+  static const struct { const char *name; rpnmath_op_t operation; } operations[] = {
+    {"add", RPNMATH_OP_ADD}, {"sub", RPNMATH_OP_SUB}, {"mul", RPNMATH_OP_MUL}, {"div", RPNMATH_OP_DIV},
+    {"eq", RPNMATH_OP_EQ}, {"ne", RPNMATH_OP_NE}, {"lt", RPNMATH_OP_LT},
+    {"le", RPNMATH_OP_LE}, {"gt", RPNMATH_OP_GT}, {"ge", RPNMATH_OP_GE},
+  };
+  static const char *width_names[RPNMATH_SIMD_WIDTH_COUNT] = {"i8", "i16", "i32", "i64"};
+  long rows = strtol(args, NULL, 10);
+  if (rows <= 0) {
+    printf("Usage: bench-simd <rows>\n\n");
+    return;
+  }
+  
+  size_t n = (size_t)rows;
+  long repeats = 1 + (1L << 24) / rows;
+  int64_t *left = malloc(n * sizeof(int64_t));
+  int64_t *right = malloc(n * sizeof(int64_t));
+  int64_t *dst = malloc(n * sizeof(int64_t));
+  int64_t *expected = malloc(n * sizeof(int64_t));
+  uint8_t *mask = malloc(n);
+  if (!left || !right || !dst || !expected || !mask) {
+    printf("Error: Out of memory\n\n");
+    free(left);
+    free(right);
+    free(dst);
+    free(expected);
+    free(mask);
+    return;
+  }
+  for (size_t row = 0; row < n; row++) {
+    mask[row] = row % 3 == 0;
+  }
+  
+  const rpnmath_simd_t *sets[RPNMATH_SIMD_ISA_COUNT];
+  printf("  %zu rows, elements per " CYCLE_UNIT ", %s chosen\n  %-10s", n, rpnmath_simd_isa_name(rpnmath_simd_best()->isa), "kernel");
+  for (int isa = 0; isa < RPNMATH_SIMD_ISA_COUNT; isa++) {
+    sets[isa] = rpnmath_simd_get((rpnmath_simd_isa_t)isa);
+    if (sets[isa]) {
+      printf(" %8s", rpnmath_simd_isa_name((rpnmath_simd_isa_t)isa));
+    }
+  }
+  printf("\n");
+  
+  for (int width = 0; width < RPNMATH_SIMD_WIDTH_COUNT; width++) {
+    size_t bytes = (size_t)1 << width;
+    for (size_t row = 0; row < n; row++) {
+      set_simd_element(left, (rpnmath_simd_width_t)width, row, (long long)((row * 7 + 3) % 23) - 11);
+      set_simd_element(right, (rpnmath_simd_width_t)width, row, (long long)((row * 5 + 1) % 9) + 1);
+    }
+    
+    // One line per operation, then one for select and one for filter
+    size_t operation_count = sizeof(operations) / sizeof(operations[0]);
+    for (size_t i = 0; i <= operation_count + 1; i++) {
+      int selecting = i == operation_count;
+      int filtering = i == operation_count + 1;
+      rpnmath_op_t operation = i >= operation_count ? RPNMATH_OP_SELECT : operations[i].operation;
+      size_t size = operation >= RPNMATH_OP_EQ && i < operation_count ? n : n * bytes;
+      printf("  %-3s %-6s", selecting ? "sel" : filtering ? "flt" : operations[i].name, width_names[width]);
+      
+      int differs = 0;
+      for (int isa = 0; isa < RPNMATH_SIMD_ISA_COUNT; isa++) {
+        if (!sets[isa]) {
+          continue;
+        }
+        rpnmath_simd_kernel_t *kernel = i >= operation_count ? NULL : sets[isa]->kernels[operation][width];
+        rpnmath_simd_select_t *select = sets[isa]->select[width];
+        rpnmath_simd_filter_t *filter = sets[isa]->filter[width];
+        
+        double start = now_cycles();
+        for (long repeat = 0; repeat < repeats; repeat++) {
+          if (selecting) {
+            select(n, mask, left, right, dst);
+          } else if (filtering) {
+            // Only the rows filtered to the front are compared
+            size = filter(n, mask, left, dst) * bytes;
+          } else {
+            kernel(n, left, right, dst);
+          }
+        }
+        double elapsed = now_cycles() - start;
+        
+        printf(" %8.2f", (double)repeats * (double)n / elapsed);
+        if (isa == RPNMATH_SIMD_SCALAR) {
+          memcpy(expected, dst, size);
+        } else if (memcmp(expected, dst, size) != 0) {
+          differs = 1;
+        }
+      }
+      printf("%s\n", differs ? "  differs from scalar" : "");
+    }
+  }
+  printf("\n");
+  
+  free(left);
+  free(right);
+  free(dst);
+  free(expected);
+  free(mask);
+}
+
+// Helper function to select the overflow policy of the following lines ("overflow <policy>")
+void set_overflow(const char *args, rpnmath_overflow_t *overflow) {
+  args += strspn(args, " ");
+  for (int policy = 0; policy < RPNMATH_OVERFLOW_COUNT; policy++) {
+    if (strcmp(args, rpnmath_overflow_name((rpnmath_overflow_t)policy)) == 0) {
+      *overflow = (rpnmath_overflow_t)policy;
+      printf("Overflow: %s\n\n", rpnmath_overflow_name(*overflow));
+      return;
+    }
+  }
+  printf("Usage: overflow wrap|trap|saturate|promote (currently %s)\n\n", rpnmath_overflow_name(*overflow));
+}
+
+// Helper function to select how decimal results are rounded ("rounding <mode>")
+void set_rounding(const char *args, rpnmath_rounding_t *rounding) {
+  args += strspn(args, " ");
+  for (int mode = 0; mode < RPNMATH_ROUNDING_COUNT; mode++) {
+    if (strcmp(args, rpnmath_rounding_name((rpnmath_rounding_t)mode)) == 0) {
+      *rounding = (rpnmath_rounding_t)mode;
+      printf("Rounding: %s\n\n", rpnmath_rounding_name(*rounding));
+      return;
+    }
+  }
+  printf("Usage: rounding half-even|half-up|down|floor|ceiling (currently %s)\n\n", rpnmath_rounding_name(*rounding));
 }
 
 int main() {
-  char expression[1000];
+  char expression[16384]; // big integer literals make for long lines
   
   printf("RPN Calculator with SSA Variables and Control Flow\n");
   printf("===================================================\n");
-  printf("Supported operators: +, -, *, /, ==, !=, <, <=, >, >=\n");
+  printf("Supported operators: +, -, *, /, ==, !=, <, <=, >, >=, &&, ||, !, select, min, max, abs\n");
   printf("Variables: $0, $1, $2, ... (SSA with block-based versioning)\n");
   printf("Assignment: = (assigns top stack value to variable)\n");
   printf("Return: ret/argcount (returns values and stops execution)\n");
-  printf("Control Flow: if, else, while, loop, end\n");
+  printf("Control Flow: COND if ... [elif COND if ...] [else ...] end, while COND loop ... end\n");
   printf("Phi Nodes: phi (for SSA variable merging)\n");
   printf("Example: \"10 $0 = 20 $0 + ret/1\" assigns 10 to $0, then returns $0 + 20\n");
   printf("Example: \"5 3 > if 100 ret/1 else 200 ret/1 end\" returns 100 if 5>3, else 200\n");
-  printf("Example: \"0 $0 = while $0 10 < $0 1 + $0 = end $0 ret/1\" loop from 0 to 10\n");
+  printf("Example: \"0 $0 = while $0 10 < loop $0 1 + $0 = end $0 ret/1\" loop from 0 to 10\n");
+  printf("Select: \"$0 $1 > $0 $1 select\" picks without branching, small if/else diamonds compile to it\n");
+  printf("Logic: \"$0 0 > $1 $0 / 3 > &&\" only runs the right-hand clause when the left one does not decide\n");
+  printf("Floats: \"2.5 1e3 *\" is 64 bit, \"0.1f\" 32 bit, mixed with integers they make floats\n");
+  printf("Decimals: \"19.99d 3 *\" is exact fixed point with the larger scale of its operands\n");
+  printf("Benchmark: \"bench 1000000 <expression>\" times the expression on every engine\n");
+  printf("           \"bench-widths 1000\" compares the same loop on integers, floats and decimals\n");
+  printf("           \"bench-logic 1000\" compares && and || against * and + on an expensive clause\n");
+  printf("           \"bench-threads 8 100000 <expression>\" runs it on 1, 2, 4 and 8 threads at once\n");
+  printf("           \"bench-batch 100000 <expression>\" runs it on columns of rows, $i reading column i\n");
+  printf("           \"bench-simd 4096\" times the column kernels of every instruction set in elements per cycle\n");
+  printf("Overflow: \"overflow wrap|trap|saturate|promote\" sets what integer overflow does (default wrap)\n");
+  printf("Rounding: \"rounding half-even|half-up|down|floor|ceiling\" sets how decimals round (default half-even)\n");
   printf("Enter 'quit' to exit\n\n");
   
+  // Everything below is set up once and reset after each line, so a line
+  // reuses the buffers of the previous one
+  rpnmath_arena_t arena;
+  rpnmath_arena_init(&arena, 0);
+  rpnmath_stack_t stack;
+  rpnmath_stack_init(&stack, 1024);
+  rpnmath_stack_t residual;
+  rpnmath_stack_init(&residual, 1024);
+  rpnmath_context_t context;
+  rpnmath_context_init(&context, &arena);
+  rpnmath_overflow_t overflow = RPNMATH_OVERFLOW_WRAP;
+  rpnmath_rounding_t rounding = RPNMATH_ROUNDING_HALF_EVEN;
+  
   while (1) {
     printf("RPN> ");
     
@@ -278,105 +1054,93 @@ int main() {
       continue;
     }
     
-    // Construct Stack
-    rpnmath_stack_t stack;
-    rpnmath_stack_init(&stack, 1024);
+    if (strncmp(expression, "bench-widths ", 13) == 0) {
+      run_width_benchmark(expression + 13, overflow, rounding);
+      continue;
+    }
     
-    // Parse expression and build stack
-    char *expression_copy = malloc(strlen(expression) + 1);
-    strcpy(expression_copy, expression);
+    if (strncmp(expression, "bench-threads ", 14) == 0) {
+      run_thread_benchmark(expression + 14, overflow, rounding);
+      continue;
+    }
     
-    char *token = strtok(expression_copy, " \t");
-    int error = 0;
+    if (strncmp(expression, "bench-batch ", 12) == 0) {
+      run_batch_benchmark(expression + 12, overflow, rounding);
+      continue;
+    }
     
-    while (token != NULL && !error) {
-      if (is_number(token)) {
-        char *endptr;
-        long long value = strtoll(token, &endptr, 10);
-        
-        if (*endptr != '\0') {
-          printf("Error: Invalid number '%s'\n", token);
-          error = 1;
-          break;
-        }
-        
-        push_number(&stack, value);
-        printf("  Pushed number: %lld\n", value);
-        
-      } else if (is_variable(token)) {
-        size_t var_id = get_variable_id(token);
-        
-        if (var_id >= RPNMATH_MAX_VARIABLES) {
-          printf("Error: Variable ID %zu exceeds maximum %d\n", var_id, RPNMATH_MAX_VARIABLES - 1);
-          error = 1;
-          break;
-        }
-        
-        push_localref(&stack, var_id);
-        printf("  Pushed local reference: $%zu\n", var_id);
-        
-      } else if (is_operation(token)) {
-        rpnmath_op_t operation = get_operation(token);
-        
-        push_operation(&stack, operation);
-        printf("  Pushed operation: %s (%s)\n", token, rpnmath_op_name(operation));
-        
-      } else {
-        // Check for VOP syntax (like "ret/1")
-        char op_name[64];
-        size_t argcount, retcount;
-        
-        if (parse_vop_syntax(token, op_name, &argcount, &retcount)) {
-          if (is_vop(op_name)) {
-            rpnmath_vop_t vop = get_vop(op_name);
-            push_vop(&stack, vop, argcount, retcount);
-            printf("  Pushed variable operation: %s/%zu/%zu (%s)\n", 
-                   op_name, argcount, retcount, rpnmath_vop_name(vop));
-          } else {
-            printf("Error: Unknown variable operation '%s'\n", op_name);
-            error = 1;
-            break;
-          }
-        } else if (is_cfop(token)) {
-          rpnmath_cfop_t cfop = get_cfop(token);
-          push_cfop(&stack, cfop);
-          printf("  Pushed control flow operation: %s (%s)\n", token, rpnmath_cfop_name(cfop));
-        } else {
-          printf("Error: Unknown token '%s'\n", token);
-          error = 1;
-          break;
-        }
-      }
-      
-      token = strtok(NULL, " \t");
+    if (strncmp(expression, "bench-simd ", 11) == 0) {
+      run_simd_benchmark(expression + 11);
+      continue;
+    }
+    
+    if (strncmp(expression, "bench-logic ", 12) == 0) {
+      run_logic_benchmark(expression + 12, overflow, rounding);
+      continue;
     }
     
-    if (!error) {
-      // Execute the entire RPN expression
+    if (strncmp(expression, "bench ", 6) == 0) {
+      run_benchmark(expression + 6, overflow, rounding);
+      continue;
+    }
+    
+    if (strncmp(expression, "overflow", 8) == 0) {
+      set_overflow(expression + 8, &overflow);
+      continue;
+    }
+    
+    if (strncmp(expression, "rounding", 8) == 0) {
+      set_rounding(expression + 8, &rounding);
+      continue;
+    }
+    
+    // Parse expression and build stack
+    int error = parse_expression(&stack, expression, 1, &arena);
+    
+    // Fold everything that does not depend on runtime values
+    if (!error && rpnmath_partial_evaluate(&stack, &residual, overflow, rounding, &context) != 0) {
+      printf("Error: %s\n\n", rpnmath_context_error(&context));
+      error = 1;
+    } else if (!error && residual.counts[RPNMATH_ITEMKIND_VOP] != 0) {
+      printf("  Residual: ");
+      print_stack(&residual, &arena);
+      printf("\n");
+    }
+    
+    rpnmath_program_t program;
+    if (!error && residual.counts[RPNMATH_ITEMKIND_VOP] == 0) {
+      // Nothing returns, the residual stack is the result
+      printf("Result: ");
+      print_stack(&residual, &arena);
+      printf("\n\n");
+    } else if (!error && rpnmath_program_compile(&program, &residual, overflow, rounding, &arena) != 0) {
+      printf("Error: %s\n\n", program.error);
+      error = 1;
+    } else if (!error) {
+      // Execute the compiled RPN expression
       printf("  Executing RPN expression...\n");
       rpnmath_item_const_t result;
-      int exec_result = rpnmath_stack_execute(&stack, &result);
+      int exec_result = rpnmath_program_execute(&program, &context, &result);
       
       if (exec_result == 0) {
-        long long result_value = get_result_value(&result);
-        printf("Result: %lld\n\n", result_value);
-        
-        // Clean up result data
-        if (result.data) {
-          free(result.data);
-        }
+        printf("Result: %s\n\n", format_result(&result, &arena));
       } else {
-        printf("Error: Execution failed\n\n");
+        printf("Error: %s\n\n", rpnmath_context_error(&context));
       }
     } else {
       printf("\n");
     }
     
-    // Clean up
-    free(expression_copy);
-    rpnmath_stack_cleanup(&stack);
+    // Reset for the next line, the context last as it lives in the arena
+    rpnmath_stack_reset(&stack);
+    rpnmath_stack_reset(&residual);
+    rpnmath_arena_reset(&arena);
+    rpnmath_context_reset(&context);
   }
   
+  rpnmath_stack_cleanup(&residual);
+  rpnmath_stack_cleanup(&stack);
+  rpnmath_arena_cleanup(&arena);
   printf("Goodbye!\n");
   return 0;
 }
\ No newline at end of file
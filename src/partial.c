@@ -0,0 +1,706 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "type.h"
+#include "item.h"
+#include "value.h"
+#include "arena.h"
+#include "stack.h"
+#include "context.h"
+#include "partial.h"
+#include "decimal.h"
+#include "exec.h"
+
+// The evaluator runs the item stream on an abstract operand stack. Entries
+// below `emitted` already have their items in the residual, the entries above
+// it are known constants that are only written out once something needs them
+// at runtime. Everything above `emitted` is therefore known, which is what
+// lets "10 10 +" fold without a trace in the residual.
+
+typedef struct rpnmath_partial_entry {
+  rpnmath_value_t value;
+  int known; // value is valid, even if the entry was already emitted
+} rpnmath_partial_entry_t;
+
+// An if/elif/else chain or loop that has not seen its end yet, tracked like
+// the compiler does so that unbalanced control flow fails here as well.
+// An if whose condition is known leaves no trace, only the part it takes is
+// evaluated. Otherwise every part starts out knowing what was known at the
+// if, and after the end only what all parts that did not return agree on is
+// known.
+typedef struct rpnmath_partial_frame {
+  rpnmath_cfop_t kind;     // IF or ELSE for the part being evaluated, WHILE before loop, LOOP in the body
+  int shares_end;          // "elif <cond> if", closed by the end of the enclosing chain
+  int waiting;             // an elif of the chain waits for the if after its condition
+  int emitted;             // the if or while is in the residual
+  int taken;               // if with a known condition: whether the first part runs
+  int has_else;            // emitted if: the first part is over
+  int first_returned;      // emitted if: the first part ended in ret
+  size_t depth;            // emitted if: operands at the start of each part
+  size_t first_depth;      // emitted if: operands at the end of the first part
+  rpnmath_value_t *start;  // variables at the start of each part, or at the loop head
+  size_t start_count;
+  rpnmath_value_t *first;  // emitted if: variables at the end of the first part
+  size_t first_count;
+} rpnmath_partial_frame_t;
+
+typedef struct rpnmath_partial {
+  rpnmath_stack_t *residual;
+  rpnmath_context_t *context; // failures are recorded here
+  rpnmath_arena_t *arena;     // the context's
+  rpnmath_overflow_t overflow;
+  rpnmath_rounding_t rounding;
+  rpnmath_partial_entry_t *entries;
+  size_t depth;
+  size_t capacity;
+  size_t emitted;
+  rpnmath_value_t *variables; // type.kind is VOID while unknown, zeroed entries are VOID
+  size_t variable_capacity;
+  rpnmath_partial_frame_t *frames;
+  size_t frame_count;
+  size_t frame_capacity;
+  int skipping;    // items are dropped up to the next part of frames[skip] or its end
+  size_t skip;
+  int returned;    // ret was evaluated, items are dropped up to the next part or end in the residual
+  int failed;      // ran out of memory, the evaluation stops after the current item
+} rpnmath_partial_t;
+
+static void rpnmath_partial_emit_const(rpnmath_partial_t *partial, const rpnmath_value_t *value) {
+  rpnmath_item_const_t item = rpnmath_value_to_const(value);
+  if (item.kind == RPNMATH_ITEMKIND_VOID || rpnmath_stack_pushc(partial->residual, &item) != 0) {
+    partial->failed = 1;
+  }
+  rpnmath_const_cleanup(&item);
+}
+
+static void rpnmath_partial_emit_op(rpnmath_partial_t *partial, rpnmath_op_t operation) {
+  rpnmath_item_op_t item = {0};
+  item.kind = RPNMATH_ITEMKIND_OP;
+  item.operation = operation;
+  if (rpnmath_stack_pushop(partial->residual, &item) != 0) {
+    partial->failed = 1;
+  }
+}
+
+static void rpnmath_partial_emit_lref(rpnmath_partial_t *partial, size_t var_id) {
+  rpnmath_item_localref_t item = {0};
+  item.kind = RPNMATH_ITEMKIND_LREF;
+  item.variable_id = var_id;
+  if (rpnmath_stack_pushlr(partial->residual, &item) != 0) {
+    partial->failed = 1;
+  }
+}
+
+// Write out the pending constants, everything on the stack is emitted afterwards
+static void rpnmath_partial_materialize(rpnmath_partial_t *partial) {
+  for (size_t i = partial->emitted; i < partial->depth; i++) {
+    rpnmath_partial_emit_const(partial, &partial->entries[i].value);
+  }
+  partial->emitted = partial->depth;
+}
+
+static void rpnmath_partial_push(rpnmath_partial_t *partial, const rpnmath_value_t *value) {
+  if (partial->depth == partial->capacity) {
+    size_t capacity = partial->capacity ? partial->capacity * 2 : 16;
+    rpnmath_partial_entry_t *entries = rpnmath_arena_grow(partial->arena, partial->entries, partial->capacity * sizeof(rpnmath_partial_entry_t),
+                                                          capacity * sizeof(rpnmath_partial_entry_t));
+    if (!entries) {
+      partial->failed = 1;
+      return;
+    }
+    partial->entries = entries;
+    partial->capacity = capacity;
+  }
+  
+  rpnmath_partial_entry_t *entry = &partial->entries[partial->depth++];
+  entry->known = value != NULL;
+  if (value) {
+    entry->value = *value;
+  } else {
+    // Runtime values are emitted by definition
+    partial->emitted = partial->depth;
+  }
+}
+
+static void rpnmath_partial_pop(rpnmath_partial_t *partial, size_t count) {
+  partial->depth -= count;
+  if (partial->emitted > partial->depth) {
+    partial->emitted = partial->depth;
+  }
+}
+
+static int rpnmath_partial_require(rpnmath_partial_t *partial, const char *name, size_t count) {
+  if (partial->depth < count) {
+    return rpnmath_context_fail_message(partial->context, RPNMATH_STATUS_COMPILE,
+                                        rpnmath_arena_printf(partial->arena, "Not enough operands for operation %s (need %zu, have %zu)",
+                                                             name, count, partial->depth));
+  }
+  return 0;
+}
+
+// Fold arithmetic into left unless it overflows into an error, that is
+// reported when the residual runs like any other
+static int rpnmath_partial_fold_arith(rpnmath_overflow_t overflow, rpnmath_rounding_t rounding, rpnmath_arena_t *arena,
+                                      rpnmath_op_t operation, rpnmath_value_t *left, const rpnmath_value_t *right) {
+  if ((left->type.kind == RPNMATH_TYPEKIND_DECIMAL || right->type.kind == RPNMATH_TYPEKIND_DECIMAL) &&
+      left->type.kind != RPNMATH_TYPEKIND_FLOAT && right->type.kind != RPNMATH_TYPEKIND_FLOAT) {
+    return rpnmath_decimal_arith(overflow, rounding, operation, left, left, right) == 0;
+  }
+  size_t bits = left->type.size > right->type.size ? left->type.size : right->type.size;
+  if (rpnmath_overflow_fails(overflow) && rpnmath_exec_overflows(operation, bits, left, right)) {
+    return 0;
+  }
+  return rpnmath_exec_arith(overflow, rounding, arena, operation, left, left, right) == 0;
+}
+
+// Fold an operation into its first operand, returns 0 when it has to stay
+// for runtime
+static int rpnmath_partial_fold(rpnmath_overflow_t overflow, rpnmath_rounding_t rounding, rpnmath_arena_t *arena,
+                                rpnmath_op_t operation, rpnmath_partial_entry_t *operands) {
+  rpnmath_value_t *left = &operands[0].value;
+  switch (operation) {
+    case RPNMATH_OP_ADD:
+    case RPNMATH_OP_SUB:
+    case RPNMATH_OP_MUL:
+      return rpnmath_partial_fold_arith(overflow, rounding, arena, operation, left, &operands[1].value);
+    case RPNMATH_OP_DIV: {
+      // Integer division by zero is reported when the residual runs, floats
+      // make an infinity or NaN
+      const rpnmath_value_t *right = &operands[1].value;
+      if (!rpnmath_exec_truth(right) && left->type.kind != RPNMATH_TYPEKIND_FLOAT &&
+          right->type.kind != RPNMATH_TYPEKIND_FLOAT) {
+        return 0;
+      }
+      return rpnmath_partial_fold_arith(overflow, rounding, arena, operation, left, right);
+    }
+    case RPNMATH_OP_EQ: rpnmath_exec_compare(left, rpnmath_exec_test(RPNMATH_INSN_EQ, left, &operands[1].value)); return 1;
+    case RPNMATH_OP_NE: rpnmath_exec_compare(left, rpnmath_exec_test(RPNMATH_INSN_NE, left, &operands[1].value)); return 1;
+    case RPNMATH_OP_LT: rpnmath_exec_compare(left, rpnmath_exec_test(RPNMATH_INSN_LT, left, &operands[1].value)); return 1;
+    case RPNMATH_OP_LE: rpnmath_exec_compare(left, rpnmath_exec_test(RPNMATH_INSN_LE, left, &operands[1].value)); return 1;
+    case RPNMATH_OP_GT: rpnmath_exec_compare(left, rpnmath_exec_test(RPNMATH_INSN_GT, left, &operands[1].value)); return 1;
+    case RPNMATH_OP_GE: rpnmath_exec_compare(left, rpnmath_exec_test(RPNMATH_INSN_GE, left, &operands[1].value)); return 1;
+    case RPNMATH_OP_SELECT: rpnmath_exec_select(left, left, &operands[1].value, &operands[2].value); return 1;
+    case RPNMATH_OP_MIN: rpnmath_exec_min(left, left, &operands[1].value); return 1;
+    case RPNMATH_OP_MAX: rpnmath_exec_max(left, left, &operands[1].value); return 1;
+    case RPNMATH_OP_ABS: {
+      // A negation that fails is left for runtime like any other
+      rpnmath_value_t negated = {0};
+      rpnmath_type_int(&negated.type, left->type.kind == RPNMATH_TYPEKIND_INT ? left->type.size : 8);
+      if (left->type.kind != RPNMATH_TYPEKIND_FLOAT &&
+          !rpnmath_partial_fold_arith(overflow, rounding, arena, RPNMATH_OP_SUB, &negated, left)) {
+        return 0;
+      }
+      return rpnmath_exec_abs(overflow, rounding, arena, left, left) == 0;
+    }
+    case RPNMATH_OP_AND: rpnmath_exec_compare(left, rpnmath_exec_truth(left) && rpnmath_exec_truth(&operands[1].value)); return 1;
+    case RPNMATH_OP_OR: rpnmath_exec_compare(left, rpnmath_exec_truth(left) || rpnmath_exec_truth(&operands[1].value)); return 1;
+    case RPNMATH_OP_NOT: rpnmath_exec_compare(left, !rpnmath_exec_truth(left)); return 1;
+    default: return 0;
+  }
+}
+
+static int rpnmath_partial_op(rpnmath_partial_t *partial, rpnmath_op_t operation) {
+  size_t count = (size_t)rpnmath_op_arg_count(operation);
+  if (rpnmath_partial_require(partial, rpnmath_op_name(operation), count) != 0) {
+    return partial->context->error.status;
+  }
+  
+  // All operands pending means none has left a trace in the residual yet
+  rpnmath_partial_entry_t *operands = &partial->entries[partial->depth - count];
+  if (partial->emitted <= partial->depth - count &&
+      rpnmath_partial_fold(partial->overflow, partial->rounding, partial->arena, operation, operands)) {
+    rpnmath_partial_pop(partial, count - 1);
+    return 0;
+  }
+  
+  rpnmath_partial_materialize(partial);
+  rpnmath_partial_emit_op(partial, operation);
+  rpnmath_partial_pop(partial, count);
+  rpnmath_partial_push(partial, NULL);
+  return 0;
+}
+
+static int rpnmath_partial_store(rpnmath_partial_t *partial, size_t var_id) {
+  if (rpnmath_partial_require(partial, "store", 1) != 0) {
+    return partial->context->error.status;
+  }
+  
+  // "CONST $n =" leaves the stack as it was, so it can go out ahead of the
+  // constants still pending below it
+  const rpnmath_partial_entry_t *top = &partial->entries[partial->depth - 1];
+  if (partial->emitted < partial->depth) {
+    rpnmath_partial_emit_const(partial, &top->value);
+  }
+  rpnmath_partial_emit_lref(partial, var_id);
+  rpnmath_partial_emit_op(partial, RPNMATH_OP_ASSIGN);
+  
+  if (var_id >= partial->variable_capacity) {
+    size_t capacity = partial->variable_capacity * 2 > var_id + 1 ? partial->variable_capacity * 2 : var_id + 1;
+    rpnmath_value_t *variables = rpnmath_arena_grow(partial->arena, partial->variables, partial->variable_capacity * sizeof(rpnmath_value_t),
+                                                    capacity * sizeof(rpnmath_value_t));
+    if (!variables) {
+      partial->failed = 1;
+      return 0;
+    }
+    partial->variables = variables;
+    partial->variable_capacity = capacity;
+  }
+  if (top->known) {
+    partial->variables[var_id] = top->value;
+  } else {
+    partial->variables[var_id].type.kind = RPNMATH_TYPEKIND_VOID;
+  }
+  rpnmath_partial_pop(partial, 1);
+  return 0;
+}
+
+static void rpnmath_partial_load(rpnmath_partial_t *partial, size_t var_id) {
+  if (var_id < partial->variable_capacity && partial->variables[var_id].type.kind != RPNMATH_TYPEKIND_VOID) {
+    rpnmath_partial_push(partial, &partial->variables[var_id]);
+    return;
+  }
+  
+  rpnmath_partial_materialize(partial);
+  rpnmath_partial_emit_lref(partial, var_id);
+  rpnmath_partial_push(partial, NULL);
+}
+
+// Operands reaching a merge depend on the path taken at runtime
+static void rpnmath_partial_forget(rpnmath_partial_t *partial) {
+  for (size_t i = 0; i < partial->depth; i++) {
+    partial->entries[i].known = 0;
+  }
+}
+
+static void rpnmath_partial_forget_variable(rpnmath_partial_t *partial, size_t var_id) {
+  if (var_id < partial->variable_capacity) {
+    partial->variables[var_id].type.kind = RPNMATH_TYPEKIND_VOID;
+  }
+}
+
+// Copy what is known about the variables, for a path meeting others later
+static rpnmath_value_t *rpnmath_partial_save(rpnmath_partial_t *partial, size_t *count) {
+  *count = 0;
+  if (partial->variable_capacity == 0) {
+    return NULL;
+  }
+  rpnmath_value_t *copy = rpnmath_arena_alloc(partial->arena, partial->variable_capacity * sizeof(rpnmath_value_t));
+  if (!copy) {
+    partial->failed = 1;
+    return NULL;
+  }
+  memcpy(copy, partial->variables, partial->variable_capacity * sizeof(rpnmath_value_t));
+  *count = partial->variable_capacity;
+  return copy;
+}
+
+static void rpnmath_partial_restore(rpnmath_partial_t *partial, const rpnmath_value_t *saved, size_t count) {
+  for (size_t i = 0; i < partial->variable_capacity; i++) {
+    if (i < count) {
+      partial->variables[i] = saved[i];
+    } else {
+      partial->variables[i].type.kind = RPNMATH_TYPEKIND_VOID;
+    }
+  }
+}
+
+// Keep knowing only the variables the saved path knows the same way
+static void rpnmath_partial_meet(rpnmath_partial_t *partial, const rpnmath_value_t *saved, size_t count) {
+  for (size_t i = 0; i < partial->variable_capacity; i++) {
+    if (i >= count || memcmp(&partial->variables[i], &saved[i], sizeof(rpnmath_value_t)) != 0) {
+      partial->variables[i].type.kind = RPNMATH_TYPEKIND_VOID;
+    }
+  }
+}
+
+static int rpnmath_partial_unbalanced(rpnmath_partial_t *partial, const char *message) {
+  return rpnmath_context_fail_message(partial->context, RPNMATH_STATUS_COMPILE, message);
+}
+
+// Open and close constructs as the compiler does, with its messages. A
+// construct ending in the condition of an elif closes the chain unless an if
+// follows at once; the compiler also weighs the operand depths, but either
+// way the same ends balance. before_if: the next item is an if.
+static int rpnmath_partial_structure(rpnmath_partial_t *partial, rpnmath_cfop_t operation, int before_if) {
+  rpnmath_partial_frame_t *top = partial->frame_count ? &partial->frames[partial->frame_count - 1] : NULL;
+  if (top && top->waiting && operation != RPNMATH_CFOP_IF && operation != RPNMATH_CFOP_WHILE &&
+      operation != RPNMATH_CFOP_PHI) {
+    return rpnmath_partial_unbalanced(partial, "elif has to be followed by a condition and if");
+  }
+  
+  switch (operation) {
+    case RPNMATH_CFOP_IF:
+    case RPNMATH_CFOP_WHILE: {
+      if (partial->frame_count == partial->frame_capacity) {
+        size_t capacity = partial->frame_capacity ? partial->frame_capacity * 2 : 8;
+        rpnmath_partial_frame_t *frames = rpnmath_arena_grow(partial->arena, partial->frames, partial->frame_capacity * sizeof(rpnmath_partial_frame_t),
+                                                             capacity * sizeof(rpnmath_partial_frame_t));
+        if (!frames) {
+          partial->failed = 1;
+          return 0;
+        }
+        partial->frames = frames;
+        partial->frame_capacity = capacity;
+      }
+      rpnmath_partial_frame_t *frame = &partial->frames[partial->frame_count++];
+      *frame = (rpnmath_partial_frame_t){0};
+      frame->kind = operation;
+      frame->shares_end = operation == RPNMATH_CFOP_IF && top && top->waiting;
+      frame->taken = 1;
+      return 0;
+    }
+    case RPNMATH_CFOP_ELIF:
+    case RPNMATH_CFOP_ELSE:
+      if (!top || top->kind != RPNMATH_CFOP_IF) {
+        return rpnmath_partial_unbalanced(partial, operation == RPNMATH_CFOP_ELIF ? "elif without a matching if" :
+                                                                                   "else without a matching if");
+      }
+      top->kind = RPNMATH_CFOP_ELSE;
+      top->waiting = operation == RPNMATH_CFOP_ELIF;
+      return 0;
+    case RPNMATH_CFOP_LOOP:
+      if (!top || top->kind != RPNMATH_CFOP_WHILE) {
+        return rpnmath_partial_unbalanced(partial, "loop without a matching while");
+      }
+      top->kind = RPNMATH_CFOP_LOOP;
+      return 0;
+    case RPNMATH_CFOP_END: {
+      if (!top || top->kind == RPNMATH_CFOP_WHILE) {
+        return rpnmath_partial_unbalanced(partial, top ? "end without a matching loop" : "end without a matching if or while");
+      }
+      // Close the chain, and the chains it continues through elif
+      int shares_end;
+      do {
+        shares_end = partial->frames[--partial->frame_count].shares_end;
+      } while (shares_end && !before_if);
+      return 0;
+    }
+    default:
+      return 0;
+  }
+}
+
+static void rpnmath_partial_emit_cfop(rpnmath_partial_t *partial, const rpnmath_item_cfop_t *cfop) {
+  rpnmath_item_cfop_t copy = *cfop;
+  partial->failed |= rpnmath_stack_pushcfop(partial->residual, &copy) != 0;
+}
+
+// Whether the item at pos is an if, which decides how an end closes elif chains
+static int rpnmath_partial_before_if(const rpnmath_stack_t *stack, size_t pos) {
+  const rpnmath_item_cfop_t *item = (const rpnmath_item_cfop_t*)(stack->data + pos);
+  return pos < stack->size && item->kind == RPNMATH_ITEMKIND_CFOP && item->operation == RPNMATH_CFOP_IF;
+}
+
+static int rpnmath_partial_if(rpnmath_partial_t *partial, const rpnmath_item_cfop_t *cfop) {
+  size_t index = partial->frame_count - 1;
+  rpnmath_partial_frame_t *frame = &partial->frames[index];
+  
+  // The if of an elif in the residual has to follow it there, any other
+  // with a known condition only leaves the part it takes
+  if (!(frame->shares_end && partial->frames[index - 1].emitted) && partial->emitted < partial->depth) {
+    frame->emitted = 0;
+    frame->taken = rpnmath_exec_truth(&partial->entries[partial->depth - 1].value);
+    rpnmath_partial_pop(partial, 1);
+    if (!frame->taken) {
+      partial->skipping = 1;
+      partial->skip = index;
+    }
+    return 0;
+  }
+  
+  rpnmath_partial_materialize(partial);
+  rpnmath_partial_emit_cfop(partial, cfop);
+  rpnmath_partial_pop(partial, 1);
+  frame->emitted = 1;
+  frame->has_else = 0;
+  frame->depth = partial->depth;
+  frame->start = rpnmath_partial_save(partial, &frame->start_count);
+  return 0;
+}
+
+static void rpnmath_partial_else(rpnmath_partial_t *partial, const rpnmath_item_cfop_t *cfop) {
+  size_t index = partial->frame_count - 1;
+  rpnmath_partial_frame_t *frame = &partial->frames[index];
+  if (!frame->emitted) {
+    // The first part was taken, the rest is dropped
+    partial->skipping = 1;
+    partial->skip = index;
+    return;
+  }
+  
+  rpnmath_partial_materialize(partial);
+  rpnmath_partial_emit_cfop(partial, cfop);
+  frame->has_else = 1;
+  frame->first_returned = partial->returned;
+  frame->first_depth = partial->depth;
+  frame->first = rpnmath_partial_save(partial, &frame->first_count);
+  
+  rpnmath_partial_restore(partial, frame->start, frame->start_count);
+  partial->depth = frame->depth;
+  partial->emitted = partial->depth;
+  partial->returned = 0;
+  rpnmath_partial_forget(partial);
+}
+
+// The variables a loop assigns are unknown at its head, which is reached
+// again from the end of the body. Scans from pos, the item after the while,
+// to the end of the loop and restores the frames afterwards.
+static int rpnmath_partial_loop_assigns(rpnmath_partial_t *partial, const rpnmath_stack_t *stack, size_t pos) {
+  size_t index = partial->frame_count - 1;
+  rpnmath_partial_frame_t loop = partial->frames[index];
+  int status = 0;
+  while (status == 0 && !partial->failed && pos < stack->size && partial->frame_count > index) {
+    const char *item = stack->data + pos;
+    rpnmath_itemkind_t kind = *(const rpnmath_itemkind_t*)item;
+    size_t next = rpnmath_stack_next(stack, pos);
+    
+    const rpnmath_item_op_t *following = (const rpnmath_item_op_t*)(stack->data + next);
+    if (kind == RPNMATH_ITEMKIND_LREF && next < stack->size && following->kind == RPNMATH_ITEMKIND_OP &&
+        following->operation == RPNMATH_OP_ASSIGN) {
+      rpnmath_partial_forget_variable(partial, ((const rpnmath_item_localref_t*)item)->variable_id);
+    } else if (kind == RPNMATH_ITEMKIND_CFOP) {
+      const rpnmath_item_cfop_t *cfop = (const rpnmath_item_cfop_t*)item;
+      if (cfop->operation == RPNMATH_CFOP_PHI) {
+        rpnmath_partial_forget_variable(partial, cfop->phi.target_var);
+      }
+      status = rpnmath_partial_structure(partial, cfop->operation, rpnmath_partial_before_if(stack, next));
+    }
+    pos = next;
+  }
+  partial->frame_count = index + 1;
+  partial->frames[index] = loop;
+  return status;
+}
+
+static int rpnmath_partial_while(rpnmath_partial_t *partial, const rpnmath_item_cfop_t *cfop, const rpnmath_stack_t *stack, size_t next) {
+  int status = rpnmath_partial_loop_assigns(partial, stack, next);
+  if (status != 0) {
+    return status;
+  }
+  
+  rpnmath_partial_materialize(partial);
+  rpnmath_partial_emit_cfop(partial, cfop);
+  rpnmath_partial_forget(partial);
+  rpnmath_partial_frame_t *frame = &partial->frames[partial->frame_count - 1];
+  frame->emitted = 1;
+  frame->start = rpnmath_partial_save(partial, &frame->start_count);
+  return 0;
+}
+
+// What is known after the end of a frame
+static void rpnmath_partial_merge(rpnmath_partial_t *partial, const rpnmath_partial_frame_t *frame) {
+  if (!frame->emitted) {
+    return;
+  }
+  if (frame->kind == RPNMATH_CFOP_LOOP) {
+    // The loop is left at its head
+    rpnmath_partial_restore(partial, frame->start, frame->start_count);
+    partial->returned = 0;
+  } else {
+    // The last part meets the first, or the path that skipped it
+    const rpnmath_value_t *other = frame->has_else ? frame->first : frame->start;
+    size_t other_count = frame->has_else ? frame->first_count : frame->start_count;
+    size_t other_depth = frame->has_else ? frame->first_depth : frame->depth;
+    int other_returned = frame->has_else && frame->first_returned;
+    if (partial->returned && !other_returned) {
+      rpnmath_partial_restore(partial, other, other_count);
+      partial->depth = other_depth;
+      partial->returned = 0;
+    } else if (!other_returned) {
+      rpnmath_partial_meet(partial, other, other_count);
+    }
+  }
+  partial->emitted = partial->depth;
+  rpnmath_partial_forget(partial);
+}
+
+// An end closes the frames from first (exclusive) down to last, innermost
+// first. It stays in the residual once when any of them is there, frames of
+// an elif chain after one in the residual are as well and share the end.
+static void rpnmath_partial_end(rpnmath_partial_t *partial, const rpnmath_item_cfop_t *cfop, size_t first, size_t last) {
+  int emitted = 0;
+  for (size_t i = last; i < first; i++) {
+    emitted |= partial->frames[i].emitted;
+  }
+  if (emitted) {
+    rpnmath_partial_materialize(partial);
+    rpnmath_partial_emit_cfop(partial, cfop);
+  }
+  for (size_t i = first; i-- > last;) {
+    rpnmath_partial_merge(partial, &partial->frames[i]);
+  }
+}
+
+static int rpnmath_partial_cfop(rpnmath_partial_t *partial, const rpnmath_stack_t *stack, size_t pos, size_t next) {
+  const char *item = stack->data + pos;
+  const rpnmath_item_cfop_t *cfop = (const rpnmath_item_cfop_t*)item;
+  size_t pops = (cfop->operation == RPNMATH_CFOP_IF || cfop->operation == RPNMATH_CFOP_LOOP) ? 1 : 0;
+  size_t frame_count = partial->frame_count;
+  
+  int status = rpnmath_partial_structure(partial, cfop->operation, rpnmath_partial_before_if(stack, next));
+  if (status != 0) {
+    return status;
+  }
+  
+  if (partial->skipping) {
+    // Dropped items only keep the structure, up to the part or end that
+    // continues the chain being skipped
+    if (partial->frame_count <= partial->skip) {
+      partial->skipping = 0;
+      rpnmath_partial_end(partial, cfop, partial->skip, partial->frame_count);
+    } else if (partial->frame_count == partial->skip + 1 && frame_count == partial->skip + 1 &&
+               (cfop->operation == RPNMATH_CFOP_ELSE || cfop->operation == RPNMATH_CFOP_ELIF) &&
+               !partial->frames[partial->skip].taken) {
+      partial->skipping = 0;
+    }
+    return 0;
+  }
+  if (partial->returned) {
+    // Nothing runs after ret up to the next part or end of a construct in
+    // the residual
+    int live = 0;
+    if (cfop->operation == RPNMATH_CFOP_ELSE || cfop->operation == RPNMATH_CFOP_ELIF) {
+      live = partial->frames[partial->frame_count - 1].emitted;
+    } else if (cfop->operation == RPNMATH_CFOP_END) {
+      for (size_t i = partial->frame_count; i < frame_count; i++) {
+        live |= partial->frames[i].emitted;
+      }
+    }
+    if (!live) {
+      return 0;
+    }
+  }
+  
+  if (rpnmath_partial_require(partial, rpnmath_cfop_name(cfop->operation), pops) != 0) {
+    return partial->context->error.status;
+  }
+  
+  switch (cfop->operation) {
+    case RPNMATH_CFOP_IF:
+      return rpnmath_partial_if(partial, cfop);
+    case RPNMATH_CFOP_ELIF:
+    case RPNMATH_CFOP_ELSE:
+      rpnmath_partial_else(partial, cfop);
+      return 0;
+    case RPNMATH_CFOP_WHILE:
+      return rpnmath_partial_while(partial, cfop, stack, next);
+    case RPNMATH_CFOP_LOOP:
+      rpnmath_partial_materialize(partial);
+      rpnmath_partial_emit_cfop(partial, cfop);
+      rpnmath_partial_pop(partial, 1);
+      return 0;
+    case RPNMATH_CFOP_END:
+      rpnmath_partial_end(partial, cfop, frame_count, partial->frame_count);
+      return 0;
+    case RPNMATH_CFOP_PHI: {
+      // The source variables are stored right after the item
+      size_t *sources = (size_t*)(item + sizeof(rpnmath_item_cfop_t));
+      rpnmath_partial_materialize(partial);
+      partial->failed |= rpnmath_stack_create_phi(partial->residual, cfop->phi.target_var, sources, cfop->phi.source_count) != 0;
+      rpnmath_partial_forget_variable(partial, cfop->phi.target_var);
+      return 0;
+    }
+    default:
+      // Nothing is known past anything else
+      rpnmath_partial_materialize(partial);
+      rpnmath_partial_emit_cfop(partial, cfop);
+      rpnmath_partial_restore(partial, NULL, 0);
+      rpnmath_partial_forget(partial);
+      return 0;
+  }
+}
+
+static int rpnmath_partial_vop(rpnmath_partial_t *partial, const rpnmath_item_vop_t *vop) {
+  size_t pops = (size_t)rpnmath_vop_arg_count(vop->operation, vop->argcount);
+  size_t pushes = (size_t)rpnmath_vop_return_count(vop->operation, vop->retcount);
+  if (vop->operation == RPNMATH_VOP_RET) {
+    pops = pops > 0 ? pops : 1;
+    pushes = 0;
+  }
+  
+  if (rpnmath_partial_require(partial, rpnmath_vop_name(vop->operation), pops) != 0) {
+    return partial->context->error.status;
+  }
+  
+  rpnmath_partial_materialize(partial);
+  rpnmath_item_vop_t copy = *vop;
+  partial->failed |= rpnmath_stack_pushvop(partial->residual, &copy) != 0;
+  
+  rpnmath_partial_pop(partial, pops);
+  for (size_t i = 0; i < pushes; i++) {
+    rpnmath_partial_push(partial, NULL);
+  }
+  partial->returned |= vop->operation == RPNMATH_VOP_RET;
+  return 0;
+}
+
+int rpnmath_partial_evaluate(const rpnmath_stack_t *stack, rpnmath_stack_t *residual, rpnmath_overflow_t overflow,
+                             rpnmath_rounding_t rounding, rpnmath_context_t *context) {
+  rpnmath_partial_t partial = {0};
+  partial.residual = residual;
+  partial.context = context;
+  partial.arena = context->arena;
+  partial.overflow = overflow;
+  partial.rounding = rounding;
+  
+  int status = 0;
+  size_t pos = rpnmath_stack_begin(stack);
+  while (status == 0 && !partial.failed && pos < stack->size) {
+    const char *item = stack->data + pos;
+    rpnmath_itemkind_t kind = *(const rpnmath_itemkind_t*)item;
+    size_t next = rpnmath_stack_next(stack, pos);
+    
+    if ((partial.skipping || partial.returned) && kind != RPNMATH_ITEMKIND_CFOP) {
+      // Part of an if the known condition does not take, or after ret
+    } else if (kind == RPNMATH_ITEMKIND_CONST) {
+      rpnmath_item_const_t view = rpnmath_stack_const_at(stack, pos);
+      rpnmath_value_t value;
+      rpnmath_value_from_const(&value, &view);
+      rpnmath_partial_push(&partial, &value);
+      
+    } else if (kind == RPNMATH_ITEMKIND_LREF) {
+      const rpnmath_item_localref_t *lref = (const rpnmath_item_localref_t*)item;
+      
+      // "$n =" stores, any other reference loads the current value
+      const rpnmath_item_op_t *following = (const rpnmath_item_op_t*)(stack->data + next);
+      if (next < stack->size && following->kind == RPNMATH_ITEMKIND_OP &&
+          following->operation == RPNMATH_OP_ASSIGN) {
+        status = rpnmath_partial_store(&partial, lref->variable_id);
+        next = rpnmath_stack_next(stack, next);
+      } else {
+        rpnmath_partial_load(&partial, lref->variable_id);
+      }
+      
+    } else if (kind == RPNMATH_ITEMKIND_OP) {
+      const rpnmath_item_op_t *op = (const rpnmath_item_op_t*)item;
+      if (op->operation == RPNMATH_OP_ASSIGN) {
+        // A valid assignment is always "$n =", which is handled above
+        status = rpnmath_context_fail_message(context, RPNMATH_STATUS_COMPILE, "Assignment target must be a local reference");
+      } else {
+        status = rpnmath_partial_op(&partial, op->operation);
+      }
+      
+    } else if (kind == RPNMATH_ITEMKIND_VOP) {
+      status = rpnmath_partial_vop(&partial, (const rpnmath_item_vop_t*)item);
+      
+    } else if (kind == RPNMATH_ITEMKIND_CFOP) {
+      status = rpnmath_partial_cfop(&partial, stack, pos, next);
+    }
+    
+    pos = next;
+  }
+  
+  if (status == 0 && !partial.failed && partial.frame_count) {
+    const rpnmath_partial_frame_t *frame = &partial.frames[partial.frame_count - 1];
+    const char *message = rpnmath_arena_printf(partial.arena, "Missing end for %s",
+                                               frame->waiting ? "elif" : rpnmath_cfop_name(frame->kind));
+    status = rpnmath_context_fail_message(context, RPNMATH_STATUS_COMPILE, message);
+  }
+  if (status == 0) {
+    rpnmath_partial_materialize(&partial);
+  }
+  if (status == 0 && partial.failed) {
+    status = rpnmath_context_fail(context, RPNMATH_STATUS_OUT_OF_MEMORY, 0);
+  }
+  return status;
+}
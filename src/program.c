@@ -0,0 +1,1482 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "type.h"
+#include "item.h"
+#include "value.h"
+#include "arena.h"
+#include "stack.h"
+#include "context.h"
+#include "program.h"
+#include "decimal.h"
+#include "exec.h"
+
+const char* rpnmath_engine_name(rpnmath_engine_t engine) {
+  switch (engine) {
+    case RPNMATH_ENGINE_SWITCH: return "switch";
+    case RPNMATH_ENGINE_THREADED: return "threaded";
+    case RPNMATH_ENGINE_REGISTER: return "register";
+    default: return "unknown";
+  }
+}
+
+const char* rpnmath_opcode_name(rpnmath_opcode_t opcode) {
+  switch (opcode) {
+    case RPNMATH_INSN_NOP: return "nop";
+    case RPNMATH_INSN_PUSH: return "push";
+    case RPNMATH_INSN_LOAD: return "load";
+    case RPNMATH_INSN_STORE: return "store";
+    case RPNMATH_INSN_ADD: return "add";
+    case RPNMATH_INSN_SUB: return "subtract";
+    case RPNMATH_INSN_MUL: return "multiply";
+    case RPNMATH_INSN_DIV: return "divide";
+    case RPNMATH_INSN_EQ: return "equal";
+    case RPNMATH_INSN_NE: return "not_equal";
+    case RPNMATH_INSN_LT: return "less_than";
+    case RPNMATH_INSN_LE: return "less_equal";
+    case RPNMATH_INSN_GT: return "greater_than";
+    case RPNMATH_INSN_GE: return "greater_equal";
+    case RPNMATH_INSN_SELECT: return "select";
+    case RPNMATH_INSN_MIN: return "minimum";
+    case RPNMATH_INSN_MAX: return "maximum";
+    case RPNMATH_INSN_ABS: return "absolute";
+    case RPNMATH_INSN_IF: return "if";
+    case RPNMATH_INSN_ELSE: return "else";
+    case RPNMATH_INSN_LOOP: return "loop";
+    case RPNMATH_INSN_END: return "end";
+    case RPNMATH_INSN_PHI: return "phi";
+    case RPNMATH_INSN_RET: return "return";
+    case RPNMATH_INSN_HALT: return "halt";
+    case RPNMATH_INSN_MOVE: return "move";
+    case RPNMATH_INSN_ADD_VC: return "add_var_const";
+    case RPNMATH_INSN_STORE_C: return "store_const";
+    case RPNMATH_INSN_IF_CMP: return "if_compare";
+#define RPNMATH_KERNEL_NAME(op, width, bits, ctype) case RPNMATH_INSN_##op##_##width: return #op "_" #width;
+    RPNMATH_KERNELS(RPNMATH_KERNEL_NAME)
+    RPNMATH_KERNELS_ADD_VC(RPNMATH_KERNEL_NAME)
+    RPNMATH_FLOAT_KERNELS(RPNMATH_KERNEL_NAME)
+    RPNMATH_FLOAT_COMPARES(RPNMATH_KERNEL_NAME)
+    RPNMATH_DECIMAL_KERNELS(RPNMATH_KERNEL_NAME)
+    RPNMATH_DECIMAL_COMPARES(RPNMATH_KERNEL_NAME)
+#undef RPNMATH_KERNEL_NAME
+    default: return "unknown";
+  }
+}
+
+const char* rpnmath_fusion_name(rpnmath_fusion_t fusion) {
+  switch (fusion) {
+    case RPNMATH_FUSION_ADD_VC: return "$n CONST +";
+    case RPNMATH_FUSION_STORE_C: return "CONST $n =";
+    case RPNMATH_FUSION_IF_CMP: return "compare if";
+    default: return "unknown";
+  }
+}
+
+// An if/elif/else chain or while loop that has not seen its end yet
+typedef struct rpnmath_compiler_frame {
+  rpnmath_cfop_t kind; // IF or ELSE for the part being compiled, WHILE before loop, LOOP in the body
+  size_t head;         // first block of the chain, or the loop block
+  size_t part;         // block of the part being compiled
+  size_t depth;        // operand stack depth when the construct was entered
+  size_t merge_depth;  // depth of the paths already waiting at the end, SIZE_MAX if none
+  int reachable;       // the construct was entered on a reachable path
+  int shares_end;      // "elif <cond> if", closed by the end of the enclosing chain
+                       // unless it turns out to be part of <cond>
+  int waiting;         // an elif of the chain waits for the if after its condition
+  int logic;           // the chain a && or || runs its right operand in
+} rpnmath_compiler_frame_t;
+
+// Marks of rpnmath_compiler_scan_logic, by stack position
+typedef enum rpnmath_logic_mark {
+  RPNMATH_LOGIC_NONE,
+  RPNMATH_LOGIC_AND, // the right operand of a && starts with this item
+  RPNMATH_LOGIC_OR,  // the right operand of a || starts with this item
+} rpnmath_logic_mark_t;
+
+// An if/elif/else chain or loop rpnmath_compiler_scan_logic is in
+typedef struct rpnmath_logic_scope {
+  int is_loop;
+  int shares_end;   // "elif <cond> if", closed by the end of the enclosing chain
+                    // unless it turns out to be part of <cond>
+  int waiting;      // an elif of the chain waits for the if after its condition
+  int has_else;
+  int entry_dead;   // entered after a ret
+  size_t base;      // values on the stack when entered
+  size_t low;       // fewest values on the stack in any part
+  size_t start;     // first item of the chain's results
+  size_t result;    // values at the end of a part that reached it, SIZE_MAX if none did
+} rpnmath_logic_scope_t;
+
+// Bookkeeping that only exists while a program is being compiled
+typedef struct rpnmath_compiler {
+  rpnmath_program_t *program;
+  rpnmath_arena_t *arena; // owns the program and the compiler's own arrays
+  size_t code_capacity;
+  size_t constant_capacity;
+  size_t phi_capacity;
+  size_t phi_source_capacity;
+  size_t phi_source_count;
+  size_t block_capacity;
+  size_t depth;      // operand stack depth after the last emitted instruction
+  int reachable;     // 0 after ret until the next merge point
+  rpnmath_compiler_frame_t *frames;
+  size_t frame_count;
+  size_t frame_capacity;
+  unsigned char *logic; // rpnmath_logic_mark_t by stack position, NULL without && and ||
+  size_t bools[2];   // constants false and true for the logic operators, SIZE_MAX until used
+  rpnmath_status_t status; // of the first failure, with the message in program->error
+} rpnmath_compiler_t;
+
+// Record why the program does not compile, message NULL when formatting it
+// ran out of memory. Only the first failure is kept. Returns -1 like every
+// failing step of the compiler.
+static int rpnmath_compiler_fail(rpnmath_compiler_t *compiler, rpnmath_status_t status, const char *message) {
+  if (compiler->status == RPNMATH_STATUS_OK) {
+    compiler->status = message ? status : RPNMATH_STATUS_OUT_OF_MEMORY;
+    compiler->program->error = message ? message : "Out of memory";
+  }
+  return -1;
+}
+
+// Grow a compile-time array so that it can hold at least count + 1 elements,
+// NULL when out of memory with array and capacity unchanged
+static void *rpnmath_compiler_grow(rpnmath_compiler_t *compiler, void *array, size_t count, size_t *capacity, size_t element_size) {
+  if (count < *capacity) {
+    return array;
+  }
+  
+  size_t new_capacity = *capacity ? *capacity * 2 : 16;
+  array = rpnmath_arena_grow(compiler->arena, array, *capacity * element_size, new_capacity * element_size);
+  if (!array) {
+    rpnmath_compiler_fail(compiler, RPNMATH_STATUS_OUT_OF_MEMORY, "Out of memory");
+    return NULL;
+  }
+  *capacity = new_capacity;
+  return array;
+}
+
+// Emit an instruction that pops `pops` values and pushes `pushes` values
+static int rpnmath_compiler_emit(rpnmath_compiler_t *compiler, rpnmath_opcode_t opcode, size_t operand, size_t pops, size_t pushes) {
+  rpnmath_program_t *program = compiler->program;
+  
+  if (compiler->depth < pops) {
+    return rpnmath_compiler_fail(compiler, RPNMATH_STATUS_COMPILE,
+                                 rpnmath_arena_printf(compiler->arena, "Not enough operands for operation %s (need %zu, have %zu)",
+                                                      rpnmath_opcode_name(opcode), pops, compiler->depth));
+  }
+  compiler->depth = compiler->depth - pops + pushes;
+  if (compiler->depth > program->max_depth) {
+    program->max_depth = compiler->depth;
+  }
+  
+  rpnmath_insn_t *code = rpnmath_compiler_grow(compiler, program->code, program->count, &compiler->code_capacity, sizeof(rpnmath_insn_t));
+  if (!code) {
+    return -1;
+  }
+  program->code = code;
+  program->code[program->count].opcode = opcode;
+  program->code[program->count].operand = operand;
+  program->code[program->count].operand2 = 0;
+  program->count++;
+  return 0;
+}
+
+static void rpnmath_compiler_use_variable(rpnmath_compiler_t *compiler, size_t var_id) {
+  if (var_id + 1 > compiler->program->variable_count) {
+    compiler->program->variable_count = var_id + 1;
+  }
+}
+
+static int rpnmath_compiler_const(rpnmath_compiler_t *compiler, const rpnmath_stack_t *stack, size_t pos) {
+  rpnmath_program_t *program = compiler->program;
+  rpnmath_item_const_t view = rpnmath_stack_const_at(stack, pos);
+  
+  rpnmath_value_t *constants = rpnmath_compiler_grow(compiler, program->constants, program->constant_count, &compiler->constant_capacity, sizeof(rpnmath_value_t));
+  if (!constants) {
+    return -1;
+  }
+  program->constants = constants;
+  rpnmath_value_t *constant = &program->constants[program->constant_count];
+  rpnmath_value_from_const(constant, &view);
+
+  // Limbs would point into the stack, the program may outlive its layout
+  if (rpnmath_type_has_limbs(&constant->type)) {
+    void *limbs = rpnmath_arena_alloc(compiler->arena, view.size);
+    if (!limbs) {
+      return rpnmath_compiler_fail(compiler, RPNMATH_STATUS_OUT_OF_MEMORY, "Out of memory");
+    }
+    memcpy(limbs, constant->limbs, view.size);
+    constant->limbs = limbs;
+  }
+
+  return rpnmath_compiler_emit(compiler, RPNMATH_INSN_PUSH, program->constant_count++, 0, 1);
+}
+
+// Push the 8 bit boolean 0 or 1, one constant each however often it is used
+static int rpnmath_compiler_bool(rpnmath_compiler_t *compiler, int value) {
+  rpnmath_program_t *program = compiler->program;
+  
+  if (compiler->bools[value] == SIZE_MAX) {
+    rpnmath_value_t *constants = rpnmath_compiler_grow(compiler, program->constants, program->constant_count, &compiler->constant_capacity, sizeof(rpnmath_value_t));
+    if (!constants) {
+      return -1;
+    }
+    program->constants = constants;
+    rpnmath_value_t *constant = &program->constants[program->constant_count];
+    memset(constant, 0, sizeof(*constant));
+    rpnmath_exec_compare(constant, value);
+    compiler->bools[value] = program->constant_count++;
+  }
+  
+  return rpnmath_compiler_emit(compiler, RPNMATH_INSN_PUSH, compiler->bools[value], 0, 1);
+}
+
+static int rpnmath_compiler_phi(rpnmath_compiler_t *compiler, const char *item) {
+  rpnmath_program_t *program = compiler->program;
+  const rpnmath_item_cfop_t *cfop = (const rpnmath_item_cfop_t*)item;
+  const size_t *sources = (const size_t*)(item + sizeof(rpnmath_item_cfop_t));
+  
+  rpnmath_phi_t *phis = rpnmath_compiler_grow(compiler, program->phis, program->phi_count, &compiler->phi_capacity, sizeof(rpnmath_phi_t));
+  if (!phis) {
+    return -1;
+  }
+  program->phis = phis;
+  rpnmath_phi_t *phi = &program->phis[program->phi_count];
+  phi->target_var = cfop->phi.target_var;
+  phi->first_source = compiler->phi_source_count;
+  phi->source_count = cfop->phi.source_count;
+  rpnmath_compiler_use_variable(compiler, phi->target_var);
+  
+  for (size_t i = 0; i < cfop->phi.source_count; i++) {
+    size_t *phi_sources = rpnmath_compiler_grow(compiler, program->phi_sources, compiler->phi_source_count, &compiler->phi_source_capacity, sizeof(size_t));
+    if (!phi_sources) {
+      return -1;
+    }
+    program->phi_sources = phi_sources;
+    program->phi_sources[compiler->phi_source_count++] = sources[i];
+    rpnmath_compiler_use_variable(compiler, sources[i]);
+  }
+  
+  return rpnmath_compiler_emit(compiler, RPNMATH_INSN_PHI, program->phi_count++, 0, 0);
+}
+
+// Returns the id of the new block, SIZE_MAX when out of memory
+static size_t rpnmath_compiler_block(rpnmath_compiler_t *compiler, size_t parent_block, int is_loop) {
+  rpnmath_program_t *program = compiler->program;
+  
+  rpnmath_block_t *blocks = rpnmath_compiler_grow(compiler, program->blocks, program->block_count, &compiler->block_capacity, sizeof(rpnmath_block_t));
+  if (!blocks) {
+    return SIZE_MAX;
+  }
+  program->blocks = blocks;
+  rpnmath_block_t *block = &program->blocks[program->block_count];
+  block->parent_block = parent_block;
+  block->start_pos = program->count;
+  block->next_pos = SIZE_MAX;
+  block->next_block = parent_block;
+  block->end_pos = SIZE_MAX;
+  block->depth = compiler->depth;
+  block->end_depth = compiler->depth;
+  block->is_loop = is_loop;
+  return program->block_count++;
+}
+
+static size_t rpnmath_compiler_current_block(rpnmath_compiler_t *compiler) {
+  return compiler->frame_count ? compiler->frames[compiler->frame_count - 1].part : 0;
+}
+
+// NULL when out of memory
+static rpnmath_compiler_frame_t *rpnmath_compiler_open(rpnmath_compiler_t *compiler, rpnmath_cfop_t kind, size_t block) {
+  rpnmath_compiler_frame_t *frames = rpnmath_compiler_grow(compiler, compiler->frames, compiler->frame_count, &compiler->frame_capacity, sizeof(rpnmath_compiler_frame_t));
+  if (!frames) {
+    return NULL;
+  }
+  compiler->frames = frames;
+  rpnmath_compiler_frame_t *frame = &compiler->frames[compiler->frame_count++];
+  frame->kind = kind;
+  frame->head = block;
+  frame->part = block;
+  frame->depth = compiler->depth;
+  frame->merge_depth = SIZE_MAX;
+  frame->reachable = compiler->reachable;
+  frame->shares_end = 0;
+  frame->waiting = 0;
+  frame->logic = 0;
+  return frame;
+}
+
+// The innermost open construct, when it is one of kind (or kind2)
+static rpnmath_compiler_frame_t *rpnmath_compiler_top(rpnmath_compiler_t *compiler, const char *name, rpnmath_cfop_t kind, rpnmath_cfop_t kind2) {
+  rpnmath_compiler_frame_t *frame = compiler->frame_count ? &compiler->frames[compiler->frame_count - 1] : NULL;
+  if (!frame || (frame->kind != kind && frame->kind != kind2)) {
+    rpnmath_compiler_fail(compiler, RPNMATH_STATUS_COMPILE,
+                          rpnmath_arena_printf(compiler->arena, "%s without a matching %s", name, rpnmath_cfop_name(kind)));
+    return NULL;
+  }
+  return frame;
+}
+
+// The condition of an elif can hold constructs of its own, so an if right
+// after the elif is not necessarily the one it waits for. A construct that
+// ended inside the condition, leaving depth values, belongs to it when it
+// leaves the one value the condition is for (chain_depth + 1) and either
+// the chain's other parts leave a different depth or an if follows at once.
+// depth is SIZE_MAX when the end is unreachable.
+static int rpnmath_elif_condition(size_t chain_depth, size_t merge_depth, size_t depth, int before_if) {
+  return depth == chain_depth + 1 && ((merge_depth != SIZE_MAX && merge_depth != depth) || before_if);
+}
+
+// Every path reaching the end of a chain has to agree on the stack depth
+static int rpnmath_compiler_merge(rpnmath_compiler_t *compiler, rpnmath_compiler_frame_t *frame) {
+  if (!compiler->reachable) {
+    return 0;
+  }
+  if (frame->merge_depth == SIZE_MAX) {
+    frame->merge_depth = compiler->depth;
+  } else if (frame->merge_depth != compiler->depth) {
+    return rpnmath_compiler_fail(compiler, RPNMATH_STATUS_COMPILE,
+                                 rpnmath_arena_printf(compiler->arena, "Branches leave different stack depths (%zu and %zu)",
+                                                      frame->merge_depth, compiler->depth));
+  }
+  return 0;
+}
+
+static int rpnmath_compiler_if(rpnmath_compiler_t *compiler) {
+  int after_elif = compiler->frame_count && compiler->frames[compiler->frame_count - 1].waiting;
+  size_t block = rpnmath_compiler_block(compiler, rpnmath_compiler_current_block(compiler), 0);
+  if (block == SIZE_MAX || rpnmath_compiler_emit(compiler, RPNMATH_INSN_IF, block, 1, 0) != 0) {
+    return -1;
+  }
+  compiler->program->blocks[block].start_pos = compiler->program->count;
+  compiler->program->blocks[block].depth = compiler->depth;
+  
+  rpnmath_compiler_frame_t *frame = rpnmath_compiler_open(compiler, RPNMATH_CFOP_IF, block);
+  if (!frame) {
+    return -1;
+  }
+  frame->shares_end = after_elif;
+  return 0;
+}
+
+// "else" and "elif" both end the taken part and open the next one
+static int rpnmath_compiler_else(rpnmath_compiler_t *compiler, rpnmath_cfop_t operation) {
+  rpnmath_program_t *program = compiler->program;
+  rpnmath_compiler_frame_t *frame = rpnmath_compiler_top(compiler, rpnmath_cfop_name(operation), RPNMATH_CFOP_IF, RPNMATH_CFOP_IF);
+  if (!frame || rpnmath_compiler_merge(compiler, frame) != 0 ||
+      rpnmath_compiler_emit(compiler, RPNMATH_INSN_ELSE, frame->head, 0, 0) != 0) {
+    return -1;
+  }
+  
+  compiler->depth = frame->depth;
+  size_t part = rpnmath_compiler_block(compiler, program->blocks[frame->head].parent_block, 0);
+  if (part == SIZE_MAX) {
+    return -1;
+  }
+  program->blocks[frame->part].next_pos = program->count;
+  program->blocks[frame->part].next_block = part;
+  
+  frame->kind = RPNMATH_CFOP_ELSE;
+  frame->part = part;
+  compiler->reachable = frame->reachable;
+  frame->waiting = operation == RPNMATH_CFOP_ELIF;
+  return 0;
+}
+
+static int rpnmath_compiler_while(rpnmath_compiler_t *compiler) {
+  size_t block = rpnmath_compiler_block(compiler, rpnmath_compiler_current_block(compiler), 1);
+  if (block == SIZE_MAX || !rpnmath_compiler_open(compiler, RPNMATH_CFOP_WHILE, block)) {
+    return -1;
+  }
+  return 0;
+}
+
+static int rpnmath_compiler_loop(rpnmath_compiler_t *compiler) {
+  rpnmath_compiler_frame_t *frame = rpnmath_compiler_top(compiler, "loop", RPNMATH_CFOP_WHILE, RPNMATH_CFOP_WHILE);
+  if (!frame || rpnmath_compiler_emit(compiler, RPNMATH_INSN_LOOP, frame->head, 1, 0) != 0) {
+    return -1;
+  }
+  if (compiler->depth != frame->depth) {
+    return rpnmath_compiler_fail(compiler, RPNMATH_STATUS_COMPILE, "Loop condition has to leave exactly one value");
+  }
+  frame->kind = RPNMATH_CFOP_LOOP;
+  return 0;
+}
+
+// before_if: the next item is an if
+static int rpnmath_compiler_end(rpnmath_compiler_t *compiler, int before_if) {
+  rpnmath_program_t *program = compiler->program;
+  rpnmath_compiler_frame_t *frame = compiler->frame_count ? &compiler->frames[compiler->frame_count - 1] : NULL;
+  if (!frame || frame->kind == RPNMATH_CFOP_WHILE) {
+    return rpnmath_compiler_fail(compiler, RPNMATH_STATUS_COMPILE,
+                                 frame ? "end without a matching loop" : "end without a matching if or while");
+  }
+  size_t end_pos = program->count;
+  
+  if (frame->kind == RPNMATH_CFOP_LOOP) {
+    if (compiler->reachable && compiler->depth != frame->depth) {
+      return rpnmath_compiler_fail(compiler, RPNMATH_STATUS_COMPILE, "Loop body has to leave the stack as it found it");
+    }
+    program->blocks[frame->head].end_pos = end_pos;
+    compiler->depth = frame->depth;
+    compiler->reachable = frame->reachable;
+    compiler->frame_count--;
+    return rpnmath_compiler_emit(compiler, RPNMATH_INSN_END, frame->head, 0, 0);
+  }
+  
+  // Close the chain, and the chains it continues through elif
+  size_t head;
+  for (;;) {
+    frame = &compiler->frames[compiler->frame_count - 1];
+    if (rpnmath_compiler_merge(compiler, frame) != 0) {
+      return -1;
+    }
+    if (frame->kind == RPNMATH_CFOP_IF) {
+      // Without else a false condition goes straight to the end
+      program->blocks[frame->part].next_pos = end_pos;
+      program->blocks[frame->part].next_block = program->blocks[frame->head].parent_block;
+      compiler->depth = frame->depth;
+      compiler->reachable = frame->reachable;
+      if (rpnmath_compiler_merge(compiler, frame) != 0) {
+        return -1;
+      }
+    }
+    
+    program->blocks[frame->head].end_pos = end_pos;
+    compiler->reachable = frame->merge_depth != SIZE_MAX;
+    compiler->depth = compiler->reachable ? frame->merge_depth : frame->depth;
+    program->blocks[frame->head].end_depth = compiler->depth;
+    head = frame->head;
+    compiler->frame_count--;
+    
+    if (!frame->shares_end) {
+      break;
+    }
+    // A construct in the condition of an elif leaves the elif waiting
+    const rpnmath_compiler_frame_t *chain = &compiler->frames[compiler->frame_count - 1];
+    if (rpnmath_elif_condition(chain->depth, chain->merge_depth, compiler->reachable ? compiler->depth : SIZE_MAX, before_if)) {
+      break;
+    }
+  }
+  
+  return rpnmath_compiler_emit(compiler, RPNMATH_INSN_END, head, 0, 0);
+}
+
+static int rpnmath_compiler_cfop(rpnmath_compiler_t *compiler, const char *item, int before_if) {
+  const rpnmath_item_cfop_t *cfop = (const rpnmath_item_cfop_t*)item;
+  
+  // The condition may hold whole constructs, but nothing of the chain itself
+  if (compiler->frame_count && compiler->frames[compiler->frame_count - 1].waiting &&
+      cfop->operation != RPNMATH_CFOP_IF && cfop->operation != RPNMATH_CFOP_WHILE && cfop->operation != RPNMATH_CFOP_PHI) {
+    return rpnmath_compiler_fail(compiler, RPNMATH_STATUS_COMPILE, "elif has to be followed by a condition and if");
+  }
+  
+  switch (cfop->operation) {
+    case RPNMATH_CFOP_IF: return rpnmath_compiler_if(compiler);
+    case RPNMATH_CFOP_ELIF:
+    case RPNMATH_CFOP_ELSE: return rpnmath_compiler_else(compiler, cfop->operation);
+    case RPNMATH_CFOP_WHILE: return rpnmath_compiler_while(compiler);
+    case RPNMATH_CFOP_LOOP: return rpnmath_compiler_loop(compiler);
+    case RPNMATH_CFOP_END: return rpnmath_compiler_end(compiler, before_if);
+    case RPNMATH_CFOP_PHI: return rpnmath_compiler_phi(compiler, item);
+    default:
+      return rpnmath_compiler_fail(compiler, RPNMATH_STATUS_COMPILE,
+                                   rpnmath_arena_printf(compiler->arena, "Control flow operation %s not supported",
+                                                        rpnmath_cfop_name(cfop->operation)));
+  }
+}
+
+// "L R &&" compiles to "L if R 0 != else 0 end" and "L R ||" to
+// "L if 1 else R 0 != end", so R only runs when L does not decide. The if
+// goes in before R's first item, which rpnmath_compiler_scan_logic found.
+// An elif waiting for the if of its condition keeps waiting.
+static int rpnmath_compiler_logic_open(rpnmath_compiler_t *compiler, rpnmath_logic_mark_t mark) {
+  int status = rpnmath_compiler_if(compiler);
+  if (status == 0) {
+    compiler->frames[compiler->frame_count - 1].shares_end = 0;
+    compiler->frames[compiler->frame_count - 1].logic = 1;
+    if (mark == RPNMATH_LOGIC_OR) {
+      status = rpnmath_compiler_bool(compiler, 1) != 0 || rpnmath_compiler_else(compiler, RPNMATH_CFOP_ELSE) != 0 ? -1 : 0;
+    }
+  }
+  return status;
+}
+
+static int rpnmath_compiler_logic_close(rpnmath_compiler_t *compiler, rpnmath_op_t operation) {
+  rpnmath_compiler_frame_t *frame = compiler->frame_count ? &compiler->frames[compiler->frame_count - 1] : NULL;
+  if (!frame || !frame->logic) {
+    return rpnmath_compiler_fail(compiler, RPNMATH_STATUS_COMPILE,
+                                 operation == RPNMATH_OP_AND ? "The right operand of && has to end in the part it starts in" :
+                                                               "The right operand of || has to end in the part it starts in");
+  }
+  
+  return rpnmath_compiler_bool(compiler, 0) != 0 ||
+         rpnmath_compiler_emit(compiler, RPNMATH_INSN_NE, 0, 2, 1) != 0 ||
+         (operation == RPNMATH_OP_AND && (rpnmath_compiler_else(compiler, RPNMATH_CFOP_ELSE) != 0 ||
+                                          rpnmath_compiler_bool(compiler, 0) != 0)) ||
+         rpnmath_compiler_end(compiler, 0) != 0 ? -1 : 0;
+}
+
+// Whether the item at pos is an if, 0 past the last item
+static int rpnmath_compiler_is_if(const rpnmath_stack_t *stack, size_t pos) {
+  const rpnmath_item_cfop_t *cfop = (const rpnmath_item_cfop_t*)(stack->data + pos);
+  return pos < stack->size && cfop->kind == RPNMATH_ITEMKIND_CFOP && cfop->operation == RPNMATH_CFOP_IF;
+}
+
+static size_t rpnmath_logic_join(size_t start, size_t other) {
+  return start == SIZE_MAX || other == SIZE_MAX ? SIZE_MAX : start < other ? start : other;
+}
+
+// Find where the right operands of && and || start. Follows every value on
+// the stack back to the first item computing it: the first of its operands,
+// or for the results of an if/else chain its condition or the deepest value
+// one of its parts took. Loops leave the stack as they found it. Everything
+// from that item to the operator is the right-hand clause, including the
+// stores in between. Returns -1 when out of memory.
+static int rpnmath_compiler_scan_logic(rpnmath_compiler_t *compiler, const rpnmath_stack_t *stack) {
+  size_t *starts = NULL; // position of the first item of each value, SIZE_MAX if unknown
+  size_t count = 0, capacity = 0;
+  rpnmath_logic_scope_t *scopes = NULL;
+  size_t scope_count = 0, scope_capacity = 0;
+  int dead = 0; // after a ret, until its part ends
+  
+  for (size_t pos = rpnmath_stack_begin(stack); pos < stack->size; pos = rpnmath_stack_next(stack, pos)) {
+    const char *item = stack->data + pos;
+    rpnmath_itemkind_t kind = *(const rpnmath_itemkind_t*)item;
+    size_t pops = 0, pushes = 0;
+    rpnmath_cfop_t cfop = RPNMATH_CFOP_MERGE;
+    
+    if (kind == RPNMATH_ITEMKIND_CONST) {
+      pushes = 1;
+    } else if (kind == RPNMATH_ITEMKIND_LREF) {
+      size_t next = rpnmath_stack_next(stack, pos);
+      const rpnmath_item_op_t *following = (const rpnmath_item_op_t*)(stack->data + next);
+      if (next < stack->size && following->kind == RPNMATH_ITEMKIND_OP &&
+          following->operation == RPNMATH_OP_ASSIGN) {
+        pops = 1;
+        pos = next;
+      } else {
+        pushes = 1;
+      }
+    } else if (kind == RPNMATH_ITEMKIND_OP) {
+      rpnmath_op_t operation = ((const rpnmath_item_op_t*)item)->operation;
+      pops = (size_t)rpnmath_op_arg_count(operation);
+      pushes = (size_t)rpnmath_op_return_count(operation);
+      if ((operation == RPNMATH_OP_AND || operation == RPNMATH_OP_OR) && count && starts[count - 1] != SIZE_MAX) {
+        if (!compiler->logic) {
+          compiler->logic = rpnmath_arena_alloc(compiler->arena, stack->size);
+          if (!compiler->logic) {
+            return rpnmath_compiler_fail(compiler, RPNMATH_STATUS_OUT_OF_MEMORY, "Out of memory");
+          }
+        }
+        compiler->logic[starts[count - 1]] = operation == RPNMATH_OP_AND ? RPNMATH_LOGIC_AND : RPNMATH_LOGIC_OR;
+      }
+    } else if (kind == RPNMATH_ITEMKIND_VOP) {
+      const rpnmath_item_vop_t *vop = (const rpnmath_item_vop_t*)item;
+      size_t arg_count = (size_t)rpnmath_vop_arg_count(vop->operation, vop->argcount);
+      pops = arg_count > 0 ? arg_count : 1;
+      dead = 1;
+    } else if (kind == RPNMATH_ITEMKIND_CFOP) {
+      cfop = ((const rpnmath_item_cfop_t*)item)->operation;
+      pops = cfop == RPNMATH_CFOP_IF || cfop == RPNMATH_CFOP_LOOP;
+    }
+    
+    // A result starts with its first operand. A part taking values from
+    // below its chain makes them part of the chain's results.
+    size_t start = pos;
+    for (size_t i = 0; i < pops; i++) {
+      size_t operand = count ? starts[--count] : SIZE_MAX;
+      start = rpnmath_logic_join(start, operand);
+      for (size_t j = 0; j < scope_count; j++) {
+        if (count < scopes[j].low) {
+          scopes[j].low = count;
+          scopes[j].start = rpnmath_logic_join(scopes[j].start, operand);
+        }
+      }
+    }
+    for (size_t i = 0; i < pushes; i++) {
+      size_t *grown = rpnmath_compiler_grow(compiler, starts, count, &capacity, sizeof(size_t));
+      if (!grown) {
+        return -1;
+      }
+      starts = grown;
+      starts[count++] = start;
+    }
+    
+    if (cfop == RPNMATH_CFOP_IF || cfop == RPNMATH_CFOP_WHILE) {
+      int after_elif = cfop == RPNMATH_CFOP_IF && scope_count && scopes[scope_count - 1].waiting;
+      rpnmath_logic_scope_t *grown = rpnmath_compiler_grow(compiler, scopes, scope_count, &scope_capacity, sizeof(rpnmath_logic_scope_t));
+      if (!grown) {
+        return -1;
+      }
+      scopes = grown;
+      rpnmath_logic_scope_t *scope = &scopes[scope_count++];
+      scope->is_loop = cfop == RPNMATH_CFOP_WHILE;
+      scope->shares_end = after_elif;
+      scope->waiting = 0;
+      scope->has_else = 0;
+      scope->entry_dead = dead;
+      scope->base = scope->low = count;
+      scope->start = start; // the condition's
+      scope->result = SIZE_MAX;
+    } else if ((cfop == RPNMATH_CFOP_ELSE || cfop == RPNMATH_CFOP_ELIF) && scope_count && !scopes[scope_count - 1].is_loop) {
+      rpnmath_logic_scope_t *scope = &scopes[scope_count - 1];
+      if (!dead) scope->result = count;
+      count = scope->base;
+      dead = scope->entry_dead;
+      scope->has_else = 1;
+      scope->waiting = cfop == RPNMATH_CFOP_ELIF;
+    } else if (cfop == RPNMATH_CFOP_END) {
+      // Close the chain, and the chains it continues through elif
+      while (scope_count) {
+        rpnmath_logic_scope_t *scope = &scopes[--scope_count];
+        if (scope->is_loop) {
+          count = scope->base;
+          dead = scope->entry_dead;
+          break;
+        }
+        if (!dead) scope->result = count;
+        count = scope->result != SIZE_MAX ? scope->result : scope->base;
+        for (size_t i = scope->low; i < count; i++) {
+          starts[i] = scope->start;
+        }
+        dead = scope->entry_dead || (scope->result == SIZE_MAX && scope->has_else);
+        if (!scope->shares_end ||
+            rpnmath_elif_condition(scopes[scope_count - 1].base, scopes[scope_count - 1].result, dead ? SIZE_MAX : count,
+                                   rpnmath_compiler_is_if(stack, rpnmath_stack_next(stack, pos)))) {
+          break;
+        }
+      }
+    }
+  }
+  return 0;
+}
+
+static int rpnmath_compiler_op(rpnmath_compiler_t *compiler, rpnmath_op_t operation) {
+  switch (operation) {
+    case RPNMATH_OP_ADD: return rpnmath_compiler_emit(compiler, RPNMATH_INSN_ADD, 0, 2, 1);
+    case RPNMATH_OP_SUB: return rpnmath_compiler_emit(compiler, RPNMATH_INSN_SUB, 0, 2, 1);
+    case RPNMATH_OP_MUL: return rpnmath_compiler_emit(compiler, RPNMATH_INSN_MUL, 0, 2, 1);
+    case RPNMATH_OP_DIV: return rpnmath_compiler_emit(compiler, RPNMATH_INSN_DIV, 0, 2, 1);
+    case RPNMATH_OP_EQ: return rpnmath_compiler_emit(compiler, RPNMATH_INSN_EQ, 0, 2, 1);
+    case RPNMATH_OP_NE: return rpnmath_compiler_emit(compiler, RPNMATH_INSN_NE, 0, 2, 1);
+    case RPNMATH_OP_LT: return rpnmath_compiler_emit(compiler, RPNMATH_INSN_LT, 0, 2, 1);
+    case RPNMATH_OP_LE: return rpnmath_compiler_emit(compiler, RPNMATH_INSN_LE, 0, 2, 1);
+    case RPNMATH_OP_GT: return rpnmath_compiler_emit(compiler, RPNMATH_INSN_GT, 0, 2, 1);
+    case RPNMATH_OP_GE: return rpnmath_compiler_emit(compiler, RPNMATH_INSN_GE, 0, 2, 1);
+    case RPNMATH_OP_SELECT: return rpnmath_compiler_emit(compiler, RPNMATH_INSN_SELECT, 0, 3, 1);
+    case RPNMATH_OP_MIN: return rpnmath_compiler_emit(compiler, RPNMATH_INSN_MIN, 0, 2, 1);
+    case RPNMATH_OP_MAX: return rpnmath_compiler_emit(compiler, RPNMATH_INSN_MAX, 0, 2, 1);
+    case RPNMATH_OP_ABS: return rpnmath_compiler_emit(compiler, RPNMATH_INSN_ABS, 0, 1, 1);
+    case RPNMATH_OP_AND:
+    case RPNMATH_OP_OR: return rpnmath_compiler_logic_close(compiler, operation);
+    case RPNMATH_OP_NOT: return rpnmath_compiler_bool(compiler, 0) != 0 ? -1 : rpnmath_compiler_emit(compiler, RPNMATH_INSN_EQ, 0, 2, 1);
+    case RPNMATH_OP_ASSIGN:
+      // A valid assignment is always "$n =", which is folded into STORE
+      return rpnmath_compiler_fail(compiler, RPNMATH_STATUS_COMPILE, "Assignment target must be a local reference");
+    default:
+      return rpnmath_compiler_fail(compiler, RPNMATH_STATUS_COMPILE, "Unknown operation");
+  }
+}
+
+static int rpnmath_is_compare(rpnmath_opcode_t opcode) {
+  return opcode >= RPNMATH_INSN_EQ && opcode <= RPNMATH_INSN_GE;
+}
+
+// Widths tracked by type inference: 0 while a position is not reached yet,
+// the bit width when every path agrees on it, RPNMATH_WIDTH_UNKNOWN otherwise.
+// Decimals with 64 bit mantissas (RPNMATH_WIDTH_D64 + scale) and floats have
+// codes of their own above every integer width.
+#define RPNMATH_WIDTH_D64 0xC0
+#define RPNMATH_WIDTH_F32 0xF0
+#define RPNMATH_WIDTH_F64 0xF1
+#define RPNMATH_WIDTH_UNKNOWN 0xFF
+
+static unsigned char rpnmath_width_of(const rpnmath_type_t *type) {
+  if (type->kind == RPNMATH_TYPEKIND_INT &&
+      (type->size == 8 || type->size == 16 || type->size == 32 || type->size == 64 ||
+       (RPNMATH_INT128 && type->size == 128))) {
+    return (unsigned char)type->size;
+  }
+  if (type->kind == RPNMATH_TYPEKIND_FLOAT) {
+    return type->size == 32 ? RPNMATH_WIDTH_F32 : RPNMATH_WIDTH_F64;
+  }
+  if (type->kind == RPNMATH_TYPEKIND_DECIMAL && type->size == 64) {
+    return (unsigned char)(RPNMATH_WIDTH_D64 + type->scale);
+  }
+  return RPNMATH_WIDTH_UNKNOWN;
+}
+
+static int rpnmath_width_is_float(unsigned char width) {
+  return width == RPNMATH_WIDTH_F32 || width == RPNMATH_WIDTH_F64;
+}
+
+static int rpnmath_width_is_decimal(unsigned char width) {
+  return width >= RPNMATH_WIDTH_D64 && width <= RPNMATH_WIDTH_D64 + RPNMATH_DECIMAL_MAX_SCALE;
+}
+
+// Scale of a decimal width, 0 for integers
+static size_t rpnmath_width_scale(unsigned char width) {
+  return rpnmath_width_is_decimal(width) ? (size_t)(width - RPNMATH_WIDTH_D64) : 0;
+}
+
+static unsigned char rpnmath_width_join(unsigned char a, unsigned char b) {
+  if (a == 0) return b;
+  if (b == 0 || a == b) return a;
+  return RPNMATH_WIDTH_UNKNOWN;
+}
+
+// Mixed integer and float operands make a float like in C. The float
+// kernels convert integers of up to 64 bits, wider ones stay generic.
+// Decimals take the larger scale and mix with integers of up to 64 bits.
+static unsigned char rpnmath_width_arith(unsigned char left, unsigned char right) {
+  if (left == RPNMATH_WIDTH_UNKNOWN || right == RPNMATH_WIDTH_UNKNOWN) {
+    return RPNMATH_WIDTH_UNKNOWN;
+  }
+  if (rpnmath_width_is_decimal(left) || rpnmath_width_is_decimal(right)) {
+    unsigned char l = left <= 64 ? RPNMATH_WIDTH_D64 : left;
+    unsigned char r = right <= 64 ? RPNMATH_WIDTH_D64 : right;
+    if (!rpnmath_width_is_decimal(l) || !rpnmath_width_is_decimal(r)) {
+      return RPNMATH_WIDTH_UNKNOWN;
+    }
+    return l > r ? l : r;
+  }
+  if (rpnmath_width_is_float(left) || rpnmath_width_is_float(right)) {
+    if (left == 128 || right == 128) {
+      return RPNMATH_WIDTH_UNKNOWN;
+    }
+    return left == RPNMATH_WIDTH_F64 || right == RPNMATH_WIDTH_F64 ? RPNMATH_WIDTH_F64 : RPNMATH_WIDTH_F32;
+  }
+  return left > right ? left : right;
+}
+
+// Kernel of a generic ADD, SUB or MUL for a known width
+static rpnmath_opcode_t rpnmath_kernel_opcode(rpnmath_opcode_t opcode, unsigned char width) {
+  size_t index = width == 8 ? 0 : width == 16 ? 1 : width == 32 ? 2 : width == 64 ? 3 : 4;
+  switch (opcode) {
+    case RPNMATH_INSN_ADD: return (rpnmath_opcode_t)(RPNMATH_INSN_ADD_I8 + index);
+    case RPNMATH_INSN_SUB: return (rpnmath_opcode_t)(RPNMATH_INSN_SUB_I8 + index);
+    case RPNMATH_INSN_MUL: return (rpnmath_opcode_t)(RPNMATH_INSN_MUL_I8 + index);
+    default: return opcode;
+  }
+}
+
+// Float kernel of a generic arithmetic or comparison opcode
+static rpnmath_opcode_t rpnmath_float_opcode(rpnmath_opcode_t opcode, unsigned char width) {
+  size_t index = width == RPNMATH_WIDTH_F64;
+  switch (opcode) {
+    case RPNMATH_INSN_ADD: return (rpnmath_opcode_t)(RPNMATH_INSN_ADD_F32 + index);
+    case RPNMATH_INSN_SUB: return (rpnmath_opcode_t)(RPNMATH_INSN_SUB_F32 + index);
+    case RPNMATH_INSN_MUL: return (rpnmath_opcode_t)(RPNMATH_INSN_MUL_F32 + index);
+    case RPNMATH_INSN_DIV: return (rpnmath_opcode_t)(RPNMATH_INSN_DIV_F32 + index);
+    default: return (rpnmath_opcode_t)(RPNMATH_INSN_EQ_F + (opcode - RPNMATH_INSN_EQ));
+  }
+}
+
+// Decimal kernel of a generic arithmetic or comparison opcode, and the
+// layout aligning the scales of its operands
+static rpnmath_opcode_t rpnmath_decimal_opcode(rpnmath_opcode_t opcode) {
+  if (opcode >= RPNMATH_INSN_EQ) {
+    return (rpnmath_opcode_t)(RPNMATH_INSN_EQ_D64 + (opcode - RPNMATH_INSN_EQ));
+  }
+  return (rpnmath_opcode_t)(RPNMATH_INSN_ADD_D64 + (opcode - RPNMATH_INSN_ADD));
+}
+
+static size_t rpnmath_decimal_layout(rpnmath_opcode_t opcode, unsigned char left, unsigned char right, unsigned char width,
+                                     rpnmath_rounding_t rounding) {
+  size_t l = rpnmath_width_scale(left);
+  size_t r = rpnmath_width_scale(right);
+  size_t scale = rpnmath_width_scale(width);
+  switch (opcode) {
+    case RPNMATH_INSN_MUL: return RPNMATH_DECIMAL_LAYOUT(0, l + r - scale, scale, rounding);
+    case RPNMATH_INSN_DIV: return RPNMATH_DECIMAL_LAYOUT(scale + r - l, 0, scale, rounding);
+    default: return RPNMATH_DECIMAL_LAYOUT(scale - l, scale - r, scale, rounding);
+  }
+}
+
+static int rpnmath_is_add(rpnmath_opcode_t opcode) {
+  return opcode == RPNMATH_INSN_ADD || (opcode >= RPNMATH_INSN_ADD_I8 && opcode < RPNMATH_INSN_ADD_I8 + RPNMATH_KERNEL_WIDTH_COUNT);
+}
+
+// Type inference: finds the width of every stack slot and variable at every
+// position by iterating over the control flow graph until nothing changes,
+// then gives ADD, SUB and MUL with two operands of known width their kernel.
+// Arithmetic and comparisons involving a float get a float kernel, which
+// also settles how integer operands are promoted, those involving a decimal
+// a decimal kernel with the scales aligned. Variables start out
+// unknown as the context may hold them already. Under the promote policy
+// integer arithmetic results have no width known ahead of time.
+static void rpnmath_program_infer(rpnmath_program_t *program, rpnmath_arena_t *arena) {
+  if (program->count == 0) {
+    return;
+  }
+  size_t stride = program->max_depth + program->variable_count;
+  size_t *depths = rpnmath_arena_alloc(arena, program->count * sizeof(size_t));
+  unsigned char *widths = rpnmath_arena_alloc(arena, (program->count + 1) * stride);
+  if (!depths || !widths) {
+    return;
+  }
+  unsigned char *state = widths + program->count * stride; // scratch for the position being visited
+  
+  for (size_t pc = 0; pc < program->count; pc++) {
+    depths[pc] = SIZE_MAX;
+  }
+  depths[0] = 0;
+  memset(widths + program->max_depth, RPNMATH_WIDTH_UNKNOWN, program->variable_count);
+  
+  int changed = 1;
+  while (changed) {
+    changed = 0;
+    for (size_t pc = 0; pc < program->count; pc++) {
+      if (depths[pc] == SIZE_MAX) {
+        continue;
+      }
+      
+      const rpnmath_insn_t *insn = &program->code[pc];
+      const rpnmath_block_t *blocks = program->blocks;
+      unsigned char *slots = state;
+      unsigned char *variables = state + program->max_depth;
+      size_t depth = depths[pc];
+      size_t successors[2] = {pc + 1, SIZE_MAX};
+      memcpy(state, widths + pc * stride, stride);
+      
+      switch (insn->opcode) {
+        case RPNMATH_INSN_PUSH:
+          slots[depth++] = rpnmath_width_of(&program->constants[insn->operand].type);
+          break;
+        case RPNMATH_INSN_LOAD:
+          slots[depth++] = variables[insn->operand];
+          break;
+        case RPNMATH_INSN_STORE:
+          variables[insn->operand] = slots[--depth];
+          break;
+        case RPNMATH_INSN_ADD:
+        case RPNMATH_INSN_SUB:
+        case RPNMATH_INSN_MUL:
+        case RPNMATH_INSN_DIV: {
+          depth--;
+          unsigned char width = rpnmath_width_arith(slots[depth - 1], slots[depth]);
+          slots[depth - 1] = program->overflow == RPNMATH_OVERFLOW_PROMOTE && !rpnmath_width_is_float(width) ?
+                             RPNMATH_WIDTH_UNKNOWN : width;
+          break;
+        }
+        case RPNMATH_INSN_EQ:
+        case RPNMATH_INSN_NE:
+        case RPNMATH_INSN_LT:
+        case RPNMATH_INSN_LE:
+        case RPNMATH_INSN_GT:
+        case RPNMATH_INSN_GE:
+          slots[--depth - 1] = 8;
+          break;
+        case RPNMATH_INSN_SELECT:
+          depth -= 2;
+          slots[depth - 1] = rpnmath_width_join(slots[depth], slots[depth + 1]);
+          break;
+        case RPNMATH_INSN_MIN:
+        case RPNMATH_INSN_MAX:
+          depth--;
+          slots[depth - 1] = rpnmath_width_join(slots[depth - 1], slots[depth]);
+          break;
+        case RPNMATH_INSN_ABS:
+          if (program->overflow == RPNMATH_OVERFLOW_PROMOTE && !rpnmath_width_is_float(slots[depth - 1])) {
+            slots[depth - 1] = RPNMATH_WIDTH_UNKNOWN;
+          }
+          break;
+        case RPNMATH_INSN_IF:
+          depth--;
+          successors[1] = blocks[insn->operand].next_pos;
+          break;
+        case RPNMATH_INSN_ELSE:
+          successors[0] = blocks[insn->operand].end_pos;
+          break;
+        case RPNMATH_INSN_LOOP:
+          depth--;
+          successors[1] = blocks[insn->operand].end_pos + 1;
+          break;
+        case RPNMATH_INSN_END:
+          if (blocks[insn->operand].is_loop) successors[0] = blocks[insn->operand].start_pos;
+          break;
+        case RPNMATH_INSN_PHI:
+          variables[program->phis[insn->operand].target_var] = RPNMATH_WIDTH_UNKNOWN;
+          break;
+        case RPNMATH_INSN_RET:
+          successors[0] = SIZE_MAX;
+          break;
+        default:
+          break;
+      }
+      
+      for (size_t i = 0; i < 2; i++) {
+        size_t next = successors[i];
+        if (next >= program->count) {
+          continue;
+        }
+        unsigned char *target = widths + next * stride;
+        if (depths[next] == SIZE_MAX) {
+          depths[next] = depth;
+          changed = 1;
+        }
+        for (size_t j = 0; j < stride; j++) {
+          unsigned char joined = rpnmath_width_join(target[j], state[j]);
+          if (joined != target[j]) {
+            target[j] = joined;
+            changed = 1;
+          }
+        }
+      }
+    }
+  }
+  
+  for (size_t pc = 0; pc < program->count; pc++) {
+    rpnmath_insn_t *insn = &program->code[pc];
+    if (depths[pc] == SIZE_MAX || insn->opcode < RPNMATH_INSN_ADD || insn->opcode > RPNMATH_INSN_GE) {
+      continue;
+    }
+    const unsigned char *slots = widths + pc * stride;
+    unsigned char left = slots[depths[pc] - 2];
+    unsigned char right = slots[depths[pc] - 1];
+    unsigned char width = rpnmath_width_arith(left, right);
+    if (rpnmath_width_is_float(width)) {
+      insn->operand = (rpnmath_width_is_float(left) ? 0 : RPNMATH_CONVERT_LEFT) |
+                      (rpnmath_width_is_float(right) ? 0 : RPNMATH_CONVERT_RIGHT);
+      insn->opcode = rpnmath_float_opcode(insn->opcode, width);
+      program->specialized++;
+    } else if (rpnmath_width_is_decimal(width)) {
+      insn->operand = rpnmath_decimal_layout(insn->opcode, left, right, width, program->rounding);
+      insn->opcode = rpnmath_decimal_opcode(insn->opcode);
+      program->specialized++;
+    } else if (width != RPNMATH_WIDTH_UNKNOWN &&
+               (insn->opcode == RPNMATH_INSN_ADD || insn->opcode == RPNMATH_INSN_SUB || insn->opcode == RPNMATH_INSN_MUL)) {
+      insn->opcode = rpnmath_kernel_opcode(insn->opcode, width);
+      program->specialized++;
+    }
+  }
+}
+
+// Mark the variables surely assigned when the instruction at pos in block
+// runs: those loaded or stored before it in its block or in the blocks
+// around it, skipping the constructs nested in them. A load that ran has
+// found its variable assigned.
+static void rpnmath_ifconvert_assigned(const rpnmath_program_t *program, size_t pos, size_t block, unsigned char *assigned) {
+  const rpnmath_block_t *blocks = program->blocks;
+  memset(assigned, 0, program->variable_count);
+  for (;;) {
+    while (pos > blocks[block].start_pos) {
+      const rpnmath_insn_t *insn = &program->code[--pos];
+      switch (insn->opcode) {
+        case RPNMATH_INSN_LOAD:
+        case RPNMATH_INSN_STORE:
+          assigned[insn->operand] = 1;
+          break;
+        case RPNMATH_INSN_PHI:
+          assigned[program->phis[insn->operand].target_var] = 1;
+          break;
+        case RPNMATH_INSN_END:
+          // Continue before the loop's condition or the chain's first if
+          pos = blocks[insn->operand].is_loop ? blocks[insn->operand].start_pos : blocks[insn->operand].start_pos - 1;
+          break;
+        default:
+          break;
+      }
+    }
+    if (block == 0) {
+      return;
+    }
+    
+    // Leave the block where its construct was entered: before the loop, at
+    // the if of an if part, or at the first if of the chain for else parts
+    const rpnmath_block_t *current = &blocks[block];
+    const rpnmath_insn_t *entry = &program->code[current->start_pos - 1];
+    if (current->is_loop) {
+      pos = current->start_pos;
+    } else if (entry->opcode == RPNMATH_INSN_ELSE) {
+      pos = blocks[entry->operand].start_pos - 1;
+    } else {
+      pos = current->start_pos - 1;
+    }
+    block = current->parent_block;
+  }
+}
+
+// Longest part that is still cheaper to run unconditionally than a branch
+// that may be mispredicted. Longer ones, like the right operand of && on a
+// long arithmetic chain, keep the jump past them.
+#define RPNMATH_IFCONVERT_MAX_PART 8
+
+// Whether code[begin, end) can run unconditionally: it pushes exactly one
+// value without touching the stack below, and nothing in it can fail or
+// write a variable. *peak is the deepest it gets above its start.
+static int rpnmath_ifconvert_pure(const rpnmath_program_t *program, size_t begin, size_t end,
+                                  const unsigned char *assigned, size_t *peak) {
+  size_t depth = 0;
+  *peak = 0;
+  if (end - begin > RPNMATH_IFCONVERT_MAX_PART) {
+    return 0;
+  }
+  for (size_t pc = begin; pc < end; pc++) {
+    rpnmath_opcode_t opcode = program->code[pc].opcode;
+    size_t pops, pushes = 1;
+    
+    if (opcode == RPNMATH_INSN_PUSH) {
+      pops = 0;
+    } else if (opcode == RPNMATH_INSN_LOAD) {
+      pops = 0;
+      if (!assigned[program->code[pc].operand]) return 0;
+    } else if (opcode == RPNMATH_INSN_NOP) {
+      pops = pushes = 0;
+    } else if (opcode == RPNMATH_INSN_SELECT) {
+      pops = 3;
+    } else if (rpnmath_is_compare(opcode) || opcode == RPNMATH_INSN_MIN || opcode == RPNMATH_INSN_MAX ||
+               (opcode >= RPNMATH_INSN_EQ_F && opcode <= RPNMATH_INSN_GE_F) ||
+               (opcode >= RPNMATH_INSN_EQ_D64 && opcode <= RPNMATH_INSN_GE_D64) ||
+               (opcode >= RPNMATH_INSN_ADD_F32 && opcode <= RPNMATH_INSN_DIV_F64)) {
+      pops = 2; // comparisons and float arithmetic never fail
+    } else if (opcode >= RPNMATH_INSN_ADD_I8 && opcode < RPNMATH_INSN_ADD_I8 + 3 * RPNMATH_KERNEL_WIDTH_COUNT &&
+               !rpnmath_overflow_fails(program->overflow)) {
+      pops = 2; // integer kernels only fail by trapping
+    } else {
+      return 0;
+    }
+    
+    if (depth < pops) return 0;
+    depth = depth - pops + pushes;
+    if (depth > *peak) *peak = depth;
+  }
+  return depth == 1;
+}
+
+// If-conversion: "COND if A else B end" where A and B each compute a single
+// value without side effects becomes "COND A B select", which runs both
+// parts but leaves nothing for the branch predictor to guess. Runs after
+// type inference, whose results stay valid as both parts see the same
+// inputs, and innermost chains first, so converted chains nest.
+static void rpnmath_program_ifconvert(rpnmath_program_t *program, rpnmath_arena_t *arena) {
+  rpnmath_insn_t *code = program->code;
+  unsigned char *removed = rpnmath_arena_alloc(arena, program->count + 1);
+  unsigned char *assigned = rpnmath_arena_alloc(arena, program->variable_count + 1);
+  size_t *remap = rpnmath_arena_alloc(arena, (program->count + 1) * sizeof(size_t));
+  if (!removed || !assigned || !remap) {
+    return;
+  }
+  
+  for (size_t id = program->block_count; id-- > 1; ) {
+    rpnmath_block_t *block = &program->blocks[id];
+    // Only the first part of a chain with an else part and an end of its own
+    if (block->is_loop || block->end_pos == SIZE_MAX || block->next_pos == SIZE_MAX ||
+        block->next_pos == block->end_pos) {
+      continue;
+    }
+    size_t if_pos = block->start_pos - 1;
+    size_t else_pos = block->next_pos - 1;
+    size_t end_pos = block->end_pos;
+    if (code[if_pos].opcode != RPNMATH_INSN_IF || code[else_pos].opcode != RPNMATH_INSN_ELSE ||
+        code[else_pos].operand != id || code[end_pos].opcode != RPNMATH_INSN_END || code[end_pos].operand != id) {
+      continue;
+    }
+    
+    size_t peak_taken, peak_other;
+    rpnmath_ifconvert_assigned(program, if_pos, block->parent_block, assigned);
+    if (!rpnmath_ifconvert_pure(program, block->start_pos, else_pos, assigned, &peak_taken) ||
+        !rpnmath_ifconvert_pure(program, block->next_pos, end_pos, assigned, &peak_other)) {
+      continue;
+    }
+    
+    // The condition stays below both parts, and the taken part's value below the other one
+    size_t depth = block->depth + 1;
+    if (depth + peak_taken > program->max_depth) program->max_depth = depth + peak_taken;
+    if (depth + 1 + peak_other > program->max_depth) program->max_depth = depth + 1 + peak_other;
+    
+    code[if_pos].opcode = code[else_pos].opcode = RPNMATH_INSN_NOP;
+    removed[if_pos] = removed[else_pos] = 1;
+    code[end_pos].opcode = RPNMATH_INSN_SELECT;
+    code[end_pos].operand = 0;
+    // Nothing jumps into or out of the chain's blocks anymore
+    block->next_pos = block->end_pos = SIZE_MAX;
+    program->converted++;
+  }
+  
+  if (!program->converted) {
+    return;
+  }
+  
+  // Drop the instructions of the converted chains, remap[old position] is
+  // the position after removal
+  size_t out = 0;
+  for (size_t in = 0; in < program->count; in++) {
+    remap[in] = out;
+    if (!removed[in]) {
+      code[out++] = code[in];
+    }
+  }
+  remap[program->count] = out;
+  
+  for (size_t i = 0; i < program->block_count; i++) {
+    rpnmath_block_t *block = &program->blocks[i];
+    block->start_pos = remap[block->start_pos];
+    if (block->next_pos != SIZE_MAX) block->next_pos = remap[block->next_pos];
+    if (block->end_pos != SIZE_MAX) block->end_pos = remap[block->end_pos];
+  }
+  
+  program->count = out;
+}
+
+// Peephole pass replacing the most frequent short sequences with one
+// superinstruction each, so they cost a single dispatch
+static void rpnmath_program_fuse(rpnmath_program_t *program, rpnmath_arena_t *arena) {
+  rpnmath_insn_t *code = program->code;
+  size_t out = 0;
+  
+  // Jumps may only land on the first instruction of a fused sequence,
+  // remap[old position] is the position after fusion
+  size_t *remap = rpnmath_arena_alloc(arena, (program->count + 1) * sizeof(size_t));
+  unsigned char *target = rpnmath_arena_alloc(arena, program->count + 2);
+  if (!remap || !target) {
+    return;
+  }
+  for (size_t i = 0; i < program->block_count; i++) {
+    const rpnmath_block_t *block = &program->blocks[i];
+    if (block->is_loop) target[block->start_pos] = 1;
+    if (block->next_pos != SIZE_MAX) target[block->next_pos] = 1;
+    if (block->end_pos != SIZE_MAX) target[block->end_pos] = target[block->end_pos + 1] = 1;
+  }
+  
+  for (size_t in = 0; in < program->count; ) {
+    rpnmath_insn_t fused = code[in];
+    size_t length = 1;
+    
+    if (in + 2 < program->count && !target[in + 1] && !target[in + 2] &&
+        code[in].opcode == RPNMATH_INSN_LOAD && code[in + 1].opcode == RPNMATH_INSN_PUSH &&
+        rpnmath_is_add(code[in + 2].opcode)) {
+      // A width specialized add keeps its kernel
+      fused.opcode = code[in + 2].opcode == RPNMATH_INSN_ADD ? RPNMATH_INSN_ADD_VC :
+        (rpnmath_opcode_t)(RPNMATH_INSN_ADD_VC_I8 + (code[in + 2].opcode - RPNMATH_INSN_ADD_I8));
+      fused.operand2 = code[in + 1].operand;
+      length = 3;
+      program->fusion.fired[RPNMATH_FUSION_ADD_VC]++;
+      
+    } else if (in + 1 < program->count && !target[in + 1] && code[in].opcode == RPNMATH_INSN_PUSH &&
+               code[in + 1].opcode == RPNMATH_INSN_STORE) {
+      fused.opcode = RPNMATH_INSN_STORE_C;
+      fused.operand = code[in + 1].operand;
+      fused.operand2 = code[in].operand;
+      length = 2;
+      program->fusion.fired[RPNMATH_FUSION_STORE_C]++;
+      
+    } else if (in + 1 < program->count && !target[in + 1] && rpnmath_is_compare(code[in].opcode) &&
+               code[in + 1].opcode == RPNMATH_INSN_IF) {
+      fused.opcode = RPNMATH_INSN_IF_CMP;
+      fused.operand = code[in + 1].operand;
+      fused.operand2 = code[in].opcode;
+      length = 2;
+      program->fusion.fired[RPNMATH_FUSION_IF_CMP]++;
+    }
+    
+    remap[in] = out;
+    code[out++] = fused;
+    program->fusion.removed += length - 1;
+    in += length;
+  }
+  remap[program->count] = out;
+  
+  for (size_t i = 0; i < program->block_count; i++) {
+    rpnmath_block_t *block = &program->blocks[i];
+    block->start_pos = remap[block->start_pos];
+    if (block->next_pos != SIZE_MAX) block->next_pos = remap[block->next_pos];
+    if (block->end_pos != SIZE_MAX) block->end_pos = remap[block->end_pos];
+  }
+  
+  program->count = out;
+}
+
+int rpnmath_program_compile(rpnmath_program_t *program, const rpnmath_stack_t *stack, rpnmath_overflow_t overflow,
+                            rpnmath_rounding_t rounding, rpnmath_arena_t *arena) {
+  memset(program, 0, sizeof(*program));
+  program->overflow = overflow;
+  program->rounding = rounding;
+  
+  rpnmath_compiler_t compiler = {0};
+  compiler.program = program;
+  compiler.arena = arena;
+  compiler.reachable = 1;
+  compiler.bools[0] = compiler.bools[1] = SIZE_MAX;
+  if (rpnmath_compiler_block(&compiler, 0, 0) == SIZE_MAX) { // the whole program
+    return compiler.status;
+  }
+  if (stack->counts[RPNMATH_ITEMKIND_OP] && rpnmath_compiler_scan_logic(&compiler, stack) != 0) {
+    return compiler.status;
+  }
+  
+  size_t pos = rpnmath_stack_begin(stack);
+  while (pos < stack->size) {
+    const char *item = stack->data + pos;
+    rpnmath_itemkind_t kind = *(const rpnmath_itemkind_t*)item;
+    size_t next = rpnmath_stack_next(stack, pos);
+    int status = 0;
+    
+    if (compiler.logic && compiler.logic[pos] != RPNMATH_LOGIC_NONE &&
+        rpnmath_compiler_logic_open(&compiler, (rpnmath_logic_mark_t)compiler.logic[pos]) != 0) {
+      return compiler.status;
+    }
+    
+    if (kind == RPNMATH_ITEMKIND_CONST) {
+      status = rpnmath_compiler_const(&compiler, stack, pos);
+      
+    } else if (kind == RPNMATH_ITEMKIND_LREF) {
+      const rpnmath_item_localref_t *lref = (const rpnmath_item_localref_t*)item;
+      rpnmath_compiler_use_variable(&compiler, lref->variable_id);
+      
+      // "$n =" stores, any other reference loads the current value
+      const rpnmath_item_op_t *following = (const rpnmath_item_op_t*)(stack->data + next);
+      if (next < stack->size && following->kind == RPNMATH_ITEMKIND_OP &&
+          following->operation == RPNMATH_OP_ASSIGN) {
+        status = rpnmath_compiler_emit(&compiler, RPNMATH_INSN_STORE, lref->variable_id, 1, 0);
+        next = rpnmath_stack_next(stack, next);
+      } else {
+        status = rpnmath_compiler_emit(&compiler, RPNMATH_INSN_LOAD, lref->variable_id, 0, 1);
+      }
+      
+    } else if (kind == RPNMATH_ITEMKIND_OP) {
+      status = rpnmath_compiler_op(&compiler, ((const rpnmath_item_op_t*)item)->operation);
+      
+    } else if (kind == RPNMATH_ITEMKIND_VOP) {
+      const rpnmath_item_vop_t *vop = (const rpnmath_item_vop_t*)item;
+      if (vop->operation != RPNMATH_VOP_RET) {
+        status = rpnmath_compiler_fail(&compiler, RPNMATH_STATUS_COMPILE,
+                                       rpnmath_arena_printf(arena, "VOP operation %s not yet implemented", rpnmath_vop_name(vop->operation)));
+      } else {
+        size_t arg_count = (size_t)rpnmath_vop_arg_count(vop->operation, vop->argcount);
+        status = rpnmath_compiler_emit(&compiler, RPNMATH_INSN_RET, arg_count, arg_count > 0 ? arg_count : 1, 0);
+        compiler.reachable = 0;
+      }
+      
+    } else if (kind == RPNMATH_ITEMKIND_CFOP) {
+      status = rpnmath_compiler_cfop(&compiler, item, rpnmath_compiler_is_if(stack, next));
+    }
+    
+    if (status != 0) {
+      return compiler.status;
+    }
+    pos = next;
+  }
+  
+  if (compiler.frame_count) {
+    const rpnmath_compiler_frame_t *frame = &compiler.frames[compiler.frame_count - 1];
+    rpnmath_compiler_fail(&compiler, RPNMATH_STATUS_COMPILE,
+                          rpnmath_arena_printf(arena, "Missing end for %s", frame->waiting ? "elif" : rpnmath_cfop_name(frame->kind)));
+    return compiler.status;
+  }
+  
+  // The optimizing passes skip themselves when out of memory, the engines can not
+  rpnmath_program_infer(program, arena);
+  rpnmath_program_ifconvert(program, arena);
+  rpnmath_program_fuse(program, arena);
+  if (rpnmath_threaded_compile(program, arena) != 0 || rpnmath_regvm_compile(program, arena) != 0) {
+    rpnmath_compiler_fail(&compiler, RPNMATH_STATUS_OUT_OF_MEMORY, "Out of memory");
+    return compiler.status;
+  }
+  return 0;
+}
+
+int rpnmath_program_execute(const rpnmath_program_t *program, rpnmath_context_t *context, rpnmath_item_const_t *result) {
+  switch (context->engine) {
+    case RPNMATH_ENGINE_SWITCH: return rpnmath_switch_execute(program, context, result);
+    case RPNMATH_ENGINE_THREADED: return rpnmath_threaded_execute(program, context, result);
+    case RPNMATH_ENGINE_REGISTER: return rpnmath_regvm_execute(program, context, result);
+    default: return rpnmath_context_fail(context, RPNMATH_STATUS_UNKNOWN_ENGINE, context->engine);
+  }
+}
+
+int rpnmath_switch_execute(const rpnmath_program_t *program, rpnmath_context_t *context, rpnmath_item_const_t *result) {
+  // The compiler proved the stack never goes deeper than max_depth, nor below zero
+  if (rpnmath_context_reserve(context, program->max_depth, program->variable_count) != 0) {
+    return context->error.status;
+  }
+  rpnmath_context_reset_blocks(context);
+  
+  rpnmath_value_t *values = context->values;
+  const rpnmath_block_t *blocks = program->blocks;
+  rpnmath_overflow_t overflow = program->overflow;
+  rpnmath_rounding_t rounding = program->rounding;
+  rpnmath_arena_t *arena = context->arena;
+  size_t top = 0;
+  size_t pc = 0;
+  
+  while (pc < program->count) {
+    const rpnmath_insn_t *insn = &program->code[pc];
+    size_t next = pc + 1;
+    
+    switch (insn->opcode) {
+      case RPNMATH_INSN_NOP:
+        break;
+        
+      case RPNMATH_INSN_PUSH:
+        values[top++] = program->constants[insn->operand];
+        break;
+        
+      case RPNMATH_INSN_LOAD:
+        if (rpnmath_context_load_variable(context, insn->operand, &values[top]) != 0) {
+          return context->error.status;
+        }
+        top++;
+        break;
+        
+      case RPNMATH_INSN_STORE:
+        top--;
+        if (rpnmath_context_store_variable(context, insn->operand, &values[top]) != 0) {
+          return context->error.status;
+        }
+        break;
+        
+      case RPNMATH_INSN_ADD_VC: {
+        const rpnmath_value_t *constant = &program->constants[insn->operand2];
+        if (rpnmath_context_load_variable(context, insn->operand, &values[top]) != 0) {
+          return context->error.status;
+        }
+        RPNMATH_EXEC_TRY(context, rpnmath_exec_arith(overflow, rounding, arena, RPNMATH_OP_ADD, &values[top], &values[top], constant), RPNMATH_OP_ADD, &values[top], constant);
+        top++;
+        break;
+      }
+        
+      case RPNMATH_INSN_STORE_C:
+        if (rpnmath_context_store_variable(context, insn->operand, &program->constants[insn->operand2]) != 0) {
+          return context->error.status;
+        }
+        break;
+        
+#define RPNMATH_SWITCH_KERNEL(op, width, bits, ctype) \
+      case RPNMATH_INSN_##op##_##width: \
+        top--; \
+        RPNMATH_EXEC_TRY(context, rpnmath_kernel_##op##_##width(overflow, arena, &values[top - 1], &values[top - 1], &values[top]), RPNMATH_OP_##op, &values[top - 1], &values[top]); \
+        break;
+#define RPNMATH_SWITCH_KERNEL_ADD_VC(op, width, bits, ctype) \
+      case RPNMATH_INSN_ADD_VC_##width: \
+        if (rpnmath_context_load_variable(context, insn->operand, &values[top]) != 0) { \
+          return context->error.status; \
+        } \
+        RPNMATH_EXEC_TRY(context, rpnmath_kernel_ADD_##width(overflow, arena, &values[top], &values[top], &program->constants[insn->operand2]), RPNMATH_OP_ADD, &values[top], &program->constants[insn->operand2]); \
+        top++; \
+        break;
+#define RPNMATH_SWITCH_KERNEL_OPERAND(op, width, bits, ctype) \
+      case RPNMATH_INSN_##op##_##width: \
+        top--; \
+        rpnmath_kernel_##op##_##width(insn->operand, &values[top - 1], &values[top - 1], &values[top]); \
+        break;
+      RPNMATH_KERNELS(RPNMATH_SWITCH_KERNEL)
+      RPNMATH_KERNELS_ADD_VC(RPNMATH_SWITCH_KERNEL_ADD_VC)
+#define RPNMATH_SWITCH_KERNEL_DECIMAL(op, width, bits, ctype) \
+      case RPNMATH_INSN_##op##_##width: \
+        top--; \
+        RPNMATH_EXEC_TRY(context, rpnmath_kernel_##op##_##width(overflow, insn->operand, &values[top - 1], &values[top - 1], &values[top]), RPNMATH_OP_##op, &values[top - 1], &values[top]); \
+        break;
+      RPNMATH_FLOAT_KERNELS(RPNMATH_SWITCH_KERNEL_OPERAND)
+      RPNMATH_FLOAT_COMPARES(RPNMATH_SWITCH_KERNEL_OPERAND)
+      RPNMATH_DECIMAL_KERNELS(RPNMATH_SWITCH_KERNEL_DECIMAL)
+      RPNMATH_DECIMAL_COMPARES(RPNMATH_SWITCH_KERNEL_OPERAND)
+#undef RPNMATH_SWITCH_KERNEL
+#undef RPNMATH_SWITCH_KERNEL_ADD_VC
+#undef RPNMATH_SWITCH_KERNEL_OPERAND
+#undef RPNMATH_SWITCH_KERNEL_DECIMAL
+        
+      case RPNMATH_INSN_ADD:
+        top--;
+        RPNMATH_EXEC_TRY(context, rpnmath_exec_arith(overflow, rounding, arena, RPNMATH_OP_ADD, &values[top - 1], &values[top - 1], &values[top]), RPNMATH_OP_ADD, &values[top - 1], &values[top]);
+        break;
+      case RPNMATH_INSN_SUB:
+        top--;
+        RPNMATH_EXEC_TRY(context, rpnmath_exec_arith(overflow, rounding, arena, RPNMATH_OP_SUB, &values[top - 1], &values[top - 1], &values[top]), RPNMATH_OP_SUB, &values[top - 1], &values[top]);
+        break;
+      case RPNMATH_INSN_MUL:
+        top--;
+        RPNMATH_EXEC_TRY(context, rpnmath_exec_arith(overflow, rounding, arena, RPNMATH_OP_MUL, &values[top - 1], &values[top - 1], &values[top]), RPNMATH_OP_MUL, &values[top - 1], &values[top]);
+        break;
+      case RPNMATH_INSN_DIV:
+        top--;
+        RPNMATH_EXEC_TRY(context, rpnmath_exec_div(overflow, rounding, arena, &values[top - 1], &values[top - 1], &values[top]), RPNMATH_OP_DIV, &values[top - 1], &values[top]);
+        break;
+      case RPNMATH_INSN_EQ:
+        top--;
+        rpnmath_exec_compare(&values[top - 1], rpnmath_exec_test(RPNMATH_INSN_EQ, &values[top - 1], &values[top]));
+        break;
+      case RPNMATH_INSN_NE:
+        top--;
+        rpnmath_exec_compare(&values[top - 1], rpnmath_exec_test(RPNMATH_INSN_NE, &values[top - 1], &values[top]));
+        break;
+      case RPNMATH_INSN_LT:
+        top--;
+        rpnmath_exec_compare(&values[top - 1], rpnmath_exec_test(RPNMATH_INSN_LT, &values[top - 1], &values[top]));
+        break;
+      case RPNMATH_INSN_LE:
+        top--;
+        rpnmath_exec_compare(&values[top - 1], rpnmath_exec_test(RPNMATH_INSN_LE, &values[top - 1], &values[top]));
+        break;
+      case RPNMATH_INSN_GT:
+        top--;
+        rpnmath_exec_compare(&values[top - 1], rpnmath_exec_test(RPNMATH_INSN_GT, &values[top - 1], &values[top]));
+        break;
+      case RPNMATH_INSN_GE:
+        top--;
+        rpnmath_exec_compare(&values[top - 1], rpnmath_exec_test(RPNMATH_INSN_GE, &values[top - 1], &values[top]));
+        break;
+        
+      case RPNMATH_INSN_SELECT:
+        top -= 2;
+        rpnmath_exec_select(&values[top - 1], &values[top - 1], &values[top], &values[top + 1]);
+        break;
+      case RPNMATH_INSN_MIN:
+        top--;
+        rpnmath_exec_min(&values[top - 1], &values[top - 1], &values[top]);
+        break;
+      case RPNMATH_INSN_MAX:
+        top--;
+        rpnmath_exec_max(&values[top - 1], &values[top - 1], &values[top]);
+        break;
+      case RPNMATH_INSN_ABS:
+        RPNMATH_EXEC_TRY(context, rpnmath_exec_abs(overflow, rounding, arena, &values[top - 1], &values[top - 1]), RPNMATH_OP_ABS, &values[top - 1], NULL);
+        break;
+        
+      case RPNMATH_INSN_IF:
+        top--;
+        next = rpnmath_exec_if(context, blocks, insn->operand, pc, rpnmath_exec_truth(&values[top]));
+        break;
+        
+      case RPNMATH_INSN_IF_CMP:
+        top -= 2;
+        next = rpnmath_exec_if(context, blocks, insn->operand, pc, rpnmath_exec_test(insn->operand2, &values[top], &values[top + 1]));
+        break;
+        
+      case RPNMATH_INSN_ELSE:
+        next = rpnmath_exec_else(blocks, insn->operand);
+        break;
+        
+      case RPNMATH_INSN_LOOP:
+        top--;
+        next = rpnmath_exec_loop(context, blocks, insn->operand, pc, rpnmath_exec_truth(&values[top]));
+        break;
+        
+      case RPNMATH_INSN_END:
+        next = rpnmath_exec_end(context, blocks, insn->operand, pc);
+        break;
+        
+      case RPNMATH_INSN_PHI: {
+        const rpnmath_phi_t *phi = &program->phis[insn->operand];
+        if (rpnmath_context_resolve_phi(context, phi->target_var,
+                                        program->phi_sources + phi->first_source,
+                                        phi->source_count) != 0) {
+          return context->error.status;
+        }
+        break;
+      }
+        
+      case RPNMATH_INSN_RET:
+        // Return the top value
+        return rpnmath_exec_ret(context, result, &values[top - 1]);
+        
+      default:
+        return rpnmath_context_fail(context, RPNMATH_STATUS_UNKNOWN_INSTRUCTION, insn->opcode);
+    }
+    
+    pc = next;
+  }
+  
+  // If we get here without returning, there was no return statement
+  return rpnmath_context_fail(context, RPNMATH_STATUS_NO_RETURN, 0);
+}
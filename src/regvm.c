@@ -0,0 +1,533 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "type.h"
+#include "item.h"
+#include "value.h"
+#include "arena.h"
+#include "context.h"
+#include "program.h"
+#include "exec.h"
+
+// Register engine. The stack code is lowered to three-address code where
+// stack slot n lives in register n, every variable has its own register and
+// every constant is preloaded into a register. Pushing a constant or a
+// variable emits nothing: the slot simply names that register, so
+// "$0 10 +" becomes a single "add r0, $0, c0".
+
+typedef struct rpnmath_lowering {
+  rpnmath_program_t *program;
+  rpnmath_arena_t *arena;
+  rpnmath_regcode_t *regcode;
+  size_t capacity;
+  unsigned *slots;         // register currently holding each stack slot
+  size_t depth;
+  unsigned char *stored;   // per variable: written on every path reaching this point
+  unsigned char *listed;   // per variable: bit 0 = listed as input, bit 1 = listed as output, bit 2 = checked
+  int straight;            // no control flow or ret seen yet, everything runs
+  size_t nesting;          // blocks around the current position, stores inside them may not run
+  int failed;              // ran out of memory, instructions are dropped from then on
+} rpnmath_lowering_t;
+
+static void rpnmath_lowering_emit_block(rpnmath_lowering_t *lowering, rpnmath_opcode_t opcode, size_t dst, size_t a, size_t b, size_t block) {
+  rpnmath_regcode_t *regcode = lowering->regcode;
+  
+  if (regcode->count == lowering->capacity) {
+    size_t capacity = lowering->capacity ? lowering->capacity * 2 : 16;
+    rpnmath_reg_insn_t *code = rpnmath_arena_grow(lowering->arena, regcode->code, lowering->capacity * sizeof(rpnmath_reg_insn_t),
+                                                  capacity * sizeof(rpnmath_reg_insn_t));
+    if (!code) {
+      lowering->failed = 1;
+      return;
+    }
+    regcode->code = code;
+    lowering->capacity = capacity;
+  }
+  
+  rpnmath_reg_insn_t *insn = &regcode->code[regcode->count++];
+  insn->opcode = opcode;
+  insn->dst = (unsigned)dst;
+  insn->a = (unsigned)a;
+  insn->b = (unsigned)b;
+  insn->block = (unsigned)block;
+}
+
+static void rpnmath_lowering_emit(rpnmath_lowering_t *lowering, rpnmath_opcode_t opcode, size_t dst, size_t a, size_t b) {
+  rpnmath_lowering_emit_block(lowering, opcode, dst, a, b, 0);
+}
+
+// Copy stack slot i into its own temporary if it still names another register
+static void rpnmath_lowering_materialize(rpnmath_lowering_t *lowering, size_t i) {
+  if (lowering->slots[i] != i) {
+    rpnmath_lowering_emit(lowering, RPNMATH_INSN_MOVE, i, lowering->slots[i], 0);
+    lowering->slots[i] = (unsigned)i;
+  }
+}
+
+// Slots that still name a variable register must not see a later write to it
+static void rpnmath_lowering_materialize_var(rpnmath_lowering_t *lowering, size_t var_id) {
+  unsigned reg = (unsigned)(lowering->regcode->variable_base + var_id);
+  for (size_t i = 0; i < lowering->depth; i++) {
+    if (lowering->slots[i] == reg) {
+      rpnmath_lowering_materialize(lowering, i);
+    }
+  }
+}
+
+// Control flow boundaries see every slot in its own temporary
+static void rpnmath_lowering_flush(rpnmath_lowering_t *lowering) {
+  for (size_t i = 0; i < lowering->depth; i++) {
+    rpnmath_lowering_materialize(lowering, i);
+  }
+}
+
+// Code reached by a jump starts from the depth the compiler proved for it,
+// with every slot in its own temporary
+static void rpnmath_lowering_enter(rpnmath_lowering_t *lowering, size_t depth) {
+  lowering->depth = depth;
+  for (size_t i = 0; i < depth; i++) {
+    lowering->slots[i] = (unsigned)i;
+  }
+}
+
+static size_t rpnmath_lowering_nesting(const rpnmath_program_t *program, size_t block) {
+  size_t nesting = 0;
+  for (; block != 0; block = program->blocks[block].parent_block) {
+    nesting++;
+  }
+  return nesting;
+}
+
+// Variables read before they are surely written come from the context, when
+// it has them. A read checks the variable is there, so a missing one fails
+// where the other engines fail; once a check ran unconditionally, later reads
+// need none.
+static void rpnmath_lowering_input(rpnmath_lowering_t *lowering, size_t var_id) {
+  rpnmath_regcode_t *regcode = lowering->regcode;
+  if (!(lowering->listed[var_id] & 1)) {
+    lowering->listed[var_id] |= 1;
+    regcode->inputs[regcode->input_count++] = var_id;
+  }
+}
+
+static void rpnmath_lowering_read(rpnmath_lowering_t *lowering, size_t var_id) {
+  if (lowering->stored[var_id] || (lowering->listed[var_id] & 4)) {
+    return;
+  }
+  
+  rpnmath_lowering_input(lowering, var_id);
+  if (lowering->straight) {
+    lowering->listed[var_id] |= 4;
+  }
+  rpnmath_lowering_emit(lowering, RPNMATH_INSN_LOAD, 0, lowering->regcode->variable_base + var_id, var_id);
+}
+
+static void rpnmath_lowering_write(rpnmath_lowering_t *lowering, size_t var_id) {
+  if (lowering->nesting == 0) {
+    lowering->stored[var_id] = 1;
+  }
+  if (!(lowering->listed[var_id] & 2)) {
+    lowering->listed[var_id] |= 2;
+    lowering->regcode->outputs[lowering->regcode->output_count++] = var_id;
+  }
+}
+
+int rpnmath_regvm_compile(rpnmath_program_t *program, rpnmath_arena_t *arena) {
+  rpnmath_regcode_t *regcode = &program->regcode;
+  memset(regcode, 0, sizeof(*regcode));
+  
+  size_t variable_count = program->variable_count;
+  regcode->variable_base = program->max_depth;
+  regcode->constant_base = regcode->variable_base + variable_count;
+  regcode->register_count = regcode->constant_base + program->constant_count;
+  
+  rpnmath_lowering_t lowering = {0};
+  lowering.program = program;
+  lowering.arena = arena;
+  lowering.regcode = regcode;
+  lowering.slots = rpnmath_arena_alloc(arena, (program->max_depth + 1) * sizeof(unsigned));
+  lowering.stored = rpnmath_arena_alloc(arena, variable_count + 1);
+  lowering.listed = rpnmath_arena_alloc(arena, variable_count + 1);
+  lowering.straight = 1;
+  regcode->inputs = rpnmath_arena_alloc(arena, (variable_count + 1) * sizeof(size_t));
+  regcode->outputs = rpnmath_arena_alloc(arena, (variable_count + 1) * sizeof(size_t));
+  regcode->blocks = rpnmath_arena_alloc(arena, program->block_count * sizeof(rpnmath_block_t));
+  
+  // Jump targets see every slot in its own temporary, just like jump sources
+  size_t *remap = rpnmath_arena_alloc(arena, (program->count + 1) * sizeof(size_t));
+  unsigned char *target = rpnmath_arena_alloc(arena, program->count + 2);
+  if (!lowering.slots || !lowering.stored || !lowering.listed || !regcode->inputs || !regcode->outputs ||
+      !regcode->blocks || !remap || !target) {
+    return -1;
+  }
+  for (size_t i = 0; i < program->block_count; i++) {
+    const rpnmath_block_t *block = &program->blocks[i];
+    if (block->is_loop) target[block->start_pos] = 1;
+    if (block->next_pos != SIZE_MAX) target[block->next_pos] = 1;
+    if (block->end_pos != SIZE_MAX) target[block->end_pos] = target[block->end_pos + 1] = 1;
+  }
+  
+  for (size_t pc = 0; pc < program->count; pc++) {
+    const rpnmath_insn_t *insn = &program->code[pc];
+    
+    if (target[pc]) {
+      rpnmath_lowering_flush(&lowering);
+    }
+    remap[pc] = regcode->count;
+    size_t depth = lowering.depth;
+    
+    switch (insn->opcode) {
+      case RPNMATH_INSN_NOP:
+        break;
+        
+      case RPNMATH_INSN_PUSH:
+        lowering.slots[lowering.depth++] = (unsigned)(regcode->constant_base + insn->operand);
+        break;
+        
+      case RPNMATH_INSN_LOAD:
+        rpnmath_lowering_read(&lowering, insn->operand);
+        lowering.slots[lowering.depth++] = (unsigned)(regcode->variable_base + insn->operand);
+        break;
+        
+      case RPNMATH_INSN_STORE: {
+        size_t reg = regcode->variable_base + insn->operand;
+        unsigned source = lowering.slots[--lowering.depth];
+        rpnmath_lowering_materialize_var(&lowering, insn->operand);
+        rpnmath_lowering_emit(&lowering, RPNMATH_INSN_MOVE, reg, source, 0);
+        rpnmath_lowering_write(&lowering, insn->operand);
+        break;
+      }
+        
+      case RPNMATH_INSN_ADD_VC:
+        rpnmath_lowering_read(&lowering, insn->operand);
+        rpnmath_lowering_emit(&lowering, RPNMATH_INSN_ADD, depth, regcode->variable_base + insn->operand,
+                              regcode->constant_base + insn->operand2);
+        lowering.slots[lowering.depth++] = (unsigned)depth;
+        break;
+        
+#define RPNMATH_LOWER_KERNEL_ADD_VC(op, width, bits, ctype) \
+      case RPNMATH_INSN_ADD_VC_##width: \
+        rpnmath_lowering_read(&lowering, insn->operand); \
+        rpnmath_lowering_emit(&lowering, RPNMATH_INSN_ADD_##width, depth, regcode->variable_base + insn->operand, \
+                              regcode->constant_base + insn->operand2); \
+        lowering.slots[lowering.depth++] = (unsigned)depth; \
+        break;
+      RPNMATH_KERNELS_ADD_VC(RPNMATH_LOWER_KERNEL_ADD_VC)
+#undef RPNMATH_LOWER_KERNEL_ADD_VC
+        
+      case RPNMATH_INSN_STORE_C:
+        rpnmath_lowering_materialize_var(&lowering, insn->operand);
+        rpnmath_lowering_emit(&lowering, RPNMATH_INSN_MOVE, regcode->variable_base + insn->operand,
+                              regcode->constant_base + insn->operand2, 0);
+        rpnmath_lowering_write(&lowering, insn->operand);
+        break;
+        
+      case RPNMATH_INSN_IF_CMP: {
+        unsigned left = lowering.slots[depth - 2];
+        unsigned right = lowering.slots[depth - 1];
+        lowering.depth -= 2;
+        rpnmath_lowering_flush(&lowering);
+        rpnmath_lowering_emit_block(&lowering, RPNMATH_INSN_IF_CMP, insn->operand2, left, right, insn->operand);
+        lowering.straight = 0;
+        lowering.nesting = rpnmath_lowering_nesting(program, insn->operand);
+        break;
+      }
+        
+      case RPNMATH_INSN_ADD:
+      case RPNMATH_INSN_SUB:
+      case RPNMATH_INSN_MUL:
+      case RPNMATH_INSN_DIV:
+      case RPNMATH_INSN_EQ:
+      case RPNMATH_INSN_NE:
+      case RPNMATH_INSN_LT:
+      case RPNMATH_INSN_LE:
+      case RPNMATH_INSN_GT:
+      case RPNMATH_INSN_GE:
+#define RPNMATH_LOWER_KERNEL(op, width, bits, ctype) case RPNMATH_INSN_##op##_##width:
+      RPNMATH_KERNELS(RPNMATH_LOWER_KERNEL)
+      RPNMATH_FLOAT_KERNELS(RPNMATH_LOWER_KERNEL)
+      RPNMATH_FLOAT_COMPARES(RPNMATH_LOWER_KERNEL)
+      RPNMATH_DECIMAL_KERNELS(RPNMATH_LOWER_KERNEL)
+      RPNMATH_DECIMAL_COMPARES(RPNMATH_LOWER_KERNEL)
+#undef RPNMATH_LOWER_KERNEL
+        // Float and decimal kernels keep their operand in block
+        rpnmath_lowering_emit_block(&lowering, insn->opcode, depth - 2, lowering.slots[depth - 2], lowering.slots[depth - 1],
+                                    insn->operand);
+        lowering.slots[depth - 2] = (unsigned)(depth - 2);
+        lowering.depth--;
+        break;
+        
+      case RPNMATH_INSN_SELECT:
+        // The condition goes in block, it is the only operand with three sources
+        rpnmath_lowering_emit_block(&lowering, RPNMATH_INSN_SELECT, depth - 3, lowering.slots[depth - 2], lowering.slots[depth - 1],
+                                    lowering.slots[depth - 3]);
+        lowering.slots[depth - 3] = (unsigned)(depth - 3);
+        lowering.depth -= 2;
+        break;
+        
+      case RPNMATH_INSN_MIN:
+      case RPNMATH_INSN_MAX:
+        rpnmath_lowering_emit(&lowering, insn->opcode, depth - 2, lowering.slots[depth - 2], lowering.slots[depth - 1]);
+        lowering.slots[depth - 2] = (unsigned)(depth - 2);
+        lowering.depth--;
+        break;
+        
+      case RPNMATH_INSN_ABS:
+        rpnmath_lowering_emit(&lowering, RPNMATH_INSN_ABS, depth - 1, lowering.slots[depth - 1], 0);
+        lowering.slots[depth - 1] = (unsigned)(depth - 1);
+        break;
+        
+      case RPNMATH_INSN_IF:
+      case RPNMATH_INSN_LOOP: {
+        unsigned condition = lowering.slots[--lowering.depth];
+        rpnmath_lowering_flush(&lowering);
+        rpnmath_lowering_emit_block(&lowering, insn->opcode, 0, condition, 0, insn->operand);
+        lowering.straight = 0;
+        lowering.nesting = rpnmath_lowering_nesting(program, insn->operand);
+        break;
+      }
+        
+      case RPNMATH_INSN_ELSE:
+        rpnmath_lowering_flush(&lowering);
+        rpnmath_lowering_emit_block(&lowering, RPNMATH_INSN_ELSE, 0, 0, 0, insn->operand);
+        rpnmath_lowering_enter(&lowering, program->blocks[insn->operand].depth);
+        break;
+        
+      case RPNMATH_INSN_END:
+        rpnmath_lowering_flush(&lowering);
+        rpnmath_lowering_emit_block(&lowering, RPNMATH_INSN_END, 0, 0, 0, insn->operand);
+        rpnmath_lowering_enter(&lowering, program->blocks[insn->operand].end_depth);
+        // One end can close several elif chains at once
+        lowering.nesting = rpnmath_lowering_nesting(program, program->blocks[insn->operand].parent_block);
+        break;
+        
+      case RPNMATH_INSN_PHI: {
+        const rpnmath_phi_t *phi = &program->phis[insn->operand];
+        rpnmath_lowering_materialize_var(&lowering, phi->target_var);
+        rpnmath_lowering_flush(&lowering);
+        // A phi takes whichever source was assigned last, missing ones are fine
+        for (size_t i = 0; i < phi->source_count; i++) {
+          size_t source_var = program->phi_sources[phi->first_source + i];
+          if (!lowering.stored[source_var]) {
+            rpnmath_lowering_input(&lowering, source_var);
+          }
+        }
+        rpnmath_lowering_emit(&lowering, RPNMATH_INSN_PHI, 0, insn->operand, 0);
+        rpnmath_lowering_write(&lowering, phi->target_var);
+        break;
+      }
+        
+      case RPNMATH_INSN_RET:
+        rpnmath_lowering_emit(&lowering, RPNMATH_INSN_RET, 0, lowering.slots[depth - 1], 0);
+        lowering.straight = 0;
+        break;
+        
+      default:
+        break;
+    }
+  }
+  
+  if (target[program->count]) {
+    rpnmath_lowering_flush(&lowering);
+  }
+  remap[program->count] = regcode->count;
+  rpnmath_lowering_emit(&lowering, RPNMATH_INSN_HALT, 0, 0, 0);
+  if (lowering.failed) {
+    return -1;
+  }
+  regcode->count--; // the halt entry is not counted
+  
+  for (size_t i = 0; i < program->block_count; i++) {
+    rpnmath_block_t *block = &regcode->blocks[i];
+    *block = program->blocks[i];
+    block->start_pos = remap[block->start_pos];
+    if (block->next_pos != SIZE_MAX) block->next_pos = remap[block->next_pos];
+    if (block->end_pos != SIZE_MAX) block->end_pos = remap[block->end_pos];
+  }
+  return 0;
+}
+
+// Variables live in registers while the program runs, the context sees them on exit
+static int rpnmath_regvm_writeback(const rpnmath_regcode_t *regcode, rpnmath_context_t *context, const rpnmath_value_t *r) {
+  for (size_t i = 0; i < regcode->output_count; i++) {
+    size_t var_id = regcode->outputs[i];
+    const rpnmath_value_t *value = &r[regcode->variable_base + var_id];
+    if (value->type.kind != RPNMATH_TYPEKIND_VOID &&
+        rpnmath_context_store_variable(context, var_id, value) != 0) {
+      return context->error.status;
+    }
+  }
+  return 0;
+}
+
+// The register code proper, registers already hold the constants and inputs
+static int rpnmath_regvm_run(const rpnmath_program_t *program, rpnmath_context_t *context, rpnmath_value_t *r,
+                             rpnmath_item_const_t *result) {
+  const rpnmath_regcode_t *regcode = &program->regcode;
+  rpnmath_overflow_t overflow = program->overflow;
+  rpnmath_rounding_t rounding = program->rounding;
+  rpnmath_arena_t *arena = context->arena;
+  
+  const rpnmath_reg_insn_t *code = regcode->code;
+  const rpnmath_block_t *blocks = regcode->blocks;
+  size_t pc = 0;
+  for (;;) {
+    const rpnmath_reg_insn_t *ip = &code[pc];
+    pc++;
+    
+    switch (ip->opcode) {
+      case RPNMATH_INSN_MOVE:
+        r[ip->dst] = r[ip->a];
+        break;
+        
+      case RPNMATH_INSN_LOAD:
+        // Only emitted for variables read before they are surely written
+        if (r[ip->a].type.kind == RPNMATH_TYPEKIND_VOID) {
+          return rpnmath_context_fail(context, RPNMATH_STATUS_UNASSIGNED, ip->b);
+        }
+        break;
+        
+#define RPNMATH_REGVM_KERNEL(op, width, bits, ctype) \
+      case RPNMATH_INSN_##op##_##width: \
+        RPNMATH_EXEC_TRY(context, rpnmath_kernel_##op##_##width(overflow, arena, &r[ip->dst], &r[ip->a], &r[ip->b]), RPNMATH_OP_##op, &r[ip->a], &r[ip->b]); \
+        break;
+#define RPNMATH_REGVM_KERNEL_OPERAND(op, width, bits, ctype) \
+      case RPNMATH_INSN_##op##_##width: \
+        rpnmath_kernel_##op##_##width(ip->block, &r[ip->dst], &r[ip->a], &r[ip->b]); \
+        break;
+      RPNMATH_KERNELS(RPNMATH_REGVM_KERNEL)
+#define RPNMATH_REGVM_KERNEL_DECIMAL(op, width, bits, ctype) \
+      case RPNMATH_INSN_##op##_##width: \
+        RPNMATH_EXEC_TRY(context, rpnmath_kernel_##op##_##width(overflow, ip->block, &r[ip->dst], &r[ip->a], &r[ip->b]), RPNMATH_OP_##op, &r[ip->a], &r[ip->b]); \
+        break;
+      RPNMATH_FLOAT_KERNELS(RPNMATH_REGVM_KERNEL_OPERAND)
+      RPNMATH_FLOAT_COMPARES(RPNMATH_REGVM_KERNEL_OPERAND)
+      RPNMATH_DECIMAL_KERNELS(RPNMATH_REGVM_KERNEL_DECIMAL)
+      RPNMATH_DECIMAL_COMPARES(RPNMATH_REGVM_KERNEL_OPERAND)
+#undef RPNMATH_REGVM_KERNEL
+#undef RPNMATH_REGVM_KERNEL_OPERAND
+#undef RPNMATH_REGVM_KERNEL_DECIMAL
+        
+      case RPNMATH_INSN_ADD:
+        RPNMATH_EXEC_TRY(context, rpnmath_exec_arith(overflow, rounding, arena, RPNMATH_OP_ADD, &r[ip->dst], &r[ip->a], &r[ip->b]), RPNMATH_OP_ADD, &r[ip->a], &r[ip->b]);
+        break;
+      case RPNMATH_INSN_SUB:
+        RPNMATH_EXEC_TRY(context, rpnmath_exec_arith(overflow, rounding, arena, RPNMATH_OP_SUB, &r[ip->dst], &r[ip->a], &r[ip->b]), RPNMATH_OP_SUB, &r[ip->a], &r[ip->b]);
+        break;
+      case RPNMATH_INSN_MUL:
+        RPNMATH_EXEC_TRY(context, rpnmath_exec_arith(overflow, rounding, arena, RPNMATH_OP_MUL, &r[ip->dst], &r[ip->a], &r[ip->b]), RPNMATH_OP_MUL, &r[ip->a], &r[ip->b]);
+        break;
+      case RPNMATH_INSN_DIV:
+        RPNMATH_EXEC_TRY(context, rpnmath_exec_div(overflow, rounding, arena, &r[ip->dst], &r[ip->a], &r[ip->b]), RPNMATH_OP_DIV, &r[ip->a], &r[ip->b]);
+        break;
+      case RPNMATH_INSN_EQ:
+        rpnmath_exec_compare(&r[ip->dst], rpnmath_exec_test(RPNMATH_INSN_EQ, &r[ip->a], &r[ip->b]));
+        break;
+      case RPNMATH_INSN_NE:
+        rpnmath_exec_compare(&r[ip->dst], rpnmath_exec_test(RPNMATH_INSN_NE, &r[ip->a], &r[ip->b]));
+        break;
+      case RPNMATH_INSN_LT:
+        rpnmath_exec_compare(&r[ip->dst], rpnmath_exec_test(RPNMATH_INSN_LT, &r[ip->a], &r[ip->b]));
+        break;
+      case RPNMATH_INSN_LE:
+        rpnmath_exec_compare(&r[ip->dst], rpnmath_exec_test(RPNMATH_INSN_LE, &r[ip->a], &r[ip->b]));
+        break;
+      case RPNMATH_INSN_GT:
+        rpnmath_exec_compare(&r[ip->dst], rpnmath_exec_test(RPNMATH_INSN_GT, &r[ip->a], &r[ip->b]));
+        break;
+      case RPNMATH_INSN_GE:
+        rpnmath_exec_compare(&r[ip->dst], rpnmath_exec_test(RPNMATH_INSN_GE, &r[ip->a], &r[ip->b]));
+        break;
+        
+      case RPNMATH_INSN_SELECT:
+        rpnmath_exec_select(&r[ip->dst], &r[ip->block], &r[ip->a], &r[ip->b]);
+        break;
+      case RPNMATH_INSN_MIN:
+        rpnmath_exec_min(&r[ip->dst], &r[ip->a], &r[ip->b]);
+        break;
+      case RPNMATH_INSN_MAX:
+        rpnmath_exec_max(&r[ip->dst], &r[ip->a], &r[ip->b]);
+        break;
+      case RPNMATH_INSN_ABS:
+        RPNMATH_EXEC_TRY(context, rpnmath_exec_abs(overflow, rounding, arena, &r[ip->dst], &r[ip->a]), RPNMATH_OP_ABS, &r[ip->a], NULL);
+        break;
+        
+      case RPNMATH_INSN_IF:
+        pc = rpnmath_exec_if(context, blocks, ip->block, pc - 1, rpnmath_exec_truth(&r[ip->a]));
+        break;
+        
+      case RPNMATH_INSN_IF_CMP:
+        pc = rpnmath_exec_if(context, blocks, ip->block, pc - 1, rpnmath_exec_test(ip->dst, &r[ip->a], &r[ip->b]));
+        break;
+        
+      case RPNMATH_INSN_ELSE:
+        pc = rpnmath_exec_else(blocks, ip->block);
+        break;
+        
+      case RPNMATH_INSN_LOOP:
+        pc = rpnmath_exec_loop(context, blocks, ip->block, pc - 1, rpnmath_exec_truth(&r[ip->a]));
+        break;
+        
+      case RPNMATH_INSN_END:
+        pc = rpnmath_exec_end(context, blocks, ip->block, pc - 1);
+        break;
+        
+      case RPNMATH_INSN_PHI: {
+        // Phi nodes compare versions kept by the context, so sync through it
+        const rpnmath_phi_t *phi = &program->phis[ip->a];
+        if (rpnmath_regvm_writeback(regcode, context, r) != 0 ||
+            rpnmath_context_resolve_phi(context, phi->target_var,
+                                        program->phi_sources + phi->first_source,
+                                        phi->source_count) != 0 ||
+            rpnmath_context_load_variable(context, phi->target_var, &r[regcode->variable_base + phi->target_var]) != 0) {
+          return context->error.status;
+        }
+        break;
+      }
+        
+      case RPNMATH_INSN_RET:
+        if (rpnmath_regvm_writeback(regcode, context, r) != 0) return context->error.status;
+        return rpnmath_exec_ret(context, result, &r[ip->a]);
+        
+      case RPNMATH_INSN_HALT:
+        // If we get here without returning, there was no return statement
+        return rpnmath_context_fail(context, RPNMATH_STATUS_NO_RETURN, 0);
+        
+      default:
+        return rpnmath_context_fail(context, RPNMATH_STATUS_UNKNOWN_INSTRUCTION, ip->opcode);
+    }
+  }
+}
+
+int rpnmath_regvm_execute(const rpnmath_program_t *program, rpnmath_context_t *context, rpnmath_item_const_t *result) {
+  const rpnmath_regcode_t *regcode = &program->regcode;
+  
+  if (rpnmath_context_reserve(context, regcode->register_count, program->variable_count) != 0) {
+    return context->error.status;
+  }
+  rpnmath_context_reset_blocks(context);
+  rpnmath_value_t *r = context->values;
+  
+  // Constants and the inputs the context has are loaded once, everything else
+  // starts unassigned until a load checks it
+  if (program->constant_count) {
+    memcpy(r + regcode->constant_base, program->constants, program->constant_count * sizeof(rpnmath_value_t));
+  }
+  for (size_t i = 0; i < program->variable_count; i++) {
+    r[regcode->variable_base + i].type.kind = RPNMATH_TYPEKIND_VOID;
+  }
+  for (size_t i = 0; i < regcode->input_count; i++) {
+    size_t var_id = regcode->inputs[i];
+    if (context->variables[var_id].version &&
+        rpnmath_context_load_variable(context, var_id, &r[regcode->variable_base + var_id]) != 0) {
+      return context->error.status;
+    }
+  }
+  
+  // Like the other engines, a failed run leaves the variables it assigned so far
+  int status = rpnmath_regvm_run(program, context, r, result);
+  if (status != 0 && status != RPNMATH_STATUS_OUT_OF_MEMORY && rpnmath_regvm_writeback(regcode, context, r) != 0) {
+    return context->error.status;
+  }
+  return status;
+}
@@ -0,0 +1,605 @@
+#include <string.h>
+#include <stdint.h>
+#include <threads.h>
+#include "type.h"
+#include "item.h"
+#include "simd.h"
+
+// Vector kernels are written with the vector extensions of GCC and Clang
+// and compiled once per instruction set with the target attribute, so a
+// single definition below becomes the SSE2, AVX2 and AVX-512 variants.
+// What the compilers would split into scalar code, changing the width of
+// lanes for masks, products and quotients, are intrinsics of each set.
+// Rows past the last whole vector, and the search for the first failing
+// row once a vector saw one, are left to the scalar kernels.
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#  define RPNMATH_SIMD_X86 1
+#else
+#  define RPNMATH_SIMD_X86 0
+#endif
+
+#define RPNMATH_SIMD_TARGET_SCALAR
+#define RPNMATH_SIMD_TARGET_SSE2 __attribute__((target("sse2")))
+#define RPNMATH_SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#define RPNMATH_SIMD_TARGET_AVX512 __attribute__((target("avx512f,avx512bw")))
+
+#define RPNMATH_SIMD_BYTES_SSE2 16
+#define RPNMATH_SIMD_BYTES_AVX2 32
+#define RPNMATH_SIMD_BYTES_AVX512 64
+
+// Element types of every width: X(isa, op, WIDTH, ctype, utype). No
+// instruction set has the upper half of 64 bit products nor divides 64 bit
+// integers exactly, multiplication and division of them stay scalar.
+#define RPNMATH_SIMD_NARROW(X, isa, op) \
+  X(isa, op, I8, int8_t, uint8_t) X(isa, op, I16, int16_t, uint16_t) X(isa, op, I32, int32_t, uint32_t)
+#define RPNMATH_SIMD_WIDTHS(X, isa, op) \
+  RPNMATH_SIMD_NARROW(X, isa, op) X(isa, op, I64, int64_t, uint64_t)
+
+#define RPNMATH_SIMD_COMPARES(X, isa) \
+  RPNMATH_SIMD_WIDTHS(X, isa, EQ) RPNMATH_SIMD_WIDTHS(X, isa, NE) RPNMATH_SIMD_WIDTHS(X, isa, LT) \
+  RPNMATH_SIMD_WIDTHS(X, isa, LE) RPNMATH_SIMD_WIDTHS(X, isa, GT) RPNMATH_SIMD_WIDTHS(X, isa, GE)
+
+#define RPNMATH_SIMD_OP_EQ ==
+#define RPNMATH_SIMD_OP_NE !=
+#define RPNMATH_SIMD_OP_LT <
+#define RPNMATH_SIMD_OP_LE <=
+#define RPNMATH_SIMD_OP_GT >
+#define RPNMATH_SIMD_OP_GE >=
+
+#define RPNMATH_SIMD_MIN(ctype, utype) ((ctype)((utype)1 << (sizeof(ctype) * 8 - 1)))
+
+// Scalar arithmetic: stores the wrapped result of a op b into result and
+// evaluates to whether the exact one did not fit
+#define RPNMATH_SIMD_SCALAR_ADD(ctype, utype, a, b, result) \
+  (result = (ctype)((unsigned long long)(a) + (unsigned long long)(b)), (((a) ^ result) & ((b) ^ result)) < 0)
+#define RPNMATH_SIMD_SCALAR_SUB(ctype, utype, a, b, result) \
+  (result = (ctype)((unsigned long long)(a) - (unsigned long long)(b)), (((a) ^ (b)) & ((a) ^ result)) < 0)
+#define RPNMATH_SIMD_SCALAR_MUL(ctype, utype, a, b, result) \
+  (result = (ctype)((unsigned long long)(a) * (unsigned long long)(b)), \
+   sizeof(ctype) < 8 ? (long long)(a) * (long long)(b) != result : rpnmath_type_would_overflow_mul(a, b))
+#define RPNMATH_SIMD_SCALAR_DIV(ctype, utype, a, b, result) \
+  ((b) == 0 ? (result = 0, 1) : \
+   (b) == -1 && (a) == RPNMATH_SIMD_MIN(ctype, utype) ? (result = (a), 1) : (result = (ctype)((a) / (b)), 0))
+
+// Scalar kernels, e.g. rpnmath_simd_SCALAR_ADD_I32
+#define RPNMATH_SIMD_SCALAR_ARITH_DEFINE(isa, op, width, ctype, utype) \
+  static size_t rpnmath_simd_SCALAR_##op##_##width(size_t n, const void *left, const void *right, void *dst) { \
+    const ctype *l = left; \
+    const ctype *r = right; \
+    ctype *d = dst; \
+    size_t failed = n; \
+    for (size_t row = 0; row < n; row++) { \
+      ctype result; \
+      if (RPNMATH_SIMD_SCALAR_##op(ctype, utype, l[row], r[row], result) && failed == n) { \
+        failed = row; \
+      } \
+      d[row] = result; \
+    } \
+    return failed; \
+  }
+
+#define RPNMATH_SIMD_SCALAR_COMPARE_DEFINE(isa, op, width, ctype, utype) \
+  static size_t rpnmath_simd_SCALAR_##op##_##width(size_t n, const void *left, const void *right, void *dst) { \
+    const ctype *l = left; \
+    const ctype *r = right; \
+    uint8_t *mask = dst; \
+    for (size_t row = 0; row < n; row++) { \
+      mask[row] = l[row] RPNMATH_SIMD_OP_##op r[row]; \
+    } \
+    return n; \
+  }
+
+#define RPNMATH_SIMD_SCALAR_SELECT_DEFINE(isa, op, width, ctype, utype) \
+  static void rpnmath_simd_SCALAR_SELECT_##width(size_t n, const uint8_t *mask, const void *left, const void *right, void *dst) { \
+    const ctype *l = left; \
+    const ctype *r = right; \
+    ctype *d = dst; \
+    for (size_t row = 0; row < n; row++) { \
+      d[row] = mask[row] ? l[row] : r[row]; \
+    } \
+  }
+
+// Every row is written, the count only advances past the selected ones
+#define RPNMATH_SIMD_SCALAR_FILTER_DEFINE(isa, op, width, ctype, utype) \
+  static size_t rpnmath_simd_SCALAR_FILTER_##width(size_t n, const uint8_t *mask, const void *src, void *dst) { \
+    const ctype *s = src; \
+    ctype *d = dst; \
+    size_t count = 0; \
+    for (size_t row = 0; row < n; row++) { \
+      d[count] = s[row]; \
+      count += mask[row] != 0; \
+    } \
+    return count; \
+  }
+
+RPNMATH_SIMD_WIDTHS(RPNMATH_SIMD_SCALAR_ARITH_DEFINE, SCALAR, ADD)
+RPNMATH_SIMD_WIDTHS(RPNMATH_SIMD_SCALAR_ARITH_DEFINE, SCALAR, SUB)
+RPNMATH_SIMD_WIDTHS(RPNMATH_SIMD_SCALAR_ARITH_DEFINE, SCALAR, MUL)
+RPNMATH_SIMD_WIDTHS(RPNMATH_SIMD_SCALAR_ARITH_DEFINE, SCALAR, DIV)
+RPNMATH_SIMD_COMPARES(RPNMATH_SIMD_SCALAR_COMPARE_DEFINE, SCALAR)
+RPNMATH_SIMD_WIDTHS(RPNMATH_SIMD_SCALAR_SELECT_DEFINE, SCALAR, SELECT)
+RPNMATH_SIMD_WIDTHS(RPNMATH_SIMD_SCALAR_FILTER_DEFINE, SCALAR, FILTER)
+
+#if RPNMATH_SIMD_X86
+
+#include <immintrin.h>
+
+// Vector types of an instruction set and width, e.g. rpnmath_simd_AVX2_I32_t
+// for 8 int32_t lanes. They convert to and from the registers the
+// intrinsics take without any instruction.
+#define RPNMATH_SIMD_LANES(isa, ctype) (RPNMATH_SIMD_BYTES_##isa / sizeof(ctype))
+#define RPNMATH_SIMD_TYPES_DEFINE(isa, op, width, ctype, utype) \
+  typedef ctype rpnmath_simd_##isa##_##width##_t __attribute__((vector_size(RPNMATH_SIMD_BYTES_##isa))); \
+  typedef utype rpnmath_simd_##isa##_##width##_unsigned_t __attribute__((vector_size(RPNMATH_SIMD_BYTES_##isa)));
+
+#define RPNMATH_SIMD_VECTOR(isa, width, suffix) rpnmath_simd_##isa##_##width##_##suffix
+
+RPNMATH_SIMD_WIDTHS(RPNMATH_SIMD_TYPES_DEFINE, SSE2, TYPES)
+RPNMATH_SIMD_WIDTHS(RPNMATH_SIMD_TYPES_DEFINE, AVX2, TYPES)
+RPNMATH_SIMD_WIDTHS(RPNMATH_SIMD_TYPES_DEFINE, AVX512, TYPES)
+
+#define RPNMATH_SIMD_REGISTER_SSE2 __m128i
+#define RPNMATH_SIMD_REGISTER_AVX2 __m256i
+#define RPNMATH_SIMD_REGISTER_AVX512 __m512i
+
+// The intrinsic of an instruction set, RPNMATH_SIMD_MM(AVX2, add_epi32) is
+// _mm256_add_epi32
+#define RPNMATH_SIMD_MM_SSE2(name) _mm_##name
+#define RPNMATH_SIMD_MM_AVX2(name) _mm256_##name
+#define RPNMATH_SIMD_MM_AVX512(name) _mm512_##name
+#define RPNMATH_SIMD_MM(isa, name) RPNMATH_SIMD_MM_##isa(name)
+
+// The lower or upper half (half is lo or hi) of every 128 bit lane of x
+// sign extended from bits to twice as many. The packs narrowing them back
+// work within 128 bit lanes just the same, so a round trip keeps the order.
+#define RPNMATH_SIMD_EXTEND(isa, half, bits, wide_bits, x) \
+  RPNMATH_SIMD_MM(isa, srai_epi##wide_bits)(RPNMATH_SIMD_MM(isa, unpack##half##_epi##bits)(x, x), bits)
+
+// Truncated quotients of 32 bit lanes, exact in floats for 16 bit operands
+#define RPNMATH_SIMD_DIVIDE_PS(isa, x, y) \
+  RPNMATH_SIMD_MM(isa, cvttps_epi32)(RPNMATH_SIMD_MM(isa, div_ps)(RPNMATH_SIMD_MM(isa, cvtepi32_ps)(x), RPNMATH_SIMD_MM(isa, cvtepi32_ps)(y)))
+
+// Building blocks every instruction set has in the same shape: products
+// and quotients of 8 and 16 bit lanes. The products set failed in every
+// lane whose exact product does not fit, the quotients take divisors that
+// are neither zero nor -1 under the smallest value.
+#define RPNMATH_SIMD_BLOCKS_DEFINE(isa) \
+  RPNMATH_SIMD_TARGET_##isa static inline RPNMATH_SIMD_VECTOR(isa, I16, t) rpnmath_simd_##isa##_I16_mul( \
+      RPNMATH_SIMD_VECTOR(isa, I16, t) a, RPNMATH_SIMD_VECTOR(isa, I16, t) b, RPNMATH_SIMD_VECTOR(isa, I16, t) *failed) { \
+    typedef RPNMATH_SIMD_REGISTER_##isa intrinsic_t; \
+    RPNMATH_SIMD_VECTOR(isa, I16, t) low = (RPNMATH_SIMD_VECTOR(isa, I16, t))RPNMATH_SIMD_MM(isa, mullo_epi16)((intrinsic_t)a, (intrinsic_t)b); \
+    RPNMATH_SIMD_VECTOR(isa, I16, t) high = (RPNMATH_SIMD_VECTOR(isa, I16, t))RPNMATH_SIMD_MM(isa, mulhi_epi16)((intrinsic_t)a, (intrinsic_t)b); \
+    *failed |= high != low >> 15; \
+    return low; \
+  } \
+  RPNMATH_SIMD_TARGET_##isa static inline RPNMATH_SIMD_VECTOR(isa, I8, t) rpnmath_simd_##isa##_I8_mul( \
+      RPNMATH_SIMD_VECTOR(isa, I8, t) a, RPNMATH_SIMD_VECTOR(isa, I8, t) b, RPNMATH_SIMD_VECTOR(isa, I8, t) *failed) { \
+    typedef RPNMATH_SIMD_REGISTER_##isa intrinsic_t; \
+    typedef RPNMATH_SIMD_VECTOR(isa, I16, unsigned_t) wide_t; \
+    wide_t low = (wide_t)RPNMATH_SIMD_MM(isa, mullo_epi16)(RPNMATH_SIMD_EXTEND(isa, lo, 8, 16, (intrinsic_t)a), \
+                                                           RPNMATH_SIMD_EXTEND(isa, lo, 8, 16, (intrinsic_t)b)); \
+    wide_t high = (wide_t)RPNMATH_SIMD_MM(isa, mullo_epi16)(RPNMATH_SIMD_EXTEND(isa, hi, 8, 16, (intrinsic_t)a), \
+                                                            RPNMATH_SIMD_EXTEND(isa, hi, 8, 16, (intrinsic_t)b)); \
+    *failed |= (RPNMATH_SIMD_VECTOR(isa, I8, t))RPNMATH_SIMD_MM(isa, packs_epi16)((intrinsic_t)(low + 128 > 255), \
+                                                                                  (intrinsic_t)(high + 128 > 255)); \
+    return (RPNMATH_SIMD_VECTOR(isa, I8, t))RPNMATH_SIMD_MM(isa, packus_epi16)((intrinsic_t)(low & 0xff), (intrinsic_t)(high & 0xff)); \
+  } \
+  RPNMATH_SIMD_TARGET_##isa static inline RPNMATH_SIMD_VECTOR(isa, I16, t) rpnmath_simd_##isa##_I16_quotient( \
+      RPNMATH_SIMD_VECTOR(isa, I16, t) a, RPNMATH_SIMD_VECTOR(isa, I16, t) b) { \
+    typedef RPNMATH_SIMD_REGISTER_##isa intrinsic_t; \
+    intrinsic_t low = RPNMATH_SIMD_DIVIDE_PS(isa, RPNMATH_SIMD_EXTEND(isa, lo, 16, 32, (intrinsic_t)a), \
+                                            RPNMATH_SIMD_EXTEND(isa, lo, 16, 32, (intrinsic_t)b)); \
+    intrinsic_t high = RPNMATH_SIMD_DIVIDE_PS(isa, RPNMATH_SIMD_EXTEND(isa, hi, 16, 32, (intrinsic_t)a), \
+                                             RPNMATH_SIMD_EXTEND(isa, hi, 16, 32, (intrinsic_t)b)); \
+    return (RPNMATH_SIMD_VECTOR(isa, I16, t))RPNMATH_SIMD_MM(isa, packs_epi32)(low, high); \
+  } \
+  RPNMATH_SIMD_TARGET_##isa static inline RPNMATH_SIMD_VECTOR(isa, I8, t) rpnmath_simd_##isa##_I8_quotient( \
+      RPNMATH_SIMD_VECTOR(isa, I8, t) a, RPNMATH_SIMD_VECTOR(isa, I8, t) b) { \
+    typedef RPNMATH_SIMD_REGISTER_##isa intrinsic_t; \
+    typedef RPNMATH_SIMD_VECTOR(isa, I16, t) wide_t; \
+    wide_t low = rpnmath_simd_##isa##_I16_quotient((wide_t)RPNMATH_SIMD_EXTEND(isa, lo, 8, 16, (intrinsic_t)a), \
+                                                   (wide_t)RPNMATH_SIMD_EXTEND(isa, lo, 8, 16, (intrinsic_t)b)); \
+    wide_t high = rpnmath_simd_##isa##_I16_quotient((wide_t)RPNMATH_SIMD_EXTEND(isa, hi, 8, 16, (intrinsic_t)a), \
+                                                    (wide_t)RPNMATH_SIMD_EXTEND(isa, hi, 8, 16, (intrinsic_t)b)); \
+    return (RPNMATH_SIMD_VECTOR(isa, I8, t))RPNMATH_SIMD_MM(isa, packs_epi16)((intrinsic_t)low, (intrinsic_t)high); \
+  }
+
+RPNMATH_SIMD_BLOCKS_DEFINE(SSE2)
+RPNMATH_SIMD_BLOCKS_DEFINE(AVX2)
+RPNMATH_SIMD_BLOCKS_DEFINE(AVX512)
+
+// SSE2 building blocks. It has neither a signed nor a low 32 bit multiply,
+// so 32 bit products come from the unsigned 64 bit ones of the even and odd
+// lanes, their upper halves corrected for negative operands.
+RPNMATH_SIMD_TARGET_SSE2 static inline rpnmath_simd_SSE2_I32_t rpnmath_simd_SSE2_I32_mul(rpnmath_simd_SSE2_I32_t a, rpnmath_simd_SSE2_I32_t b,
+                                                                                       rpnmath_simd_SSE2_I32_t *failed) {
+  __m128i even = _mm_mul_epu32((__m128i)a, (__m128i)b);
+  __m128i odd = _mm_mul_epu32(_mm_srli_epi64((__m128i)a, 32), _mm_srli_epi64((__m128i)b, 32));
+  rpnmath_simd_SSE2_I32_t low = (rpnmath_simd_SSE2_I32_t)_mm_unpacklo_epi32(_mm_shuffle_epi32(even, 0x08), _mm_shuffle_epi32(odd, 0x08));
+  rpnmath_simd_SSE2_I32_unsigned_t high = (rpnmath_simd_SSE2_I32_unsigned_t)_mm_unpacklo_epi32(_mm_shuffle_epi32(even, 0x0d),
+                                                                                               _mm_shuffle_epi32(odd, 0x0d));
+  high -= (rpnmath_simd_SSE2_I32_unsigned_t)((a >> 31) & b) + (rpnmath_simd_SSE2_I32_unsigned_t)((b >> 31) & a);
+  *failed |= (rpnmath_simd_SSE2_I32_t)high != low >> 31;
+  return low;
+}
+
+RPNMATH_SIMD_TARGET_SSE2 static inline rpnmath_simd_SSE2_I32_t rpnmath_simd_SSE2_I32_quotient(rpnmath_simd_SSE2_I32_t a, rpnmath_simd_SSE2_I32_t b) {
+  __m128i low = _mm_cvttpd_epi32(_mm_div_pd(_mm_cvtepi32_pd((__m128i)a), _mm_cvtepi32_pd((__m128i)b)));
+  __m128i high = _mm_cvttpd_epi32(_mm_div_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32((__m128i)a, 0x0e)),
+                                             _mm_cvtepi32_pd(_mm_shuffle_epi32((__m128i)b, 0x0e))));
+  return (rpnmath_simd_SSE2_I32_t)_mm_unpacklo_epi64(low, high);
+}
+
+// Masks of one byte per lane, narrowed with saturating packs
+RPNMATH_SIMD_TARGET_SSE2 static inline void rpnmath_simd_SSE2_I8_store_mask(uint8_t *dst, rpnmath_simd_SSE2_I8_t lanes) {
+  _mm_storeu_si128((__m128i*)dst, _mm_and_si128((__m128i)lanes, _mm_set1_epi8(1)));
+}
+
+RPNMATH_SIMD_TARGET_SSE2 static inline void rpnmath_simd_SSE2_I16_store_mask(uint8_t *dst, rpnmath_simd_SSE2_I16_t lanes) {
+  __m128i bytes = _mm_packs_epi16((__m128i)lanes, (__m128i)lanes);
+  _mm_storel_epi64((__m128i*)dst, _mm_and_si128(bytes, _mm_set1_epi8(1)));
+}
+
+RPNMATH_SIMD_TARGET_SSE2 static inline void rpnmath_simd_SSE2_I32_store_mask(uint8_t *dst, rpnmath_simd_SSE2_I32_t lanes) {
+  __m128i words = _mm_packs_epi32((__m128i)lanes, (__m128i)lanes);
+  int bytes = _mm_cvtsi128_si32(_mm_and_si128(_mm_packs_epi16(words, words), _mm_set1_epi8(1)));
+  memcpy(dst, &bytes, 4);
+}
+
+RPNMATH_SIMD_TARGET_SSE2 static inline void rpnmath_simd_SSE2_I64_store_mask(uint8_t *dst, rpnmath_simd_SSE2_I64_t lanes) {
+  __m128i words = _mm_shuffle_epi32((__m128i)lanes, 0x08);
+  words = _mm_packs_epi32(words, words);
+  int bytes = _mm_cvtsi128_si32(_mm_and_si128(_mm_packs_epi16(words, words), _mm_set1_epi8(1)));
+  memcpy(dst, &bytes, 2);
+}
+
+// Mask bytes unpacked onto themselves fill their lanes, any nonzero byte
+// selects it
+RPNMATH_SIMD_TARGET_SSE2 static inline rpnmath_simd_SSE2_I8_t rpnmath_simd_SSE2_I8_load_mask(const uint8_t *src) {
+  rpnmath_simd_SSE2_I8_t bytes = (rpnmath_simd_SSE2_I8_t)_mm_loadu_si128((const __m128i*)src);
+  return bytes != 0;
+}
+
+RPNMATH_SIMD_TARGET_SSE2 static inline rpnmath_simd_SSE2_I16_t rpnmath_simd_SSE2_I16_load_mask(const uint8_t *src) {
+  __m128i bytes = _mm_loadl_epi64((const __m128i*)src);
+  return (rpnmath_simd_SSE2_I16_t)((rpnmath_simd_SSE2_I8_t)_mm_unpacklo_epi8(bytes, bytes) != 0);
+}
+
+RPNMATH_SIMD_TARGET_SSE2 static inline rpnmath_simd_SSE2_I32_t rpnmath_simd_SSE2_I32_load_mask(const uint8_t *src) {
+  int packed;
+  memcpy(&packed, src, 4);
+  __m128i bytes = _mm_cvtsi32_si128(packed);
+  bytes = _mm_unpacklo_epi8(bytes, bytes);
+  return (rpnmath_simd_SSE2_I32_t)((rpnmath_simd_SSE2_I8_t)_mm_unpacklo_epi16(bytes, bytes) != 0);
+}
+
+RPNMATH_SIMD_TARGET_SSE2 static inline rpnmath_simd_SSE2_I64_t rpnmath_simd_SSE2_I64_load_mask(const uint8_t *src) {
+  uint16_t packed;
+  memcpy(&packed, src, 2);
+  __m128i bytes = _mm_cvtsi32_si128(packed);
+  bytes = _mm_unpacklo_epi8(bytes, bytes);
+  bytes = _mm_unpacklo_epi16(bytes, bytes);
+  return (rpnmath_simd_SSE2_I64_t)((rpnmath_simd_SSE2_I8_t)_mm_unpacklo_epi32(bytes, bytes) != 0);
+}
+
+// AVX2 building blocks. Signed products of the even and odd lanes give the
+// upper halves of 32 bit products, 128 bit halves go through the SSE2
+// conversions and packs.
+RPNMATH_SIMD_TARGET_AVX2 static inline rpnmath_simd_AVX2_I32_t rpnmath_simd_AVX2_I32_mul(rpnmath_simd_AVX2_I32_t a, rpnmath_simd_AVX2_I32_t b,
+                                                                                       rpnmath_simd_AVX2_I32_t *failed) {
+  __m256i even = _mm256_mul_epi32((__m256i)a, (__m256i)b);
+  __m256i odd = _mm256_mul_epi32(_mm256_srli_epi64((__m256i)a, 32), _mm256_srli_epi64((__m256i)b, 32));
+  rpnmath_simd_AVX2_I32_t high = (rpnmath_simd_AVX2_I32_t)_mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xaa);
+  rpnmath_simd_AVX2_I32_t low = (rpnmath_simd_AVX2_I32_t)_mm256_mullo_epi32((__m256i)a, (__m256i)b);
+  *failed |= high != low >> 31;
+  return low;
+}
+
+RPNMATH_SIMD_TARGET_AVX2 static inline rpnmath_simd_AVX2_I32_t rpnmath_simd_AVX2_I32_quotient(rpnmath_simd_AVX2_I32_t a, rpnmath_simd_AVX2_I32_t b) {
+  __m128i low = _mm256_cvttpd_epi32(_mm256_div_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128((__m256i)a)),
+                                                  _mm256_cvtepi32_pd(_mm256_castsi256_si128((__m256i)b))));
+  __m128i high = _mm256_cvttpd_epi32(_mm256_div_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256((__m256i)a, 1)),
+                                                   _mm256_cvtepi32_pd(_mm256_extracti128_si256((__m256i)b, 1))));
+  return (rpnmath_simd_AVX2_I32_t)_mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+}
+
+RPNMATH_SIMD_TARGET_AVX2 static inline void rpnmath_simd_AVX2_I8_store_mask(uint8_t *dst, rpnmath_simd_AVX2_I8_t lanes) {
+  _mm256_storeu_si256((__m256i*)dst, _mm256_and_si256((__m256i)lanes, _mm256_set1_epi8(1)));
+}
+
+RPNMATH_SIMD_TARGET_AVX2 static inline void rpnmath_simd_AVX2_I16_store_mask(uint8_t *dst, rpnmath_simd_AVX2_I16_t lanes) {
+  __m128i bytes = _mm_packs_epi16(_mm256_castsi256_si128((__m256i)lanes), _mm256_extracti128_si256((__m256i)lanes, 1));
+  _mm_storeu_si128((__m128i*)dst, _mm_and_si128(bytes, _mm_set1_epi8(1)));
+}
+
+RPNMATH_SIMD_TARGET_AVX2 static inline void rpnmath_simd_AVX2_I32_store_mask(uint8_t *dst, rpnmath_simd_AVX2_I32_t lanes) {
+  __m128i words = _mm_packs_epi32(_mm256_castsi256_si128((__m256i)lanes), _mm256_extracti128_si256((__m256i)lanes, 1));
+  _mm_storel_epi64((__m128i*)dst, _mm_and_si128(_mm_packs_epi16(words, words), _mm_set1_epi8(1)));
+}
+
+RPNMATH_SIMD_TARGET_AVX2 static inline void rpnmath_simd_AVX2_I64_store_mask(uint8_t *dst, rpnmath_simd_AVX2_I64_t lanes) {
+  __m128i words = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32((__m256i)lanes, _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6)));
+  words = _mm_packs_epi32(words, words);
+  int bytes = _mm_cvtsi128_si32(_mm_and_si128(_mm_packs_epi16(words, words), _mm_set1_epi8(1)));
+  memcpy(dst, &bytes, 4);
+}
+
+RPNMATH_SIMD_TARGET_AVX2 static inline rpnmath_simd_AVX2_I8_t rpnmath_simd_AVX2_I8_load_mask(const uint8_t *src) {
+  rpnmath_simd_AVX2_I8_t bytes = (rpnmath_simd_AVX2_I8_t)_mm256_loadu_si256((const __m256i*)src);
+  return bytes != 0;
+}
+
+RPNMATH_SIMD_TARGET_AVX2 static inline rpnmath_simd_AVX2_I16_t rpnmath_simd_AVX2_I16_load_mask(const uint8_t *src) {
+  return (rpnmath_simd_AVX2_I16_t)_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)src)) != 0;
+}
+
+RPNMATH_SIMD_TARGET_AVX2 static inline rpnmath_simd_AVX2_I32_t rpnmath_simd_AVX2_I32_load_mask(const uint8_t *src) {
+  return (rpnmath_simd_AVX2_I32_t)_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)src)) != 0;
+}
+
+RPNMATH_SIMD_TARGET_AVX2 static inline rpnmath_simd_AVX2_I64_t rpnmath_simd_AVX2_I64_load_mask(const uint8_t *src) {
+  int packed;
+  memcpy(&packed, src, 4);
+  return (rpnmath_simd_AVX2_I64_t)_mm256_cvtepu8_epi64(_mm_cvtsi32_si128(packed)) != 0;
+}
+
+// AVX-512 building blocks, like the AVX2 ones on twice the lanes. Masks
+// narrow and widen with the conversions between lane widths it adds.
+RPNMATH_SIMD_TARGET_AVX512 static inline rpnmath_simd_AVX512_I32_t rpnmath_simd_AVX512_I32_mul(rpnmath_simd_AVX512_I32_t a, rpnmath_simd_AVX512_I32_t b,
+                                                                                             rpnmath_simd_AVX512_I32_t *failed) {
+  __m512i even = _mm512_mul_epi32((__m512i)a, (__m512i)b);
+  __m512i odd = _mm512_mul_epi32(_mm512_srli_epi64((__m512i)a, 32), _mm512_srli_epi64((__m512i)b, 32));
+  rpnmath_simd_AVX512_I32_t high = (rpnmath_simd_AVX512_I32_t)_mm512_mask_blend_epi32(0xaaaa, _mm512_srli_epi64(even, 32), odd);
+  rpnmath_simd_AVX512_I32_t low = (rpnmath_simd_AVX512_I32_t)_mm512_mullo_epi32((__m512i)a, (__m512i)b);
+  *failed |= high != low >> 31;
+  return low;
+}
+
+RPNMATH_SIMD_TARGET_AVX512 static inline rpnmath_simd_AVX512_I32_t rpnmath_simd_AVX512_I32_quotient(rpnmath_simd_AVX512_I32_t a, rpnmath_simd_AVX512_I32_t b) {
+  __m256i low = _mm512_cvttpd_epi32(_mm512_div_pd(_mm512_cvtepi32_pd(_mm512_castsi512_si256((__m512i)a)),
+                                                  _mm512_cvtepi32_pd(_mm512_castsi512_si256((__m512i)b))));
+  __m256i high = _mm512_cvttpd_epi32(_mm512_div_pd(_mm512_cvtepi32_pd(_mm512_extracti64x4_epi64((__m512i)a, 1)),
+                                                   _mm512_cvtepi32_pd(_mm512_extracti64x4_epi64((__m512i)b, 1))));
+  return (rpnmath_simd_AVX512_I32_t)_mm512_inserti64x4(_mm512_castsi256_si512(low), high, 1);
+}
+
+RPNMATH_SIMD_TARGET_AVX512 static inline void rpnmath_simd_AVX512_I8_store_mask(uint8_t *dst, rpnmath_simd_AVX512_I8_t lanes) {
+  _mm512_storeu_si512(dst, _mm512_and_si512((__m512i)lanes, _mm512_set1_epi8(1)));
+}
+
+RPNMATH_SIMD_TARGET_AVX512 static inline void rpnmath_simd_AVX512_I16_store_mask(uint8_t *dst, rpnmath_simd_AVX512_I16_t lanes) {
+  _mm256_storeu_si256((__m256i*)dst, _mm256_and_si256(_mm512_cvtepi16_epi8((__m512i)lanes), _mm256_set1_epi8(1)));
+}
+
+RPNMATH_SIMD_TARGET_AVX512 static inline void rpnmath_simd_AVX512_I32_store_mask(uint8_t *dst, rpnmath_simd_AVX512_I32_t lanes) {
+  _mm_storeu_si128((__m128i*)dst, _mm_and_si128(_mm512_cvtepi32_epi8((__m512i)lanes), _mm_set1_epi8(1)));
+}
+
+RPNMATH_SIMD_TARGET_AVX512 static inline void rpnmath_simd_AVX512_I64_store_mask(uint8_t *dst, rpnmath_simd_AVX512_I64_t lanes) {
+  _mm_storel_epi64((__m128i*)dst, _mm_and_si128(_mm512_cvtepi64_epi8((__m512i)lanes), _mm_set1_epi8(1)));
+}
+
+RPNMATH_SIMD_TARGET_AVX512 static inline rpnmath_simd_AVX512_I8_t rpnmath_simd_AVX512_I8_load_mask(const uint8_t *src) {
+  rpnmath_simd_AVX512_I8_t bytes = (rpnmath_simd_AVX512_I8_t)_mm512_loadu_si512(src);
+  return bytes != 0;
+}
+
+RPNMATH_SIMD_TARGET_AVX512 static inline rpnmath_simd_AVX512_I16_t rpnmath_simd_AVX512_I16_load_mask(const uint8_t *src) {
+  return (rpnmath_simd_AVX512_I16_t)_mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)src)) != 0;
+}
+
+RPNMATH_SIMD_TARGET_AVX512 static inline rpnmath_simd_AVX512_I32_t rpnmath_simd_AVX512_I32_load_mask(const uint8_t *src) {
+  return (rpnmath_simd_AVX512_I32_t)_mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*)src)) != 0;
+}
+
+RPNMATH_SIMD_TARGET_AVX512 static inline rpnmath_simd_AVX512_I64_t rpnmath_simd_AVX512_I64_load_mask(const uint8_t *src) {
+  return (rpnmath_simd_AVX512_I64_t)_mm512_cvtepu8_epi64(_mm_loadl_epi64((const __m128i*)src)) != 0;
+}
+
+// AVX-512 filters: compress moves the selected lanes of a register to its
+// front, the whole register is stored at the count and the next one
+// overwrites what lies past the selected lanes. Without VBMI2 only 32 and
+// 64 bit lanes compress, 8 and 16 bit rows go through 32 bit lanes. The
+// store ends where the rows loaded do, so dst may be src.
+#define RPNMATH_SIMD_AVX512_FILTER_DEFINE(width, ctype, lanes, bits, load, store) \
+  RPNMATH_SIMD_TARGET_AVX512 static size_t rpnmath_simd_AVX512_FILTER_##width(size_t n, const uint8_t *mask, const void *src, \
+                                                                            void *dst) { \
+    const ctype *s = src; \
+    ctype *d = dst; \
+    size_t count = 0; \
+    size_t row = 0; \
+    for (; row + lanes <= n; row += lanes) { \
+      __mmask##lanes chosen = _mm512_test_epi##bits##_mask((__m512i)rpnmath_simd_AVX512_I##bits##_load_mask(mask + row), \
+                                                          _mm512_set1_epi##bits(1)); \
+      __m512i packed = _mm512_maskz_compress_epi##bits(chosen, load); \
+      store; \
+      count += (size_t)__builtin_popcount(chosen); \
+    } \
+    return count + rpnmath_simd_SCALAR_FILTER_##width(n - row, mask + row, s + row, d + count); \
+  }
+
+RPNMATH_SIMD_AVX512_FILTER_DEFINE(I8, int8_t, 16, 32, _mm512_cvtepi8_epi32(_mm_loadu_si128((const __m128i*)(s + row))),
+                                  _mm_storeu_si128((__m128i*)(d + count), _mm512_cvtepi32_epi8(packed)))
+RPNMATH_SIMD_AVX512_FILTER_DEFINE(I16, int16_t, 16, 32, _mm512_cvtepi16_epi32(_mm256_loadu_si256((const __m256i*)(s + row))),
+                                  _mm256_storeu_si256((__m256i*)(d + count), _mm512_cvtepi32_epi16(packed)))
+RPNMATH_SIMD_AVX512_FILTER_DEFINE(I32, int32_t, 16, 32, _mm512_loadu_si512(s + row), _mm512_storeu_si512(d + count, packed))
+RPNMATH_SIMD_AVX512_FILTER_DEFINE(I64, int64_t, 8, 64, _mm512_loadu_si512(s + row), _mm512_storeu_si512(d + count, packed))
+
+// Vector arithmetic: result = a op b wrapped, and the sign bit of every
+// lane whose exact result did not fit set in failed
+#define RPNMATH_SIMD_VECTOR_ADD(isa, width, ctype, utype) \
+  result = (RPNMATH_SIMD_VECTOR(isa, width, t))((RPNMATH_SIMD_VECTOR(isa, width, unsigned_t))a + \
+                                                (RPNMATH_SIMD_VECTOR(isa, width, unsigned_t))b); \
+  failed |= (a ^ result) & (b ^ result);
+#define RPNMATH_SIMD_VECTOR_SUB(isa, width, ctype, utype) \
+  result = (RPNMATH_SIMD_VECTOR(isa, width, t))((RPNMATH_SIMD_VECTOR(isa, width, unsigned_t))a - \
+                                                (RPNMATH_SIMD_VECTOR(isa, width, unsigned_t))b); \
+  failed |= (a ^ b) & (a ^ result);
+#define RPNMATH_SIMD_VECTOR_MUL(isa, width, ctype, utype) \
+  result = rpnmath_simd_##isa##_##width##_mul(a, b, &failed);
+// Lanes dividing by zero or the smallest value by -1 divide by 1 instead,
+// which already is the wrapped result of the latter
+#define RPNMATH_SIMD_VECTOR_DIV(isa, width, ctype, utype) { \
+    RPNMATH_SIMD_VECTOR(isa, width, t) zero = b == 0; \
+    RPNMATH_SIMD_VECTOR(isa, width, t) bad = zero | ((a == RPNMATH_SIMD_MIN(ctype, utype)) & (b == -1)); \
+    result = rpnmath_simd_##isa##_##width##_quotient(a, (b & ~bad) | (bad & 1)) & ~zero; \
+    failed |= bad; \
+  }
+
+// Vector kernels, e.g. rpnmath_simd_AVX2_ADD_I32. After a vector with a
+// failing lane the scalar kernel goes over the rows again to find it.
+#define RPNMATH_SIMD_VECTOR_ARITH_DEFINE(isa, op, width, ctype, utype) \
+  RPNMATH_SIMD_TARGET_##isa static size_t rpnmath_simd_##isa##_##op##_##width(size_t n, const void *left, const void *right, void *dst) { \
+    const ctype *l = left; \
+    const ctype *r = right; \
+    ctype *d = dst; \
+    RPNMATH_SIMD_VECTOR(isa, width, t) failed = {0}; \
+    size_t row = 0; \
+    for (; row + RPNMATH_SIMD_LANES(isa, ctype) <= n; row += RPNMATH_SIMD_LANES(isa, ctype)) { \
+      RPNMATH_SIMD_VECTOR(isa, width, t) a, b, result; \
+      memcpy(&a, l + row, sizeof(a)); \
+      memcpy(&b, r + row, sizeof(b)); \
+      RPNMATH_SIMD_VECTOR_##op(isa, width, ctype, utype) \
+      memcpy(d + row, &result, sizeof(result)); \
+    } \
+    for (size_t lane = 0; lane < RPNMATH_SIMD_LANES(isa, ctype); lane++) { \
+      if (failed[lane] < 0) { \
+        rpnmath_simd_SCALAR_##op##_##width(n - row, l + row, r + row, d + row); \
+        return rpnmath_simd_SCALAR_##op##_##width(row, l, r, d); \
+      } \
+    } \
+    size_t tail = rpnmath_simd_SCALAR_##op##_##width(n - row, l + row, r + row, d + row); \
+    return tail < n - row ? row + tail : n; \
+  }
+
+#define RPNMATH_SIMD_VECTOR_COMPARE_DEFINE(isa, op, width, ctype, utype) \
+  RPNMATH_SIMD_TARGET_##isa static size_t rpnmath_simd_##isa##_##op##_##width(size_t n, const void *left, const void *right, void *dst) { \
+    const ctype *l = left; \
+    const ctype *r = right; \
+    uint8_t *mask = dst; \
+    size_t row = 0; \
+    for (; row + RPNMATH_SIMD_LANES(isa, ctype) <= n; row += RPNMATH_SIMD_LANES(isa, ctype)) { \
+      RPNMATH_SIMD_VECTOR(isa, width, t) a, b; \
+      memcpy(&a, l + row, sizeof(a)); \
+      memcpy(&b, r + row, sizeof(b)); \
+      rpnmath_simd_##isa##_##width##_store_mask(mask + row, a RPNMATH_SIMD_OP_##op b); \
+    } \
+    rpnmath_simd_SCALAR_##op##_##width(n - row, l + row, r + row, mask + row); \
+    return n; \
+  }
+
+#define RPNMATH_SIMD_VECTOR_SELECT_DEFINE(isa, op, width, ctype, utype) \
+  RPNMATH_SIMD_TARGET_##isa static void rpnmath_simd_##isa##_SELECT_##width(size_t n, const uint8_t *mask, \
+                                                                            const void *left, const void *right, void *dst) { \
+    const ctype *l = left; \
+    const ctype *r = right; \
+    ctype *d = dst; \
+    size_t row = 0; \
+    for (; row + RPNMATH_SIMD_LANES(isa, ctype) <= n; row += RPNMATH_SIMD_LANES(isa, ctype)) { \
+      RPNMATH_SIMD_VECTOR(isa, width, t) a, b, result; \
+      memcpy(&a, l + row, sizeof(a)); \
+      memcpy(&b, r + row, sizeof(b)); \
+      RPNMATH_SIMD_VECTOR(isa, width, t) chosen = rpnmath_simd_##isa##_##width##_load_mask(mask + row); \
+      result = (a & chosen) | (b & ~chosen); \
+      memcpy(d + row, &result, sizeof(result)); \
+    } \
+    rpnmath_simd_SCALAR_SELECT_##width(n - row, mask + row, l + row, r + row, d + row); \
+  }
+
+#define RPNMATH_SIMD_ISA_DEFINE(isa) \
+  RPNMATH_SIMD_WIDTHS(RPNMATH_SIMD_VECTOR_ARITH_DEFINE, isa, ADD) \
+  RPNMATH_SIMD_WIDTHS(RPNMATH_SIMD_VECTOR_ARITH_DEFINE, isa, SUB) \
+  RPNMATH_SIMD_NARROW(RPNMATH_SIMD_VECTOR_ARITH_DEFINE, isa, MUL) \
+  RPNMATH_SIMD_NARROW(RPNMATH_SIMD_VECTOR_ARITH_DEFINE, isa, DIV) \
+  RPNMATH_SIMD_COMPARES(RPNMATH_SIMD_VECTOR_COMPARE_DEFINE, isa) \
+  RPNMATH_SIMD_WIDTHS(RPNMATH_SIMD_VECTOR_SELECT_DEFINE, isa, SELECT)
+
+RPNMATH_SIMD_ISA_DEFINE(SSE2)
+RPNMATH_SIMD_ISA_DEFINE(AVX2)
+RPNMATH_SIMD_ISA_DEFINE(AVX512)
+
+#endif
+
+// The kernel table of an instruction set, 64 bit multiplication and
+// division are the scalar kernels everywhere, filters those of filter_set
+#define RPNMATH_SIMD_ROW(set, op) \
+  {rpnmath_simd_##set##_##op##_I8, rpnmath_simd_##set##_##op##_I16, rpnmath_simd_##set##_##op##_I32, rpnmath_simd_##set##_##op##_I64}
+#define RPNMATH_SIMD_TABLE(set, filter_set) \
+  static const rpnmath_simd_t rpnmath_simd_##set = { \
+    .isa = RPNMATH_SIMD_##set, \
+    .kernels = { \
+      [RPNMATH_OP_ADD] = RPNMATH_SIMD_ROW(set, ADD), \
+      [RPNMATH_OP_SUB] = RPNMATH_SIMD_ROW(set, SUB), \
+      [RPNMATH_OP_MUL] = {rpnmath_simd_##set##_MUL_I8, rpnmath_simd_##set##_MUL_I16, rpnmath_simd_##set##_MUL_I32, \
+                          rpnmath_simd_SCALAR_MUL_I64}, \
+      [RPNMATH_OP_DIV] = {rpnmath_simd_##set##_DIV_I8, rpnmath_simd_##set##_DIV_I16, rpnmath_simd_##set##_DIV_I32, \
+                          rpnmath_simd_SCALAR_DIV_I64}, \
+      [RPNMATH_OP_EQ] = RPNMATH_SIMD_ROW(set, EQ), \
+      [RPNMATH_OP_NE] = RPNMATH_SIMD_ROW(set, NE), \
+      [RPNMATH_OP_LT] = RPNMATH_SIMD_ROW(set, LT), \
+      [RPNMATH_OP_LE] = RPNMATH_SIMD_ROW(set, LE), \
+      [RPNMATH_OP_GT] = RPNMATH_SIMD_ROW(set, GT), \
+      [RPNMATH_OP_GE] = RPNMATH_SIMD_ROW(set, GE), \
+    }, \
+    .select = RPNMATH_SIMD_ROW(set, SELECT), \
+    .filter = RPNMATH_SIMD_ROW(filter_set, FILTER), \
+  };
+
+RPNMATH_SIMD_TABLE(SCALAR, SCALAR)
+#if RPNMATH_SIMD_X86
+RPNMATH_SIMD_TABLE(SSE2, SCALAR)
+RPNMATH_SIMD_TABLE(AVX2, SCALAR)
+RPNMATH_SIMD_TABLE(AVX512, AVX512)
+#endif
+
+const char* rpnmath_simd_isa_name(rpnmath_simd_isa_t isa) {
+  switch (isa) {
+    case RPNMATH_SIMD_SCALAR: return "scalar";
+    case RPNMATH_SIMD_SSE2: return "sse2";
+    case RPNMATH_SIMD_AVX2: return "avx2";
+    case RPNMATH_SIMD_AVX512: return "avx512";
+    default: return "unknown";
+  }
+}
+
+rpnmath_simd_width_t rpnmath_simd_width(size_t bits) {
+  switch (rpnmath_type_native_size(bits)) {
+    case 1: return RPNMATH_SIMD_I8;
+    case 2: return RPNMATH_SIMD_I16;
+    case 4: return RPNMATH_SIMD_I32;
+    default: return RPNMATH_SIMD_I64;
+  }
+}
+
+const rpnmath_simd_t* rpnmath_simd_get(rpnmath_simd_isa_t isa) {
+  switch (isa) {
+    case RPNMATH_SIMD_SCALAR:
+      return &rpnmath_simd_SCALAR;
+#if RPNMATH_SIMD_X86
+    // These check the CPU and that the OS saves the wider registers
+    case RPNMATH_SIMD_SSE2:
+      return __builtin_cpu_supports("sse2") ? &rpnmath_simd_SSE2 : NULL;
+    case RPNMATH_SIMD_AVX2:
+      return __builtin_cpu_supports("avx2") ? &rpnmath_simd_AVX2 : NULL;
+    case RPNMATH_SIMD_AVX512:
+      return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") ? &rpnmath_simd_AVX512 : NULL;
+#endif
+    default:
+      return NULL;
+  }
+}
+
+// The only state the library keeps, written once by rpnmath_simd_choose
+static once_flag rpnmath_simd_once = ONCE_FLAG_INIT;
+static const rpnmath_simd_t *rpnmath_simd_chosen;
+
+static void rpnmath_simd_choose(void) {
+  for (int isa = RPNMATH_SIMD_ISA_COUNT - 1; isa >= 0 && !rpnmath_simd_chosen; isa--) {
+    rpnmath_simd_chosen = rpnmath_simd_get((rpnmath_simd_isa_t)isa);
+  }
+}
+
+const rpnmath_simd_t* rpnmath_simd_best(void) {
+  call_once(&rpnmath_simd_once, rpnmath_simd_choose);
+  return rpnmath_simd_chosen;
+}
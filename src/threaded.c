@@ -0,0 +1,318 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include "type.h"
+#include "item.h"
+#include "value.h"
+#include "arena.h"
+#include "context.h"
+#include "program.h"
+#include "exec.h"
+
+// Direct-threaded engine. rpnmath_threaded_compile pre-decodes the program into
+// rpnmath_threaded_insn_t entries holding the address of their handler, so every
+// handler ends with an indirect jump straight to the next one. Compilers without
+// computed goto fall back to a switch over the same pre-decoded array.
+
+#if defined(__GNUC__) || defined(__clang__)
+#  define RPNMATH_COMPUTED_GOTO 1
+#else
+#  define RPNMATH_COMPUTED_GOTO 0
+#endif
+
+#if RPNMATH_COMPUTED_GOTO
+// Labels as values are a GNU extension
+#  pragma GCC diagnostic push
+#  pragma GCC diagnostic ignored "-Wpedantic"
+#  define RPNMATH_DISPATCH_BEGIN goto *ip->handler; {
+#  define RPNMATH_DISPATCH_END }
+#  define RPNMATH_TARGET(name) op_##name
+#  define RPNMATH_NEXT() do { ip++; goto *ip->handler; } while (0)
+#  define RPNMATH_JUMP(pos) do { ip = code + (pos); goto *ip->handler; } while (0)
+#else
+#  define RPNMATH_DISPATCH_BEGIN dispatch: switch (ip->opcode) {
+#  define RPNMATH_DISPATCH_END default: return rpnmath_context_fail(context, RPNMATH_STATUS_UNKNOWN_INSTRUCTION, ip->opcode); }
+#  define RPNMATH_TARGET(name) case RPNMATH_INSN_##name
+#  define RPNMATH_NEXT() do { ip++; goto dispatch; } while (0)
+#  define RPNMATH_JUMP(pos) do { ip = code + (pos); goto dispatch; } while (0)
+#endif
+
+// Runs the program, or when labels is not NULL only hands out the handler table
+static int rpnmath_threaded_run(const rpnmath_program_t *program, rpnmath_context_t *context,
+                                rpnmath_item_const_t *result, const void *const **labels) {
+#if RPNMATH_COMPUTED_GOTO
+  static const void *const handlers[] = {
+    [RPNMATH_INSN_NOP] = &&op_NOP,
+    [RPNMATH_INSN_PUSH] = &&op_PUSH,
+    [RPNMATH_INSN_LOAD] = &&op_LOAD,
+    [RPNMATH_INSN_STORE] = &&op_STORE,
+    [RPNMATH_INSN_ADD] = &&op_ADD,
+    [RPNMATH_INSN_SUB] = &&op_SUB,
+    [RPNMATH_INSN_MUL] = &&op_MUL,
+    [RPNMATH_INSN_DIV] = &&op_DIV,
+    [RPNMATH_INSN_EQ] = &&op_EQ,
+    [RPNMATH_INSN_NE] = &&op_NE,
+    [RPNMATH_INSN_LT] = &&op_LT,
+    [RPNMATH_INSN_LE] = &&op_LE,
+    [RPNMATH_INSN_GT] = &&op_GT,
+    [RPNMATH_INSN_GE] = &&op_GE,
+    [RPNMATH_INSN_SELECT] = &&op_SELECT,
+    [RPNMATH_INSN_MIN] = &&op_MIN,
+    [RPNMATH_INSN_MAX] = &&op_MAX,
+    [RPNMATH_INSN_ABS] = &&op_ABS,
+    [RPNMATH_INSN_IF] = &&op_IF,
+    [RPNMATH_INSN_ELSE] = &&op_ELSE,
+    [RPNMATH_INSN_LOOP] = &&op_LOOP,
+    [RPNMATH_INSN_END] = &&op_END,
+    [RPNMATH_INSN_PHI] = &&op_PHI,
+    [RPNMATH_INSN_RET] = &&op_RET,
+    [RPNMATH_INSN_HALT] = &&op_HALT,
+    [RPNMATH_INSN_ADD_VC] = &&op_ADD_VC,
+    [RPNMATH_INSN_STORE_C] = &&op_STORE_C,
+    [RPNMATH_INSN_IF_CMP] = &&op_IF_CMP,
+#define RPNMATH_KERNEL_HANDLER(op, width, bits, ctype) [RPNMATH_INSN_##op##_##width] = &&op_##op##_##width,
+    RPNMATH_KERNELS(RPNMATH_KERNEL_HANDLER)
+    RPNMATH_KERNELS_ADD_VC(RPNMATH_KERNEL_HANDLER)
+    RPNMATH_FLOAT_KERNELS(RPNMATH_KERNEL_HANDLER)
+    RPNMATH_FLOAT_COMPARES(RPNMATH_KERNEL_HANDLER)
+    RPNMATH_DECIMAL_KERNELS(RPNMATH_KERNEL_HANDLER)
+    RPNMATH_DECIMAL_COMPARES(RPNMATH_KERNEL_HANDLER)
+#undef RPNMATH_KERNEL_HANDLER
+  };
+  
+  if (labels) {
+    *labels = handlers;
+    return 0;
+  }
+#else
+  if (labels) {
+    *labels = NULL;
+    return 0;
+  }
+#endif
+  
+  // The compiler proved the stack never goes deeper than max_depth, nor below zero
+  if (rpnmath_context_reserve(context, program->max_depth, program->variable_count) != 0) {
+    return context->error.status;
+  }
+  rpnmath_context_reset_blocks(context);
+  
+  const rpnmath_threaded_insn_t *code = program->threaded;
+  const rpnmath_threaded_insn_t *ip = code;
+  const rpnmath_block_t *blocks = program->blocks;
+  rpnmath_overflow_t overflow = program->overflow;
+  rpnmath_rounding_t rounding = program->rounding;
+  rpnmath_arena_t *arena = context->arena;
+  rpnmath_value_t *sp = context->values; // next free slot
+  
+  RPNMATH_DISPATCH_BEGIN
+    
+  RPNMATH_TARGET(NOP):
+    RPNMATH_NEXT();
+    
+  RPNMATH_TARGET(PUSH):
+    *sp++ = *ip->constant;
+    RPNMATH_NEXT();
+    
+  RPNMATH_TARGET(LOAD):
+    if (rpnmath_context_load_variable(context, ip->operand, sp) != 0) return context->error.status;
+    sp++;
+    RPNMATH_NEXT();
+    
+  RPNMATH_TARGET(STORE):
+    sp--;
+    if (rpnmath_context_store_variable(context, ip->operand, sp) != 0) return context->error.status;
+    RPNMATH_NEXT();
+    
+  RPNMATH_TARGET(ADD_VC):
+    if (rpnmath_context_load_variable(context, ip->operand, sp) != 0) return context->error.status;
+    RPNMATH_EXEC_TRY(context, rpnmath_exec_arith(overflow, rounding, arena, RPNMATH_OP_ADD, sp, sp, ip->constant2), RPNMATH_OP_ADD, sp, ip->constant2);
+    sp++;
+    RPNMATH_NEXT();
+    
+  RPNMATH_TARGET(STORE_C):
+    if (rpnmath_context_store_variable(context, ip->operand, ip->constant2) != 0) return context->error.status;
+    RPNMATH_NEXT();
+    
+#define RPNMATH_KERNEL_TARGET(op, width, bits, ctype) \
+  RPNMATH_TARGET(op##_##width): \
+    sp--; \
+    RPNMATH_EXEC_TRY(context, rpnmath_kernel_##op##_##width(overflow, arena, sp - 1, sp - 1, sp), RPNMATH_OP_##op, sp - 1, sp); \
+    RPNMATH_NEXT();
+#define RPNMATH_KERNEL_TARGET_ADD_VC(op, width, bits, ctype) \
+  RPNMATH_TARGET(ADD_VC_##width): \
+    if (rpnmath_context_load_variable(context, ip->operand, sp) != 0) return context->error.status; \
+    RPNMATH_EXEC_TRY(context, rpnmath_kernel_ADD_##width(overflow, arena, sp, sp, ip->constant2), RPNMATH_OP_ADD, sp, ip->constant2); \
+    sp++; \
+    RPNMATH_NEXT();
+#define RPNMATH_KERNEL_TARGET_OPERAND(op, width, bits, ctype) \
+  RPNMATH_TARGET(op##_##width): \
+    sp--; \
+    rpnmath_kernel_##op##_##width(ip->operand, sp - 1, sp - 1, sp); \
+    RPNMATH_NEXT();
+  RPNMATH_KERNELS(RPNMATH_KERNEL_TARGET)
+  RPNMATH_KERNELS_ADD_VC(RPNMATH_KERNEL_TARGET_ADD_VC)
+#define RPNMATH_KERNEL_TARGET_DECIMAL(op, width, bits, ctype) \
+  RPNMATH_TARGET(op##_##width): \
+    sp--; \
+    RPNMATH_EXEC_TRY(context, rpnmath_kernel_##op##_##width(overflow, ip->operand, sp - 1, sp - 1, sp), RPNMATH_OP_##op, sp - 1, sp); \
+    RPNMATH_NEXT();
+  RPNMATH_FLOAT_KERNELS(RPNMATH_KERNEL_TARGET_OPERAND)
+  RPNMATH_FLOAT_COMPARES(RPNMATH_KERNEL_TARGET_OPERAND)
+  RPNMATH_DECIMAL_KERNELS(RPNMATH_KERNEL_TARGET_DECIMAL)
+  RPNMATH_DECIMAL_COMPARES(RPNMATH_KERNEL_TARGET_OPERAND)
+#undef RPNMATH_KERNEL_TARGET
+#undef RPNMATH_KERNEL_TARGET_ADD_VC
+#undef RPNMATH_KERNEL_TARGET_OPERAND
+#undef RPNMATH_KERNEL_TARGET_DECIMAL
+    
+  RPNMATH_TARGET(ADD):
+    sp--;
+    RPNMATH_EXEC_TRY(context, rpnmath_exec_arith(overflow, rounding, arena, RPNMATH_OP_ADD, sp - 1, sp - 1, sp), RPNMATH_OP_ADD, sp - 1, sp);
+    RPNMATH_NEXT();
+    
+  RPNMATH_TARGET(SUB):
+    sp--;
+    RPNMATH_EXEC_TRY(context, rpnmath_exec_arith(overflow, rounding, arena, RPNMATH_OP_SUB, sp - 1, sp - 1, sp), RPNMATH_OP_SUB, sp - 1, sp);
+    RPNMATH_NEXT();
+    
+  RPNMATH_TARGET(MUL):
+    sp--;
+    RPNMATH_EXEC_TRY(context, rpnmath_exec_arith(overflow, rounding, arena, RPNMATH_OP_MUL, sp - 1, sp - 1, sp), RPNMATH_OP_MUL, sp - 1, sp);
+    RPNMATH_NEXT();
+    
+  RPNMATH_TARGET(DIV):
+    sp--;
+    RPNMATH_EXEC_TRY(context, rpnmath_exec_div(overflow, rounding, arena, sp - 1, sp - 1, sp), RPNMATH_OP_DIV, sp - 1, sp);
+    RPNMATH_NEXT();
+    
+  RPNMATH_TARGET(EQ):
+    sp--;
+    rpnmath_exec_compare(sp - 1, rpnmath_exec_test(RPNMATH_INSN_EQ, sp - 1, sp));
+    RPNMATH_NEXT();
+    
+  RPNMATH_TARGET(NE):
+    sp--;
+    rpnmath_exec_compare(sp - 1, rpnmath_exec_test(RPNMATH_INSN_NE, sp - 1, sp));
+    RPNMATH_NEXT();
+    
+  RPNMATH_TARGET(LT):
+    sp--;
+    rpnmath_exec_compare(sp - 1, rpnmath_exec_test(RPNMATH_INSN_LT, sp - 1, sp));
+    RPNMATH_NEXT();
+    
+  RPNMATH_TARGET(LE):
+    sp--;
+    rpnmath_exec_compare(sp - 1, rpnmath_exec_test(RPNMATH_INSN_LE, sp - 1, sp));
+    RPNMATH_NEXT();
+    
+  RPNMATH_TARGET(GT):
+    sp--;
+    rpnmath_exec_compare(sp - 1, rpnmath_exec_test(RPNMATH_INSN_GT, sp - 1, sp));
+    RPNMATH_NEXT();
+    
+  RPNMATH_TARGET(GE):
+    sp--;
+    rpnmath_exec_compare(sp - 1, rpnmath_exec_test(RPNMATH_INSN_GE, sp - 1, sp));
+    RPNMATH_NEXT();
+    
+  RPNMATH_TARGET(SELECT):
+    sp -= 2;
+    rpnmath_exec_select(sp - 1, sp - 1, sp, sp + 1);
+    RPNMATH_NEXT();
+    
+  RPNMATH_TARGET(MIN):
+    sp--;
+    rpnmath_exec_min(sp - 1, sp - 1, sp);
+    RPNMATH_NEXT();
+    
+  RPNMATH_TARGET(MAX):
+    sp--;
+    rpnmath_exec_max(sp - 1, sp - 1, sp);
+    RPNMATH_NEXT();
+    
+  RPNMATH_TARGET(ABS):
+    RPNMATH_EXEC_TRY(context, rpnmath_exec_abs(overflow, rounding, arena, sp - 1, sp - 1), RPNMATH_OP_ABS, sp - 1, NULL);
+    RPNMATH_NEXT();
+    
+  RPNMATH_TARGET(IF):
+    sp--;
+    RPNMATH_JUMP(rpnmath_exec_if(context, blocks, ip->operand, (size_t)(ip - code), rpnmath_exec_truth(sp)));
+    
+  RPNMATH_TARGET(IF_CMP):
+    sp -= 2;
+    RPNMATH_JUMP(rpnmath_exec_if(context, blocks, ip->operand, (size_t)(ip - code), rpnmath_exec_test(ip->operand2, sp, sp + 1)));
+    
+  RPNMATH_TARGET(ELSE):
+    RPNMATH_JUMP(rpnmath_exec_else(blocks, ip->operand));
+    
+  RPNMATH_TARGET(LOOP):
+    sp--;
+    RPNMATH_JUMP(rpnmath_exec_loop(context, blocks, ip->operand, (size_t)(ip - code), rpnmath_exec_truth(sp)));
+    
+  RPNMATH_TARGET(END):
+    RPNMATH_JUMP(rpnmath_exec_end(context, blocks, ip->operand, (size_t)(ip - code)));
+    
+  RPNMATH_TARGET(PHI): {
+    const rpnmath_phi_t *phi = &program->phis[ip->operand];
+    if (rpnmath_context_resolve_phi(context, phi->target_var,
+                                    program->phi_sources + phi->first_source,
+                                    phi->source_count) != 0) {
+      return context->error.status;
+    }
+    RPNMATH_NEXT();
+  }
+    
+  RPNMATH_TARGET(RET):
+    // Return the top value
+    return rpnmath_exec_ret(context, result, sp - 1);
+    
+  RPNMATH_TARGET(HALT):
+    // If we get here without returning, there was no return statement
+    return rpnmath_context_fail(context, RPNMATH_STATUS_NO_RETURN, 0);
+    
+  RPNMATH_DISPATCH_END
+}
+
+#if RPNMATH_COMPUTED_GOTO
+#  pragma GCC diagnostic pop
+#endif
+
+int rpnmath_threaded_compile(rpnmath_program_t *program, rpnmath_arena_t *arena) {
+  const void *const *labels;
+  rpnmath_threaded_run(NULL, NULL, NULL, &labels);
+  
+  program->threaded = rpnmath_arena_alloc(arena, (program->count + 1) * sizeof(rpnmath_threaded_insn_t));
+  if (!program->threaded) {
+    return -1;
+  }
+  
+  for (size_t i = 0; i <= program->count; i++) {
+    rpnmath_threaded_insn_t *insn = &program->threaded[i];
+    
+    if (i == program->count) {
+      insn->opcode = RPNMATH_INSN_HALT;
+      insn->operand = 0;
+      insn->operand2 = 0;
+      insn->handler = labels ? labels[insn->opcode] : NULL;
+      continue;
+    }
+    
+    const rpnmath_insn_t *source = &program->code[i];
+    insn->opcode = source->opcode;
+    insn->operand = source->operand;
+    insn->operand2 = source->operand2;
+    if (source->opcode == RPNMATH_INSN_PUSH) {
+      insn->constant = &program->constants[source->operand];
+    } else if (source->opcode == RPNMATH_INSN_ADD_VC || source->opcode == RPNMATH_INSN_STORE_C ||
+               (source->opcode >= RPNMATH_INSN_ADD_VC_I8 && source->opcode < RPNMATH_INSN_ADD_VC_I8 + RPNMATH_KERNEL_WIDTH_COUNT)) {
+      insn->constant2 = &program->constants[source->operand2];
+    }
+    
+    insn->handler = labels ? labels[insn->opcode] : NULL;
+  }
+  return 0;
+}
+
+int rpnmath_threaded_execute(const rpnmath_program_t *program, rpnmath_context_t *context, rpnmath_item_const_t *result) {
+  return rpnmath_threaded_run(program, context, result, NULL);
+}
@@ -1,5 +1,3 @@
-#include <stdio.h>
-#include <stdlib.h>
 #include <stdint.h>
 #include <limits.h>
 #include "type.h"
@@ -26,16 +24,44 @@ void rpnmath_type_int(rpnmath_type_t *type, size_t bitwidth) {
   type->_int = bitwidth;
 }
 
-// Helper function to get the native C type size for a given bit width
+void rpnmath_type_bigint(rpnmath_type_t *type, size_t bitwidth) {
+  type->kind = RPNMATH_TYPEKIND_BIGINT;
+  type->size = bitwidth;
+  type->_int = bitwidth;
+}
+
+void rpnmath_type_float(rpnmath_type_t *type, size_t bitwidth) {
+  type->kind = RPNMATH_TYPEKIND_FLOAT;
+  type->size = bitwidth;
+  type->_int = 0;
+}
+
+void rpnmath_type_decimal(rpnmath_type_t *type, size_t bitwidth, size_t scale) {
+  type->kind = RPNMATH_TYPEKIND_DECIMAL;
+  type->size = bitwidth;
+  type->scale = scale;
+}
+
+// Helper function to get the native C type size for a given bit width.
+// Anything wider is a big integer kept in limbs (see rpnmath_type_bytes), so
+// the widest native size is all callers can get; nothing here stops the process.
 size_t rpnmath_type_native_size(size_t bitwidth) {
   if (bitwidth <= 8) return 1;    // char
   if (bitwidth <= 16) return 2;   // short
   if (bitwidth <= 32) return 4;   // int
+#if RPNMATH_INT128
   if (bitwidth <= 64) return 8;   // long long
-  
-  // For anything over 64 bits, use TODO macro
-  printf("TODO: Support for integers over 64 bits not implemented\n");
-  abort();
+  return 16;                      // __int128
+#else
+  return 8;                       // long long
+#endif
+}
+
+size_t rpnmath_type_bytes(const rpnmath_type_t *type) {
+  if (rpnmath_type_has_limbs(type)) {
+    return rpnmath_type_sizeof(type->size);
+  }
+  return rpnmath_type_native_size(type->size);
 }
 
 // Helper function to determine if an operation would overflow
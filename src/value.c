@@ -0,0 +1,377 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <ctype.h>
+#include "type.h"
+#include "item.h"
+#include "value.h"
+#include "bigint.h"
+#include "decimal.h"
+
+long long rpnmath_value_narrow(long long value, size_t bitwidth) {
+  switch (rpnmath_type_native_size(bitwidth)) {
+    case 1: return (int8_t)value;
+    case 2: return (int16_t)value;
+    case 4: return (int32_t)value;
+    default: return (int64_t)value;
+  }
+}
+
+const char* rpnmath_overflow_name(rpnmath_overflow_t overflow) {
+  switch (overflow) {
+    case RPNMATH_OVERFLOW_WRAP: return "wrap";
+    case RPNMATH_OVERFLOW_TRAP: return "trap";
+    case RPNMATH_OVERFLOW_SATURATE: return "saturate";
+    case RPNMATH_OVERFLOW_PROMOTE: return "promote";
+    default: return "UNKNOWN";
+  }
+}
+
+const char* rpnmath_rounding_name(rpnmath_rounding_t rounding) {
+  switch (rounding) {
+    case RPNMATH_ROUNDING_HALF_EVEN: return "half-even";
+    case RPNMATH_ROUNDING_HALF_UP: return "half-up";
+    case RPNMATH_ROUNDING_DOWN: return "down";
+    case RPNMATH_ROUNDING_FLOOR: return "floor";
+    case RPNMATH_ROUNDING_CEILING: return "ceiling";
+    default: return "UNKNOWN";
+  }
+}
+
+// The widest integer arithmetic available, wide enough for the exact
+// result of any operation on integers of half its width
+#if RPNMATH_INT128
+typedef rpnmath_int128_t rpnmath_exact_t;
+typedef rpnmath_uint128_t rpnmath_exact_unsigned_t;
+#  define RPNMATH_EXACT_GET(value) rpnmath_value_get128(value)
+#else
+typedef long long rpnmath_exact_t;
+typedef unsigned long long rpnmath_exact_unsigned_t;
+#  define RPNMATH_EXACT_GET(value) ((value)->i)
+#endif
+#define RPNMATH_EXACT_BITS (sizeof(rpnmath_exact_t) * 8)
+
+int rpnmath_overflow_fails(rpnmath_overflow_t overflow) {
+  return overflow == RPNMATH_OVERFLOW_TRAP;
+}
+
+// Store an integer that fits in bits as the value's new content
+static void rpnmath_value_set_exact(rpnmath_value_t *value, rpnmath_exact_t exact, size_t bits) {
+  rpnmath_type_int(&value->type, bits);
+#if RPNMATH_INT128
+  if (bits > 64) {
+    rpnmath_value_set128(value, exact);
+    return;
+  }
+#endif
+  value->i = rpnmath_value_narrow((long long)exact, bits);
+}
+
+int rpnmath_value_overflow(rpnmath_overflow_t overflow, rpnmath_arena_t *arena, rpnmath_op_t operation, rpnmath_value_t *dst,
+                           const rpnmath_value_t *left, const rpnmath_value_t *right, size_t bits) {
+  rpnmath_exact_t l = RPNMATH_EXACT_GET(left);
+  rpnmath_exact_t r = RPNMATH_EXACT_GET(right);
+  size_t native_bits = rpnmath_type_native_size(bits) * 8;
+  
+  if (overflow == RPNMATH_OVERFLOW_WRAP) {
+    rpnmath_exact_unsigned_t wrapped;
+    switch (operation) {
+      case RPNMATH_OP_ADD: wrapped = (rpnmath_exact_unsigned_t)l + (rpnmath_exact_unsigned_t)r; break;
+      case RPNMATH_OP_SUB: wrapped = (rpnmath_exact_unsigned_t)l - (rpnmath_exact_unsigned_t)r; break;
+      case RPNMATH_OP_MUL: wrapped = (rpnmath_exact_unsigned_t)l * (rpnmath_exact_unsigned_t)r; break;
+      default: wrapped = r == -1 ? 0 - (rpnmath_exact_unsigned_t)l : (rpnmath_exact_unsigned_t)(l / r); break;
+    }
+    rpnmath_value_set_exact(dst, (rpnmath_exact_t)wrapped, bits);
+    return 0;
+  }
+  
+  if (overflow == RPNMATH_OVERFLOW_SATURATE) {
+    // The sign of the exact result follows from the operands alone
+    int positive;
+    switch (operation) {
+      case RPNMATH_OP_ADD: positive = r > 0; break;
+      case RPNMATH_OP_SUB: positive = r < 0; break;
+      case RPNMATH_OP_MUL: positive = (l < 0) == (r < 0); break;
+      default: positive = 1; break; // only the smallest value divided by -1 overflows
+    }
+    rpnmath_exact_t max = (rpnmath_exact_t)(((rpnmath_exact_unsigned_t)1 << (native_bits - 1)) - 1);
+    rpnmath_value_set_exact(dst, positive ? max : -max - 1, bits);
+    return 0;
+  }
+  
+  if (overflow == RPNMATH_OVERFLOW_PROMOTE) {
+    if (native_bits * 2 > RPNMATH_EXACT_BITS) {
+      return rpnmath_bigint_arith(operation, dst, left, right, arena);
+    }
+    
+    // Operands of at most half the exact width can not overflow it
+    rpnmath_exact_t exact;
+    switch (operation) {
+      case RPNMATH_OP_ADD: exact = l + r; break;
+      case RPNMATH_OP_SUB: exact = l - r; break;
+      case RPNMATH_OP_MUL: exact = l * r; break;
+      default: exact = l / r; break;
+    }
+    rpnmath_value_set_exact(dst, exact, native_bits * 2);
+    return 0;
+  }
+  
+  return RPNMATH_STATUS_OVERFLOW;
+}
+
+size_t rpnmath_value_format_size(const rpnmath_value_t *value) {
+  if (rpnmath_type_has_limbs(&value->type)) {
+    return rpnmath_bigint_format_size(value);
+  }
+  return RPNMATH_VALUE_FORMAT_SIZE;
+}
+
+// Floats print with the fewest digits that read back as the same value,
+// and always as a float literal again: "2.0", "0.1f"
+static void rpnmath_value_format_float(const rpnmath_value_t *value, char *buffer, size_t size) {
+  int single = value->type.size == 32;
+  if (value->f != value->f) {
+    // The sign of a NaN carries no meaning
+    snprintf(buffer, size, "nan");
+    return;
+  }
+  char text[RPNMATH_VALUE_FORMAT_SIZE];
+  for (int digits = single ? 6 : 15; ; digits++) {
+    snprintf(text, sizeof(text), "%.*g", digits, value->f);
+    if (digits == (single ? 9 : 17) ||
+        (single ? (double)strtof(text, NULL) == value->f : strtod(text, NULL) == value->f)) {
+      break;
+    }
+  }
+  
+  int finite = value->f - value->f == 0;
+  snprintf(buffer, size, "%s%s%s", text, finite && !strpbrk(text, ".e") ? ".0" : "", finite && single ? "f" : "");
+}
+
+void rpnmath_value_format(const rpnmath_value_t *value, char *buffer, size_t size) {
+  if (rpnmath_type_has_limbs(&value->type)) {
+    rpnmath_bigint_format(value, buffer, size);
+    return;
+  }
+  if (value->type.kind == RPNMATH_TYPEKIND_FLOAT) {
+    rpnmath_value_format_float(value, buffer, size);
+    return;
+  }
+  if (value->type.kind == RPNMATH_TYPEKIND_DECIMAL) {
+    rpnmath_decimal_format(value, buffer, size);
+    return;
+  }
+  
+  rpnmath_exact_t exact = RPNMATH_EXACT_GET(value);
+  
+  // Digits are produced backwards from the magnitude, which also covers the smallest value
+  char digits[RPNMATH_VALUE_FORMAT_SIZE];
+  size_t count = 0;
+  rpnmath_exact_unsigned_t magnitude = exact < 0 ? 0 - (rpnmath_exact_unsigned_t)exact : (rpnmath_exact_unsigned_t)exact;
+  do {
+    digits[count++] = (char)('0' + (int)(magnitude % 10));
+    magnitude /= 10;
+  } while (magnitude);
+  
+  size_t length = 0;
+  if (exact < 0 && length + 1 < size) {
+    buffer[length++] = '-';
+  }
+  while (count && length + 1 < size) {
+    buffer[length++] = digits[--count];
+  }
+  if (size) {
+    buffer[length] = '\0';
+  }
+}
+
+double rpnmath_value_to_double(const rpnmath_value_t *value) {
+  if (value->type.kind == RPNMATH_TYPEKIND_FLOAT) {
+    return value->f;
+  }
+  if (rpnmath_type_has_limbs(&value->type)) {
+    return rpnmath_bigint_to_double(value);
+  }
+  if (value->type.kind == RPNMATH_TYPEKIND_DECIMAL) {
+    return rpnmath_decimal_to_double(value);
+  }
+#if RPNMATH_INT128
+  if (value->type.size > 64) {
+    return (double)rpnmath_value_get128(value);
+  }
+#endif
+  return (double)value->i;
+}
+
+// Powers of ten that are exact in double (and up to 1e10 in float)
+static const double rpnmath_pow10[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+int rpnmath_value_parse_float(rpnmath_value_t *value, const char *str) {
+  const char *p = str;
+  int negative = *p == '-';
+  if (*p == '-' || *p == '+') p++;
+  
+  // Up to 19 significant digits are gathered in an integer mantissa,
+  // inexact is set when a nonzero digit past those is dropped
+  uint64_t mantissa = 0;
+  long exponent = 0;
+  size_t digits = 0;
+  int inexact = 0;
+  int is_float = 0;
+  for (; isdigit((unsigned char)*p); p++, digits++) {
+    if (mantissa < UINT64_C(1000000000000000000)) {
+      mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+    } else {
+      exponent++;
+      inexact |= *p != '0';
+    }
+  }
+  if (*p == '.') {
+    is_float = 1;
+    for (p++; isdigit((unsigned char)*p); p++, digits++) {
+      if (mantissa < UINT64_C(1000000000000000000)) {
+        mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+        exponent--;
+      } else {
+        inexact |= *p != '0';
+      }
+    }
+  }
+  if (digits == 0) {
+    return -1;
+  }
+  if (*p == 'e' || *p == 'E') {
+    is_float = 1;
+    p++;
+    int exponent_negative = *p == '-';
+    if (*p == '-' || *p == '+') p++;
+    if (!isdigit((unsigned char)*p)) {
+      return -1;
+    }
+    long written = 0;
+    for (; isdigit((unsigned char)*p); p++) {
+      if (written < 100000) written = written * 10 + (*p - '0');
+    }
+    exponent += exponent_negative ? -written : written;
+  }
+  int single = *p == 'f' || *p == 'F';
+  if (single) p++;
+  if (*p != '\0' || !(is_float || single)) {
+    return -1;
+  }
+  
+  // Clinger's fast path: an exact mantissa scaled by an exact power of ten
+  // is correctly rounded by a single operation. Everything else goes to the
+  // C library, which stops at the f suffix by itself.
+  double result;
+  if (single) {
+    float narrow;
+    if (!inexact && mantissa <= (UINT64_C(1) << 24) && exponent >= -10 && exponent <= 10) {
+      narrow = exponent < 0 ? (float)mantissa / (float)rpnmath_pow10[-exponent] : (float)mantissa * (float)rpnmath_pow10[exponent];
+      narrow = negative ? -narrow : narrow;
+    } else {
+      narrow = strtof(str, NULL);
+    }
+    result = narrow;
+  } else if (!inexact && mantissa <= (UINT64_C(1) << 53) && exponent >= -22 && exponent <= 22) {
+    result = exponent < 0 ? (double)mantissa / rpnmath_pow10[-exponent] : (double)mantissa * rpnmath_pow10[exponent];
+    result = negative ? -result : result;
+  } else {
+    result = strtod(str, NULL);
+  }
+  
+  rpnmath_type_float(&value->type, single ? 32 : 64);
+  value->f = result;
+  return 0;
+}
+
+void rpnmath_value_from_const(rpnmath_value_t *value, const rpnmath_item_const_t *item) {
+  rpnmath_value_load(value, &item->type, rpnmath_const_data(item));
+}
+
+void rpnmath_value_load(rpnmath_value_t *value, const rpnmath_type_t *type, const void *data) {
+  value->type = *type;
+  value->i = 0;
+  
+  if (type->kind == RPNMATH_TYPEKIND_FLOAT) {
+    value->f = type->size == 32 ? *(const float*)data : *(const double*)data;
+    return;
+  }
+  if (type->kind != RPNMATH_TYPEKIND_INT && type->kind != RPNMATH_TYPEKIND_BIGINT &&
+      type->kind != RPNMATH_TYPEKIND_DECIMAL) {
+    return;
+  }
+  
+  // Limbs are referenced where they are, the data has to outlive the value
+  if (rpnmath_type_has_limbs(type)) {
+    value->limbs = data;
+    return;
+  }
+  switch (rpnmath_type_native_size(type->size)) {
+    case 1: value->i = *(const int8_t*)data; break;
+    case 2: value->i = *(const int16_t*)data; break;
+    case 4: value->i = *(const int32_t*)data; break;
+    case 8: value->i = *(const int64_t*)data; break;
+#if RPNMATH_INT128
+    case 16: {
+      // Wide payloads are only guaranteed the alignment of the item stream
+      rpnmath_int128_t wide;
+      memcpy(&wide, data, sizeof(wide));
+      rpnmath_value_set128(value, wide);
+      break;
+    }
+#endif
+  }
+}
+
+void rpnmath_value_store(const rpnmath_value_t *value, void *data) {
+  if (value->type.kind == RPNMATH_TYPEKIND_FLOAT) {
+    if (value->type.size == 32) {
+      *(float*)data = (float)value->f;
+    } else {
+      *(double*)data = value->f;
+    }
+    return;
+  }
+  if (rpnmath_type_has_limbs(&value->type)) {
+    memcpy(data, value->limbs, rpnmath_type_bytes(&value->type));
+    return;
+  }
+  
+  switch (rpnmath_type_native_size(value->type.size)) {
+    case 1: *(int8_t*)data = (int8_t)value->i; break;
+    case 2: *(int16_t*)data = (int16_t)value->i; break;
+    case 4: *(int32_t*)data = (int32_t)value->i; break;
+    case 8: *(int64_t*)data = (int64_t)value->i; break;
+#if RPNMATH_INT128
+    case 16: {
+      rpnmath_int128_t wide = rpnmath_value_get128(value);
+      memcpy(data, &wide, sizeof(wide));
+      break;
+    }
+#endif
+  }
+}
+
+rpnmath_item_const_t rpnmath_value_to_const(const rpnmath_value_t *value) {
+  rpnmath_item_const_t item = {0};
+  item.kind = RPNMATH_ITEMKIND_CONST;
+  item.type = value->type;
+  item.size = rpnmath_type_bytes(&value->type);
+  if (item.size > RPNMATH_CONST_INLINE_SIZE) {
+    item.data = malloc(item.size);
+    if (!item.data) {
+      item.kind = RPNMATH_ITEMKIND_VOID;
+      item.size = 0;
+      return item;
+    }
+  }
+  
+  rpnmath_value_store(value, rpnmath_const_data(&item));
+  return item;
+}
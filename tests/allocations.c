@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include "stack.h"
+#include "program.h"
+#include "context.h"
+#include "arena.h"
+#include "value.h"
+#include "source.h"
+
+// Once a program is compiled, evaluating it again and again on a reset arena
+// must not touch the heap. The test is linked with --wrap for malloc, calloc
+// and realloc, so every call the library makes lands in a counter first.
+
+#define WARMUP_RUNS 3
+#define MEASURED_RUNS 1000
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *data, size_t size);
+
+static size_t allocations = 0;
+
+void *__wrap_malloc(size_t size) {
+  allocations++;
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+  allocations++;
+  return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *data, size_t size) {
+  allocations++;
+  return __real_realloc(data, size);
+}
+
+typedef struct test_case {
+  const char *name;
+  const char *source;
+  rpnmath_overflow_t overflow;
+  double expected;
+} test_case_t;
+
+static const test_case_t cases[] = {
+  // Loop with a branch on every iteration
+  {"branches", "0 $0 = 0 $1 = while $0 100 < loop $0 50 < if $1 $0 + $1 = else $1 $0 - $1 = end $0 1 + $0 = end $1 ret/1",
+   RPNMATH_OVERFLOW_WRAP, -2500.0},
+  // 40! outgrows 128 bits, so the variable becomes a big integer in the arena
+  {"promote", "1 $0 = 1 $1 = while $0 40 <= loop $1 $0 * $1 = $0 1 + $0 = end $1 ret/1",
+   RPNMATH_OVERFLOW_PROMOTE, 8.15915283247897734e47},
+};
+
+// Run one compiled program repeatedly on engine, returns the number of
+// failures
+static int run_case(const test_case_t *test, const rpnmath_program_t *program, rpnmath_engine_t engine) {
+  rpnmath_arena_t arena;
+  rpnmath_arena_init(&arena, 0);
+  rpnmath_context_t context;
+  
+  size_t before = 0;
+  for (int run = 0; run < WARMUP_RUNS + MEASURED_RUNS; run++) {
+    if (run == WARMUP_RUNS) {
+      before = allocations;
+    }
+    rpnmath_arena_reset(&arena);
+    rpnmath_context_init(&context, &arena);
+    context.engine = engine;
+    
+    rpnmath_item_const_t result;
+    int status = rpnmath_program_execute(program, &context, &result);
+    if (status != RPNMATH_STATUS_OK) {
+      fprintf(stderr, "%s on %s: %s\n", test->name, rpnmath_engine_name(engine), rpnmath_context_error(&context));
+      rpnmath_arena_cleanup(&arena);
+      return 1;
+    }
+    rpnmath_value_t value;
+    rpnmath_value_from_const(&value, &result);
+    double got = rpnmath_value_to_double(&value);
+    if (got != test->expected) {
+      fprintf(stderr, "%s on %s: got %g, expected %g\n", test->name, rpnmath_engine_name(engine), got, test->expected);
+      rpnmath_arena_cleanup(&arena);
+      return 1;
+    }
+  }
+  size_t counted = allocations - before;
+  rpnmath_arena_cleanup(&arena);
+  
+  if (counted != 0) {
+    fprintf(stderr, "%s on %s: %zu heap allocations in %d runs\n", test->name, rpnmath_engine_name(engine),
+            counted, MEASURED_RUNS);
+    return 1;
+  }
+  return 0;
+}
+
+int main(void) {
+  int failures = 0;
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    rpnmath_stack_t stack;
+    if (rpnmath_stack_init(&stack, 0) != 0 || push_source(&stack, cases[i].source) != 0) {
+      return 1;
+    }
+    rpnmath_arena_t program_arena;
+    rpnmath_arena_init(&program_arena, 0);
+    rpnmath_program_t program = {0};
+    if (rpnmath_program_compile(&program, &stack, cases[i].overflow, RPNMATH_ROUNDING_HALF_EVEN, &program_arena) != RPNMATH_STATUS_OK) {
+      fprintf(stderr, "%s: %s\n", cases[i].name, program.error ? program.error : "Compilation failed");
+      return 1;
+    }
+    
+    for (int engine = 0; engine < RPNMATH_ENGINE_COUNT; engine++) {
+      failures += run_case(&cases[i], &program, (rpnmath_engine_t)engine);
+    }
+    
+    rpnmath_arena_cleanup(&program_arena);
+    rpnmath_stack_cleanup(&stack);
+  }
+  
+  if (failures == 0) {
+    printf("no heap allocations in %d runs of each program on every engine\n", MEASURED_RUNS);
+  }
+  return failures != 0;
+}
@@ -0,0 +1,278 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "stack.h"
+#include "program.h"
+#include "context.h"
+#include "arena.h"
+#include "value.h"
+#include "batch.h"
+#include "source.h"
+
+// rpnmath_batch_execute has to agree with running the program on every row
+// on its own: the same results, and for a failing run the same status at
+// the same lowest row. Every program runs under every overflow policy over
+// columns of each width, with the smallest and largest values of every
+// width in both of the vectors the rows make up.
+
+// More than one vector, so that the second one starts mid column
+#define ROWS (RPNMATH_BATCH_SIZE + 76)
+
+// $0 to $3 are int8_t to int64_t, $4 float, $5 double, $6 a decimal with
+// two digits after the point. $7 and $8 are left for the programs.
+#define COLUMN_COUNT 7
+
+static const char *sources[] = {
+  // Absolutes, the smallest value of each width has none of that width
+  "$0 abs ret/1",
+  "$1 abs ret/1",
+  "$2 abs ret/1",
+  "$3 abs ret/1",
+  "-128i8 abs ret/1",
+  // Arithmetic of each width, growing where operands differ
+  "$0 1i8 + ret/1",
+  "$0 1i8 - ret/1",
+  "$0 $0 * ret/1",
+  "$1 $1 * ret/1",
+  "$2 $2 + ret/1",
+  "$3 $3 * ret/1",
+  "$3 1i8 - ret/1",
+  "$0 $1 * $2 + ret/1",
+  "$0 -1i8 / ret/1",
+  "$3 -1i8 / ret/1",
+  "$1 7i8 / ret/1",
+  "$2 $0 / ret/1",
+  "$0 $1 0i8 == if 1i8 else $1 end / ret/1",
+  // Comparisons and picks
+  "$0 $1 < $2 $3 select ret/1",
+  "$0 $3 min ret/1",
+  "$1 $2 max ret/1",
+  // Rows taking different paths
+  "$0 0i8 < if $0 abs else $0 2i8 * end ret/1",
+  "$2 100i8 > if $2 $2 * ret/1 end $2 1i8 - ret/1",
+  "$2 0i8 < if 1i8 else $2 1000i16 < if 2i8 else 3i8 end end $2 * ret/1",
+  "$0 0i8 < if 1i8 $7 = end $7 ret/1",
+  "0i8 $7 = $0 abs $8 = while $8 0i8 > loop $7 $8 + $7 = $8 10i8 - $8 = end $7 ret/1",
+  "1i8 $7 = 0i8 $8 = while $8 5i8 < loop $7 $1 * $7 = $8 1i8 + $8 = end $7 ret/1",
+  // Floats
+  "$4 $5 * $0 + ret/1",
+  "$4 abs $4 min ret/1",
+  "$4 $4 * $4 * ret/1",
+  "$4 $0 / ret/1",
+  "$5 0i8 < if $5 abs else $4 end ret/1",
+  // Decimals
+  "$6 2i8 * $0 + ret/1",
+  "$6 $6 * ret/1",
+  "$6 $3 + ret/1",
+  "$6 $0 / ret/1",
+  "$6 0i8 < if $6 abs else $6 1.5d * end ret/1",
+};
+
+static const rpnmath_overflow_t policies[] = {
+  RPNMATH_OVERFLOW_WRAP, RPNMATH_OVERFLOW_TRAP, RPNMATH_OVERFLOW_SATURATE, RPNMATH_OVERFLOW_PROMOTE,
+};
+
+static int8_t column_i8[ROWS];
+static int16_t column_i16[ROWS];
+static int32_t column_i32[ROWS];
+static int64_t column_i64[ROWS];
+static float column_f32[ROWS];
+static double column_f64[ROWS];
+static int64_t column_d64[ROWS]; // mantissas
+static rpnmath_column_t columns[COLUMN_COUNT];
+
+// Rows 100 to 107 of each vector hold the edges of every column, the rest
+// alternates small numbers and ones spread over the whole width
+static void fill_columns(void) {
+  uint64_t seed = 0x9e3779b97f4a7c15u;
+  for (size_t row = 0; row < ROWS; row++) {
+    seed = seed * 6364136223846793005u + 1442695040888963407u;
+    int64_t random = (int64_t)(seed >> 1);
+    int64_t small = (int64_t)(seed >> 33) % 101 - 50;
+    size_t edge = row % RPNMATH_BATCH_SIZE - 100;
+    if (edge < 8) {
+      static const int64_t edges[8][4] = {
+        {INT8_MIN, INT16_MIN, INT32_MIN, INT64_MIN}, {INT8_MAX, INT16_MAX, INT32_MAX, INT64_MAX},
+        {INT8_MIN + 1, INT16_MIN + 1, INT32_MIN + 1, INT64_MIN + 1}, {INT8_MAX - 1, INT16_MAX - 1, INT32_MAX - 1, INT64_MAX - 1},
+        {-1, -1, -1, -1}, {0, 0, 0, 0}, {1, 1, 1, 1}, {2, 2, 2, 2},
+      };
+      static const double floats[8] = {-FLT_MAX, FLT_MAX, -1e-3, 0.5, -1, 0, 1, 2.5};
+      column_i8[row] = (int8_t)edges[edge][0];
+      column_i16[row] = (int16_t)edges[edge][1];
+      column_i32[row] = (int32_t)edges[edge][2];
+      column_i64[row] = edges[edge][3];
+      column_f32[row] = (float)floats[edge];
+      column_f64[row] = edge < 2 ? (edge ? DBL_MAX : -DBL_MAX) : floats[edge];
+      column_d64[row] = edges[edge][3];
+    } else if (row % 2) {
+      column_i8[row] = (int8_t)random;
+      column_i16[row] = (int16_t)random;
+      column_i32[row] = (int32_t)random;
+      column_i64[row] = random;
+      column_f32[row] = (float)random / 1e12f;
+      column_f64[row] = (double)random / 1e6;
+      column_d64[row] = random / 1000;
+    } else {
+      column_i8[row] = (int8_t)small;
+      column_i16[row] = (int16_t)(small * 7);
+      column_i32[row] = (int32_t)(small * 1000);
+      column_i64[row] = small * 100000;
+      column_f32[row] = (float)small / 4;
+      column_f64[row] = (double)small / 8;
+      column_d64[row] = small * 37;
+    }
+  }
+
+  void *data[COLUMN_COUNT] = {column_i8, column_i16, column_i32, column_i64, column_f32, column_f64, column_d64};
+  for (size_t i = 0; i < COLUMN_COUNT; i++) {
+    columns[i].data = data[i];
+    if (i < 4) {
+      rpnmath_type_int(&columns[i].type, (size_t)8 << i);
+    } else if (i < 6) {
+      rpnmath_type_float(&columns[i].type, i == 4 ? 32 : 64);
+    } else {
+      rpnmath_type_decimal(&columns[i].type, 64, 2);
+    }
+  }
+}
+
+// What a row's result becomes in the output column, or -1 when the column
+// can not hold it: doubles take anything, 64 bit integers only integers
+// that fit
+static int expect_output(const rpnmath_value_t *value, const rpnmath_type_t *type, rpnmath_value_t *expected) {
+  if (type->kind == RPNMATH_TYPEKIND_FLOAT) {
+    rpnmath_type_float(&expected->type, 64);
+    expected->f = rpnmath_value_to_double(value);
+    return 0;
+  }
+  if ((value->type.kind != RPNMATH_TYPEKIND_INT && value->type.kind != RPNMATH_TYPEKIND_BIGINT) ||
+      rpnmath_type_has_limbs(&value->type)) {
+    return -1;
+  }
+  rpnmath_type_int(&expected->type, 64);
+#if RPNMATH_INT128
+  if (value->type.size > 64) {
+    rpnmath_int128_t wide = rpnmath_value_get128(value);
+    if (wide < INT64_MIN || wide > INT64_MAX) {
+      return -1;
+    }
+    expected->i = (long long)wide;
+    return 0;
+  }
+#endif
+  expected->i = value->i;
+  return 0;
+}
+
+static int same_output(const rpnmath_value_t *expected, const rpnmath_value_t *got) {
+  if (expected->type.kind == RPNMATH_TYPEKIND_FLOAT) {
+    return expected->f == got->f || (isnan(expected->f) && isnan(got->f));
+  }
+  return expected->i == got->i;
+}
+
+// Run one compiled program over the columns both ways into an output of
+// type, returns the number of failures
+static int run_case(const char *source, rpnmath_overflow_t overflow, const rpnmath_program_t *program, const rpnmath_type_t *type) {
+  static rpnmath_value_t expected[ROWS];
+  static char output_data[ROWS * sizeof(int64_t)];
+  const char *output_name = type->kind == RPNMATH_TYPEKIND_FLOAT ? "double" : "int64_t";
+  rpnmath_arena_t arena;
+  rpnmath_arena_init(&arena, 0);
+  rpnmath_context_t context;
+
+  // Row by row, up to the first row that fails
+  size_t expected_row = ROWS;
+  int expected_status = RPNMATH_STATUS_OK;
+  for (size_t row = 0; row < ROWS && expected_status == RPNMATH_STATUS_OK; row++) {
+    rpnmath_arena_reset(&arena);
+    rpnmath_context_init(&context, &arena);
+    for (size_t id = 0; id < COLUMN_COUNT && id < program->variable_count; id++) {
+      rpnmath_value_t value;
+      rpnmath_value_load(&value, &columns[id].type, (const char*)columns[id].data + row * rpnmath_type_bytes(&columns[id].type));
+      rpnmath_context_store_variable(&context, id, &value);
+    }
+    rpnmath_item_const_t result;
+    expected_status = rpnmath_program_execute(program, &context, &result);
+    if (expected_status == RPNMATH_STATUS_OK) {
+      rpnmath_value_t value;
+      rpnmath_value_from_const(&value, &result);
+      if (expect_output(&value, type, &expected[row]) != 0) {
+        expected_status = RPNMATH_STATUS_COLUMN_RANGE;
+      }
+    }
+    if (expected_status != RPNMATH_STATUS_OK) {
+      expected_row = row;
+    }
+  }
+
+  rpnmath_arena_reset(&arena);
+  rpnmath_context_init(&context, &arena);
+  rpnmath_column_t output = {.type = *type, .data = output_data};
+  size_t failed_row;
+  int status = rpnmath_batch_execute(program, &context, columns, COLUMN_COUNT, &output, ROWS, &failed_row);
+
+  int failures = 0;
+  if (status != expected_status || failed_row != expected_row) {
+    fprintf(stderr, "%s under %s into %s: batch status %d on row %zu, row by row %d on row %zu\n", source,
+            rpnmath_overflow_name(overflow), output_name, status, failed_row, expected_status, expected_row);
+    failures++;
+  }
+  size_t checked = failed_row < expected_row ? failed_row : expected_row;
+  for (size_t row = 0; row < checked; row++) {
+    rpnmath_value_t got;
+    rpnmath_value_load(&got, type, output_data + row * sizeof(int64_t));
+    if (!same_output(&expected[row], &got)) {
+      char want[RPNMATH_VALUE_FORMAT_SIZE], have[RPNMATH_VALUE_FORMAT_SIZE];
+      rpnmath_value_format(&expected[row], want, sizeof(want));
+      rpnmath_value_format(&got, have, sizeof(have));
+      fprintf(stderr, "%s under %s into %s: row %zu is %s, row by row %s\n", source, rpnmath_overflow_name(overflow),
+              output_name, row, have, want);
+      failures++;
+      break;
+    }
+  }
+
+  rpnmath_arena_cleanup(&arena);
+  return failures;
+}
+
+int main(void) {
+  fill_columns();
+  rpnmath_type_t outputs[2];
+  rpnmath_type_float(&outputs[0], 64);
+  rpnmath_type_int(&outputs[1], 64);
+
+  int failures = 0;
+  size_t runs = 0;
+  for (size_t i = 0; i < sizeof(sources) / sizeof(sources[0]); i++) {
+    for (size_t p = 0; p < sizeof(policies) / sizeof(policies[0]); p++) {
+      rpnmath_stack_t stack;
+      if (rpnmath_stack_init(&stack, 0) != 0 || push_source(&stack, sources[i]) != 0) {
+        return 1;
+      }
+      rpnmath_arena_t program_arena;
+      rpnmath_arena_init(&program_arena, 0);
+      rpnmath_program_t program = {0};
+      if (rpnmath_program_compile(&program, &stack, policies[p], RPNMATH_ROUNDING_HALF_EVEN, &program_arena) != RPNMATH_STATUS_OK) {
+        fprintf(stderr, "%s: %s\n", sources[i], program.error ? program.error : "Compilation failed");
+        return 1;
+      }
+
+      for (size_t o = 0; o < sizeof(outputs) / sizeof(outputs[0]); o++) {
+        failures += run_case(sources[i], policies[p], &program, &outputs[o]);
+        runs++;
+      }
+
+      rpnmath_arena_cleanup(&program_arena);
+      rpnmath_stack_cleanup(&stack);
+    }
+  }
+
+  if (failures == 0) {
+    printf("batch matched row by row execution in %zu runs of %d rows\n", runs, ROWS);
+  }
+  return failures != 0;
+}
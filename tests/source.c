@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "value.h"
+#include "decimal.h"
+#include "source.h"
+
+// Integers are 64 bit unless they end in i8, i16 or i32, anything else
+// is a float or decimal literal
+static int push_literal(rpnmath_stack_t *stack, const char *token) {
+  char *end;
+  long long integer = strtoll(token, &end, 10);
+  rpnmath_value_t value = {0};
+  if (*end == '\0' || (*end == 'i' && isdigit((unsigned char)end[1]))) {
+    size_t bits = *end ? strtoul(end + 1, NULL, 10) : 64;
+    if (bits > 64 || rpnmath_value_narrow(integer, bits) != integer) {
+      return -1;
+    }
+    rpnmath_type_int(&value.type, bits);
+    value.i = integer;
+  } else if (rpnmath_value_parse_float(&value, token) != 0 && rpnmath_decimal_parse(&value, token) != 0) {
+    return -1;
+  }
+  
+  rpnmath_item_const_t item = rpnmath_value_to_const(&value);
+  if (item.kind == RPNMATH_ITEMKIND_VOID) {
+    return -1;
+  }
+  int pushed = rpnmath_stack_pushc(stack, &item);
+  rpnmath_const_cleanup(&item);
+  return pushed;
+}
+
+int push_source(rpnmath_stack_t *stack, const char *source) {
+  static const struct { const char *name; rpnmath_op_t op; } ops[] = {
+    {"+", RPNMATH_OP_ADD}, {"-", RPNMATH_OP_SUB}, {"*", RPNMATH_OP_MUL}, {"/", RPNMATH_OP_DIV},
+    {"=", RPNMATH_OP_ASSIGN}, {"==", RPNMATH_OP_EQ}, {"!=", RPNMATH_OP_NE}, {"<", RPNMATH_OP_LT},
+    {"<=", RPNMATH_OP_LE}, {">", RPNMATH_OP_GT}, {">=", RPNMATH_OP_GE}, {"select", RPNMATH_OP_SELECT},
+    {"min", RPNMATH_OP_MIN}, {"max", RPNMATH_OP_MAX}, {"abs", RPNMATH_OP_ABS},
+  };
+  static const struct { const char *name; rpnmath_cfop_t cfop; } cfops[] = {
+    {"if", RPNMATH_CFOP_IF}, {"else", RPNMATH_CFOP_ELSE}, {"while", RPNMATH_CFOP_WHILE},
+    {"loop", RPNMATH_CFOP_LOOP}, {"end", RPNMATH_CFOP_END},
+  };
+  
+  char token[32];
+  int length;
+  while (sscanf(source, " %31s%n", token, &length) == 1) {
+    source += length;
+    int pushed = -1;
+    if (token[0] == '$') {
+      rpnmath_item_localref_t item = {.kind = RPNMATH_ITEMKIND_LREF, .variable_id = strtoul(token + 1, NULL, 10)};
+      pushed = rpnmath_stack_pushlr(stack, &item);
+    } else if (strcmp(token, "ret/1") == 0) {
+      rpnmath_item_vop_t item = {.kind = RPNMATH_ITEMKIND_VOP, .operation = RPNMATH_VOP_RET, .argcount = 1, .retcount = 1};
+      pushed = rpnmath_stack_pushvop(stack, &item);
+    } else if (isdigit((unsigned char)token[0]) || (token[0] == '-' && isdigit((unsigned char)token[1]))) {
+      pushed = push_literal(stack, token);
+    } else {
+      for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); i++) {
+        if (strcmp(token, ops[i].name) == 0) {
+          rpnmath_item_op_t item = {.kind = RPNMATH_ITEMKIND_OP, .operation = ops[i].op};
+          pushed = rpnmath_stack_pushop(stack, &item);
+        }
+      }
+      for (size_t i = 0; i < sizeof(cfops) / sizeof(cfops[0]); i++) {
+        if (strcmp(token, cfops[i].name) == 0) {
+          rpnmath_item_cfop_t item = {.kind = RPNMATH_ITEMKIND_CFOP, .operation = cfops[i].cfop};
+          pushed = rpnmath_stack_pushcfop(stack, &item);
+        }
+      }
+    }
+    if (pushed != 0) {
+      fprintf(stderr, "cannot push %s\n", token);
+      return -1;
+    }
+  }
+  return 0;
+}
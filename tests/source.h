@@ -0,0 +1,12 @@
+#ifndef RPNMATH_TESTS_SOURCE_H
+#define RPNMATH_TESTS_SOURCE_H
+
+#include "stack.h"
+
+// Push the items of a program written the way the REPL reads it, limited to
+// numbers, $n, arithmetic, comparisons, select, min, max, abs, =, control
+// flow and ret/1. Integers are 64 bit, or of the width a suffix gives them
+// ("-128i8"). Returns -1 on anything else.
+int push_source(rpnmath_stack_t *stack, const char *source);
+
+#endif // RPNMATH_TESTS_SOURCE_H
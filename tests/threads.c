@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <threads.h>
+#include "stack.h"
+#include "program.h"
+#include "context.h"
+#include "arena.h"
+#include "value.h"
+#include "source.h"
+
+// Several threads execute one shared program at once, each on a context and
+// arena of its own, cycling through the engines. Build with RPNMATH_TSAN to
+// have ThreadSanitizer check that execution only reads the program; its
+// runtime has to intercept thrd_create, which older ones do not.
+
+#define THREAD_COUNT 8
+#define RUNS 2000
+
+// Sum of 0 to $0 - 1 with the odd numbers counted twice, so that taking the
+// wrong branch of the if inside the loop changes the result
+static const char *source =
+  "0 $1 = 0 $2 = while $1 $0 < loop $1 2 / 2 * $1 == if $2 $1 + $2 = else $2 $1 2 * + $2 = end $1 1 + $1 = end $2 ret/1";
+
+typedef struct worker {
+  const rpnmath_program_t *program;
+  size_t index;
+  int failures;
+} worker_t;
+
+static int run_worker(void *argument) {
+  worker_t *worker = argument;
+  rpnmath_arena_t arena;
+  rpnmath_arena_init(&arena, 0);
+  rpnmath_context_t context;
+  
+  for (int run = 0; run < RUNS; run++) {
+    rpnmath_arena_reset(&arena);
+    rpnmath_context_init(&context, &arena);
+    context.engine = (rpnmath_engine_t)((worker->index + (size_t)run) % RPNMATH_ENGINE_COUNT);
+    
+    // Every thread and run has an input of its own
+    int64_t n = (int64_t)(worker->index * 31 + (size_t)run % 97);
+    rpnmath_item_const_t input = {.kind = RPNMATH_ITEMKIND_CONST, .size = sizeof(int64_t)};
+    rpnmath_type_int(&input.type, 64);
+    *(int64_t*)rpnmath_const_data(&input) = n;
+    
+    rpnmath_item_const_t result;
+    if (rpnmath_context_assign_variable(&context, 0, &input) != 0 ||
+        rpnmath_program_execute(worker->program, &context, &result) != 0) {
+      fprintf(stderr, "thread %zu on %s: %s\n", worker->index, rpnmath_engine_name(context.engine),
+              rpnmath_context_error(&context));
+      worker->failures++;
+      continue;
+    }
+    rpnmath_value_t value;
+    rpnmath_value_from_const(&value, &result);
+    double expected = (double)(n * (n - 1) / 2 + (n / 2) * (n / 2));
+    if (rpnmath_value_to_double(&value) != expected) {
+      fprintf(stderr, "thread %zu on %s: got %g for %lld, expected %g\n", worker->index,
+              rpnmath_engine_name(context.engine), rpnmath_value_to_double(&value), (long long)n, expected);
+      worker->failures++;
+    }
+  }
+  
+  rpnmath_arena_cleanup(&arena);
+  return 0;
+}
+
+int main(void) {
+  rpnmath_stack_t stack;
+  if (rpnmath_stack_init(&stack, 0) != 0 || push_source(&stack, source) != 0) {
+    return 1;
+  }
+  rpnmath_arena_t program_arena;
+  rpnmath_arena_init(&program_arena, 0);
+  rpnmath_program_t program = {0};
+  if (rpnmath_program_compile(&program, &stack, RPNMATH_OVERFLOW_TRAP, RPNMATH_ROUNDING_HALF_EVEN, &program_arena) != RPNMATH_STATUS_OK) {
+    fprintf(stderr, "%s\n", program.error ? program.error : "Compilation failed");
+    return 1;
+  }
+  
+  worker_t workers[THREAD_COUNT];
+  thrd_t threads[THREAD_COUNT];
+  size_t started = 0;
+  for (; started < THREAD_COUNT; started++) {
+    workers[started] = (worker_t){.program = &program, .index = started};
+    if (thrd_create(&threads[started], run_worker, &workers[started]) != thrd_success) {
+      fprintf(stderr, "cannot start thread %zu\n", started);
+      break;
+    }
+  }
+  int failures = started < THREAD_COUNT;
+  for (size_t i = 0; i < started; i++) {
+    thrd_join(threads[i], NULL);
+    failures += workers[i].failures;
+  }
+  
+  rpnmath_arena_cleanup(&program_arena);
+  rpnmath_stack_cleanup(&stack);
+  
+  if (failures == 0) {
+    printf("%d threads ran the shared program %d times each\n", THREAD_COUNT, RUNS);
+  }
+  return failures != 0;
+}